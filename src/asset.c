@@ -0,0 +1,1402 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include <SDL2/SDL_image.h>
+
+#include "asset.h"
+#include "atlas.h"
+#include "blit.h"
+#include "htable.h"
+#include "log.h"
+#include "pack.h"
+#include "variant.h"
+
+// Images kept in their original format, and indexed images, are cached apart
+// from converted ones, under their path followed by one of these bytes, after
+// the terminator
+#define ASSET_ORIGINAL_MARKER '\x01'
+#define ASSET_INDEXED_MARKER '\x02'
+
+// Image benchmark settings. Each image is tiled across the target this many
+// times, in both of its formats.
+#define ASSET_BENCHMARK_SIZE 1024
+#define ASSET_BENCHMARK_PASSES 16
+
+typedef struct AssetLoadJob AssetLoadJob;
+
+struct Asset {
+    // The interned path, which is also this asset's key in the cache
+    char* path;
+    size_t key_size;
+
+    AssetState state;
+
+    size_t refcount;
+    size_t bytes;
+
+    // When atlased, the surface is an atlas page shared with other assets,
+    // and the clip is this image's place on it
+    bool atlased;
+
+    SDL_Surface* surface;
+    SDL_Rect clip;
+
+    // Whether the image was decoded in SDL_PIXELFORMAT_INDEX8, which holds
+    // while its surface is a placeholder, too
+    bool indexed;
+
+    // The background load in flight, if loading
+    AssetLoadJob* job;
+
+    // The frame the image was last drawn in
+    uint64_t drawn;
+
+    // Images which can be evicted are linked into the eviction list while
+    // they're resident, most recently drawn first
+    bool evictable;
+
+    Asset* lru_prev;
+    Asset* lru_next;
+
+    // Every loaded asset is also linked into a list, for cleanup
+    Asset* prev;
+    Asset* next;
+};
+
+// Jobs are only touched by loader threads while queued. Once done, they're
+// handed back to the main thread, which is the only thread to touch assets.
+struct AssetLoadJob {
+    Asset* asset;
+
+    // Belongs to the asset, which can't be freed while its load is in flight
+    const char* path;
+
+    // The format to convert to, as of when the job was queued
+    uint32_t format;
+
+    SDL_Surface* surface;
+
+    bool done;
+
+    AssetLoadJob* next;
+};
+
+HashTable* asset_table = NULL;
+
+Asset* asset_list = NULL;
+
+AssetStats asset_stats;
+
+// The format images are converted to as they load
+uint32_t asset_format = ASSET_PIXEL_FORMAT_DEFAULT;
+
+// The eviction list, the memory budget it's trimmed to, and the number of the
+// current frame, which is advanced by every sync
+Asset* asset_lru_head = NULL;
+Asset* asset_lru_tail = NULL;
+
+size_t asset_budget = 0;
+
+uint64_t asset_frame = 0;
+
+// Shared by every asset which is loading, or failed to load
+SDL_Surface* asset_placeholder = NULL;
+
+// Callbacks waiting on assets. Like trigger events, there are two lists, so
+// that callbacks registered during delivery wait for the next sync.
+AssetCallbackList asset_cb_list = {0};
+AssetCallbackList asset_cb_back = {0};
+
+// Background loader, started by the first asynchronous acquisition
+SDL_mutex* asset_loader_lock = NULL;
+SDL_cond* asset_loader_work = NULL;
+SDL_cond* asset_loader_done = NULL;
+
+SDL_Thread* asset_loader_threads[ASSET_LOADER_THREADS] = {0};
+size_t asset_loader_thread_count = 0;
+
+bool asset_loader_quit = false;
+
+// Guarded by asset_loader_lock. Queued jobs are taken in order, while done
+// jobs are pushed and published newest first.
+AssetLoadJob* asset_queue_head = NULL;
+AssetLoadJob* asset_queue_tail = NULL;
+AssetLoadJob* asset_done = NULL;
+
+bool asset_init(void) {
+    if (asset_table) {
+        logmsg(LOG_WARN, "asset: Failed to initialize asset cache, already initialized");
+
+        return false;
+    }
+
+    asset_placeholder = SDL_CreateRGBSurfaceWithFormat(0, 1, 1, 32, SDL_PIXELFORMAT_ARGB8888);
+
+    if (!asset_placeholder) {
+        logmsg(LOG_WARN, "asset: Failed to create placeholder image: %s", SDL_GetError());
+
+        return false;
+    }
+
+    asset_table = htable_create(64);
+
+    if (!asset_table) {
+        logmsg(LOG_WARN, "asset: Failed to create asset table, the system is out of memory");
+
+        SDL_FreeSurface(asset_placeholder);
+
+        asset_placeholder = NULL;
+
+        return false;
+    }
+
+    memset(&asset_stats, 0, sizeof(AssetStats));
+
+    asset_stats.budget = asset_budget;
+
+    return true;
+}
+
+void asset_set_budget(size_t bytes) {
+    logmsg(LOG_DEBUG, "asset: Setting image memory budget to %zu bytes", bytes);
+
+    asset_budget = bytes;
+    asset_stats.budget = bytes;
+}
+
+bool asset_set_display_format(uint32_t format) {
+    uint32_t alpha;
+
+    // Images keep their alpha, so pick the same layout with an alpha channel
+    switch (format) {
+        case SDL_PIXELFORMAT_ARGB8888:
+        case SDL_PIXELFORMAT_RGB888:
+            alpha = SDL_PIXELFORMAT_ARGB8888;
+            break;
+        case SDL_PIXELFORMAT_ABGR8888:
+        case SDL_PIXELFORMAT_BGR888:
+            alpha = SDL_PIXELFORMAT_ABGR8888;
+            break;
+        case SDL_PIXELFORMAT_RGBA8888:
+        case SDL_PIXELFORMAT_RGBX8888:
+            alpha = SDL_PIXELFORMAT_RGBA8888;
+            break;
+        case SDL_PIXELFORMAT_BGRA8888:
+        case SDL_PIXELFORMAT_BGRX8888:
+            alpha = SDL_PIXELFORMAT_BGRA8888;
+            break;
+        default:
+            logmsg(LOG_WARN, "asset: Unable to convert images to %s, keeping %s", SDL_GetPixelFormatName(format), SDL_GetPixelFormatName(asset_format));
+
+            return false;
+    }
+
+    logmsg(LOG_DEBUG, "asset: Converting images to %s", SDL_GetPixelFormatName(alpha));
+
+    asset_format = alpha;
+
+    return true;
+}
+
+// Conversion
+
+// Converts a decoded image to the given format, with premultiplied alpha,
+// freeing the decoded image. Images with a color key are either fully opaque
+// or fully transparent, and premultiplying leaves their transparent pixels as
+// zero, so they keep zero as their key.
+//
+// This is run by loader threads, so it doesn't log.
+SDL_Surface* asset_convert(SDL_Surface* loaded, uint32_t format) {
+    bool keyed = SDL_HasColorKey(loaded) && loaded->format->Amask == 0;
+
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, format, 0);
+
+    SDL_FreeSurface(loaded);
+
+    if (!surface) {
+        return NULL;
+    }
+
+    // Converting turns the key into alpha, which premultiplying then clears
+    SDL_SetColorKey(surface, SDL_FALSE, 0);
+
+    if (!blit_premultiply(surface)) {
+        SDL_FreeSurface(surface);
+
+        return NULL;
+    }
+
+    if (keyed) {
+        SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+        SDL_SetColorKey(surface, SDL_TRUE, 0);
+    }
+
+    return surface;
+}
+
+// Decodes and converts an image
+SDL_Surface* asset_load(const char* path, uint32_t format) {
+    SDL_Surface* loaded = IMG_Load(path);
+
+    return loaded ? asset_convert(loaded, format) : NULL;
+}
+
+// Gets a packed image, which is already premultiplied, in the display format
+SDL_Surface* asset_load_packed(const char* path) {
+    SDL_Surface* packed = pack_image_get(path);
+
+    if (!packed || packed->format->format == asset_format) {
+        return packed;
+    }
+
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(packed, asset_format, 0);
+
+    SDL_FreeSurface(packed);
+
+    if (!surface) {
+        logmsg(LOG_WARN, "asset: Failed to convert packed image '%s': %s", path, SDL_GetError());
+    }
+
+    return surface;
+}
+
+// Background loading
+
+int asset_loader_run(void* data) {
+    (void)data;
+
+    SDL_LockMutex(asset_loader_lock);
+
+    while (true) {
+        while (!asset_queue_head && !asset_loader_quit) {
+            SDL_CondWait(asset_loader_work, asset_loader_lock);
+        }
+
+        if (asset_loader_quit) {
+            break;
+        }
+
+        AssetLoadJob* job = asset_queue_head;
+
+        asset_queue_head = job->next;
+
+        if (!asset_queue_head) {
+            asset_queue_tail = NULL;
+        }
+
+        SDL_UnlockMutex(asset_loader_lock);
+
+        SDL_Surface* surface = asset_load(job->path, job->format);
+
+        SDL_LockMutex(asset_loader_lock);
+
+        job->surface = surface;
+        job->done = true;
+        job->next = asset_done;
+
+        asset_done = job;
+
+        SDL_CondBroadcast(asset_loader_done);
+    }
+
+    SDL_UnlockMutex(asset_loader_lock);
+
+    return 0;
+}
+
+void asset_job_list_free(AssetLoadJob* job) {
+    while (job) {
+        AssetLoadJob* next = job->next;
+
+        job->asset->job = NULL;
+
+        SDL_FreeSurface(job->surface);
+
+        free(job);
+
+        job = next;
+    }
+}
+
+void asset_loader_stop(void) {
+    if (!asset_loader_lock) {
+        return;
+    }
+
+    SDL_LockMutex(asset_loader_lock);
+
+    asset_loader_quit = true;
+
+    SDL_CondBroadcast(asset_loader_work);
+    SDL_UnlockMutex(asset_loader_lock);
+
+    for (size_t i = 0; i < asset_loader_thread_count; i++) {
+        SDL_WaitThread(asset_loader_threads[i], NULL);
+
+        asset_loader_threads[i] = NULL;
+    }
+
+    // Nothing is left to take the lock, so unfinished jobs can be freed as-is
+    asset_job_list_free(asset_queue_head);
+    asset_job_list_free(asset_done);
+
+    asset_queue_head = NULL;
+    asset_queue_tail = NULL;
+    asset_done = NULL;
+
+    SDL_DestroyCond(asset_loader_work);
+    SDL_DestroyCond(asset_loader_done);
+    SDL_DestroyMutex(asset_loader_lock);
+
+    asset_loader_lock = NULL;
+    asset_loader_work = NULL;
+    asset_loader_done = NULL;
+
+    asset_loader_thread_count = 0;
+    asset_loader_quit = false;
+}
+
+bool asset_loader_start(void) {
+    if (asset_loader_lock) {
+        return true;
+    }
+
+    logmsg(LOG_DEBUG, "asset: Starting %d background loader threads", ASSET_LOADER_THREADS);
+
+    asset_loader_lock = SDL_CreateMutex();
+    asset_loader_work = SDL_CreateCond();
+    asset_loader_done = SDL_CreateCond();
+
+    if (!asset_loader_lock || !asset_loader_work || !asset_loader_done) {
+        logmsg(LOG_WARN, "asset: Failed to start background loader: %s", SDL_GetError());
+
+        SDL_DestroyCond(asset_loader_work);
+        SDL_DestroyCond(asset_loader_done);
+        SDL_DestroyMutex(asset_loader_lock);
+
+        asset_loader_lock = NULL;
+        asset_loader_work = NULL;
+        asset_loader_done = NULL;
+
+        return false;
+    }
+
+    for (size_t i = 0; i < ASSET_LOADER_THREADS; i++) {
+        SDL_Thread* t = SDL_CreateThread(asset_loader_run, "asset_loader", NULL);
+
+        if (!t) {
+            logmsg(LOG_WARN, "asset: Failed to start background loader thread: %s", SDL_GetError());
+
+            continue;
+        }
+
+        asset_loader_threads[asset_loader_thread_count++] = t;
+    }
+
+    if (asset_loader_thread_count == 0) {
+        asset_loader_stop();
+
+        return false;
+    }
+
+    return true;
+}
+
+// Callbacks
+
+bool asset_regcb(Asset* a, asset_cb_t cb, void* userdata) {
+    AssetCallbackList* l = &asset_cb_list;
+
+    if (l->count == l->size) {
+        size_t new_size = l->size ? l->size * 2 : 8;
+
+        AssetCallback* tmp = realloc(l->cb, new_size * sizeof(AssetCallback));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "asset: Failed to register callback for asset '%s', the system is out of memory", a->path);
+
+            return false;
+        }
+
+        l->cb = tmp;
+        l->size = new_size;
+    }
+
+    l->cb[l->count++] = (AssetCallback){.asset = a, .cb = cb, .userdata = userdata};
+
+    return true;
+}
+
+bool asset_unregcb(Asset* a, asset_cb_t cb, void* userdata) {
+    AssetCallbackList* l = &asset_cb_list;
+
+    for (size_t i = 0; i < l->count; i++) {
+        if (l->cb[i].asset == a && l->cb[i].cb == cb && l->cb[i].userdata == userdata) {
+            memmove(&l->cb[i], &l->cb[i + 1], (l->count - i - 1) * sizeof(AssetCallback));
+
+            l->count--;
+
+            return true;
+        }
+    }
+
+    // Callbacks being delivered are skipped rather than removed, so that
+    // delivery isn't disturbed
+    l = &asset_cb_back;
+
+    for (size_t i = 0; i < l->count; i++) {
+        if (l->cb[i].asset == a && l->cb[i].cb == cb && l->cb[i].userdata == userdata) {
+            l->cb[i].cb = NULL;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Drops any callbacks left waiting on an asset which is about to be freed
+void asset_cb_purge(Asset* a) {
+    size_t kept = 0;
+
+    for (size_t i = 0; i < asset_cb_list.count; i++) {
+        if (asset_cb_list.cb[i].asset != a) {
+            asset_cb_list.cb[kept++] = asset_cb_list.cb[i];
+        }
+    }
+
+    asset_cb_list.count = kept;
+
+    for (size_t i = 0; i < asset_cb_back.count; i++) {
+        if (asset_cb_back.cb[i].asset == a) {
+            asset_cb_back.cb[i].cb = NULL;
+        }
+    }
+}
+
+// Eviction
+
+void asset_lru_unlink(Asset* a) {
+    if (a->lru_prev) {
+        a->lru_prev->lru_next = a->lru_next;
+    }
+    else {
+        asset_lru_head = a->lru_next;
+    }
+
+    if (a->lru_next) {
+        a->lru_next->lru_prev = a->lru_prev;
+    }
+    else {
+        asset_lru_tail = a->lru_prev;
+    }
+
+    a->lru_prev = NULL;
+    a->lru_next = NULL;
+    a->evictable = false;
+}
+
+// Moves an image to the front of the eviction list, linking it in if needed
+void asset_lru_push(Asset* a) {
+    if (a->evictable) {
+        if (a == asset_lru_head) {
+            return;
+        }
+
+        asset_lru_unlink(a);
+    }
+
+    a->evictable = true;
+    a->lru_next = asset_lru_head;
+
+    if (asset_lru_head) {
+        asset_lru_head->lru_prev = a;
+    }
+    else {
+        asset_lru_tail = a;
+    }
+
+    asset_lru_head = a;
+}
+
+// Frees an image's surface, keeping the asset and its clip for the reload
+void asset_evict(Asset* a) {
+    logmsg(LOG_DEBUG, "asset: Evicting image '%s'", a->path);
+
+    asset_lru_unlink(a);
+
+    variant_forget(a->surface);
+
+    // The renderer may still hold the surface, in which case it's freed along
+    // with its texture
+    SDL_FreeSurface(a->surface);
+
+    a->surface = asset_placeholder;
+    a->state = ASSET_EVICTED;
+
+    asset_stats.resident_bytes -= a->bytes;
+    asset_stats.evicted++;
+    asset_stats.evictions++;
+
+    a->bytes = 0;
+}
+
+// Evicts the least recently drawn images, until the cache is within budget or
+// only images drawn since the last sync are left
+void asset_trim(void) {
+    while (asset_budget && asset_stats.resident_bytes > asset_budget && asset_lru_tail && asset_lru_tail->drawn < asset_frame) {
+        asset_evict(asset_lru_tail);
+    }
+
+    asset_frame++;
+}
+
+// Assets
+
+void asset_free(Asset* a) {
+    if (a->prev) {
+        a->prev->next = a->next;
+    }
+    else {
+        asset_list = a->next;
+    }
+
+    if (a->next) {
+        a->next->prev = a->prev;
+    }
+
+    if (a->evictable) {
+        asset_lru_unlink(a);
+    }
+
+    asset_stats.count--;
+    asset_stats.resident_bytes -= a->bytes;
+
+    if (a->state == ASSET_LOADING) {
+        asset_stats.loading--;
+    }
+
+    if (a->state == ASSET_EVICTED) {
+        asset_stats.evicted--;
+    }
+
+    if (!a->atlased && a->surface != asset_placeholder) {
+        variant_forget(a->surface);
+
+        SDL_FreeSurface(a->surface);
+    }
+
+    free(a->path);
+    free(a);
+}
+
+void asset_unload(Asset* a) {
+    logmsg(LOG_DEBUG, "asset: Unloading image '%s'", a->path);
+
+    asset_cb_purge(a);
+
+    if (htable_remove(asset_table, (const uint8_t*)a->path, a->key_size) != 0) {
+        logmsg(LOG_ERR, "asset: Failed to remove asset '%s', but it was present in the asset table", a->path);
+
+        _exit(-1);
+    }
+
+    asset_free(a);
+}
+
+void asset_cleanup(void) {
+    if (!asset_table) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "asset: Cleaning up asset cache");
+
+    asset_loader_stop();
+
+    while (asset_list) {
+        Asset* a = asset_list;
+
+        if (a->refcount > 0) {
+            logmsg(LOG_WARN, "asset: Freeing asset '%s' with %zu references still held", a->path, a->refcount);
+        }
+
+        asset_free(a);
+    }
+
+    free(asset_cb_list.cb);
+    free(asset_cb_back.cb);
+
+    memset(&asset_cb_list, 0, sizeof(AssetCallbackList));
+    memset(&asset_cb_back, 0, sizeof(AssetCallbackList));
+
+    htable_destroy(asset_table);
+
+    SDL_FreeSurface(asset_placeholder);
+
+    asset_table = NULL;
+    asset_placeholder = NULL;
+}
+
+// Creates and caches an asset which has no image yet. The key is the path,
+// and can run on past its terminator.
+Asset* asset_create(const char* path, size_t key_size) {
+    Asset* a = calloc(1, sizeof(Asset));
+
+    if (!a) {
+        logmsg(LOG_WARN, "asset: Failed to cache image '%s', the system is out of memory", path);
+
+        return NULL;
+    }
+
+    a->path = malloc(key_size);
+
+    if (!a->path) {
+        logmsg(LOG_WARN, "asset: Failed to cache image '%s', the system is out of memory", path);
+
+        free(a);
+
+        return NULL;
+    }
+
+    memcpy(a->path, path, key_size);
+
+    a->key_size = key_size;
+
+    if (htable_add(asset_table, (const uint8_t*)a->path, key_size, KV_VOIDPTR, a) != 0) {
+        logmsg(LOG_WARN, "asset: Failed to map image '%s' in asset table", path);
+
+        free(a->path);
+        free(a);
+
+        return NULL;
+    }
+
+    a->state = ASSET_LOADING;
+    a->refcount = 1;
+    a->surface = asset_placeholder;
+    a->clip = (SDL_Rect){.x = 0, .y = 0, .w = 1, .h = 1};
+
+    a->next = asset_list;
+
+    if (asset_list) {
+        asset_list->prev = a;
+    }
+
+    asset_list = a;
+
+    asset_stats.count++;
+    asset_stats.loading++;
+
+    return a;
+}
+
+// Points an asset at its image in the atlas
+void asset_set_region(Asset* a, const AtlasRegion* region) {
+    a->state = ASSET_READY;
+    a->atlased = true;
+    a->surface = atlas_get_page(region->page);
+    a->clip = region->rect;
+    a->bytes = (size_t)region->rect.w * (size_t)region->rect.h * a->surface->format->BytesPerPixel;
+
+    asset_stats.loading--;
+    asset_stats.resident_bytes += a->bytes;
+}
+
+// Gives an asset its own surface
+void asset_set_image(Asset* a, SDL_Surface* surface) {
+    a->state = ASSET_READY;
+    a->surface = surface;
+    a->clip = (SDL_Rect){.x = 0, .y = 0, .w = surface->w, .h = surface->h};
+    a->bytes = (size_t)surface->pitch * (size_t)surface->h;
+    a->indexed = surface->format->format == SDL_PIXELFORMAT_INDEX8;
+
+    asset_stats.loading--;
+    asset_stats.resident_bytes += a->bytes;
+}
+
+// Gives an asset its decoded image. Small images are moved into the atlas, so
+// that sprites can share textures. Those left on their own surface are run
+// length encoded if they have a color key, since keyed images blit fastest
+// that way.
+void asset_set_surface(Asset* a, SDL_Surface* surface) {
+    AtlasRegion region;
+
+    if (atlas_accepts(surface->w, surface->h) && atlas_pack(a->path, surface, &region)) {
+        SDL_FreeSurface(surface);
+
+        asset_set_region(a, &region);
+
+        return;
+    }
+
+    if (SDL_HasColorKey(surface)) {
+        SDL_SetSurfaceRLE(surface, 1);
+    }
+
+    asset_set_image(a, surface);
+
+    // New images count as drawn, so that they aren't evicted before they've
+    // had a chance to be
+    a->drawn = asset_frame;
+
+    asset_lru_push(a);
+}
+
+// Hands a finished background load to its asset, freeing the asset if it was
+// released while loading
+void asset_publish(AssetLoadJob* job) {
+    Asset* a = job->asset;
+
+    a->job = NULL;
+
+    if (job->surface) {
+        asset_set_surface(a, job->surface);
+    }
+    else {
+        logmsg(LOG_WARN, "asset: Failed to load image at path '%s'", a->path);
+
+        a->state = ASSET_FAILED;
+
+        asset_stats.loading--;
+    }
+
+    free(job);
+
+    if (a->refcount == 0) {
+        asset_unload(a);
+    }
+}
+
+// Blocks until the background load of the given asset is done, then publishes
+// it ahead of the next sync
+void asset_wait(Asset* a) {
+    AssetLoadJob* job = a->job;
+
+    logmsg(LOG_DEBUG, "asset: Waiting on background load of image '%s'", a->path);
+
+    SDL_LockMutex(asset_loader_lock);
+
+    while (!job->done) {
+        SDL_CondWait(asset_loader_done, asset_loader_lock);
+    }
+
+    for (AssetLoadJob** j = &asset_done; *j; j = &(*j)->next) {
+        if (*j == job) {
+            *j = job->next;
+
+            break;
+        }
+    }
+
+    SDL_UnlockMutex(asset_loader_lock);
+
+    asset_publish(job);
+}
+
+// Queues a loading asset to be decoded by the background loader, which must
+// already be started
+bool asset_queue(Asset* a) {
+    AssetLoadJob* job = calloc(1, sizeof(AssetLoadJob));
+
+    if (!job) {
+        logmsg(LOG_WARN, "asset: Failed to queue image '%s' for loading, the system is out of memory", a->path);
+
+        return false;
+    }
+
+    logmsg(LOG_DEBUG, "asset: Queueing image '%s' for loading", a->path);
+
+    job->asset = a;
+    job->path = a->path;
+    job->format = asset_format;
+
+    a->job = job;
+
+    SDL_LockMutex(asset_loader_lock);
+
+    if (asset_queue_tail) {
+        asset_queue_tail->next = job;
+    }
+    else {
+        asset_queue_head = job;
+    }
+
+    asset_queue_tail = job;
+
+    SDL_CondSignal(asset_loader_work);
+    SDL_UnlockMutex(asset_loader_lock);
+
+    return true;
+}
+
+// Brings back an evicted image. Like on first acquisition, packed images are
+// read at once, and others are decoded in the background, unless the loader
+// can't be started.
+void asset_reload(Asset* a) {
+    logmsg(LOG_DEBUG, "asset: Reloading evicted image '%s'", a->path);
+
+    a->state = ASSET_LOADING;
+
+    asset_stats.evicted--;
+    asset_stats.loading++;
+    asset_stats.reloads++;
+
+    SDL_Surface* surface = asset_load_packed(a->path);
+
+    if (!surface) {
+        if (asset_loader_start() && asset_queue(a)) {
+            return;
+        }
+
+        surface = asset_load(a->path, asset_format);
+    }
+
+    if (!surface) {
+        logmsg(LOG_WARN, "asset: Failed to reload image at path '%s'", a->path);
+
+        a->state = ASSET_FAILED;
+
+        asset_stats.loading--;
+
+        return;
+    }
+
+    asset_set_surface(a, surface);
+}
+
+Asset* asset_image_acquire(const char* path) {
+    if (!asset_table) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, the asset cache is not initialized");
+
+        return NULL;
+    }
+
+    if (!path) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, path is NULL");
+
+        return NULL;
+    }
+
+    size_t key_size = strlen(path) + 1;
+
+    Asset* a = htable_lookup(asset_table, (const uint8_t*)path, key_size, NULL);
+
+    if (a) {
+        if (a->state == ASSET_FAILED) {
+            logmsg(LOG_WARN, "asset: Unable to acquire asset, image at path '%s' failed to load", path);
+
+            return NULL;
+        }
+
+        asset_stats.hits++;
+        a->refcount++;
+
+        if (a->state == ASSET_EVICTED) {
+            asset_reload(a);
+        }
+
+        if (a->state == ASSET_LOADING) {
+            asset_wait(a);
+        }
+
+        if (a->state == ASSET_FAILED) {
+            asset_release(a);
+
+            return NULL;
+        }
+
+        return a;
+    }
+
+    asset_stats.misses++;
+
+    AtlasRegion region;
+
+    if (atlas_find(path, &region)) {
+        a = asset_create(path, key_size);
+
+        if (a) {
+            asset_set_region(a, &region);
+        }
+
+        return a;
+    }
+
+    // Packed images are already decoded, so need no loading
+    SDL_Surface* surface = asset_load_packed(path);
+
+    if (!surface) {
+        logmsg(LOG_DEBUG, "asset: Loading image '%s'", path);
+
+        surface = asset_load(path, asset_format);
+    }
+
+    if (!surface) {
+        logmsg(LOG_WARN, "asset: Failed to load image at path '%s'", path);
+
+        return NULL;
+    }
+
+    a = asset_create(path, key_size);
+
+    if (!a) {
+        SDL_FreeSurface(surface);
+
+        return NULL;
+    }
+
+    asset_set_surface(a, surface);
+
+    return a;
+}
+
+Asset* asset_image_acquire_async(const char* path) {
+    if (!asset_table) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, the asset cache is not initialized");
+
+        return NULL;
+    }
+
+    if (!path) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, path is NULL");
+
+        return NULL;
+    }
+
+    size_t key_size = strlen(path) + 1;
+
+    Asset* a = htable_lookup(asset_table, (const uint8_t*)path, key_size, NULL);
+
+    if (a) {
+        if (a->state == ASSET_FAILED) {
+            logmsg(LOG_WARN, "asset: Unable to acquire asset, image at path '%s' failed to load", path);
+
+            return NULL;
+        }
+
+        asset_stats.hits++;
+        a->refcount++;
+
+        // Callbacks are called once the image is back
+        if (a->state == ASSET_EVICTED) {
+            asset_reload(a);
+        }
+
+        return a;
+    }
+
+    asset_stats.misses++;
+
+    AtlasRegion region;
+
+    bool atlased = atlas_find(path, &region);
+
+    SDL_Surface* surface = atlased ? NULL : asset_load_packed(path);
+
+    if (!atlased && !surface && !asset_loader_start()) {
+        return NULL;
+    }
+
+    a = asset_create(path, key_size);
+
+    if (!a) {
+        SDL_FreeSurface(surface);
+
+        return NULL;
+    }
+
+    // Images which need no decoding are ready at once
+    if (atlased) {
+        asset_set_region(a, &region);
+
+        return a;
+    }
+
+    if (surface) {
+        asset_set_surface(a, surface);
+
+        return a;
+    }
+
+    if (!asset_queue(a)) {
+        a->refcount = 0;
+
+        asset_unload(a);
+
+        return NULL;
+    }
+
+    return a;
+}
+
+// Acquires an image which is cached apart from converted ones, under its path
+// followed by the given marker. These are only ever loaded synchronously, by
+// the given function, so are never still loading.
+Asset* asset_image_acquire_marked(const char* path, char marker, SDL_Surface* (*load)(const char* path)) {
+    if (!asset_table) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, the asset cache is not initialized");
+
+        return NULL;
+    }
+
+    if (!path) {
+        logmsg(LOG_WARN, "asset: Unable to acquire asset, path is NULL");
+
+        return NULL;
+    }
+
+    size_t len = strlen(path);
+    size_t key_size = len + 2;
+
+    char* key = malloc(key_size);
+
+    if (!key) {
+        logmsg(LOG_WARN, "asset: Unable to acquire image '%s', the system is out of memory", path);
+
+        return NULL;
+    }
+
+    memcpy(key, path, len + 1);
+
+    key[len + 1] = marker;
+
+    Asset* a = htable_lookup(asset_table, (const uint8_t*)key, key_size, NULL);
+
+    if (a) {
+        free(key);
+
+        asset_stats.hits++;
+        a->refcount++;
+
+        return a;
+    }
+
+    asset_stats.misses++;
+
+    SDL_Surface* surface = load(path);
+
+    if (!surface) {
+        logmsg(LOG_WARN, "asset: Failed to load image at path '%s'", path);
+
+        free(key);
+
+        return NULL;
+    }
+
+    a = asset_create(key, key_size);
+
+    free(key);
+
+    if (!a) {
+        SDL_FreeSurface(surface);
+
+        return NULL;
+    }
+
+    asset_set_image(a, surface);
+
+    return a;
+}
+
+SDL_Surface* asset_load_original(const char* path) {
+    logmsg(LOG_DEBUG, "asset: Loading image '%s' in its original format", path);
+
+    return IMG_Load(path);
+}
+
+Asset* asset_image_acquire_original(const char* path) {
+    return asset_image_acquire_marked(path, ASSET_ORIGINAL_MARKER, asset_load_original);
+}
+
+// Loads an image as indexed, with a straight alpha palette. Images which
+// aren't indexed already are indexed if they have few enough colors.
+SDL_Surface* asset_load_indexed(const char* path) {
+    logmsg(LOG_DEBUG, "asset: Loading image '%s' as indexed", path);
+
+    SDL_Surface* packed = pack_image_get(path);
+    SDL_Surface* loaded = packed ? packed : IMG_Load(path);
+
+    if (!loaded) {
+        return NULL;
+    }
+
+    if (loaded->format->format == SDL_PIXELFORMAT_INDEX8) {
+        SDL_Palette* palette = loaded->format->palette;
+        Uint32 key;
+
+        // A color key becomes a transparent palette entry
+        if (SDL_GetColorKey(loaded, &key) == 0 && key < (Uint32)palette->ncolors) {
+            SDL_Color clear = palette->colors[key];
+
+            clear.a = 0;
+
+            SDL_SetPaletteColors(palette, &clear, (int)key, 1);
+            SDL_SetColorKey(loaded, SDL_FALSE, 0);
+        }
+
+        return loaded;
+    }
+
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, BLIT_PIXEL_FORMAT, 0);
+
+    SDL_FreeSurface(loaded);
+
+    if (!surface) {
+        logmsg(LOG_WARN, "asset: Failed to convert image '%s' for indexing: %s", path, SDL_GetError());
+
+        return NULL;
+    }
+
+    // Packed images are premultiplied
+    if (packed && !blit_unpremultiply(surface)) {
+        SDL_FreeSurface(surface);
+
+        return NULL;
+    }
+
+    SDL_Surface* indexed = blit_index(surface);
+
+    SDL_FreeSurface(surface);
+
+    return indexed;
+}
+
+Asset* asset_image_acquire_indexed(const char* path) {
+    return asset_image_acquire_marked(path, ASSET_INDEXED_MARKER, asset_load_indexed);
+}
+
+void asset_sync(void) {
+    if (!asset_table) {
+        return;
+    }
+
+    if (asset_loader_lock) {
+        SDL_LockMutex(asset_loader_lock);
+
+        AssetLoadJob* done = asset_done;
+
+        asset_done = NULL;
+
+        SDL_UnlockMutex(asset_loader_lock);
+
+        while (done) {
+            AssetLoadJob* next = done->next;
+
+            asset_publish(done);
+
+            done = next;
+        }
+    }
+
+    asset_trim();
+
+    if (asset_cb_list.count == 0) {
+        return;
+    }
+
+    // Every callback might be delivered, so make room for all of them
+    if (asset_cb_back.size < asset_cb_list.count) {
+        AssetCallback* tmp = realloc(asset_cb_back.cb, asset_cb_list.size * sizeof(AssetCallback));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "asset: Failed to deliver asset callbacks, the system is out of memory");
+
+            return;
+        }
+
+        asset_cb_back.cb = tmp;
+        asset_cb_back.size = asset_cb_list.size;
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < asset_cb_list.count; i++) {
+        if (asset_cb_list.cb[i].asset->state == ASSET_LOADING) {
+            asset_cb_list.cb[kept++] = asset_cb_list.cb[i];
+        }
+        else {
+            asset_cb_back.cb[asset_cb_back.count++] = asset_cb_list.cb[i];
+        }
+    }
+
+    asset_cb_list.count = kept;
+
+    for (size_t i = 0; i < asset_cb_back.count; i++) {
+        AssetCallback* c = &asset_cb_back.cb[i];
+
+        if (c->cb) {
+            c->cb(c->asset, c->userdata);
+        }
+    }
+
+    asset_cb_back.count = 0;
+}
+
+void asset_release(Asset* a) {
+    if (!a) {
+        return;
+    }
+
+    if (a->refcount == 0) {
+        logmsg(LOG_ERR, "asset: Released asset '%s' which holds no references", a->path);
+
+        _exit(-1);
+    }
+
+    if (--a->refcount > 0) {
+        return;
+    }
+
+    // A loader thread still has the path, so the asset is freed once the load
+    // is published
+    if (a->state == ASSET_LOADING) {
+        return;
+    }
+
+    asset_unload(a);
+}
+
+bool asset_touch(Asset* a) {
+    a->drawn = asset_frame;
+
+    if (a->state == ASSET_EVICTED) {
+        asset_reload(a);
+    }
+
+    if (a->state != ASSET_READY) {
+        return false;
+    }
+
+    if (a->evictable) {
+        asset_lru_push(a);
+    }
+
+    return true;
+}
+
+SDL_Surface* asset_get_surface(Asset* a) {
+    return a->surface;
+}
+
+SDL_Rect asset_get_clip(Asset* a) {
+    return a->clip;
+}
+
+bool asset_is_indexed(Asset* a) {
+    return a->indexed;
+}
+
+AssetState asset_get_state(Asset* a) {
+    return a->state;
+}
+
+const char* asset_get_path(Asset* a) {
+    return a->path;
+}
+
+size_t asset_get_refcount(Asset* a) {
+    return a->refcount;
+}
+
+const AssetStats* asset_get_stats(void) {
+    return &asset_stats;
+}
+
+// Benchmarking
+
+// Tiles an image across the target, returning the pixels drawn per second
+double asset_benchmark_run(SDL_Surface* image, SDL_Surface* target, bool premultiplied) {
+    uint64_t pixels = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    for (int pass = 0; pass < ASSET_BENCHMARK_PASSES; pass++) {
+        for (int y = 0; y < target->h; y += image->h) {
+            for (int x = 0; x < target->w; x += image->w) {
+                SDL_Rect dst = {x, y, image->w, image->h};
+
+                // Premultiplied images need the blitter, which SDL can't
+                // blend correctly, unless they're keyed
+                if (premultiplied && !SDL_HasColorKey(image) && image->format->format == BLIT_PIXEL_FORMAT) {
+                    blit_surface(image, NULL, target, x, y, 1.0, BLIT_PREMULTIPLIED);
+                }
+                else {
+                    SDL_BlitSurface(image, NULL, target, &dst);
+                }
+
+                pixels += (uint64_t)image->w * (uint64_t)image->h;
+            }
+        }
+    }
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    return (seconds > 0.0) ? (double)pixels / seconds : 0.0;
+}
+
+bool asset_benchmark(char* const* paths, size_t count) {
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, ASSET_BENCHMARK_SIZE, ASSET_BENCHMARK_SIZE, 32, BLIT_PIXEL_FORMAT);
+
+    if (!target) {
+        logmsg(LOG_WARN, "asset: Failed to benchmark images, unable to create target: %s", SDL_GetError());
+
+        return false;
+    }
+
+    size_t measured = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        SDL_Surface* original = IMG_Load(paths[i]);
+
+        if (!original) {
+            logmsg(LOG_WARN, "asset: Skipping image '%s', failed to load it", paths[i]);
+
+            continue;
+        }
+
+        SDL_Surface* copy = SDL_DuplicateSurface(original);
+        SDL_Surface* converted = copy ? asset_convert(copy, asset_format) : NULL;
+
+        if (!converted) {
+            logmsg(LOG_WARN, "asset: Skipping image '%s', failed to convert it: %s", paths[i], SDL_GetError());
+
+            SDL_FreeSurface(original);
+
+            continue;
+        }
+
+        if (SDL_HasColorKey(converted)) {
+            SDL_SetSurfaceRLE(converted, 1);
+        }
+
+        double before = asset_benchmark_run(original, target, false);
+        double after = asset_benchmark_run(converted, target, true);
+
+        logmsg(LOG_INFO,
+            "asset: '%s' (%dx%d): %.1f Mpixels/s as loaded in %s, %.1f Mpixels/s converted to %s%s",
+            paths[i],
+            original->w,
+            original->h,
+            before / 1e6,
+            SDL_GetPixelFormatName(original->format->format),
+            after / 1e6,
+            SDL_GetPixelFormatName(converted->format->format),
+            SDL_HasColorKey(converted) ? " with RLE" : "");
+
+        SDL_FreeSurface(original);
+        SDL_FreeSurface(converted);
+
+        measured++;
+    }
+
+    SDL_FreeSurface(target);
+
+    return measured > 0;
+}
@@ -0,0 +1,267 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_ASSET
+#define RPGNG_ASSET
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// The number of background threads which decode images for
+// asset_image_acquire_async()
+#define ASSET_LOADER_THREADS 2
+
+// The format images are converted to until asset_set_display_format() is
+// called, which matches atlas pages and packed images
+#define ASSET_PIXEL_FORMAT_DEFAULT SDL_PIXELFORMAT_ARGB8888
+
+typedef struct Asset Asset;
+
+typedef enum AssetState {
+    ASSET_LOADING,
+    ASSET_READY,
+    ASSET_FAILED,
+    // The image was dropped to stay within the budget, and is reloaded the
+    // next time it's drawn or acquired
+    ASSET_EVICTED
+} AssetState;
+
+typedef void (*asset_cb_t)(Asset* a, void* userdata);
+
+typedef struct AssetCallback {
+    Asset* asset;
+
+    asset_cb_t cb;
+
+    void* userdata;
+} AssetCallback;
+
+typedef struct AssetCallbackList {
+    size_t size;
+    size_t count;
+
+    AssetCallback* cb;
+} AssetCallbackList;
+
+typedef struct AssetStats {
+    // Acquisitions served from the cache, and acquisitions which had to load
+    // from disk
+    uint64_t hits;
+    uint64_t misses;
+
+    // Assets currently loaded, and how many of those are still being decoded
+    // in the background
+    size_t count;
+    size_t loading;
+
+    // Approximate memory held by loaded assets, in bytes, and the most they
+    // may hold before images are evicted, or 0 for no limit
+    size_t resident_bytes;
+    size_t budget;
+
+    // Assets whose images are currently evicted, along with the number of
+    // evictions and reloads so far
+    size_t evicted;
+    uint64_t evictions;
+    uint64_t reloads;
+} AssetStats;
+
+/**
+ * Initializes the asset cache.
+ *
+ * This function must be called once before any assets are acquired.
+ */
+bool asset_init(void);
+
+/**
+ * Frees every cached asset, whether or not it's still referenced.
+ */
+void asset_cleanup(void);
+
+/**
+ * Sets the format images are converted to as they load, which should be the
+ * window's, so that drawing them needs no conversion. Formats without an
+ * alpha channel are given one in the same layout.
+ *
+ * Images already loaded keep the format they were converted to.
+ *
+ * @return On success, returns true. Returns false if images can't be stored
+ * in a variant of the given format, in which case the current one is kept.
+ */
+bool asset_set_display_format(uint32_t format);
+
+/**
+ * Sets the most memory loaded images may hold. Whenever asset_sync() finds
+ * the cache over budget, images which weren't drawn since the previous sync
+ * are evicted, least recently drawn first, until it's back within budget.
+ *
+ * Only images on their own surfaces are evicted, since atlas pages are shared
+ * and images in their original format are read directly. Evicted assets keep
+ * their references and clip, and reload in the background once they're drawn
+ * again.
+ *
+ * @param bytes The budget in bytes, or 0 for no limit.
+ */
+void asset_set_budget(size_t bytes);
+
+/**
+ * Acquires a reference to the image at the given path, loading it if it isn't
+ * already cached. Every holder of a reference to the same path shares the same
+ * surface.
+ *
+ * Images are converted once, as they load, to the display format with
+ * premultiplied alpha. Draw them with blit_surface() and BLIT_PREMULTIPLIED,
+ * or with a premultiplied blend mode. Images with a color key keep it, with
+ * their transparent pixels at zero, and are run length encoded unless they're
+ * atlased.
+ *
+ * If the image is being loaded in the background, or was evicted, this waits
+ * for it.
+ *
+ * @return On success, returns an asset handle, which must be released with
+ * asset_release(). On failure, returns NULL.
+ */
+Asset* asset_image_acquire(const char* path);
+
+/**
+ * Acquires a reference to the image at the given path like
+ * asset_image_acquire(), but returns without waiting for the image to load.
+ * If it isn't already cached, the image is decoded by a background thread,
+ * and until asset_sync() publishes it, the asset holds a transparent
+ * placeholder surface.
+ *
+ * @return On success, returns an asset handle, which must be released with
+ * asset_release(). On failure, returns NULL. A load which fails in the
+ * background leaves the asset in the ASSET_FAILED state instead.
+ */
+Asset* asset_image_acquire_async(const char* path);
+
+/**
+ * Acquires a reference to the image at the given path, in whatever format it
+ * was decoded to, with straight alpha. This is cached apart from the converted
+ * image, and is never atlased or read from a pack. It's meant for tools which
+ * need the pixels as they are on disk; images drawn as sprites should be
+ * acquired with asset_image_acquire().
+ *
+ * @return On success, returns an asset handle, which must be released with
+ * asset_release(). On failure, returns NULL.
+ */
+Asset* asset_image_acquire_original(const char* path);
+
+/**
+ * Marks an image as drawn this frame, which keeps it from being evicted at the
+ * next sync. An evicted image starts reloading.
+ *
+ * @return Returns true if the image is ready to draw. Returns false if it's
+ * still loading, or failed to.
+ */
+bool asset_touch(Asset* a);
+
+/**
+ * Acquires a reference to the image at the given path as an indexed image, in
+ * SDL_PIXELFORMAT_INDEX8, with its own palette in straight alpha. Indexed
+ * images take a quarter of the memory of converted ones, and can be drawn
+ * with any Palette. Images which aren't stored indexed are indexed as they
+ * load, if they have 256 colors or fewer. These are cached apart from
+ * converted images, and are never atlased or evicted.
+ *
+ * @return On success, returns an asset handle, which must be released with
+ * asset_release(). Returns NULL if the image fails to load, or has too many
+ * colors.
+ */
+Asset* asset_image_acquire_indexed(const char* path);
+
+/**
+ * Publishes every image decoded in the background since the last call, then
+ * evicts images over the budget, then calls the callbacks of assets which are
+ * no longer loading. This should be called once per frame, from the main
+ * thread.
+ *
+ * Callbacks registered by other callbacks are called on the next sync.
+ */
+void asset_sync(void);
+
+/**
+ * Registers a callback, called by the next asset_sync() after the given asset
+ * finishes loading, or by the next asset_sync() if it already has. Each
+ * registration is called once.
+ *
+ * Callbacks must be removed with asset_unregcb() before the last reference to
+ * the asset is released.
+ *
+ * @param userdata A pointer which is passed back to the callback as-is.
+ */
+bool asset_regcb(Asset* a, asset_cb_t cb, void* userdata);
+
+/**
+ * Removes the given callback, if it hasn't been called yet.
+ *
+ * @return Returns true on success. Returns false if the given callback was not
+ * found.
+ */
+bool asset_unregcb(Asset* a, asset_cb_t cb, void* userdata);
+
+/**
+ * Releases a reference to an asset. The asset is freed once its last reference
+ * is released, or once it finishes loading if it's still loading.
+ */
+void asset_release(Asset* a);
+
+/**
+ * Gets the surface of an image asset. The surface belongs to the cache, and
+ * must not be freed or modified.
+ *
+ * Small images are packed into the texture atlas, in which case the surface is
+ * an atlas page shared with other images. Use asset_get_clip() to find the
+ * image on it.
+ */
+SDL_Surface* asset_get_surface(Asset* a);
+
+/**
+ * Gets the area of the asset's surface which holds the image. Evicted images
+ * keep their clip, though their surface is a placeholder until they reload.
+ */
+SDL_Rect asset_get_clip(Asset* a);
+
+/**
+ * Returns true if the image was decoded as indexed, in SDL_PIXELFORMAT_INDEX8.
+ * Unlike the format of its surface, this doesn't change while the image is
+ * loading or evicted, though it's false until the image is first decoded.
+ */
+bool asset_is_indexed(Asset* a);
+
+/**
+ * Gets the state of an asset.
+ */
+AssetState asset_get_state(Asset* a);
+
+/**
+ * Gets the path from which an asset was loaded.
+ */
+const char* asset_get_path(Asset* a);
+
+/**
+ * Gets the number of references held to an asset.
+ */
+size_t asset_get_refcount(Asset* a);
+
+/**
+ * Gets the asset cache statistics.
+ */
+const AssetStats* asset_get_stats(void);
+
+/**
+ * Measures blit throughput of the given images, both as they're decoded and
+ * as they're converted at load, and logs the results. Decoded images are
+ * drawn with SDL_BlitSurface(), and converted ones the way they're meant to
+ * be drawn. The asset cache needn't be initialized.
+ *
+ * @return Returns true if at least one image was measured.
+ */
+bool asset_benchmark(char* const* paths, size_t count);
+
+#endif
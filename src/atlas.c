@@ -0,0 +1,790 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL_image.h>
+#include <jansson.h>
+
+#include "atlas.h"
+#include "blit.h"
+#include "htable.h"
+#include "log.h"
+
+#ifdef __WIN32__
+#define strdup _strdup
+#endif
+
+#define ATLAS_PATH_LEN_MAX 4096
+
+// A segment of the skyline, the upper edge of the packed area of a page.
+// Segments are sorted by x, and together span the width of the page.
+typedef struct AtlasSkyline {
+    int x;
+    int y;
+    int w;
+} AtlasSkyline;
+
+typedef struct AtlasPage {
+    SDL_Surface* surface;
+
+    // Pages loaded from disk have no skyline, and are never packed into
+    bool closed;
+
+    // Bumped whenever an image is copied into the page
+    uint64_t version;
+
+    size_t size;
+    size_t count;
+
+    AtlasSkyline* nodes;
+} AtlasPage;
+
+typedef struct AtlasEntry {
+    char* name;
+
+    AtlasRegion region;
+} AtlasEntry;
+
+int atlas_page_size = 0;
+
+size_t atlas_pages_size = 0;
+size_t atlas_pages_count = 0;
+AtlasPage* atlas_pages = NULL;
+
+// Packed images, by name and in packing order
+HashTable* atlas_table = NULL;
+
+size_t atlas_entries_size = 0;
+AtlasEntry** atlas_entries = NULL;
+
+AtlasStats atlas_stats;
+
+bool atlas_grow(void** array, size_t* size, size_t count, size_t elem_size) {
+    if (count <= *size) {
+        return true;
+    }
+
+    size_t new_size = *size ? *size * 2 : 8;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+
+    void* tmp = realloc(*array, new_size * elem_size);
+
+    if (!tmp) {
+        return false;
+    }
+
+    *array = tmp;
+    *size = new_size;
+
+    return true;
+}
+
+bool atlas_init(int page_size) {
+    if (atlas_table) {
+        logmsg(LOG_WARN, "atlas: Failed to initialize atlas, already initialized");
+
+        return false;
+    }
+
+    if (page_size <= 0) {
+        logmsg(LOG_WARN, "atlas: Failed to initialize atlas, page size must be positive");
+
+        return false;
+    }
+
+    atlas_table = htable_create(64);
+
+    if (!atlas_table) {
+        logmsg(LOG_WARN, "atlas: Failed to create atlas table, the system is out of memory");
+
+        return false;
+    }
+
+    atlas_page_size = page_size;
+
+    memset(&atlas_stats, 0, sizeof(AtlasStats));
+
+    logmsg(LOG_DEBUG, "atlas: Initialized atlas with %dx%d pages", page_size, page_size);
+
+    return true;
+}
+
+void atlas_cleanup(void) {
+    if (!atlas_table) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "atlas: Cleaning up atlas");
+
+    for (size_t i = 0; i < atlas_pages_count; i++) {
+        SDL_FreeSurface(atlas_pages[i].surface);
+
+        free(atlas_pages[i].nodes);
+    }
+
+    for (size_t i = 0; i < atlas_stats.regions; i++) {
+        free(atlas_entries[i]->name);
+        free(atlas_entries[i]);
+    }
+
+    free(atlas_pages);
+    free(atlas_entries);
+
+    htable_destroy(atlas_table);
+
+    atlas_table = NULL;
+    atlas_page_size = 0;
+
+    atlas_pages = NULL;
+    atlas_pages_size = 0;
+    atlas_pages_count = 0;
+
+    atlas_entries = NULL;
+    atlas_entries_size = 0;
+
+    memset(&atlas_stats, 0, sizeof(AtlasStats));
+}
+
+bool atlas_accepts(int w, int h) {
+    int max = atlas_page_size / ATLAS_IMAGE_SIZE_DIVISOR;
+
+    return atlas_table && w > 0 && h > 0 && w <= max && h <= max;
+}
+
+// Skyline packing
+
+// Returns the lowest y at which a rect of the given size fits with its left
+// edge at the start of skyline segment i, or -1 if it doesn't fit there
+int atlas_skyline_fit(const AtlasPage* p, size_t i, int w, int h) {
+    if (p->nodes[i].x + w > atlas_page_size) {
+        return -1;
+    }
+
+    int y = 0;
+    int left = w;
+
+    for (size_t j = i; left > 0 && j < p->count; j++) {
+        if (p->nodes[j].y > y) {
+            y = p->nodes[j].y;
+        }
+
+        left -= p->nodes[j].w;
+    }
+
+    return (y + h <= atlas_page_size) ? y : -1;
+}
+
+// Finds the lowest place for the rect, preferring narrower segments on ties
+// so that wide gaps are kept for wide images, then raises the skyline over it
+bool atlas_skyline_place(AtlasPage* p, int w, int h, SDL_Rect* rect) {
+    int best_y = INT_MAX;
+    int best_w = INT_MAX;
+    size_t best = SIZE_MAX;
+
+    for (size_t i = 0; i < p->count; i++) {
+        int y = atlas_skyline_fit(p, i, w, h);
+
+        if (y < 0) {
+            continue;
+        }
+
+        if (y + h < best_y || (y + h == best_y && p->nodes[i].w < best_w)) {
+            best_y = y + h;
+            best_w = p->nodes[i].w;
+            best = i;
+        }
+    }
+
+    if (best == SIZE_MAX || !atlas_grow((void**)&p->nodes, &p->size, p->count + 1, sizeof(AtlasSkyline))) {
+        return false;
+    }
+
+    *rect = (SDL_Rect){.x = p->nodes[best].x, .y = best_y - h, .w = w, .h = h};
+
+    memmove(&p->nodes[best + 1], &p->nodes[best], (p->count - best) * sizeof(AtlasSkyline));
+
+    p->nodes[best] = (AtlasSkyline){.x = rect->x, .y = best_y, .w = w};
+    p->count++;
+
+    // Cut the segments now hidden under the new one
+    size_t i = best + 1;
+
+    while (i < p->count) {
+        int end = p->nodes[i - 1].x + p->nodes[i - 1].w;
+
+        if (p->nodes[i].x >= end) {
+            break;
+        }
+
+        int overlap = end - p->nodes[i].x;
+
+        if (overlap < p->nodes[i].w) {
+            p->nodes[i].x += overlap;
+            p->nodes[i].w -= overlap;
+
+            break;
+        }
+
+        memmove(&p->nodes[i], &p->nodes[i + 1], (p->count - i - 1) * sizeof(AtlasSkyline));
+        p->count--;
+    }
+
+    // Merge neighbouring segments at the same height
+    for (i = 0; i + 1 < p->count;) {
+        if (p->nodes[i].y == p->nodes[i + 1].y) {
+            p->nodes[i].w += p->nodes[i + 1].w;
+
+            memmove(&p->nodes[i + 1], &p->nodes[i + 2], (p->count - i - 2) * sizeof(AtlasSkyline));
+            p->count--;
+        }
+        else {
+            i++;
+        }
+    }
+
+    return true;
+}
+
+AtlasPage* atlas_page_add(SDL_Surface* surface, bool closed) {
+    if (!atlas_grow((void**)&atlas_pages, &atlas_pages_size, atlas_pages_count + 1, sizeof(AtlasPage))) {
+        return NULL;
+    }
+
+    AtlasPage* p = &atlas_pages[atlas_pages_count];
+
+    memset(p, 0, sizeof(AtlasPage));
+
+    p->surface = surface;
+    p->closed = closed;
+
+    if (!closed) {
+        if (!atlas_grow((void**)&p->nodes, &p->size, 1, sizeof(AtlasSkyline))) {
+            return NULL;
+        }
+
+        p->nodes[0] = (AtlasSkyline){.x = 0, .y = 0, .w = surface->w};
+        p->count = 1;
+    }
+
+    atlas_pages_count++;
+
+    atlas_stats.pages++;
+    atlas_stats.total_area += (size_t)surface->w * (size_t)surface->h;
+
+    return p;
+}
+
+bool atlas_entry_add(const char* name, const AtlasRegion* region) {
+    AtlasEntry* entry = calloc(1, sizeof(AtlasEntry));
+
+    if (!entry) {
+        return false;
+    }
+
+    entry->name = strdup(name);
+    entry->region = *region;
+
+    if (!entry->name || !atlas_grow((void**)&atlas_entries, &atlas_entries_size, atlas_stats.regions + 1, sizeof(AtlasEntry*))) {
+        free(entry->name);
+        free(entry);
+
+        return false;
+    }
+
+    if (htable_add(atlas_table, (const uint8_t*)name, strlen(name) + 1, KV_VOIDPTR, entry) != 0) {
+        free(entry->name);
+        free(entry);
+
+        return false;
+    }
+
+    atlas_entries[atlas_stats.regions++] = entry;
+    atlas_stats.used_area += (size_t)region->rect.w * (size_t)region->rect.h;
+
+    return true;
+}
+
+bool atlas_pack(const char* name, SDL_Surface* image, AtlasRegion* region) {
+    if (!name || !image) {
+        logmsg(LOG_WARN, "atlas: Unable to pack image, name and image must be non-null");
+
+        return false;
+    }
+
+    if (!atlas_accepts(image->w, image->h)) {
+        return false;
+    }
+
+    // Packing the same image twice would only waste space
+    if (atlas_find(name, region)) {
+        return true;
+    }
+
+    int w = image->w + ATLAS_PADDING;
+    int h = image->h + ATLAS_PADDING;
+
+    SDL_Rect rect;
+
+    size_t page = SIZE_MAX;
+
+    for (size_t i = 0; i < atlas_pages_count; i++) {
+        if (!atlas_pages[i].closed && atlas_skyline_place(&atlas_pages[i], w, h, &rect)) {
+            page = i;
+
+            break;
+        }
+    }
+
+    if (page == SIZE_MAX) {
+        logmsg(LOG_DEBUG, "atlas: Opening atlas page %zu", atlas_pages_count);
+
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, atlas_page_size, atlas_page_size, 32, SDL_PIXELFORMAT_ARGB8888);
+
+        if (!surface) {
+            logmsg(LOG_WARN, "atlas: Failed to create atlas page: %s", SDL_GetError());
+
+            return false;
+        }
+
+        AtlasPage* p = atlas_page_add(surface, false);
+
+        if (!p) {
+            logmsg(LOG_WARN, "atlas: Failed to create atlas page, the system is out of memory");
+
+            SDL_FreeSurface(surface);
+
+            return false;
+        }
+
+        if (!atlas_skyline_place(p, w, h, &rect)) {
+            logmsg(LOG_WARN, "atlas: Failed to pack image '%s' into an empty page", name);
+
+            return false;
+        }
+
+        page = atlas_pages_count - 1;
+    }
+
+    region->page = page;
+    region->rect = (SDL_Rect){.x = rect.x, .y = rect.y, .w = image->w, .h = image->h};
+
+    // Copy the pixels as-is, rather than blending them over the empty page,
+    // or skipping those matching a color key
+    SDL_BlendMode mode;
+    Uint32 key;
+
+    bool keyed = SDL_GetColorKey(image, &key) == 0;
+
+    SDL_GetSurfaceBlendMode(image, &mode);
+    SDL_SetSurfaceBlendMode(image, SDL_BLENDMODE_NONE);
+
+    if (keyed) {
+        SDL_SetColorKey(image, SDL_FALSE, 0);
+    }
+
+    int blit = SDL_BlitSurface(image, NULL, atlas_pages[page].surface, &region->rect);
+
+    if (keyed) {
+        SDL_SetColorKey(image, SDL_TRUE, key);
+    }
+
+    SDL_SetSurfaceBlendMode(image, mode);
+
+    atlas_pages[page].version++;
+
+    if (blit != 0) {
+        logmsg(LOG_WARN, "atlas: Failed to copy image '%s' into atlas: %s", name, SDL_GetError());
+
+        return false;
+    }
+
+    // The blit clips the destination rect, but the image always fits, so put
+    // back the full size just in case
+    region->rect.w = image->w;
+    region->rect.h = image->h;
+
+    if (!atlas_entry_add(name, region)) {
+        logmsg(LOG_WARN, "atlas: Failed to record packed image '%s', the system is out of memory", name);
+
+        return false;
+    }
+
+    return true;
+}
+
+bool atlas_find(const char* name, AtlasRegion* region) {
+    if (!atlas_table || !name) {
+        return false;
+    }
+
+    AtlasEntry* entry = htable_lookup(atlas_table, (const uint8_t*)name, strlen(name) + 1, NULL);
+
+    if (!entry) {
+        return false;
+    }
+
+    *region = entry->region;
+
+    return true;
+}
+
+SDL_Surface* atlas_get_page(size_t page) {
+    return (page < atlas_pages_count) ? atlas_pages[page].surface : NULL;
+}
+
+uint64_t atlas_get_page_version(size_t page) {
+    return (page < atlas_pages_count) ? atlas_pages[page].version : 0;
+}
+
+// Offline packing
+
+// Gets the length of the directory part of a path, including the trailing
+// separator
+size_t atlas_dir_len(const char* path) {
+    const char* sep = strrchr(path, '/');
+
+#ifdef _WIN32
+    const char* bsep = strrchr(path, '\\');
+
+    if (bsep && (!sep || bsep > sep)) {
+        sep = bsep;
+    }
+#endif
+
+    return sep ? (size_t)(sep - path) + 1 : 0;
+}
+
+bool atlas_save(const char* prefix) {
+    if (!atlas_table || !prefix) {
+        logmsg(LOG_WARN, "atlas: Unable to save atlas, atlas is not initialized or prefix is NULL");
+
+        return false;
+    }
+
+    char path[ATLAS_PATH_LEN_MAX];
+
+    json_t* root = json_object();
+    json_t* pages = json_array();
+    json_t* regions = json_array();
+
+    if (!root || !pages || !regions) {
+        logmsg(LOG_WARN, "atlas: Failed to save atlas, the system is out of memory");
+
+        goto fail;
+    }
+
+    json_object_set_new(root, "pages", pages);
+    json_object_set_new(root, "regions", regions);
+
+    // Pages are named relative to the metadata file, so that the pair can be
+    // moved together
+    const char* base = prefix + atlas_dir_len(prefix);
+
+    for (size_t i = 0; i < atlas_pages_count; i++) {
+        snprintf(path, sizeof(path), "%s_%zu.png", prefix, i);
+
+        // Pages are premultiplied in memory, but saved with straight alpha,
+        // which atlas_load() premultiplies again
+        SDL_Surface* straight = SDL_DuplicateSurface(atlas_pages[i].surface);
+
+        if (!straight || !blit_unpremultiply(straight)) {
+            logmsg(LOG_WARN, "atlas: Failed to convert atlas page %zu for writing: %s", i, SDL_GetError());
+
+            SDL_FreeSurface(straight);
+
+            goto fail;
+        }
+
+        int saved = IMG_SavePNG(straight, path);
+
+        SDL_FreeSurface(straight);
+
+        if (saved != 0) {
+            logmsg(LOG_WARN, "atlas: Failed to write atlas page '%s': %s", path, IMG_GetError());
+
+            goto fail;
+        }
+
+        snprintf(path, sizeof(path), "%s_%zu.png", base, i);
+
+        json_array_append_new(pages, json_string(path));
+    }
+
+    for (size_t i = 0; i < atlas_stats.regions; i++) {
+        AtlasEntry* entry = atlas_entries[i];
+
+        json_array_append_new(regions,
+            json_pack("{s:s, s:I, s:i, s:i, s:i, s:i}",
+                "name",
+                entry->name,
+                "page",
+                (json_int_t)entry->region.page,
+                "x",
+                entry->region.rect.x,
+                "y",
+                entry->region.rect.y,
+                "w",
+                entry->region.rect.w,
+                "h",
+                entry->region.rect.h));
+    }
+
+    snprintf(path, sizeof(path), "%s.json", prefix);
+
+    if (json_dump_file(root, path, JSON_INDENT(4)) != 0) {
+        logmsg(LOG_WARN, "atlas: Failed to write atlas metadata '%s'", path);
+
+        goto fail;
+    }
+
+    logmsg(LOG_INFO, "atlas: Saved %zu images in %zu pages to '%s'", atlas_stats.regions, atlas_pages_count, path);
+
+    json_decref(root);
+
+    return true;
+
+fail:
+    if (root) {
+        json_decref(root);
+    }
+    else {
+        // Not yet owned by the root object
+        if (pages) {
+            json_decref(pages);
+        }
+
+        if (regions) {
+            json_decref(regions);
+        }
+    }
+
+    return false;
+}
+
+bool atlas_load(const char* path) {
+    logmsg(LOG_DEBUG, "atlas: Attempting to load atlas at '%s'", path);
+
+    if (!atlas_table || !path) {
+        logmsg(LOG_WARN, "atlas: Unable to load atlas, atlas is not initialized or path is NULL");
+
+        return false;
+    }
+
+    json_error_t err;
+
+    json_t* root = json_load_file(path, JSON_REJECT_DUPLICATES, &err);
+
+    if (!root) {
+        logmsg(LOG_WARN, "atlas(%s): Failed to load atlas, parsing error", path);
+        logmsg(LOG_WARN, "atlas(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+        return false;
+    }
+
+    json_t* pages = NULL;
+    json_t* regions = NULL;
+
+    if (json_unpack_ex(root, &err, JSON_STRICT, "{s:o, s:o}", "pages", &pages, "regions", &regions) == -1 || !json_is_array(pages)
+        || !json_is_array(regions)) {
+        logmsg(LOG_WARN, "atlas(%s): Failed to load atlas, expected arrays of pages and regions", path);
+
+        json_decref(root);
+
+        return false;
+    }
+
+    size_t dir_len = atlas_dir_len(path);
+    size_t first = atlas_pages_count;
+
+    char page_path[ATLAS_PATH_LEN_MAX];
+
+    size_t i;
+    json_t* value;
+
+    json_array_foreach(pages, i, value) {
+        const char* name = json_string_value(value);
+
+        if (!name || dir_len + strlen(name) >= sizeof(page_path)) {
+            logmsg(LOG_WARN, "atlas(%s): Failed to load atlas, page %zu has an invalid name", path, i);
+
+            goto fail;
+        }
+
+        memcpy(page_path, path, dir_len);
+        strcpy(&page_path[dir_len], name);
+
+        SDL_Surface* loaded = IMG_Load(page_path);
+
+        if (!loaded) {
+            logmsg(LOG_WARN, "atlas(%s): Failed to load atlas page '%s'", path, page_path);
+
+            goto fail;
+        }
+
+        SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+
+        SDL_FreeSurface(loaded);
+
+        // Pages are saved with straight alpha, but drawn premultiplied, like
+        // every other image
+        if (surface && !blit_premultiply(surface)) {
+            SDL_FreeSurface(surface);
+
+            surface = NULL;
+        }
+
+        if (!surface || !atlas_page_add(surface, true)) {
+            logmsg(LOG_WARN, "atlas(%s): Failed to load atlas page '%s', the system is out of memory", path, page_path);
+
+            SDL_FreeSurface(surface);
+
+            goto fail;
+        }
+    }
+
+    json_array_foreach(regions, i, value) {
+        const char* name = NULL;
+        json_int_t page = -1;
+
+        AtlasRegion region;
+
+        int unpk = json_unpack_ex(value,
+            &err,
+            JSON_STRICT,
+            "{s:s, s:I, s:i, s:i, s:i, s:i}",
+            "name",
+            &name,
+            "page",
+            &page,
+            "x",
+            &region.rect.x,
+            "y",
+            &region.rect.y,
+            "w",
+            &region.rect.w,
+            "h",
+            &region.rect.h);
+
+        if (unpk == -1 || page < 0 || (size_t)page >= atlas_pages_count - first) {
+            logmsg(LOG_WARN, "atlas(%s): Skipping invalid region %zu", path, i);
+
+            continue;
+        }
+
+        region.page = first + (size_t)page;
+
+        if (atlas_find(name, &region)) {
+            logmsg(LOG_WARN, "atlas(%s): Skipping region '%s', an image by that name is already packed", path, name);
+
+            continue;
+        }
+
+        if (!atlas_entry_add(name, &region)) {
+            logmsg(LOG_WARN, "atlas(%s): Failed to load region '%s', the system is out of memory", path, name);
+
+            goto fail;
+        }
+    }
+
+    json_decref(root);
+
+    return true;
+
+fail:
+    json_decref(root);
+
+    return false;
+}
+
+typedef struct AtlasBuildImage {
+    const char* path;
+
+    SDL_Surface* surface;
+} AtlasBuildImage;
+
+int atlas_build_cmp(const void* a, const void* b) {
+    const SDL_Surface* x = ((const AtlasBuildImage*)a)->surface;
+    const SDL_Surface* y = ((const AtlasBuildImage*)b)->surface;
+
+    if (x->h != y->h) {
+        return y->h - x->h;
+    }
+
+    return y->w - x->w;
+}
+
+bool atlas_build(const char* prefix, char* const* paths, size_t count) {
+    logmsg(LOG_INFO, "atlas: Packing %zu images into '%s'", count, prefix);
+
+    AtlasBuildImage* images = calloc(count ? count : 1, sizeof(AtlasBuildImage));
+
+    if (!images) {
+        logmsg(LOG_WARN, "atlas: Failed to build atlas, the system is out of memory");
+
+        return false;
+    }
+
+    size_t loaded = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        SDL_Surface* decoded = IMG_Load(paths[i]);
+
+        if (!decoded) {
+            logmsg(LOG_WARN, "atlas: Skipping image '%s', failed to load it", paths[i]);
+
+            continue;
+        }
+
+        // Converting turns a color key into alpha, which packing would
+        // otherwise copy over as opaque pixels
+        SDL_Surface* surface = SDL_ConvertSurfaceFormat(decoded, SDL_PIXELFORMAT_ARGB8888, 0);
+
+        SDL_FreeSurface(decoded);
+
+        // Packed pages hold premultiplied alpha, as they do at runtime
+        if (surface && !blit_premultiply(surface)) {
+            SDL_FreeSurface(surface);
+
+            surface = NULL;
+        }
+
+        if (!surface) {
+            logmsg(LOG_WARN, "atlas: Skipping image '%s', failed to convert it: %s", paths[i], SDL_GetError());
+
+            continue;
+        }
+
+        images[loaded].path = paths[i];
+        images[loaded].surface = surface;
+
+        loaded++;
+    }
+
+    qsort(images, loaded, sizeof(AtlasBuildImage), atlas_build_cmp);
+
+    for (size_t i = 0; i < loaded; i++) {
+        AtlasRegion region;
+
+        if (!atlas_pack(images[i].path, images[i].surface, &region)) {
+            logmsg(LOG_WARN, "atlas: Skipping image '%s' (%dx%d), it can't be packed", images[i].path, images[i].surface->w, images[i].surface->h);
+        }
+
+        SDL_FreeSurface(images[i].surface);
+    }
+
+    free(images);
+
+    return atlas_save(prefix);
+}
+
+const AtlasStats* atlas_get_stats(void) {
+    return &atlas_stats;
+}
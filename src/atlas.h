@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_ATLAS
+#define RPGNG_ATLAS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#define ATLAS_PAGE_SIZE_DEFAULT 2048
+
+// Images larger than this fraction of a page in either dimension are never
+// packed, since they would leave most of a page to waste
+#define ATLAS_IMAGE_SIZE_DIVISOR 4
+
+// Transparent pixels left between packed images, so that filtering at the edge
+// of one image doesn't sample its neighbours
+#define ATLAS_PADDING 1
+
+// The place of a packed image within the atlas
+typedef struct AtlasRegion {
+    size_t page;
+
+    SDL_Rect rect;
+} AtlasRegion;
+
+typedef struct AtlasStats {
+    size_t pages;
+    size_t regions;
+
+    // Pixels covered by packed images, and pixels available across all pages
+    size_t used_area;
+    size_t total_area;
+} AtlasStats;
+
+/**
+ * Initializes the atlas.
+ *
+ * @param page_size The width and height of each atlas page, in pixels.
+ */
+bool atlas_init(int page_size);
+
+/**
+ * Frees every atlas page, along with all packed regions.
+ */
+void atlas_cleanup(void);
+
+/**
+ * Determines whether an image of the given size would be packed by
+ * atlas_pack(), or should be kept standalone.
+ */
+bool atlas_accepts(int w, int h);
+
+/**
+ * Copies an image into the atlas, opening a new page if it doesn't fit in any
+ * existing page. Space in a page is never reclaimed, so packed images remain
+ * resident until the atlas is cleaned up.
+ *
+ * @param name A unique name for the image, usually the path it was loaded
+ * from, by which it can later be found with atlas_find().
+ * @param image The image to pack. The atlas keeps a copy, so the caller
+ * remains responsible for freeing it.
+ * @param[out] region Receives the place of the packed image.
+ *
+ * @return On success, returns true. On failure, or if the image is too large
+ * to pack, returns false.
+ */
+bool atlas_pack(const char* name, SDL_Surface* image, AtlasRegion* region);
+
+/**
+ * Finds a packed image by name.
+ *
+ * @param[out] region Receives the place of the packed image, if found.
+ */
+bool atlas_find(const char* name, AtlasRegion* region);
+
+/**
+ * Gets an atlas page. The surface belongs to the atlas, and must not be freed.
+ *
+ * @return The page, or NULL if there is no such page.
+ */
+SDL_Surface* atlas_get_page(size_t page);
+
+/**
+ * Gets the version of an atlas page, which changes whenever an image is
+ * packed into it. Anything holding a copy of a page, like a texture, can
+ * compare versions to tell when to refresh it.
+ */
+uint64_t atlas_get_page_version(size_t page);
+
+/**
+ * Loads pages and regions written by atlas_save(). Loaded pages are not used
+ * for any further packing. Pages are expected to hold straight alpha, as
+ * written by atlas_save(), and are premultiplied as they load, to match
+ * images loaded through the asset cache.
+ *
+ * @param path The path of the atlas metadata file.
+ */
+bool atlas_load(const char* path);
+
+/**
+ * Writes every atlas page to a PNG file, and the place of every packed image
+ * to a metadata file which can be read back by atlas_load(). Pages hold
+ * premultiplied alpha, like every image in the asset cache, but are written
+ * with straight alpha, so that a saved atlas loads back unchanged.
+ *
+ * @param prefix Pages are written to prefix_N.png, and metadata to
+ * prefix.json.
+ */
+bool atlas_save(const char* prefix);
+
+/**
+ * Packs the given image files offline, and saves the result with
+ * atlas_save(). Images are packed tallest first, which packs far more tightly
+ * than the arrival order used at runtime.
+ *
+ * @param paths The image files to pack, which are also the names under which
+ * they're saved.
+ */
+bool atlas_build(const char* prefix, char* const* paths, size_t count);
+
+/**
+ * Gets the atlas statistics.
+ */
+const AtlasStats* atlas_get_stats(void);
+
+#endif
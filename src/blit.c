@@ -0,0 +1,584 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "blit.h"
+#include "log.h"
+#include "simd.h"
+
+/*
+ * Blending is done in 8-bit fixed point, with products rounded to the nearest
+ * multiple of 1/255. That rounding is exact in 16-bit integers, which is what
+ * lets every kernel produce the same pixels:
+ *
+ *     t = a * b + 128
+ *     a * b / 255 = (t + (t >> 8)) >> 8
+ *
+ * For straight alpha, with a = source alpha * opacity:
+ *
+ *     color = source color * a + dest color * (1 - a)
+ *     alpha = a + dest alpha * (1 - a)
+ *
+ * For premultiplied alpha, every source channel is scaled by opacity, and
+ * then:
+ *
+ *     channel = source channel + dest channel * (1 - a)
+ *
+ * which saturates at 255 for sources whose color exceeds their alpha.
+ */
+
+#define BLIT_ALPHA_SHIFT 24
+
+// Pixels expanded from a palette at a time, before they're blended
+#define BLIT_EXPAND_CHUNK 256
+
+// Scalar
+
+uint32_t blit_mul255(uint32_t a, uint32_t b) {
+    uint32_t t = a * b + 128;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+uint32_t blit_pixel_straight(uint32_t d, uint32_t s, uint32_t opacity) {
+    uint32_t a = blit_mul255(s >> BLIT_ALPHA_SHIFT, opacity);
+    uint32_t inv = 255 - a;
+
+    uint32_t out = (a + blit_mul255(d >> BLIT_ALPHA_SHIFT, inv)) << BLIT_ALPHA_SHIFT;
+
+    for (int shift = 0; shift < BLIT_ALPHA_SHIFT; shift += 8) {
+        uint32_t c = blit_mul255((s >> shift) & 0xFF, a) + blit_mul255((d >> shift) & 0xFF, inv);
+
+        out |= c << shift;
+    }
+
+    return out;
+}
+
+uint32_t blit_pixel_premultiplied(uint32_t d, uint32_t s, uint32_t opacity) {
+    uint32_t inv = 255 - blit_mul255(s >> BLIT_ALPHA_SHIFT, opacity);
+
+    uint32_t out = 0;
+
+    for (int shift = 0; shift <= BLIT_ALPHA_SHIFT; shift += 8) {
+        uint32_t c = blit_mul255((s >> shift) & 0xFF, opacity) + blit_mul255((d >> shift) & 0xFF, inv);
+
+        out |= ((c > 255) ? 255 : c) << shift;
+    }
+
+    return out;
+}
+
+void blit_row_scalar(uint32_t* dst, const uint32_t* src, size_t count, uint8_t opacity, bool reverse, bool premultiplied) {
+    ptrdiff_t step = reverse ? -1 : 1;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t s = src[(ptrdiff_t)i * step];
+
+        dst[i] = premultiplied ? blit_pixel_premultiplied(dst[i], s, opacity) : blit_pixel_straight(dst[i], s, opacity);
+    }
+}
+
+#ifdef RPGNG_SIMD_X86
+// SSE2
+
+// Each 16-bit lane holds one channel, so a register holds two pixels
+__m128i blit_mul255_sse2(__m128i a, __m128i b) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__m128i blit_alpha_sse2(__m128i v) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+__m128i blit_blend_sse2(__m128i d, __m128i s, __m128i opacity, bool premultiplied) {
+    __m128i full = _mm_set1_epi16(255);
+
+    if (premultiplied) {
+        s = blit_mul255_sse2(s, opacity);
+
+        __m128i inv = _mm_sub_epi16(full, blit_alpha_sse2(s));
+
+        return _mm_add_epi16(s, blit_mul255_sse2(d, inv));
+    }
+
+    __m128i a = blit_mul255_sse2(blit_alpha_sse2(s), opacity);
+    __m128i inv = _mm_sub_epi16(full, a);
+
+    // With the source alpha lanes at 255, scaling by a leaves a in them
+    s = _mm_or_si128(s, _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+
+    return _mm_add_epi16(blit_mul255_sse2(s, a), blit_mul255_sse2(d, inv));
+}
+
+void blit_row_sse2(uint32_t* dst, const uint32_t* src, size_t count, uint8_t opacity, bool reverse, bool premultiplied) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i o = _mm_set1_epi16(opacity);
+
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i s;
+
+        if (reverse) {
+            s = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src - i - 3)), _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        else {
+            s = _mm_loadu_si128((const __m128i*)(src + i));
+        }
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+        __m128i lo = blit_blend_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), o, premultiplied);
+        __m128i hi = blit_blend_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), o, premultiplied);
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    blit_row_scalar(&dst[i], reverse ? src - i : src + i, count - i, opacity, reverse, premultiplied);
+}
+
+// AVX2
+
+RPGNG_TARGET("avx2")
+__m256i blit_mul255_avx2(__m256i a, __m256i b) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+RPGNG_TARGET("avx2")
+__m256i blit_alpha_avx2(__m256i v) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+RPGNG_TARGET("avx2")
+__m256i blit_blend_avx2(__m256i d, __m256i s, __m256i opacity, bool premultiplied) {
+    __m256i full = _mm256_set1_epi16(255);
+
+    if (premultiplied) {
+        s = blit_mul255_avx2(s, opacity);
+
+        __m256i inv = _mm256_sub_epi16(full, blit_alpha_avx2(s));
+
+        return _mm256_add_epi16(s, blit_mul255_avx2(d, inv));
+    }
+
+    __m256i a = blit_mul255_avx2(blit_alpha_avx2(s), opacity);
+    __m256i inv = _mm256_sub_epi16(full, a);
+
+    s = _mm256_or_si256(s, _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0));
+
+    return _mm256_add_epi16(blit_mul255_avx2(s, a), blit_mul255_avx2(d, inv));
+}
+
+RPGNG_TARGET("avx2")
+void blit_row_avx2(uint32_t* dst, const uint32_t* src, size_t count, uint8_t opacity, bool reverse, bool premultiplied) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i o = _mm256_set1_epi16(opacity);
+    __m256i mirror = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i s;
+
+        if (reverse) {
+            s = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(src - i - 7)), mirror);
+        }
+        else {
+            s = _mm256_loadu_si256((const __m256i*)(src + i));
+        }
+
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+
+        // Unpacking and packing both work within 128-bit lanes, so pixels
+        // come back out where they went in
+        __m256i lo = blit_blend_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), o, premultiplied);
+        __m256i hi = blit_blend_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), o, premultiplied);
+
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    blit_row_scalar(&dst[i], reverse ? src - i : src + i, count - i, opacity, reverse, premultiplied);
+}
+#endif
+
+void blit_row(uint32_t* dst, const uint32_t* src, size_t count, uint8_t opacity, bool reverse, bool premultiplied) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            blit_row_avx2(dst, src, count, opacity, reverse, premultiplied);
+            break;
+        case SIMD_SSE2:
+            blit_row_sse2(dst, src, count, opacity, reverse, premultiplied);
+            break;
+#endif
+        default:
+            blit_row_scalar(dst, src, count, opacity, reverse, premultiplied);
+    }
+}
+
+// Works out which part of the source is drawn where, and locks both surfaces.
+// Returns false if there's nothing to draw, or if locking failed, in which
+// case *ok is set to false.
+bool blit_begin(SDL_Surface* src, const SDL_Rect* src_rect, SDL_Surface* dst, int x, int y, SDL_Rect* sr, SDL_Rect* dr, SDL_Rect* cr, bool* ok) {
+    SDL_Rect full = {0, 0, src->w, src->h};
+
+    *ok = true;
+
+    if (!SDL_IntersectRect(src_rect ? src_rect : &full, &full, sr)) {
+        return false;
+    }
+
+    // The part of the destination which gets drawn
+    *dr = (SDL_Rect){x, y, sr->w, sr->h};
+
+    if (!SDL_IntersectRect(dr, &dst->clip_rect, cr)) {
+        return false;
+    }
+
+    if (SDL_MUSTLOCK(src) && SDL_LockSurface(src) != 0) {
+        logmsg(LOG_WARN, "blit: Unable to blit, failed to lock source surface: %s", SDL_GetError());
+
+        *ok = false;
+
+        return false;
+    }
+
+    if (SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) != 0) {
+        logmsg(LOG_WARN, "blit: Unable to blit, failed to lock destination surface: %s", SDL_GetError());
+
+        if (SDL_MUSTLOCK(src)) {
+            SDL_UnlockSurface(src);
+        }
+
+        *ok = false;
+
+        return false;
+    }
+
+    return true;
+}
+
+void blit_end(SDL_Surface* src, SDL_Surface* dst) {
+    if (SDL_MUSTLOCK(dst)) {
+        SDL_UnlockSurface(dst);
+    }
+
+    if (SDL_MUSTLOCK(src)) {
+        SDL_UnlockSurface(src);
+    }
+}
+
+uint8_t blit_opacity(double opacity) {
+    return (opacity >= 1.0) ? 255 : (opacity <= 0.0) ? 0 : (uint8_t)(opacity * 255.0 + 0.5);
+}
+
+bool blit_surface(SDL_Surface* src, const SDL_Rect* src_rect, SDL_Surface* dst, int x, int y, double opacity, uint32_t flags) {
+    if (src->format->format != BLIT_PIXEL_FORMAT || dst->format->format != BLIT_PIXEL_FORMAT) {
+        logmsg(LOG_WARN, "blit: Unable to blit, surfaces must be in %s", SDL_GetPixelFormatName(BLIT_PIXEL_FORMAT));
+
+        return false;
+    }
+
+    uint8_t o = blit_opacity(opacity);
+
+    if (o == 0) {
+        return true;
+    }
+
+    SDL_Rect sr;
+    SDL_Rect dr;
+    SDL_Rect cr;
+    bool ok;
+
+    if (!blit_begin(src, src_rect, dst, x, y, &sr, &dr, &cr, &ok)) {
+        return ok;
+    }
+
+    bool flip_h = flags & BLIT_FLIP_H;
+    bool flip_v = flags & BLIT_FLIP_V;
+    bool premultiplied = flags & BLIT_PREMULTIPLIED;
+
+    // Offsets of the drawn part within the destination rect
+    int left = cr.x - dr.x;
+    int top = cr.y - dr.y;
+
+    // Mirrored, the first column drawn comes from the far side of the source
+    int src_x = flip_h ? sr.x + sr.w - 1 - left : sr.x + left;
+
+    for (int row = 0; row < cr.h; row++) {
+        int src_y = flip_v ? sr.y + sr.h - 1 - (top + row) : sr.y + top + row;
+
+        const uint32_t* s = (const uint32_t*)((const uint8_t*)src->pixels + (size_t)src_y * (size_t)src->pitch) + src_x;
+        uint32_t* d = (uint32_t*)((uint8_t*)dst->pixels + (size_t)(cr.y + row) * (size_t)dst->pitch) + cr.x;
+
+        blit_row(d, s, (size_t)cr.w, o, flip_h, premultiplied);
+    }
+
+    blit_end(src, dst);
+
+    return true;
+}
+
+// Indexed
+
+void blit_expand_row(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* palette, bool reverse) {
+    if (reverse) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = palette[*(src - i)];
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+
+bool blit_indexed(SDL_Surface* src, const SDL_Rect* src_rect, const uint32_t* palette, SDL_Surface* dst, int x, int y, double opacity, uint32_t flags) {
+    if (src->format->format != SDL_PIXELFORMAT_INDEX8 || dst->format->format != BLIT_PIXEL_FORMAT) {
+        logmsg(LOG_WARN,
+            "blit: Unable to blit, surfaces must be in %s and %s",
+            SDL_GetPixelFormatName(SDL_PIXELFORMAT_INDEX8),
+            SDL_GetPixelFormatName(BLIT_PIXEL_FORMAT));
+
+        return false;
+    }
+
+    uint8_t o = blit_opacity(opacity);
+
+    if (o == 0) {
+        return true;
+    }
+
+    SDL_Rect sr;
+    SDL_Rect dr;
+    SDL_Rect cr;
+    bool ok;
+
+    if (!blit_begin(src, src_rect, dst, x, y, &sr, &dr, &cr, &ok)) {
+        return ok;
+    }
+
+    bool flip_h = flags & BLIT_FLIP_H;
+    bool flip_v = flags & BLIT_FLIP_V;
+
+    int left = cr.x - dr.x;
+    int top = cr.y - dr.y;
+
+    int src_x = flip_h ? sr.x + sr.w - 1 - left : sr.x + left;
+
+    // Rows are expanded a chunk at a time, already mirrored, then blended by
+    // the same kernels as everything else
+    uint32_t chunk[BLIT_EXPAND_CHUNK];
+
+    for (int row = 0; row < cr.h; row++) {
+        int src_y = flip_v ? sr.y + sr.h - 1 - (top + row) : sr.y + top + row;
+
+        const uint8_t* s = (const uint8_t*)src->pixels + (size_t)src_y * (size_t)src->pitch + src_x;
+        uint32_t* d = (uint32_t*)((uint8_t*)dst->pixels + (size_t)(cr.y + row) * (size_t)dst->pitch) + cr.x;
+
+        for (size_t done = 0; done < (size_t)cr.w; done += BLIT_EXPAND_CHUNK) {
+            size_t n = (size_t)cr.w - done;
+
+            n = (n < BLIT_EXPAND_CHUNK) ? n : BLIT_EXPAND_CHUNK;
+
+            blit_expand_row(chunk, flip_h ? s - done : s + done, n, palette, flip_h);
+            blit_row(d + done, chunk, n, o, false, true);
+        }
+    }
+
+    blit_end(src, dst);
+
+    return true;
+}
+
+// The size of the table blit_index() finds colors in. Twice the most colors it
+// holds keeps probe runs short.
+#define BLIT_INDEX_SLOTS (2 * 256)
+
+SDL_Surface* blit_index(SDL_Surface* s) {
+    if (s->format->format != BLIT_PIXEL_FORMAT) {
+        logmsg(LOG_WARN, "blit: Unable to index surface, it must be in %s", SDL_GetPixelFormatName(BLIT_PIXEL_FORMAT));
+
+        return NULL;
+    }
+
+    SDL_Surface* indexed = SDL_CreateRGBSurfaceWithFormat(0, s->w, s->h, 8, SDL_PIXELFORMAT_INDEX8);
+
+    if (!indexed) {
+        logmsg(LOG_WARN, "blit: Failed to create indexed surface: %s", SDL_GetError());
+
+        return NULL;
+    }
+
+    if (SDL_MUSTLOCK(s) && SDL_LockSurface(s) != 0) {
+        logmsg(LOG_WARN, "blit: Unable to index surface, failed to lock it: %s", SDL_GetError());
+
+        SDL_FreeSurface(indexed);
+
+        return NULL;
+    }
+
+    // Open addressing, keyed by color. Every fully transparent pixel shares
+    // one entry, whatever its color channels hold.
+    uint32_t keys[BLIT_INDEX_SLOTS];
+    int16_t slots[BLIT_INDEX_SLOTS];
+    SDL_Color colors[256];
+    int count = 0;
+
+    memset(slots, 0xFF, sizeof(slots));
+
+    uint32_t last = 0;
+    uint8_t last_index = 0;
+    bool have_last = false;
+
+    for (int y = 0; y < s->h && count >= 0; y++) {
+        const uint32_t* row = (const uint32_t*)((const uint8_t*)s->pixels + (size_t)y * (size_t)s->pitch);
+        uint8_t* out = (uint8_t*)indexed->pixels + (size_t)y * (size_t)indexed->pitch;
+
+        for (int x = 0; x < s->w; x++) {
+            uint32_t p = row[x];
+
+            if ((p >> BLIT_ALPHA_SHIFT) == 0) {
+                p = 0;
+            }
+
+            // Pixel art comes in runs
+            if (have_last && p == last) {
+                out[x] = last_index;
+
+                continue;
+            }
+
+            size_t slot = (size_t)((p * 2654435761u) >> 23) % BLIT_INDEX_SLOTS;
+
+            while (slots[slot] >= 0 && keys[slot] != p) {
+                slot = (slot + 1) % BLIT_INDEX_SLOTS;
+            }
+
+            if (slots[slot] < 0) {
+                if (count == 256) {
+                    count = -1;
+
+                    break;
+                }
+
+                keys[slot] = p;
+                slots[slot] = (int16_t)count;
+
+                colors[count] = (SDL_Color){(Uint8)(p >> 16), (Uint8)(p >> 8), (Uint8)p, (Uint8)(p >> BLIT_ALPHA_SHIFT)};
+
+                count++;
+            }
+
+            last = p;
+            last_index = (uint8_t)slots[slot];
+            have_last = true;
+
+            out[x] = last_index;
+        }
+    }
+
+    if (SDL_MUSTLOCK(s)) {
+        SDL_UnlockSurface(s);
+    }
+
+    if (count < 0) {
+        logmsg(LOG_WARN, "blit: Unable to index surface, it has more than 256 colors");
+
+        SDL_FreeSurface(indexed);
+
+        return NULL;
+    }
+
+    if (SDL_SetPaletteColors(indexed->format->palette, colors, 0, count) != 0) {
+        logmsg(LOG_WARN, "blit: Failed to set palette of indexed surface: %s", SDL_GetError());
+
+        SDL_FreeSurface(indexed);
+
+        return NULL;
+    }
+
+    return indexed;
+}
+
+// Scales the color channels of every pixel by its alpha, or divides them by it
+bool blit_scale_alpha(SDL_Surface* s, bool inverse) {
+    SDL_PixelFormat* f = s->format;
+
+    if (f->BytesPerPixel != 4 || f->Amask == 0 || SDL_ISPIXELFORMAT_INDEXED(f->format)) {
+        logmsg(LOG_WARN, "blit: Unable to scale alpha, %s has no 8-bit alpha channel", SDL_GetPixelFormatName(f->format));
+
+        return false;
+    }
+
+    if (SDL_MUSTLOCK(s) && SDL_LockSurface(s) != 0) {
+        logmsg(LOG_WARN, "blit: Unable to scale alpha, failed to lock surface: %s", SDL_GetError());
+
+        return false;
+    }
+
+    uint32_t ashift = f->Ashift;
+
+    for (int y = 0; y < s->h; y++) {
+        uint32_t* row = (uint32_t*)((uint8_t*)s->pixels + (size_t)y * (size_t)s->pitch);
+
+        for (int x = 0; x < s->w; x++) {
+            uint32_t p = row[x];
+            uint32_t a = (p >> ashift) & 0xFF;
+
+            // Opaque pixels are unchanged either way
+            if (a == 255) {
+                continue;
+            }
+
+            uint32_t out = a << ashift;
+
+            for (uint32_t shift = 0; shift < 32; shift += 8) {
+                if (shift == ashift || a == 0) {
+                    continue;
+                }
+
+                uint32_t c = (p >> shift) & 0xFF;
+
+                if (inverse) {
+                    c = (c * 255 + a / 2) / a;
+                    c = (c > 255) ? 255 : c;
+                }
+                else {
+                    c = blit_mul255(c, a);
+                }
+
+                out |= c << shift;
+            }
+
+            row[x] = out;
+        }
+    }
+
+    if (SDL_MUSTLOCK(s)) {
+        SDL_UnlockSurface(s);
+    }
+
+    return true;
+}
+
+bool blit_premultiply(SDL_Surface* s) {
+    return blit_scale_alpha(s, false);
+}
+
+bool blit_unpremultiply(SDL_Surface* s) {
+    return blit_scale_alpha(s, true);
+}
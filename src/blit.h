@@ -0,0 +1,110 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_BLIT
+#define RPGNG_BLIT
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// The only pixel format the blitter reads and writes, which is the format
+// atlas pages and packed images are stored in
+#define BLIT_PIXEL_FORMAT SDL_PIXELFORMAT_ARGB8888
+
+typedef enum BlitFlags {
+    BLIT_FLIP_H = 1 << 0,
+    BLIT_FLIP_V = 1 << 1,
+
+    // The source's color channels are already multiplied by its alpha
+    BLIT_PREMULTIPLIED = 1 << 2,
+} BlitFlags;
+
+/**
+ * Blends part of one surface onto another in a single pass, scaling the
+ * source's alpha by the given opacity, and mirroring it as requested. Both
+ * surfaces must be in BLIT_PIXEL_FORMAT, and must not be the same surface.
+ *
+ * Every kernel produces exactly the same pixels, whichever instruction set
+ * simd_level() selects.
+ *
+ * @param src_rect The part of src to draw, or NULL for all of it.
+ * @param x The column of dst to draw the left edge at.
+ * @param y The row of dst to draw the top edge at.
+ * @param opacity From 0.0, which draws nothing, to 1.0, which draws the
+ * source as it is.
+ * @param flags Any of the above flags, or 0.
+ *
+ * @return On success, returns true. Returns false if either surface is in the
+ * wrong format, or couldn't be locked.
+ */
+bool blit_surface(SDL_Surface* src, const SDL_Rect* src_rect, SDL_Surface* dst, int x, int y, double opacity, uint32_t flags);
+
+/**
+ * Blends a row of pixels onto another. This is the kernel blit_surface() runs
+ * on every row.
+ *
+ * @param src The first source pixel to read. If reverse is true, pixels are
+ * read from here leftward, instead of rightward.
+ * @param opacity From 0 to 255.
+ */
+void blit_row(uint32_t* dst, const uint32_t* src, size_t count, uint8_t opacity, bool reverse, bool premultiplied);
+
+/**
+ * Blends part of an indexed surface onto another like blit_surface(), looking
+ * each pixel up in the given palette as it goes. The source must be in
+ * SDL_PIXELFORMAT_INDEX8, and the destination in BLIT_PIXEL_FORMAT.
+ *
+ * @param palette PALETTE_SIZE entries in BLIT_PIXEL_FORMAT, with
+ * premultiplied alpha, like those of a Palette. The surface's own palette is
+ * ignored.
+ * @param flags BLIT_FLIP_H, BLIT_FLIP_V, or 0. Palettes are always
+ * premultiplied.
+ *
+ * @return On success, returns true. Returns false if either surface is in the
+ * wrong format, or couldn't be locked.
+ */
+bool blit_indexed(SDL_Surface* src, const SDL_Rect* src_rect, const uint32_t* palette, SDL_Surface* dst, int x, int y, double opacity, uint32_t flags);
+
+/**
+ * Converts a surface of 256 colors or fewer to an indexed copy, with one
+ * palette entry per distinct color. Fully transparent pixels all share one
+ * entry. The palette is in straight alpha, like the source.
+ *
+ * @param s A surface in BLIT_PIXEL_FORMAT, with straight alpha.
+ *
+ * @return On success, returns a new surface in SDL_PIXELFORMAT_INDEX8.
+ * Returns NULL if the surface has too many colors, or is in the wrong format.
+ */
+SDL_Surface* blit_index(SDL_Surface* s);
+
+/**
+ * Multiplies two 8-bit values as fractions of 255, rounding to the nearest,
+ * which is how every kernel scales channels.
+ */
+uint32_t blit_mul255(uint32_t a, uint32_t b);
+
+/**
+ * Multiplies the color channels of every pixel by its alpha, in place, with
+ * the same rounding the kernels use. The surface can be in any 32-bit format
+ * with 8-bit channels and an alpha channel.
+ *
+ * @return On success, returns true. Returns false if the surface is in an
+ * unsupported format, or couldn't be locked.
+ */
+bool blit_premultiply(SDL_Surface* s);
+
+/**
+ * Undoes blit_premultiply(), in place, for consumers which only understand
+ * straight alpha. Precision lost to premultiplying isn't recovered, and fully
+ * transparent pixels come back black.
+ *
+ * @return On success, returns true. Returns false if the surface is in an
+ * unsupported format, or couldn't be locked.
+ */
+bool blit_unpremultiply(SDL_Surface* s);
+
+#endif
@@ -0,0 +1,486 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "collision.h"
+#include "entity.h"
+#include "log.h"
+
+#include "component/sprite.h"
+#include "component/transform.h"
+
+#define COLLISION_DEFAULT_SIZE 64
+
+const char* collision_event_type_str[] = {
+    [COLLISION_BEGIN] = "BEGIN",
+    [COLLISION_PERSIST] = "PERSIST",
+    [COLLISION_END] = "END",
+};
+
+typedef struct CollisionBody {
+    Transform* t;
+    Sprite* s;
+
+    CollisionAABB aabb;
+
+    // This body's position in the active list, while it's being swept
+    size_t active;
+
+    bool present;
+} CollisionBody;
+
+// One end of a body's extent along the sweep axis
+typedef struct CollisionEndpoint {
+    float value;
+
+    uint16_t entity_id;
+
+    bool max;
+} CollisionEndpoint;
+
+typedef struct CollisionWorld {
+    // Bodies indexed by entity ID
+    size_t bodies_size;
+    size_t count;
+
+    CollisionBody* bodies;
+
+    // Every body's endpoints along the x axis, kept sorted between updates
+    size_t endpoints_size;
+
+    CollisionEndpoint* endpoints;
+
+    // Bodies whose extent contains the current sweep position
+    size_t active_size;
+    size_t active_count;
+
+    uint16_t* active;
+
+    // Overlapping pairs from this update and the last, as sorted keys
+    size_t pairs_size;
+    size_t pairs_count;
+
+    uint32_t* pairs;
+
+    size_t pairs_prev_size;
+    size_t pairs_prev_count;
+
+    uint32_t* pairs_prev;
+
+    size_t events_size;
+
+    CollisionEvent* events;
+} CollisionWorld;
+
+CollisionWorld collision_world;
+
+CollisionCallbackList collision_cb_list = {0};
+
+// Grows the given array to hold at least count elements
+bool collision_reserve(void** array, size_t* size, size_t count, size_t elem_size) {
+    if (count <= *size) {
+        return true;
+    }
+
+    size_t new_size = *size ? *size : COLLISION_DEFAULT_SIZE;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+
+    void* tmp = realloc(*array, new_size * elem_size);
+
+    if (!tmp) {
+        return false;
+    }
+
+    *array = tmp;
+    *size = new_size;
+
+    return true;
+}
+
+void collision_cleanup(void) {
+    free(collision_world.bodies);
+    free(collision_world.endpoints);
+    free(collision_world.active);
+    free(collision_world.pairs);
+    free(collision_world.pairs_prev);
+    free(collision_world.events);
+    free(collision_cb_list.cb);
+
+    memset(&collision_world, 0, sizeof(CollisionWorld));
+    memset(&collision_cb_list, 0, sizeof(CollisionCallbackList));
+}
+
+bool collision_regcb(collision_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "collision: Attempting to register callback (%p)", cb);
+
+    if (!cb) {
+        logmsg(LOG_WARN, "collision: Unable to register callback, callback is NULL");
+
+        return false;
+    }
+
+    CollisionCallbackList* list = &collision_cb_list;
+
+    if (!collision_reserve((void**)&list->cb, &list->size, list->count + 1, sizeof(CollisionCallback))) {
+        logmsg(LOG_WARN, "collision: Failed to register callback, the system is out of memory");
+
+        return false;
+    }
+
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
+
+    list->count++;
+
+    return true;
+}
+
+bool collision_unregcb(collision_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "collision: Attempting to unregister callback (%p)", cb);
+
+    CollisionCallbackList* list = &collision_cb_list;
+
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(CollisionCallback));
+
+            list->count--;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void collision_body_update(CollisionBody* body) {
+    SDL_Rect clip = sprite_get_clip(body->s);
+
+    float x = transform_get_pos_x(body->t);
+    float y = transform_get_pos_y(body->t);
+    float scale = (float)transform_get_scale(body->t);
+
+    float x1 = x + (float)clip.w * scale;
+    float y1 = y + (float)clip.h * scale;
+
+    // Negative scales mirror the box about the entity's position
+    body->aabb.min_x = (x < x1) ? x : x1;
+    body->aabb.max_x = (x < x1) ? x1 : x;
+    body->aabb.min_y = (y < y1) ? y : y1;
+    body->aabb.max_y = (y < y1) ? y1 : y;
+}
+
+bool collision_add(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "collision: Attempting to add collision body for entity[%" PRIu16 "]", entity_id);
+
+    Transform* t = entity_get_component(entity_id, TRANSFORM);
+    Sprite* s = entity_get_component(entity_id, SPRITE);
+
+    if (!t || !s) {
+        logmsg(LOG_WARN, "collision: Unable to add collision body for entity[%" PRIu16 "], it needs both a transform and a sprite", entity_id);
+
+        return false;
+    }
+
+    CollisionWorld* w = &collision_world;
+
+    if (entity_id < w->bodies_size && w->bodies[entity_id].present) {
+        logmsg(LOG_WARN, "collision: Unable to add collision body for entity[%" PRIu16 "], it already has one", entity_id);
+
+        return false;
+    }
+
+    size_t bodies_size = w->bodies_size;
+
+    if (!collision_reserve((void**)&w->bodies, &w->bodies_size, (size_t)entity_id + 1, sizeof(CollisionBody))) {
+        logmsg(LOG_WARN, "collision: Failed to add collision body for entity[%" PRIu16 "], the system is out of memory", entity_id);
+
+        return false;
+    }
+
+    memset(&w->bodies[bodies_size], 0, (w->bodies_size - bodies_size) * sizeof(CollisionBody));
+
+    if (!collision_reserve((void**)&w->endpoints, &w->endpoints_size, 2 * (w->count + 1), sizeof(CollisionEndpoint))) {
+        logmsg(LOG_WARN, "collision: Failed to add collision body for entity[%" PRIu16 "], the system is out of memory", entity_id);
+
+        return false;
+    }
+
+    CollisionBody* body = &w->bodies[entity_id];
+
+    body->t = t;
+    body->s = s;
+    body->present = true;
+
+    collision_body_update(body);
+
+    // New endpoints go on the end, and are sorted into place on the next update
+    CollisionEndpoint* e = &w->endpoints[2 * w->count];
+
+    e[0] = (CollisionEndpoint){.value = body->aabb.min_x, .entity_id = entity_id, .max = false};
+    e[1] = (CollisionEndpoint){.value = body->aabb.max_x, .entity_id = entity_id, .max = true};
+
+    w->count++;
+
+    return true;
+}
+
+bool collision_remove(uint16_t entity_id) {
+    CollisionWorld* w = &collision_world;
+
+    if (entity_id >= w->bodies_size || !w->bodies[entity_id].present) {
+        return false;
+    }
+
+    logmsg(LOG_DEBUG, "collision: Removing collision body for entity[%" PRIu16 "]", entity_id);
+
+    w->bodies[entity_id].present = false;
+
+    // Close the gaps left by this body's endpoints, keeping the rest in order
+    size_t n = 2 * w->count;
+    size_t live = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (w->endpoints[i].entity_id != entity_id) {
+            w->endpoints[live++] = w->endpoints[i];
+        }
+    }
+
+    w->count--;
+
+    return true;
+}
+
+bool collision_get_aabb(uint16_t entity_id, CollisionAABB* aabb) {
+    if (entity_id >= collision_world.bodies_size || !collision_world.bodies[entity_id].present) {
+        return false;
+    }
+
+    *aabb = collision_world.bodies[entity_id].aabb;
+
+    return true;
+}
+
+bool collision_test_aabb(const CollisionAABB* a, const CollisionAABB* b, CollisionContact* contact) {
+    if (a->max_x < b->min_x || b->max_x < a->min_x || a->max_y < b->min_y || b->max_y < a->min_y) {
+        return false;
+    }
+
+    if (!contact) {
+        return true;
+    }
+
+    float ox = ((a->max_x < b->max_x) ? a->max_x : b->max_x) - ((a->min_x > b->min_x) ? a->min_x : b->min_x);
+    float oy = ((a->max_y < b->max_y) ? a->max_y : b->max_y) - ((a->min_y > b->min_y) ? a->min_y : b->min_y);
+
+    // Separate along whichever axis needs the smaller push
+    if (ox < oy) {
+        contact->normal_x = (a->min_x + a->max_x <= b->min_x + b->max_x) ? 1 : -1;
+        contact->normal_y = 0;
+        contact->depth = ox;
+    }
+    else {
+        contact->normal_x = 0;
+        contact->normal_y = (a->min_y + a->max_y <= b->min_y + b->max_y) ? 1 : -1;
+        contact->depth = oy;
+    }
+
+    return true;
+}
+
+// Orders endpoints by position, with minimums before maximums at the same
+// position so that touching boxes overlap
+bool collision_endpoint_less(const CollisionEndpoint* a, const CollisionEndpoint* b) {
+    return a->value < b->value || (a->value == b->value && !a->max && b->max);
+}
+
+// Insertion sort, which is linear on input that's already nearly sorted. Bodies
+// rarely pass each other between updates, so that's the common case.
+void collision_endpoints_sort(CollisionEndpoint* endpoints, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        CollisionEndpoint e = endpoints[i];
+
+        size_t j = i;
+
+        for (; j > 0 && collision_endpoint_less(&e, &endpoints[j - 1]); j--) {
+            endpoints[j] = endpoints[j - 1];
+        }
+
+        endpoints[j] = e;
+    }
+}
+
+int collision_pair_cmp(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+// Sweeps the sorted endpoints, recording every pair of bodies whose boxes
+// overlap
+bool collision_sweep(void) {
+    CollisionWorld* w = &collision_world;
+
+    size_t n = 2 * w->count;
+
+    if (!collision_reserve((void**)&w->active, &w->active_size, w->count, sizeof(uint16_t))) {
+        return false;
+    }
+
+    w->active_count = 0;
+    w->pairs_count = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t id = w->endpoints[i].entity_id;
+
+        CollisionBody* body = &w->bodies[id];
+
+        if (w->endpoints[i].max) {
+            uint16_t last = w->active[--w->active_count];
+
+            w->active[body->active] = last;
+            w->bodies[last].active = body->active;
+
+            continue;
+        }
+
+        // Every active body overlaps this one along x, so only y is left to
+        // check
+        for (size_t j = 0; j < w->active_count; j++) {
+            uint16_t other = w->active[j];
+
+            CollisionAABB* a = &w->bodies[other].aabb;
+
+            if (a->max_y < body->aabb.min_y || body->aabb.max_y < a->min_y) {
+                continue;
+            }
+
+            if (!collision_reserve((void**)&w->pairs, &w->pairs_size, w->pairs_count + 1, sizeof(uint32_t))) {
+                return false;
+            }
+
+            uint16_t lo = (id < other) ? id : other;
+            uint16_t hi = (id < other) ? other : id;
+
+            w->pairs[w->pairs_count++] = ((uint32_t)lo << 16) | hi;
+        }
+
+        body->active = w->active_count;
+        w->active[w->active_count++] = id;
+    }
+
+    if (w->pairs_count > 1) {
+        qsort(w->pairs, w->pairs_count, sizeof(uint32_t), collision_pair_cmp);
+    }
+
+    return true;
+}
+
+bool collision_event_push(CollisionEventType type, uint32_t pair, size_t* count) {
+    CollisionWorld* w = &collision_world;
+
+    if (!collision_reserve((void**)&w->events, &w->events_size, *count + 1, sizeof(CollisionEvent))) {
+        return false;
+    }
+
+    CollisionEvent* ev = &w->events[(*count)++];
+
+    ev->type = type;
+    ev->a = (uint16_t)(pair >> 16);
+    ev->b = (uint16_t)(pair & 0xFFFF);
+
+    memset(&ev->contact, 0, sizeof(CollisionContact));
+
+    if (type != COLLISION_END) {
+        collision_test_aabb(&w->bodies[ev->a].aabb, &w->bodies[ev->b].aabb, &ev->contact);
+    }
+
+    return true;
+}
+
+void collision_update(void) {
+    CollisionWorld* w = &collision_world;
+
+    size_t n = 2 * w->count;
+
+    // Each body has exactly one minimum endpoint, so boxes are recomputed once
+    // per body
+    for (size_t i = 0; i < n; i++) {
+        if (!w->endpoints[i].max) {
+            collision_body_update(&w->bodies[w->endpoints[i].entity_id]);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        CollisionEndpoint* e = &w->endpoints[i];
+        CollisionAABB* aabb = &w->bodies[e->entity_id].aabb;
+
+        e->value = e->max ? aabb->max_x : aabb->min_x;
+    }
+
+    collision_endpoints_sort(w->endpoints, n);
+
+    if (!collision_sweep()) {
+        logmsg(LOG_WARN, "collision: Failed to update collisions, the system is out of memory");
+
+        return;
+    }
+
+    // Merge this update's pairs with the last update's to classify them
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < w->pairs_prev_count || j < w->pairs_count) {
+        bool ok;
+
+        if (j == w->pairs_count || (i < w->pairs_prev_count && w->pairs_prev[i] < w->pairs[j])) {
+            ok = collision_event_push(COLLISION_END, w->pairs_prev[i++], &count);
+        }
+        else if (i == w->pairs_prev_count || w->pairs[j] < w->pairs_prev[i]) {
+            ok = collision_event_push(COLLISION_BEGIN, w->pairs[j++], &count);
+        }
+        else {
+            ok = collision_event_push(COLLISION_PERSIST, w->pairs[j++], &count);
+            i++;
+        }
+
+        if (!ok) {
+            logmsg(LOG_WARN, "collision: Dropped collision events, the system is out of memory");
+
+            break;
+        }
+    }
+
+    // This update's pairs become the last update's
+    uint32_t* pairs = w->pairs_prev;
+    size_t pairs_size = w->pairs_prev_size;
+
+    w->pairs_prev = w->pairs;
+    w->pairs_prev_size = w->pairs_size;
+    w->pairs_prev_count = w->pairs_count;
+
+    w->pairs = pairs;
+    w->pairs_size = pairs_size;
+    w->pairs_count = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    for (size_t k = 0; k < collision_cb_list.count; k++) {
+        collision_cb_list.cb[k].cb(w->events, count, collision_cb_list.cb[k].userdata);
+    }
+}
+
+size_t collision_count(void) {
+    return collision_world.count;
+}
@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_COLLISION
+#define RPGNG_COLLISION
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum CollisionEventType {
+    COLLISION_BEGIN,
+    COLLISION_PERSIST,
+    COLLISION_END
+} CollisionEventType;
+
+// Strings representing the above event types. Use the above enum values as indexes.
+extern const char* collision_event_type_str[];
+
+typedef struct CollisionAABB {
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+} CollisionAABB;
+
+// The smallest translation which separates two overlapping boxes. The normal
+// points from the first box towards the second.
+typedef struct CollisionContact {
+    float normal_x;
+    float normal_y;
+
+    float depth;
+} CollisionContact;
+
+// A change in the overlap state of a pair of bodies. Entity a always has the
+// lower ID. END events carry no contact.
+typedef struct CollisionEvent {
+    CollisionEventType type;
+
+    uint16_t a;
+    uint16_t b;
+
+    CollisionContact contact;
+} CollisionEvent;
+
+typedef void (*collision_cb_t)(const CollisionEvent* events, size_t count, void* userdata);
+
+typedef struct CollisionCallback {
+    collision_cb_t cb;
+
+    void* userdata;
+} CollisionCallback;
+
+typedef struct CollisionCallbackList {
+    size_t size;
+    size_t count;
+
+    CollisionCallback* cb;
+} CollisionCallbackList;
+
+/**
+ * Frees all resources held by the collision system.
+ */
+void collision_cleanup(void);
+
+/**
+ * Registers a callback which receives every collision event produced by
+ * collision_update(), in one batch.
+ *
+ * @param userdata A pointer which is passed back to the callback as-is.
+ */
+bool collision_regcb(collision_cb_t cb, void* userdata);
+
+/**
+ * Removes the given callback.
+ *
+ * @return Returns true on success. Returns false if the given callback was not
+ * found.
+ */
+bool collision_unregcb(collision_cb_t cb, void* userdata);
+
+/**
+ * Adds a collision body for the given entity. Its bounding box is the entity's
+ * sprite clip rect, placed at the entity's position and multiplied by its
+ * scale. Rotation is not taken into account.
+ *
+ * The entity must have both a Transform and a Sprite. The body is removed
+ * automatically when either is destroyed.
+ */
+bool collision_add(uint16_t entity_id);
+
+/**
+ * Removes the collision body of the given entity. Any overlaps it was part of
+ * end on the next update.
+ *
+ * @return Returns false if the entity has no collision body.
+ */
+bool collision_remove(uint16_t entity_id);
+
+/**
+ * Gets the bounding box of the given entity's collision body, as of the most
+ * recent update.
+ */
+bool collision_get_aabb(uint16_t entity_id, CollisionAABB* aabb);
+
+/**
+ * Tests two boxes for overlap. Boxes which only touch at an edge overlap.
+ *
+ * @param[out] contact If the boxes overlap, receives the contact between them.
+ * This may be NULL if the contact is not needed.
+ */
+bool collision_test_aabb(const CollisionAABB* a, const CollisionAABB* b, CollisionContact* contact);
+
+/**
+ * Recomputes every body's bounding box, finds overlapping pairs, and delivers
+ * the resulting begin, persist and end events to registered callbacks.
+ *
+ * Endpoints stay sorted between updates, so when bodies move a little each
+ * tick, the cost is close to linear in the number of bodies plus the number of
+ * overlaps.
+ */
+void collision_update(void);
+
+/**
+ * Gets the number of collision bodies.
+ */
+size_t collision_count(void);
+
+#endif
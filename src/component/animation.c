@@ -0,0 +1,552 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "../entity.h"
+#include "../htable.h"
+#include "../log.h"
+
+#include "animation.h"
+#include "component.h"
+#include "sprite.h"
+
+const ComponentType animation_component_type = ANIMATION;
+
+struct AnimationClip {
+    char* name;
+
+    AnimationLoop loop;
+
+    size_t count;
+    AnimationFrame* frames;
+
+    // The time at which each frame ends, from the start of the clip
+    float* ends;
+
+    // The length of one pass through the clip
+    float duration;
+
+    // Next in the clip list
+    AnimationClip* next;
+};
+
+struct Animation {
+    uint16_t entity_id;
+
+    // The slot in the animation store at which this animation's playback state
+    // lives. This changes when other animations are destroyed.
+    size_t index;
+};
+
+// Playback state is kept as a structure of arrays, so that animation_update()
+// can stream through it in one pass. Slots are dense; destroying an animation
+// moves the last slot into the hole it leaves.
+typedef struct AnimationStore {
+    size_t size;
+    size_t count;
+
+    // The clip being played, or NULL if the animation is stopped
+    const AnimationClip** clip;
+
+    // The sprite the clip is played on, or NULL if it was destroyed
+    Sprite** sprite;
+
+    float* time;
+    float* speed;
+
+    // The frame being shown
+    uint32_t* frame;
+
+    // The animation handle which owns each slot
+    Animation** owner;
+} AnimationStore;
+
+AnimationStore animation_store = {0};
+
+AnimationStats animation_stats = {0};
+
+// Clips by name, along with a list of every clip so they can be freed
+HashTable* animation_clip_table = NULL;
+AnimationClip* animation_clip_list = NULL;
+
+void animation_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(animation): Cleaning up animation store and clips");
+
+    if (animation_store.count > 0) {
+        logmsg(LOG_WARN, "component(animation): Cleaning up with %zu animations still alive", animation_store.count);
+    }
+
+    for (size_t i = 0; i < animation_store.count; i++) {
+        free(animation_store.owner[i]);
+    }
+
+    free(animation_store.clip);
+    free(animation_store.sprite);
+    free(animation_store.time);
+    free(animation_store.speed);
+    free(animation_store.frame);
+    free(animation_store.owner);
+
+    memset(&animation_store, 0, sizeof(animation_store));
+    memset(&animation_stats, 0, sizeof(animation_stats));
+
+    while (animation_clip_list) {
+        AnimationClip* c = animation_clip_list;
+
+        animation_clip_list = c->next;
+
+        free(c);
+    }
+
+    htable_destroy(animation_clip_table);
+
+    animation_clip_table = NULL;
+}
+
+const AnimationClip* animation_clip_create(const char* name, const AnimationFrame* frames, size_t count, AnimationLoop loop) {
+    if (!name || !frames || count == 0 || count > UINT32_MAX) {
+        logmsg(LOG_WARN, "component(animation): Unable to create clip, a clip needs a name and at least one frame");
+
+        return NULL;
+    }
+
+    if (loop != ANIMATION_ONCE && loop != ANIMATION_LOOP && loop != ANIMATION_PINGPONG) {
+        logmsg(LOG_WARN, "component(animation): Unable to create clip '%s', invalid loop mode %d", name, loop);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!(frames[i].duration > 0) || !isfinite(frames[i].duration) || frames[i].rect.w <= 0 || frames[i].rect.h <= 0) {
+            logmsg(LOG_WARN, "component(animation): Unable to create clip '%s', frame %zu is empty or has no duration", name, i);
+
+            return NULL;
+        }
+    }
+
+    if (!animation_clip_table) {
+        animation_clip_table = htable_create(16);
+
+        if (!animation_clip_table) {
+            logmsg(LOG_WARN, "component(animation): Failed to create clip table, the system is out of memory");
+
+            return NULL;
+        }
+    }
+
+    size_t name_size = strlen(name);
+
+    if (htable_lookup(animation_clip_table, (const uint8_t*)name, name_size, NULL)) {
+        logmsg(LOG_WARN, "component(animation): Unable to create clip, a clip named '%s' already exists", name);
+
+        return NULL;
+    }
+
+    // The clip, its frames, their end times, and its name share one block
+    AnimationClip* c = malloc(sizeof(AnimationClip) + count * (sizeof(AnimationFrame) + sizeof(float)) + name_size + 1);
+
+    if (!c) {
+        logmsg(LOG_WARN, "component(animation): Failed to create clip '%s', the system is out of memory", name);
+
+        return NULL;
+    }
+
+    c->frames = (AnimationFrame*)(c + 1);
+    c->ends = (float*)(c->frames + count);
+    c->name = (char*)(c->ends + count);
+    c->loop = loop;
+    c->count = count;
+
+    memcpy(c->frames, frames, count * sizeof(AnimationFrame));
+    memcpy(c->name, name, name_size + 1);
+
+    float end = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        end += frames[i].duration;
+
+        c->ends[i] = end;
+    }
+
+    c->duration = end;
+
+    if (htable_add(animation_clip_table, (const uint8_t*)c->name, name_size, KV_VOIDPTR, c) != 0) {
+        logmsg(LOG_WARN, "component(animation): Failed to map clip '%s' in clip table", name);
+
+        free(c);
+
+        return NULL;
+    }
+
+    c->next = animation_clip_list;
+    animation_clip_list = c;
+
+    return c;
+}
+
+const AnimationClip* animation_clip_get(const char* name) {
+    if (!animation_clip_table || !name) {
+        return NULL;
+    }
+
+    return htable_lookup(animation_clip_table, (const uint8_t*)name, strlen(name), NULL);
+}
+
+size_t animation_clip_frame_count(const AnimationClip* clip) {
+    return clip->count;
+}
+
+float animation_clip_duration(const AnimationClip* clip) {
+    return clip->duration;
+}
+
+// The time it takes to get back to where the clip started
+float animation_clip_period(const AnimationClip* c) {
+    return c->loop == ANIMATION_PINGPONG ? c->duration * 2 : c->duration;
+}
+
+// Finds the frame shown at the given time, which must already be within one
+// pass of the clip. Animations usually move at most a frame per tick, so the
+// search walks from the frame they were last on.
+uint32_t animation_clip_frame_at(const AnimationClip* c, float time, uint32_t hint) {
+    if (c->loop == ANIMATION_PINGPONG && time > c->duration) {
+        time = c->duration * 2 - time;
+    }
+
+    uint32_t f = hint < c->count ? hint : 0;
+
+    while (f + 1 < c->count && time >= c->ends[f]) {
+        f++;
+    }
+
+    while (f > 0 && time < c->ends[f - 1]) {
+        f--;
+    }
+
+    return f;
+}
+
+bool animation_store_grow(void) {
+    size_t size = animation_store.size ? animation_store.size * 2 : SLOT_DEFAULT_SIZE;
+
+    logmsg(LOG_DEBUG, "component(animation): Growing animation store to %zu slots", size);
+
+    // Arrays are resized one at a time. If we run out of memory partway
+    // through, the arrays that were already resized are simply larger than
+    // they need to be, and the store size remains unchanged.
+    const AnimationClip** clip = realloc(animation_store.clip, size * sizeof(AnimationClip*));
+
+    if (!clip) {
+        return false;
+    }
+
+    animation_store.clip = clip;
+
+    Sprite** sprite = realloc(animation_store.sprite, size * sizeof(Sprite*));
+
+    if (!sprite) {
+        return false;
+    }
+
+    animation_store.sprite = sprite;
+
+    float* time = realloc(animation_store.time, size * sizeof(float));
+
+    if (!time) {
+        return false;
+    }
+
+    animation_store.time = time;
+
+    float* speed = realloc(animation_store.speed, size * sizeof(float));
+
+    if (!speed) {
+        return false;
+    }
+
+    animation_store.speed = speed;
+
+    uint32_t* frame = realloc(animation_store.frame, size * sizeof(uint32_t));
+
+    if (!frame) {
+        return false;
+    }
+
+    animation_store.frame = frame;
+
+    Animation** owner = realloc(animation_store.owner, size * sizeof(Animation*));
+
+    if (!owner) {
+        return false;
+    }
+
+    animation_store.owner = owner;
+
+    animation_store.size = size;
+
+    return true;
+}
+
+bool animation_create(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(animation): Attempting to create animation for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(animation): Unable to create animation, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    if (entity_has_component(e->id, animation_component_type)) {
+        logmsg(LOG_WARN, "component(animation): Unable to create animation, entity[%" PRIu16 "]('%s') already has animation", e->id, e->name);
+
+        return false;
+    }
+
+    if (!entity_has_component(e->id, SPRITE)) {
+        logmsg(LOG_WARN, "component(animation): Unable to create animation, entity[%" PRIu16 "]('%s') has no sprite", e->id, e->name);
+
+        return false;
+    }
+
+    Sprite* s = entity_get_component(e->id, SPRITE);
+
+    if (!s) {
+        return false;
+    }
+
+    if (animation_store.count == animation_store.size && !animation_store_grow()) {
+        logmsg(LOG_WARN, "component(animation): Failed to grow animation store, the system is out of memory");
+
+        return false;
+    }
+
+    Animation* a = calloc(1, sizeof(Animation));
+
+    if (!a) {
+        logmsg(LOG_WARN, "component(animation): Failed to create animation, the system is out of memory");
+
+        return false;
+    }
+
+    if (htable_add(e->components, (uint8_t*)&animation_component_type, sizeof(animation_component_type), KV_VOIDPTR, a) != 0) {
+        logmsg(LOG_WARN, "component(animation): Failed to map animation in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        free(a);
+
+        return false;
+    }
+
+    a->entity_id = e->id;
+    a->index = animation_store.count++;
+
+    animation_store.clip[a->index] = NULL;
+    animation_store.sprite[a->index] = s;
+    animation_store.time[a->index] = 0;
+    animation_store.speed[a->index] = 1;
+    animation_store.frame[a->index] = 0;
+    animation_store.owner[a->index] = a;
+
+    return true;
+}
+
+bool animation_destroy(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(animation): Attempting to destroy animation for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(animation): Unable to destroy animation, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    Animation* a = htable_lookup(e->components, (uint8_t*)&animation_component_type, sizeof(animation_component_type), NULL);
+
+    if (!a) {
+        logmsg(LOG_WARN, "component(animation): Failed to get animation associated with entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        return false;
+    }
+
+    // Move the last slot into the hole left by this animation
+    size_t last = --animation_store.count;
+
+    if (a->index != last) {
+        animation_store.clip[a->index] = animation_store.clip[last];
+        animation_store.sprite[a->index] = animation_store.sprite[last];
+        animation_store.time[a->index] = animation_store.time[last];
+        animation_store.speed[a->index] = animation_store.speed[last];
+        animation_store.frame[a->index] = animation_store.frame[last];
+        animation_store.owner[a->index] = animation_store.owner[last];
+
+        animation_store.owner[a->index]->index = a->index;
+    }
+
+    free(a);
+
+    if (htable_remove(e->components, (uint8_t*)&animation_component_type, sizeof(animation_component_type)) < 0) {
+        logmsg(LOG_ERR,
+            "component(animation): Failed to remove animation associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
+            e->id,
+            e->name);
+
+        _exit(-1);
+    }
+
+    return true;
+}
+
+void animation_forget(uint16_t entity_id) {
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        return;
+    }
+
+    // Not every sprite is animated, so this looks the component up quietly
+    Animation* a = htable_lookup(e->components, (uint8_t*)&animation_component_type, sizeof(animation_component_type), NULL);
+
+    if (!a) {
+        return;
+    }
+
+    animation_store.clip[a->index] = NULL;
+    animation_store.sprite[a->index] = NULL;
+}
+
+bool animation_play(Animation* a, const AnimationClip* clip) {
+    size_t i = a->index;
+
+    if (!clip) {
+        animation_store.clip[i] = NULL;
+
+        return true;
+    }
+
+    // The sprite may have been replaced since the last clip was played
+    if (!animation_store.sprite[i]) {
+        if (!entity_has_component(a->entity_id, SPRITE)) {
+            logmsg(LOG_WARN, "component(animation): Unable to play clip '%s', entity[%" PRIu16 "] has no sprite", clip->name, a->entity_id);
+
+            return false;
+        }
+
+        animation_store.sprite[i] = entity_get_component(a->entity_id, SPRITE);
+
+        if (!animation_store.sprite[i]) {
+            return false;
+        }
+    }
+
+    // Backward playback starts from the end
+    float time = animation_store.speed[i] < 0 ? animation_clip_period(clip) : 0;
+    uint32_t frame = animation_clip_frame_at(clip, time, 0);
+
+    animation_store.clip[i] = clip;
+    animation_store.time[i] = time;
+    animation_store.frame[i] = frame;
+
+    sprite_frame_set(animation_store.sprite[i], clip->frames[frame].rect);
+
+    return true;
+}
+
+void animation_speed_set(Animation* a, float speed) {
+    animation_store.speed[a->index] = isfinite(speed) ? speed : 0;
+}
+
+const AnimationClip* animation_get_clip(Animation* a) {
+    return animation_store.clip[a->index];
+}
+
+size_t animation_get_frame(Animation* a) {
+    return animation_store.frame[a->index];
+}
+
+float animation_get_speed(Animation* a) {
+    return animation_store.speed[a->index];
+}
+
+float animation_get_time(Animation* a) {
+    return animation_store.time[a->index];
+}
+
+bool animation_is_finished(Animation* a) {
+    const AnimationClip* c = animation_store.clip[a->index];
+
+    if (!c || c->loop != ANIMATION_ONCE) {
+        return false;
+    }
+
+    float time = animation_store.time[a->index];
+
+    return animation_store.speed[a->index] < 0 ? time <= 0 : time >= c->duration;
+}
+
+void animation_update(double dt) {
+    animation_stats.playing = 0;
+    animation_stats.frame_changes = 0;
+
+    for (size_t i = 0; i < animation_store.count; i++) {
+        const AnimationClip* c = animation_store.clip[i];
+        float speed = animation_store.speed[i];
+
+        if (!c || speed == 0) {
+            continue;
+        }
+
+        float period = animation_clip_period(c);
+        float time = animation_store.time[i] + (float)dt * speed;
+
+        if (c->loop == ANIMATION_ONCE) {
+            // Finished clips hold their last frame without costing anything
+            if ((speed > 0 && animation_store.time[i] >= period) || (speed < 0 && animation_store.time[i] <= 0)) {
+                continue;
+            }
+
+            time = fminf(fmaxf(time, 0), period);
+        }
+        else if (time >= period || time < 0) {
+            time = fmodf(time, period);
+
+            if (time < 0) {
+                time += period;
+            }
+
+            // Rounding can leave a negative remainder a hair short of the
+            // period once it's added back
+            if (time >= period) {
+                time = 0;
+            }
+        }
+
+        animation_stats.playing++;
+
+        animation_store.time[i] = time;
+
+        uint32_t frame = animation_clip_frame_at(c, time, animation_store.frame[i]);
+
+        if (frame != animation_store.frame[i]) {
+            animation_store.frame[i] = frame;
+
+            sprite_frame_set(animation_store.sprite[i], c->frames[frame].rect);
+
+            animation_stats.frame_changes++;
+        }
+    }
+}
+
+const AnimationStats* animation_get_stats(void) {
+    return &animation_stats;
+}
@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_ANIMATION
+#define RPGNG_ANIMATION
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+typedef struct Animation Animation;
+
+typedef struct AnimationClip AnimationClip;
+
+typedef enum AnimationLoop {
+    // Plays through once, then holds the last frame
+    ANIMATION_ONCE,
+    // Starts over from the first frame after the last
+    ANIMATION_LOOP,
+    // Plays forward, then backward, then forward again
+    ANIMATION_PINGPONG
+} AnimationLoop;
+
+typedef struct AnimationFrame {
+    // The region of the sprite's image to draw, relative to the image
+    SDL_Rect rect;
+
+    // How long the frame is shown for, in seconds
+    float duration;
+} AnimationFrame;
+
+typedef struct AnimationStats {
+    // Animations which are advancing, as of the last update
+    size_t playing;
+
+    // Animations whose frame changed during the last update
+    size_t frame_changes;
+} AnimationStats;
+
+/*
+ * An animation plays a clip on its entity's Sprite, by moving the sprite's clip
+ * rect from frame to frame.
+ *
+ * Clips are immutable, and shared by every animation playing them. The
+ * playback state of each animation is kept in a dense store, which
+ * animation_update() advances in a single pass, touching a sprite only when its
+ * frame actually changes.
+ */
+
+/**
+ * Frees all clips and animations.
+ */
+void animation_cleanup(void);
+
+/**
+ * Creates a named clip. The frames are copied, and the clip lives until
+ * animation_cleanup().
+ *
+ * @param frames The frames of the clip, in order. Every frame must last longer
+ * than 0 seconds.
+ *
+ * @return On success, returns the new clip. Returns NULL if a clip with the
+ * given name already exists, if a frame is invalid, or if the system is out of
+ * memory.
+ */
+const AnimationClip* animation_clip_create(const char* name, const AnimationFrame* frames, size_t count, AnimationLoop loop);
+
+/**
+ * Looks up a clip by name.
+ *
+ * @return The clip, or NULL if no clip has the given name.
+ */
+const AnimationClip* animation_clip_get(const char* name);
+
+/**
+ * Gets the number of frames in a clip.
+ */
+size_t animation_clip_frame_count(const AnimationClip* clip);
+
+/**
+ * Gets the length of one pass through a clip, in seconds.
+ */
+float animation_clip_duration(const AnimationClip* clip);
+
+/**
+ * Associates an Animation component with the given entity. The entity must
+ * already have a Sprite. The animation starts out with no clip, and leaves the
+ * sprite as it is until a clip is played.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool animation_create(uint16_t entity_id);
+
+/**
+ * Destroys the Animation associated with the given entity. The sprite keeps
+ * showing whichever frame it was on.
+ *
+ * @return On success, returns true. If the given entity does not have an
+ * animation component, this function returns false.
+ */
+bool animation_destroy(uint16_t entity_id);
+
+/**
+ * Detaches the animation of the given entity from its sprite, which is about to
+ * be destroyed. The animation stops, and does nothing until it's given a clip
+ * again. This is called when an entity's Sprite is destroyed.
+ */
+void animation_forget(uint16_t entity_id);
+
+/**
+ * Plays a clip from its first frame, and shows that frame immediately.
+ *
+ * @param clip The clip to play, or NULL to stop playing.
+ *
+ * @return On success, returns true. Returns false if the entity no longer has a
+ * Sprite.
+ */
+bool animation_play(Animation* a, const AnimationClip* clip);
+
+/**
+ * Sets the playback speed. 1 plays the clip as authored, 0 pauses it, and
+ * negative speeds play it backward.
+ */
+void animation_speed_set(Animation* a, float speed);
+
+/**
+ * Gets the clip being played, or NULL if there isn't one.
+ */
+const AnimationClip* animation_get_clip(Animation* a);
+
+/**
+ * Gets the index of the frame being shown.
+ */
+size_t animation_get_frame(Animation* a);
+
+/**
+ * Gets the playback speed.
+ */
+float animation_get_speed(Animation* a);
+
+/**
+ * Gets the time since the start of the clip, in seconds. Ping-pong clips count
+ * the backward half too, so this runs up to twice the clip duration.
+ */
+float animation_get_time(Animation* a);
+
+/**
+ * Determines whether a clip which plays once has reached its end. Looping clips
+ * never finish.
+ */
+bool animation_is_finished(Animation* a);
+
+/**
+ * Advances every playing animation, and moves the clip rect of each sprite
+ * whose frame changed. This is called once per simulation tick.
+ *
+ * @param dt The time to advance by, in seconds.
+ */
+void animation_update(double dt);
+
+/**
+ * Gets statistics from the last update.
+ */
+const AnimationStats* animation_get_stats(void);
+
+#endif
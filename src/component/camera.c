@@ -0,0 +1,389 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "../config.h"
+#include "../entity.h"
+#include "../log.h"
+#include "../spatial.h"
+
+#include "camera.h"
+#include "component.h"
+#include "sprite.h"
+#include "transform.h"
+
+// One bit for every possible entity ID
+#define CAMERA_VISIBLE_WORDS ((UINT16_MAX + 1) / 64)
+
+const ComponentType camera_component_type = CAMERA;
+const ComponentType camera_sprite_type = SPRITE;
+
+struct Camera {
+    uint16_t entity_id;
+
+    float view_w;
+    float view_h;
+    float margin;
+
+    float parallax[CAMERA_LAYER_COUNT];
+
+    // The distinct parallax factors in use, each of which needs its own query
+    size_t factor_count;
+    float factors[CAMERA_LAYER_COUNT];
+
+    size_t size;
+    size_t count;
+
+    uint16_t* visible;
+
+    // Set bits mark the entities in the visible list
+    uint64_t visible_bits[CAMERA_VISIBLE_WORDS];
+
+    CameraStats stats;
+};
+
+size_t camera_list_size = 0;
+size_t camera_list_count = 0;
+Camera** camera_list = NULL;
+
+// Scratch space for spatial queries
+size_t camera_query_size = 0;
+uint16_t* camera_query = NULL;
+
+bool camera_create(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(camera): Attempting to create camera for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(camera): Unable to create camera, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    if (entity_has_component(e->id, camera_component_type)) {
+        logmsg(LOG_WARN, "component(camera): Unable to create camera, entity[%" PRIu16 "]('%s') already has camera", e->id, e->name);
+
+        return false;
+    }
+
+    if (!entity_has_component(e->id, TRANSFORM)) {
+        logmsg(LOG_WARN, "component(camera): Unable to create camera, entity[%" PRIu16 "]('%s') has no transform", e->id, e->name);
+
+        return false;
+    }
+
+    if (camera_list_count == camera_list_size) {
+        size_t new_size = camera_list_size ? camera_list_size * 2 : SLOT_DEFAULT_SIZE;
+
+        Camera** tmp = realloc(camera_list, new_size * sizeof(Camera*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(camera): Failed to create camera for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+            return false;
+        }
+
+        camera_list = tmp;
+        camera_list_size = new_size;
+    }
+
+    Camera* c = calloc(1, sizeof(Camera));
+
+    if (!c) {
+        logmsg(LOG_WARN, "component(camera): Failed to create camera for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+        return false;
+    }
+
+    c->entity_id = e->id;
+    c->view_w = (float)global_config.window.width;
+    c->view_h = (float)global_config.window.height;
+    c->margin = CAMERA_MARGIN_DEFAULT;
+
+    for (size_t i = 0; i < CAMERA_LAYER_COUNT; i++) {
+        c->parallax[i] = 1.0f;
+    }
+
+    c->factors[0] = 1.0f;
+    c->factor_count = 1;
+
+    if (htable_add(e->components, (uint8_t*)&camera_component_type, sizeof(camera_component_type), KV_VOIDPTR, c) != 0) {
+        logmsg(LOG_WARN, "component(camera): Failed to map camera in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        free(c);
+
+        return false;
+    }
+
+    camera_list[camera_list_count++] = c;
+
+    return true;
+}
+
+bool camera_destroy(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(camera): Attempting to destroy camera for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(camera): Unable to destroy camera, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    Camera* c = htable_lookup(e->components, (uint8_t*)&camera_component_type, sizeof(camera_component_type), NULL);
+
+    if (!c) {
+        logmsg(LOG_WARN, "component(camera): Unable to destroy camera, failed to get camera associated with entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        return false;
+    }
+
+    // Fill the gap with the last camera
+    for (size_t i = 0; i < camera_list_count; i++) {
+        if (camera_list[i] == c) {
+            camera_list[i] = camera_list[--camera_list_count];
+
+            break;
+        }
+    }
+
+    free(c->visible);
+    free(c);
+
+    if (htable_remove(e->components, (uint8_t*)&camera_component_type, sizeof(camera_component_type)) < 0) {
+        logmsg(LOG_ERR,
+            "component(camera): Failed to remove camera associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
+            e->id,
+            e->name);
+
+        _exit(-1);
+    }
+
+    return true;
+}
+
+void camera_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(camera): Cleaning up camera list");
+
+    if (camera_list_count > 0) {
+        logmsg(LOG_WARN, "component(camera): Cleaning up with %zu cameras still alive", camera_list_count);
+    }
+
+    for (size_t i = 0; i < camera_list_count; i++) {
+        free(camera_list[i]->visible);
+        free(camera_list[i]);
+    }
+
+    free(camera_list);
+    free(camera_query);
+
+    camera_list = NULL;
+    camera_list_size = 0;
+    camera_list_count = 0;
+
+    camera_query = NULL;
+    camera_query_size = 0;
+}
+
+bool camera_visible_add(Camera* c, uint16_t entity_id) {
+    if (c->count == c->size) {
+        size_t new_size = c->size ? c->size * 2 : 256;
+
+        uint16_t* tmp = realloc(c->visible, new_size * sizeof(uint16_t));
+
+        if (!tmp) {
+            return false;
+        }
+
+        c->visible = tmp;
+        c->size = new_size;
+    }
+
+    c->visible[c->count++] = entity_id;
+    c->visible_bits[entity_id / 64] |= UINT64_C(1) << (entity_id % 64);
+
+    return true;
+}
+
+void camera_update_one(Camera* c, size_t max) {
+    // Only the bits set last pass need clearing
+    for (size_t i = 0; i < c->count; i++) {
+        c->visible_bits[c->visible[i] / 64] = 0;
+    }
+
+    c->count = 0;
+
+    c->stats.visible = 0;
+    c->stats.culled = sprite_count();
+    c->stats.queries = 0;
+
+    Transform* t = entity_get_component(c->entity_id, TRANSFORM);
+
+    if (!t || max == 0) {
+        return;
+    }
+
+    float cx = transform_get_pos_x(t);
+    float cy = transform_get_pos_y(t);
+
+    // Sprites are indexed by their top left corner, but may cover the view
+    // from as far away as the largest of them reaches, in any direction once
+    // rotated
+    float pad = c->margin + sprite_get_reach();
+
+    for (size_t f = 0; f < c->factor_count; f++) {
+        float factor = c->factors[f];
+
+        // The view, in the world as seen by layers of this factor
+        float x = cx * factor - c->view_w / 2.0f - pad;
+        float y = cy * factor - c->view_h / 2.0f - pad;
+
+        size_t found = spatial_query_rect(x, y, c->view_w + pad * 2.0f, c->view_h + pad * 2.0f, camera_query, max);
+
+        c->stats.queries++;
+
+        for (size_t i = 0; i < found; i++) {
+            // Most of what's indexed may not have a sprite, so look without
+            // complaining
+            Entity* e = entity_get(camera_query[i]);
+            Sprite* s = e ? htable_lookup(e->components, (uint8_t*)&camera_sprite_type, sizeof(camera_sprite_type), NULL) : NULL;
+
+            // Layers of other factors are found by their own query
+            if (!s || c->parallax[sprite_get_z(s)] != factor) {
+                continue;
+            }
+
+            if (!camera_visible_add(c, camera_query[i])) {
+                logmsg(LOG_WARN, "component(camera): Failed to update visibility for camera[%" PRIu16 "], the system is out of memory", c->entity_id);
+
+                break;
+            }
+        }
+    }
+
+    c->stats.visible = c->count;
+    c->stats.culled = (c->stats.culled > c->count) ? c->stats.culled - c->count : 0;
+}
+
+void camera_update(void) {
+    if (camera_list_count == 0) {
+        return;
+    }
+
+    size_t max = spatial_count();
+
+    if (max > camera_query_size) {
+        size_t new_size = camera_query_size ? camera_query_size : 256;
+
+        while (new_size < max) {
+            new_size *= 2;
+        }
+
+        uint16_t* tmp = realloc(camera_query, new_size * sizeof(uint16_t));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(camera): Unable to update cameras, the system is out of memory");
+
+            return;
+        }
+
+        camera_query = tmp;
+        camera_query_size = new_size;
+    }
+
+    for (size_t i = 0; i < camera_list_count; i++) {
+        camera_update_one(camera_list[i], max);
+    }
+}
+
+bool camera_set_viewport(Camera* c, float w, float h) {
+    if (!(w > 0) || !(h > 0)) {
+        logmsg(LOG_WARN, "component(camera): Unable to set viewport of camera[%" PRIu16 "], size must be positive", c->entity_id);
+
+        return false;
+    }
+
+    c->view_w = w;
+    c->view_h = h;
+
+    return true;
+}
+
+bool camera_set_margin(Camera* c, float margin) {
+    if (!(margin >= 0)) {
+        logmsg(LOG_WARN, "component(camera): Unable to set margin of camera[%" PRIu16 "], margin must not be negative", c->entity_id);
+
+        return false;
+    }
+
+    c->margin = margin;
+
+    return true;
+}
+
+bool camera_set_parallax(Camera* c, uint8_t z, float factor) {
+    if (!(factor >= 0)) {
+        logmsg(LOG_WARN, "component(camera): Unable to set parallax of camera[%" PRIu16 "], factor must not be negative", c->entity_id);
+
+        return false;
+    }
+
+    c->parallax[z] = factor;
+
+    // Collect the distinct factors again
+    c->factor_count = 0;
+
+    for (size_t i = 0; i < CAMERA_LAYER_COUNT; i++) {
+        size_t j = 0;
+
+        while (j < c->factor_count && c->factors[j] != c->parallax[i]) {
+            j++;
+        }
+
+        if (j == c->factor_count) {
+            c->factors[c->factor_count++] = c->parallax[i];
+        }
+    }
+
+    return true;
+}
+
+float camera_get_parallax(Camera* c, uint8_t z) {
+    return c->parallax[z];
+}
+
+void camera_get_origin(Camera* c, uint8_t z, float* x, float* y) {
+    float factor = c->parallax[z];
+
+    Transform* t = entity_get_component(c->entity_id, TRANSFORM);
+
+    float cx = t ? transform_get_render_x(t) : 0.0f;
+    float cy = t ? transform_get_render_y(t) : 0.0f;
+
+    *x = cx * factor - c->view_w / 2.0f;
+    *y = cy * factor - c->view_h / 2.0f;
+}
+
+const uint16_t* camera_get_visible(Camera* c, size_t* count) {
+    *count = c->count;
+
+    return c->visible;
+}
+
+bool camera_is_visible(Camera* c, uint16_t entity_id) {
+    return (c->visible_bits[entity_id / 64] >> (entity_id % 64)) & 1;
+}
+
+const CameraStats* camera_get_stats(Camera* c) {
+    return &c->stats;
+}
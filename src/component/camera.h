@@ -0,0 +1,116 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_CAMERA
+#define RPGNG_CAMERA
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "component.h"
+
+// Distance beyond the edges of the view within which sprites still count as
+// visible. Sprites are found by their position, which is their top left
+// corner, and the view is widened by the reach of the largest sprite besides
+// this, so the margin need only cover sprites scaled up past their size.
+#define CAMERA_MARGIN_DEFAULT 64.0f
+
+// One parallax factor for each sprite z-order
+#define CAMERA_LAYER_COUNT 256
+
+typedef struct Camera Camera;
+
+typedef struct CameraStats {
+    // Sprites found in the view by the last visibility pass, and sprites which
+    // weren't
+    size_t visible;
+    size_t culled;
+
+    // Spatial index queries made by the last visibility pass, one for each
+    // distinct parallax factor
+    size_t queries;
+} CameraStats;
+
+/**
+ * Associates a camera with the given entity, which must have a Transform. The
+ * camera is centered on the entity's position, and its viewport is the size
+ * of the window, as configured.
+ *
+ * Visibility is found through the spatial index, so cameras see nothing unless
+ * spatial_init() has been called.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool camera_create(uint16_t entity_id);
+
+/**
+ * Destroys the camera associated with the given entity.
+ *
+ * @return On success, returns true. If the given entity does not have a
+ * camera component, this function returns false.
+ */
+bool camera_destroy(uint16_t entity_id);
+
+/**
+ * Frees all resources associated with the Camera component system.
+ */
+void camera_cleanup(void);
+
+/**
+ * Finds the sprites within view of every camera. This should be called once
+ * per frame, after component signals have been flushed.
+ */
+void camera_update(void);
+
+/**
+ * Sets the size of a camera's view, in pixels.
+ */
+bool camera_set_viewport(Camera* c, float w, float h);
+
+/**
+ * Sets the distance beyond the edges of the view within which sprites still
+ * count as visible.
+ */
+bool camera_set_margin(Camera* c, float margin);
+
+/**
+ * Sets how far sprites of the given z-order scroll as the camera moves. A
+ * factor of 1.0, the default, scrolls with the world. Smaller factors scroll
+ * more slowly, as distant backgrounds do, and 0.0 doesn't scroll at all.
+ */
+bool camera_set_parallax(Camera* c, uint8_t z, float factor);
+
+/**
+ * Gets the parallax factor of the given z-order.
+ */
+float camera_get_parallax(Camera* c, uint8_t z);
+
+/**
+ * Gets the world position of the top left corner of the view, as seen by
+ * sprites of the given z-order, at the camera's interpolated position. This
+ * is subtracted from a sprite's position to place it on screen.
+ */
+void camera_get_origin(Camera* c, uint8_t z, float* x, float* y);
+
+/**
+ * Gets the entities whose sprites were found in view by the last visibility
+ * pass, in no particular order.
+ *
+ * @param[out] count The number of entity IDs returned.
+ */
+const uint16_t* camera_get_visible(Camera* c, size_t* count);
+
+/**
+ * Determines whether the given entity's sprite was found in view by the last
+ * visibility pass.
+ */
+bool camera_is_visible(Camera* c, uint16_t entity_id);
+
+/**
+ * Gets the statistics of a camera's last visibility pass.
+ */
+const CameraStats* camera_get_stats(Camera* c);
+
+#endif
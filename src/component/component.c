@@ -14,10 +14,15 @@
 #include "../htable.h"
 #include "../log.h"
 
+#include "animation.h"
+#include "camera.h"
 #include "component.h"
 #include "dialogue.h"
 #include "inventory.h"
+#include "sprite.h"
+#include "tilemap.h"
 #include "transform.h"
+#include "trigger.h"
 
 bool component_init(void) {
     if (!inventory_init()) {
@@ -55,15 +60,30 @@ bool component_cleanup(uint16_t entity_id) {
         bool ret = false;
 
         switch (keys[i].key[0]) {
+            case ANIMATION:
+                ret = animation_destroy(entity_id);
+                break;
+            case CAMERA:
+                ret = camera_destroy(entity_id);
+                break;
             case DIALOGUE:
                 ret = dialogue_destroy(entity_id);
                 break;
             case INVENTORY:
                 ret = inventory_destroy(entity_id);
                 break;
+            case SPRITE:
+                ret = sprite_destroy(entity_id);
+                break;
+            case TILEMAP:
+                ret = tilemap_destroy(entity_id);
+                break;
             case TRANSFORM:
                 ret = transform_destroy(entity_id);
                 break;
+            case TRIGGER:
+                ret = trigger_destroy(entity_id);
+                break;
             default:
                 logmsg(LOG_WARN,
                     "component: Unknown component[%" PRIu8 "] associated with entity[%" PRIu16 "]('%s') cannot be destroyed",
@@ -82,3 +102,11 @@ bool component_cleanup(uint16_t entity_id) {
 
     return true;
 }
+
+void component_flush(void) {
+    transform_signal_flush();
+    sprite_signal_flush();
+
+    // Trigger events are produced by the transform flush above
+    trigger_flush();
+}
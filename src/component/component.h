@@ -10,11 +10,15 @@
 #define SLOT_DEFAULT_SIZE 8
 
 typedef enum ComponentType {
+    ANIMATION,
+    CAMERA,
     DIALOGUE,
     DIALOGUEWIDGET,
     INVENTORY,
     SPRITE,
-    TRANSFORM
+    TILEMAP,
+    TRANSFORM,
+    TRIGGER
 } ComponentType;
 
 bool component_init(void);
@@ -27,4 +31,10 @@ bool component_init(void);
  */
 bool component_cleanup(uint16_t entity_id);
 
+/**
+ * Delivers all deferred component signals queued since the last flush. This
+ * should be called once per frame.
+ */
+void component_flush(void);
+
 #endif
@@ -3,23 +3,29 @@
 // SPDX-License-Identifier: BSD-2-Clause
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef _MSC_VER
 #include <unistd.h>
 #endif
 
-#include <SDL2/SDL_image.h>
-
+#include "../asset.h"
+#include "../collision.h"
 #include "../entity.h"
 #include "../log.h"
+#include "../render.h"
 
+#include "animation.h"
 #include "sprite.h"
 
 const ComponentType sprite_component_type = SPRITE;
 
 struct Sprite {
+    uint16_t entity_id;
+
     bool flip_h;
     bool flip_v;
 
@@ -28,21 +34,80 @@ struct Sprite {
     double opacity;
 
     SDL_Rect clip;
-    SDL_Surface* surface;
 
-    SpriteCallbackList cb_list;
+    // The part of the image chosen by sprite_frame_set(), relative to the
+    // image, which is kept so it can be applied once the image loads
+    SDL_Rect frame;
+    bool framed;
+
+    // The image is shared with every other sprite loaded from the same path,
+    // and belongs to the asset cache. Its surface is looked up as it's drawn,
+    // since the cache may evict and reload it.
+    Asset* image;
+
+    // For indexed images, the palette the sprite is drawn with, or NULL for
+    // the image's own
+    Palette* palette;
+
+    // Set while the image is loading in the background, along with the
+    // callback to call once it's done
+    bool loading;
+
+    sprite_load_cb_t load_cb;
+    void* load_userdata;
+
+    // Position in the sprite list
+    size_t index;
+
+    // Callbacks, bucketed by signal type
+    SpriteCallbackList cb_list[SPRITE_SIGNAL_TYPE_COUNT];
+
+    // For each signal type, the position (plus one) of this sprite's event in
+    // the signal queue, or 0 if no event is queued
+    size_t pending[SPRITE_SIGNAL_TYPE_COUNT];
 };
 
+// Deferred signals are appended to a per-type queue, and delivered in one batch
+// by sprite_signal_flush(). The queue is drained completely on every flush, so
+// it's rewound rather than consumed like a ring.
+typedef struct SpriteSignalQueue {
+    size_t size;
+    size_t count;
+
+    SpriteSignalEvent* events;
+
+    // The sprite which emitted each event, or NULL if the sprite was destroyed
+    // before the event could be delivered
+    Sprite** owner;
+} SpriteSignalQueue;
+
+SpriteBatchCallbackList sprite_batch_cb_list[SPRITE_SIGNAL_TYPE_COUNT] = {0};
+
+// Every sprite, densely packed so that they can be walked without going
+// through each entity
+size_t sprite_list_size = 0;
+size_t sprite_list_count = 0;
+Sprite** sprite_list = NULL;
+
+// The farthest any sprite's clip has reached from its entity's position, at
+// any rotation, since the sprites were last cleaned up
+float sprite_reach = 0.0f;
+
+// Each type has two queues which swap places on every flush, so that signals
+// emitted by batch callbacks don't land in the batch being delivered
+SpriteSignalQueue sprite_queue[SPRITE_SIGNAL_TYPE_COUNT] = {0};
+SpriteSignalQueue sprite_queue_back[SPRITE_SIGNAL_TYPE_COUNT] = {0};
+
 // Signals
 
 const char* sprite_signal_type_str[] = {
-    "flip_h",
-    "flip_v",
-    "z_order",
-    "opacity",
+    [FLIP_H] = "flip_h",
+    [FLIP_V] = "flip_v",
+    [OPACITY] = "opacity",
+    [Z_ORDER] = "z_order",
 };
 
-bool sprite_regcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb) {
+bool sprite_regcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb, void* userdata) {
     logmsg(LOG_DEBUG, "component(sprite): Attempting to register callback for signal['%s']", sprite_signal_type_str[type]);
 
     if (!cb) {
@@ -57,63 +122,96 @@ bool sprite_regcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb) {
         return false;
     }
 
-    // If the array isn't yet initialized, do that now
-    if (!s->cb_list.cb) {
-        s->cb_list.cb = calloc(SLOT_DEFAULT_SIZE, sizeof(SpriteCallback));
+    SpriteCallbackList* list = &s->cb_list[type];
 
-        if (!s->cb_list.cb) {
-            logmsg(LOG_WARN, "component(sprite): Failed to initialize callback array, the system is out of memory");
+    // If the array is full, double the size
+    if (list->size == list->count) {
+        size_t size = list->size ? list->size * 2 : SLOT_DEFAULT_SIZE;
+
+        SpriteCallback* tmp = realloc(list->cb, size * sizeof(SpriteCallback));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(sprite): Failed to resize callback array, the system is out of memory");
 
             return false;
         }
+
+        list->cb = tmp;
+        list->size = size;
     }
 
-    // If the array is full, double the size
-    if (s->cb_list.size == s->cb_list.count) {
-        SpriteCallback* tmp = realloc(s->cb_list.cb, s->cb_list.size * 2 * sizeof(SpriteCallback));
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
 
-        if (!tmp) {
-            logmsg(LOG_WARN, "component(sprite): Failed to resize callback array, the system is out of memory");
+    list->count++;
 
-            return false;
+    return true;
+}
+
+bool sprite_unregcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(sprite): Attempting to unregister callback (%p)", cb);
+
+    SpriteCallbackList* list = &s->cb_list[type];
+
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            // Keep the bucket compact so that dispatch never has to skip holes
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(SpriteCallback));
+
+            list->count--;
+
+            return true;
         }
+    }
 
-        s->cb_list.cb = tmp;
+    return false;
+}
 
-        // Initialize the new memory so that we can find empty slots correctly
-        memset(&s->cb_list.cb[s->cb_list.size], 0, s->cb_list.size * sizeof(SpriteCallback));
+bool sprite_regcb_batch(SpriteSignalType type, sprite_batch_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(sprite): Attempting to register batch callback for signal['%s']", sprite_signal_type_str[type]);
 
-        s->cb_list.size *= 2;
+    if (!cb) {
+        logmsg(LOG_WARN, "component(sprite): Unable to register NULL batch callback");
+
+        return false;
     }
 
-    // Add the callback
-    for (size_t i = 0; i < s->cb_list.size; i++) {
-        if (s->cb_list.cb[i].cb == NULL) {
-            s->cb_list.cb[i].cb = cb;
-            s->cb_list.cb[i].type = type;
+    SpriteBatchCallbackList* list = &sprite_batch_cb_list[type];
 
-            s->cb_list.count++;
+    // If the array is full, double the size
+    if (list->size == list->count) {
+        size_t size = list->size ? list->size * 2 : SLOT_DEFAULT_SIZE;
 
-            return true;
+        SpriteBatchCallback* tmp = realloc(list->cb, size * sizeof(SpriteBatchCallback));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(sprite): Failed to resize batch callback array, the system is out of memory");
+
+            return false;
         }
+
+        list->cb = tmp;
+        list->size = size;
     }
 
-    logmsg(LOG_ERR,
-        "component(sprite): Failed to register callback for signal['%s'], callback array isn't full, but a free slot was never found",
-        sprite_signal_type_str[type]);
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
 
-    _exit(-1);
+    list->count++;
+
+    return true;
 }
 
-bool sprite_unregcb(Sprite* s, sprite_cb_t cb) {
-    logmsg(LOG_DEBUG, "component(sprite): Attempting to unregister callback (%p)", cb);
+bool sprite_unregcb_batch(SpriteSignalType type, sprite_batch_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(sprite): Attempting to unregister batch callback (%p)", cb);
+
+    SpriteBatchCallbackList* list = &sprite_batch_cb_list[type];
 
-    for (size_t i = 0; i < s->cb_list.size; i++) {
-        if (s->cb_list.cb[i].cb == cb) {
-            s->cb_list.cb[i].cb = NULL;
-            s->cb_list.cb[i].type = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(SpriteBatchCallback));
 
-            s->cb_list.count--;
+            list->count--;
 
             return true;
         }
@@ -122,15 +220,200 @@ bool sprite_unregcb(Sprite* s, sprite_cb_t cb) {
     return false;
 }
 
+bool sprite_signal_queue_grow(SpriteSignalQueue* q) {
+    size_t size = q->size ? q->size * 2 : SLOT_DEFAULT_SIZE;
+
+    SpriteSignalEvent* events = realloc(q->events, size * sizeof(SpriteSignalEvent));
+
+    if (!events) {
+        return false;
+    }
+
+    q->events = events;
+
+    Sprite** owner = realloc(q->owner, size * sizeof(Sprite*));
+
+    if (!owner) {
+        return false;
+    }
+
+    q->owner = owner;
+
+    q->size = size;
+
+    return true;
+}
+
+void sprite_signal_queue(Sprite* s, SpriteSignalType type, SpriteSignalArgs args) {
+    SpriteSignalQueue* q = &sprite_queue[type];
+
+    // Coalesce with the event already queued for this sprite, keeping the
+    // original old values
+    if (s->pending[type]) {
+        SpriteSignalArgs* queued = &q->events[s->pending[type] - 1].args;
+
+        switch (type) {
+            case FLIP_H:
+                queued->flip_h = args.flip_h;
+                break;
+            case FLIP_V:
+                queued->flip_v = args.flip_v;
+                break;
+            case OPACITY:
+                queued->opacity = args.opacity;
+                break;
+            case Z_ORDER:
+                queued->z = args.z;
+                break;
+        }
+
+        return;
+    }
+
+    if (q->count == q->size && !sprite_signal_queue_grow(q)) {
+        logmsg(LOG_WARN,
+            "component(sprite): Dropped signal['%s'] for entity[%" PRIu16 "], the system is out of memory",
+            sprite_signal_type_str[type],
+            s->entity_id);
+
+        return;
+    }
+
+    q->events[q->count].entity_id = s->entity_id;
+    q->events[q->count].args = args;
+    q->owner[q->count] = s;
+
+    s->pending[type] = ++q->count;
+}
+
 void sprite_signal(Sprite* s, SpriteSignalType type, SpriteSignalArgs args) {
-    for (size_t i = 0; i < s->cb_list.size; i++) {
-        if (s->cb_list.cb[i].type == type) {
-            s->cb_list.cb[i].cb(args);
+    SpriteCallbackList* list = &s->cb_list[type];
+
+    // Most signals have no subscribers at all, so test for that first
+    if ((list->count | sprite_batch_cb_list[type].count) == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < list->count; i++) {
+        list->cb[i].cb(s->entity_id, args, list->cb[i].userdata);
+    }
+
+    if (sprite_batch_cb_list[type].count > 0) {
+        sprite_signal_queue(s, type, args);
+    }
+}
+
+void sprite_signal_flush(void) {
+    for (SpriteSignalType type = FLIP_H; type < SPRITE_SIGNAL_TYPE_COUNT; type++) {
+        SpriteSignalQueue q = sprite_queue[type];
+
+        if (q.count == 0) {
+            continue;
+        }
+
+        sprite_queue[type] = sprite_queue_back[type];
+
+        // Drop events from destroyed sprites, and detach the rest from their
+        // sprites so that new signals start a new batch
+        size_t live = 0;
+
+        for (size_t i = 0; i < q.count; i++) {
+            if (q.owner[i]) {
+                q.owner[i]->pending[type] = 0;
+
+                q.events[live++] = q.events[i];
+            }
         }
+
+        SpriteBatchCallbackList* list = &sprite_batch_cb_list[type];
+
+        for (size_t i = 0; i < list->count && live > 0; i++) {
+            list->cb[i].cb(type, q.events, live, list->cb[i].userdata);
+        }
+
+        q.count = 0;
+
+        sprite_queue_back[type] = q;
     }
 }
 
-bool sprite_create(uint16_t entity_id, char* path) {
+// Creates a sprite from an acquired image, taking over the reference
+// Sets the part of the image which is drawn, keeping track of the largest
+void sprite_clip_set(Sprite* s, SDL_Rect clip) {
+    s->clip = clip;
+
+    float reach = sqrtf((float)clip.w * (float)clip.w + (float)clip.h * (float)clip.h);
+
+    if (reach > sprite_reach) {
+        sprite_reach = reach;
+    }
+}
+
+Sprite* sprite_attach(Entity* e, Asset* image) {
+    Sprite* s = calloc(1, sizeof(Sprite));
+
+    if (!s) {
+        logmsg(LOG_WARN, "component(sprite): Failed to create sprite for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+        asset_release(image);
+
+        return NULL;
+    }
+
+    s->entity_id = e->id;
+    s->opacity = 1.0;
+    s->image = image;
+    sprite_clip_set(s, asset_get_clip(image));
+
+    if (sprite_list_count == sprite_list_size) {
+        size_t new_size = sprite_list_size ? sprite_list_size * 2 : 64;
+
+        Sprite** tmp = realloc(sprite_list, new_size * sizeof(Sprite*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(sprite): Failed to create sprite for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+            asset_release(image);
+
+            free(s);
+
+            return NULL;
+        }
+
+        sprite_list = tmp;
+        sprite_list_size = new_size;
+    }
+
+    if (htable_add(e->components, (uint8_t*)&sprite_component_type, sizeof(sprite_component_type), KV_VOIDPTR, s) != 0) {
+        logmsg(LOG_WARN, "component(sprite): Failed to map sprite in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        asset_release(s->image);
+
+        free(s);
+
+        return NULL;
+    }
+
+    if (!render_sprite_add(s)) {
+        logmsg(LOG_WARN, "component(sprite): Failed to add sprite to draw list for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        htable_remove(e->components, (uint8_t*)&sprite_component_type, sizeof(sprite_component_type));
+
+        asset_release(s->image);
+
+        free(s);
+
+        return NULL;
+    }
+
+    s->index = sprite_list_count;
+
+    sprite_list[sprite_list_count++] = s;
+
+    return s;
+}
+
+Entity* sprite_create_check(uint16_t entity_id) {
     logmsg(LOG_DEBUG, "component(sprite): Attempting to create new sprite for entity[%" PRIu16 "]", entity_id);
 
     Entity* e = entity_get(entity_id);
@@ -138,44 +421,126 @@ bool sprite_create(uint16_t entity_id, char* path) {
     if (!e) {
         logmsg(LOG_WARN, "component(sprite): Unable to create sprite, failed to get entity[%" PRIu16 "]", entity_id);
 
-        return false;
+        return NULL;
     }
 
     if (entity_has_component(e->id, sprite_component_type)) {
         logmsg(LOG_WARN, "component(sprite): Unable to create sprite, entity[%" PRIu16 "]('%s') already has sprite", e->id, e->name);
 
+        return NULL;
+    }
+
+    return e;
+}
+
+bool sprite_create(uint16_t entity_id, char* path) {
+    Entity* e = sprite_create_check(entity_id);
+
+    if (!e) {
         return false;
     }
 
-    SDL_Surface* surface = IMG_Load(path);
+    Asset* image = asset_image_acquire(path);
 
-    if (!surface) {
+    if (!image) {
         logmsg(
             LOG_WARN, "component(sprite): Unable to create sprite for entity[%" PRIu16 "]('%s'), failed to load image at path '%s'", e->id, e->name, path);
 
         return false;
     }
 
-    Sprite* s = calloc(1, sizeof(Sprite));
+    return sprite_attach(e, image) != NULL;
+}
 
-    if (!s) {
-        logmsg(LOG_WARN, "component(sprite): Failed to create sprite for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+bool sprite_create_indexed(uint16_t entity_id, char* path) {
+    Entity* e = sprite_create_check(entity_id);
 
+    if (!e) {
         return false;
     }
 
-    // TODO(zero-one): Do we need to do this, or is 0,0 the same thing?
-    // surface->clip_rect.w = surface->w;
-    // surface->clip_rect.h = surface->h;
+    Asset* image = asset_image_acquire_indexed(path);
 
-    s->surface = surface;
+    if (!image) {
+        logmsg(LOG_WARN,
+            "component(sprite): Unable to create sprite for entity[%" PRIu16 "]('%s'), failed to load indexed image at path '%s'",
+            e->id,
+            e->name,
+            path);
 
-    if (htable_add(e->components, (uint8_t*)&sprite_component_type, sizeof(sprite_component_type), KV_VOIDPTR, s) != 0) {
-        logmsg(LOG_WARN, "component(sprite): Failed to map sprite in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+        return false;
+    }
 
-        SDL_FreeSurface(s->surface);
+    return sprite_attach(e, image) != NULL;
+}
 
-        free(s);
+// Places the chosen frame within the image, cut down to fit it
+SDL_Rect sprite_frame_clip(Sprite* s) {
+    SDL_Rect image = asset_get_clip(s->image);
+    SDL_Rect frame = {image.x + s->frame.x, image.y + s->frame.y, s->frame.w, s->frame.h};
+    SDL_Rect clip;
+
+    if (!SDL_IntersectRect(&image, &frame, &clip)) {
+        clip = (SDL_Rect){image.x, image.y, 0, 0};
+    }
+
+    return clip;
+}
+
+// Picks up the image once the asset cache publishes it
+void sprite_image_ready(Asset* a, void* userdata) {
+    Sprite* s = userdata;
+
+    s->loading = false;
+
+    sprite_clip_set(s, s->framed ? sprite_frame_clip(s) : asset_get_clip(a));
+
+    if (s->palette && !sprite_is_indexed(s)) {
+        logmsg(LOG_WARN, "component(sprite): Dropped palette of sprite for entity[%" PRIu16 "], its image isn't indexed", s->entity_id);
+
+        palette_release(s->palette);
+
+        s->palette = NULL;
+    }
+
+    render_sprite_touch(s->entity_id);
+
+    if (s->load_cb) {
+        s->load_cb(s->entity_id, asset_get_state(a) == ASSET_READY, s->load_userdata);
+    }
+}
+
+bool sprite_create_async(uint16_t entity_id, char* path, sprite_load_cb_t cb, void* userdata) {
+    Entity* e = sprite_create_check(entity_id);
+
+    if (!e) {
+        return false;
+    }
+
+    Asset* image = asset_image_acquire_async(path);
+
+    if (!image) {
+        logmsg(LOG_WARN,
+            "component(sprite): Unable to create sprite for entity[%" PRIu16 "]('%s'), failed to queue image at path '%s'",
+            e->id,
+            e->name,
+            path);
+
+        return false;
+    }
+
+    Sprite* s = sprite_attach(e, image);
+
+    if (!s) {
+        return false;
+    }
+
+    s->loading = true;
+    s->load_cb = cb;
+    s->load_userdata = userdata;
+
+    if (!asset_regcb(image, sprite_image_ready, s)) {
+        sprite_destroy(entity_id);
 
         return false;
     }
@@ -202,13 +567,69 @@ bool sprite_destroy(uint16_t entity_id) {
         return false;
     }
 
-    SDL_FreeSurface(s->surface);
+    for (SpriteSignalType type = FLIP_H; type < SPRITE_SIGNAL_TYPE_COUNT; type++) {
+        free(s->cb_list[type].cb);
+
+        // Queued signals outlive the sprite, but are never delivered
+        if (s->pending[type]) {
+            sprite_queue[type].owner[s->pending[type] - 1] = NULL;
+        }
+    }
+
+    if (s->loading) {
+        asset_unregcb(s->image, sprite_image_ready, s);
+    }
+
+    asset_release(s->image);
+    palette_release(s->palette);
+
+    render_sprite_remove(entity_id);
+
+    // Fill the gap with the last sprite
+    sprite_list[s->index] = sprite_list[--sprite_list_count];
+    sprite_list[s->index]->index = s->index;
 
     free(s);
 
+    collision_remove(entity_id);
+    animation_forget(entity_id);
+
+    if (htable_remove(e->components, (uint8_t*)&sprite_component_type, sizeof(sprite_component_type)) < 0) {
+        logmsg(LOG_ERR,
+            "component(sprite): Failed to remove sprite associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
+            e->id,
+            e->name);
+
+        _exit(-1);
+    }
+
     return true;
 }
 
+void sprite_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(sprite): Cleaning up sprite list and signal queues");
+
+    for (SpriteSignalType type = FLIP_H; type < SPRITE_SIGNAL_TYPE_COUNT; type++) {
+        free(sprite_batch_cb_list[type].cb);
+        free(sprite_queue[type].events);
+        free(sprite_queue[type].owner);
+        free(sprite_queue_back[type].events);
+        free(sprite_queue_back[type].owner);
+    }
+
+    free(sprite_list);
+
+    sprite_list = NULL;
+    sprite_list_size = 0;
+    sprite_list_count = 0;
+
+    sprite_reach = 0.0f;
+
+    memset(sprite_batch_cb_list, 0, sizeof(sprite_batch_cb_list));
+    memset(sprite_queue, 0, sizeof(sprite_queue));
+    memset(sprite_queue_back, 0, sizeof(sprite_queue_back));
+}
+
 void sprite_flip_h(Sprite* s) {
     bool flip_h_old = s->flip_h;
 
@@ -248,3 +669,105 @@ void sprite_z_set(Sprite* s, uint8_t z) {
 
     sprite_signal(s, Z_ORDER, args);
 }
+
+void sprite_frame_set(Sprite* s, SDL_Rect frame) {
+    s->frame = frame;
+    s->framed = true;
+
+    // The frame is applied once the image is in
+    if (s->loading) {
+        return;
+    }
+
+    SDL_Rect clip = sprite_frame_clip(s);
+
+    if (SDL_RectEquals(&clip, &s->clip)) {
+        return;
+    }
+
+    sprite_clip_set(s, clip);
+
+    render_sprite_touch(s->entity_id);
+}
+
+bool sprite_palette_set(Sprite* s, Palette* palette) {
+    // Whether an image still loading is indexed isn't known yet, so its
+    // palette is checked once it's in
+    if (!s->loading && !sprite_is_indexed(s)) {
+        logmsg(LOG_WARN, "component(sprite): Unable to set palette of sprite for entity[%" PRIu16 "], its image isn't indexed", s->entity_id);
+
+        return false;
+    }
+
+    if (palette == s->palette) {
+        return true;
+    }
+
+    if (palette) {
+        palette_acquire(palette);
+    }
+
+    palette_release(s->palette);
+
+    s->palette = palette;
+
+    render_sprite_touch(s->entity_id);
+
+    return true;
+}
+
+bool sprite_is_indexed(Sprite* s) {
+    return asset_is_indexed(s->image);
+}
+
+Palette* sprite_get_palette(Sprite* s) {
+    return s->palette;
+}
+
+bool sprite_is_loading(Sprite* s) {
+    return s->loading;
+}
+
+SDL_Rect sprite_get_clip(Sprite* s) {
+    return s->clip;
+}
+
+SDL_Surface* sprite_get_surface(Sprite* s) {
+    return asset_get_surface(s->image);
+}
+
+Asset* sprite_get_image(Sprite* s) {
+    return s->image;
+}
+
+uint16_t sprite_get_entity(Sprite* s) {
+    return s->entity_id;
+}
+
+bool sprite_get_flip_h(Sprite* s) {
+    return s->flip_h;
+}
+
+bool sprite_get_flip_v(Sprite* s) {
+    return s->flip_v;
+}
+
+double sprite_get_opacity(Sprite* s) {
+    return s->opacity;
+}
+
+uint8_t sprite_get_z(Sprite* s) {
+    return s->z;
+}
+
+Sprite* sprite_get(size_t index) {
+    return (index < sprite_list_count) ? sprite_list[index] : NULL;
+}
+
+size_t sprite_count(void) {
+    return sprite_list_count;
+}
+
+float sprite_get_reach(void) {
+    return sprite_reach;
+}
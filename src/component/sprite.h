@@ -6,10 +6,14 @@
 #define RPGNG_SPRITE
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <SDL2/SDL.h>
 
+#include "../asset.h"
+#include "../palette.h"
+
 #include "component.h"
 
 typedef struct Sprite Sprite;
@@ -21,6 +25,8 @@ typedef enum SpriteSignalType {
     Z_ORDER,
 } SpriteSignalType;
 
+#define SPRITE_SIGNAL_TYPE_COUNT (Z_ORDER + 1)
+
 typedef union SpriteSignalArgs {
     // Flip H
     struct {
@@ -46,12 +52,14 @@ typedef union SpriteSignalArgs {
 
 extern const char* sprite_signal_type_str[];
 
-typedef void (*sprite_cb_t)(SpriteSignalArgs);
+typedef void (*sprite_cb_t)(uint16_t entity_id, SpriteSignalArgs args, void* userdata);
 
-typedef struct SpriteCallback {
-    SpriteSignalType type;
+typedef void (*sprite_load_cb_t)(uint16_t entity_id, bool success, void* userdata);
 
+typedef struct SpriteCallback {
     sprite_cb_t cb;
+
+    void* userdata;
 } SpriteCallback;
 
 typedef struct SpriteCallbackList {
@@ -61,22 +69,78 @@ typedef struct SpriteCallbackList {
     SpriteCallback* cb;
 } SpriteCallbackList;
 
+// A deferred signal, delivered to batch callbacks by sprite_signal_flush().
+//
+// Signals of the same type from the same entity are coalesced, so the old
+// values are those from before the first signal since the last flush, and the
+// new values are those from the most recent signal.
+typedef struct SpriteSignalEvent {
+    uint16_t entity_id;
+
+    SpriteSignalArgs args;
+} SpriteSignalEvent;
+
+typedef void (*sprite_batch_cb_t)(SpriteSignalType type, const SpriteSignalEvent* events, size_t count, void* userdata);
+
+typedef struct SpriteBatchCallback {
+    sprite_batch_cb_t cb;
+
+    void* userdata;
+} SpriteBatchCallback;
+
+typedef struct SpriteBatchCallbackList {
+    size_t size;
+    size_t count;
+
+    SpriteBatchCallback* cb;
+} SpriteBatchCallbackList;
+
 /**
  * Registers a callback of the given type.
  *
  * @param type The signal type. Only signals of this type will trigger a
  * callback.
+ * @param userdata A pointer which is passed back to the callback as-is.
+ */
+bool sprite_regcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb, void* userdata);
+
+/**
+ * Removes the given callback. Signals of the given type will no longer trigger
+ * a callback to the given function with the given userdata.
+ *
+ * @return Returns true on success. Returns false if the given callback was not
+ * found.
+ */
+bool sprite_unregcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb, void* userdata);
+
+/**
+ * Registers a batch callback of the given type.
+ *
+ * Batch callbacks are registered for every sprite. Signals are queued, and
+ * delivered to batch callbacks all at once by sprite_signal_flush(). Signals
+ * are only queued while at least one batch callback of their type is
+ * registered.
+ *
+ * @param type The signal type. Only signals of this type will be delivered.
+ * @param userdata A pointer which is passed back to the callback as-is.
  */
-bool sprite_regcb(Sprite* s, SpriteSignalType type, sprite_cb_t cb);
+bool sprite_regcb_batch(SpriteSignalType type, sprite_batch_cb_t cb, void* userdata);
 
 /**
- * Removes the given callback. Signals will no longer trigger a callback to the
- * given function.
+ * Removes the given batch callback.
  *
  * @return Returns true on success. Returns false if the given callback was not
  * found.
  */
-bool sprite_unregcb(Sprite* s, sprite_cb_t cb);
+bool sprite_unregcb_batch(SpriteSignalType type, sprite_batch_cb_t cb, void* userdata);
+
+/**
+ * Delivers all queued signals to the registered batch callbacks, one batch per
+ * signal type. This should be called once per frame.
+ *
+ * Signals emitted by batch callbacks are queued for the next flush.
+ */
+void sprite_signal_flush(void);
 
 /**
  * Frees all resources associated with the Sprite component system.
@@ -92,6 +156,34 @@ void sprite_cleanup(void);
  */
 bool sprite_create(uint16_t entity_id, char* path);
 
+/**
+ * Associates a Sprite component with the given entity, drawn from an indexed
+ * image, which takes a quarter of the memory. Sprites loaded from the same
+ * path share the image, and can each be drawn with their own palette.
+ *
+ * @param path An image file of 256 colors or fewer.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool sprite_create_indexed(uint16_t entity_id, char* path);
+
+/**
+ * Associates a Sprite component with the given entity, without waiting for its
+ * image to load. Until the image is published by asset_sync(), the sprite
+ * draws a transparent placeholder.
+ *
+ * @param path An image file from which the sprite will be created.
+ * @param cb An optional callback, called by the asset_sync() which publishes
+ * the image. It's called even if the image was already loaded, and isn't
+ * called if the sprite is destroyed first.
+ * @param userdata A pointer which is passed back to the callback as-is.
+ *
+ * @return On success, returns true. On failure, returns false. If the image
+ * fails to load in the background, the sprite keeps the placeholder, and the
+ * callback is told of the failure.
+ */
+bool sprite_create_async(uint16_t entity_id, char* path, sprite_load_cb_t cb, void* userdata);
+
 /**
  * Destroys the Sprite associated with the given entity.
  *
@@ -126,4 +218,109 @@ void sprite_opacity_set(Sprite* s, double opacity);
  */
 void sprite_z_set(Sprite* s, uint8_t z);
 
+/**
+ * Recolors a sprite drawn from an indexed image, by drawing it with the given
+ * palette instead of the image's own. The sprite holds a reference to the
+ * palette, and is redrawn whenever the palette changes.
+ *
+ * A palette may be set while the sprite's image is still loading. If the
+ * image turns out not to be indexed, the palette is dropped once it's in.
+ *
+ * @param palette A palette, or NULL for the image's own.
+ *
+ * @return On success, returns true. Returns false if the sprite's image isn't
+ * indexed.
+ */
+bool sprite_palette_set(Sprite* s, Palette* palette);
+
+/**
+ * Determines whether the sprite is drawn from an indexed image. This is false
+ * until an image loading in the background is first decoded.
+ */
+bool sprite_is_indexed(Sprite* s);
+
+/**
+ * Gets the palette the sprite is drawn with, or NULL if it's drawn with its
+ * image's own.
+ */
+Palette* sprite_get_palette(Sprite* s);
+
+/**
+ * Draws only part of the sprite's image, such as one frame of a sprite sheet.
+ * If the image is still loading, the frame is applied once it's in.
+ *
+ * @param frame The region to draw, relative to the top left corner of the
+ * image. Parts of it outside the image are left out.
+ */
+void sprite_frame_set(Sprite* s, SDL_Rect frame);
+
+/**
+ * Determines whether the sprite's image is still being loaded.
+ */
+bool sprite_is_loading(Sprite* s);
+
+/**
+ * Gets the region of the sprite's surface which is drawn. This defaults to the
+ * whole image.
+ */
+SDL_Rect sprite_get_clip(Sprite* s);
+
+/**
+ * Gets the surface holding the sprite's image. This may be an atlas page
+ * shared with other sprites, or a placeholder while the image is loading or
+ * evicted.
+ */
+SDL_Surface* sprite_get_surface(Sprite* s);
+
+/**
+ * Gets the sprite's image, which belongs to the asset cache.
+ */
+Asset* sprite_get_image(Sprite* s);
+
+/**
+ * Gets the ID of the entity that owns the given sprite.
+ */
+uint16_t sprite_get_entity(Sprite* s);
+
+/**
+ * Determines whether the sprite is mirrored horizontally.
+ */
+bool sprite_get_flip_h(Sprite* s);
+
+/**
+ * Determines whether the sprite is mirrored vertically.
+ */
+bool sprite_get_flip_v(Sprite* s);
+
+/**
+ * Gets the sprite opacity, between 0 and 1. Sprites start out opaque.
+ */
+double sprite_get_opacity(Sprite* s);
+
+/**
+ * Gets the sprite z-order.
+ */
+uint8_t sprite_get_z(Sprite* s);
+
+/**
+ * Gets a sprite by its position in the sprite list. Positions change as
+ * sprites are destroyed.
+ *
+ * @return The sprite, or NULL if the index is out of range.
+ */
+Sprite* sprite_get(size_t index);
+
+/**
+ * Returns the number of sprites.
+ */
+size_t sprite_count(void);
+
+/**
+ * Returns the farthest any sprite's clip has reached from its entity's
+ * position, unscaled, at any rotation. This is the diagonal of the largest
+ * clip any sprite has had since sprite_cleanup(), and never shrinks before
+ * then.
+ */
+float sprite_get_reach(void);
+
 #endif
@@ -0,0 +1,599 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "../blit.h"
+#include "../entity.h"
+#include "../log.h"
+
+#include "component.h"
+#include "tilemap.h"
+#include "transform.h"
+
+#define TILEMAP_CHUNK_TILES (TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE)
+
+const ComponentType tilemap_component_type = TILEMAP;
+
+typedef struct TilemapChunk {
+    // Tile IDs, row by row
+    uint16_t tiles[TILEMAP_CHUNK_TILES];
+
+    // The version of the layer when its tiles last changed
+    uint64_t edited;
+
+    // For static layers, the tiles composited into one image, whether any of
+    // them changed since, and how many times the image was built
+    SDL_Surface* cache;
+    bool stale;
+    uint64_t version;
+} TilemapChunk;
+
+typedef struct TilemapLayer {
+    uint8_t z;
+    bool dynamic;
+
+    uint64_t version;
+
+    // Row by row, NULL until a tile is set in them
+    TilemapChunk** chunks;
+} TilemapLayer;
+
+struct Tilemap {
+    uint16_t entity_id;
+
+    Asset* tileset;
+
+    int tile_w;
+    int tile_h;
+
+    // Tiles across the tileset, and in all of it
+    uint32_t columns;
+    uint16_t tile_count;
+
+    // In tiles, and in chunks
+    uint32_t width;
+    uint32_t height;
+    uint32_t chunks_w;
+    uint32_t chunks_h;
+
+    size_t layer_count;
+    TilemapLayer layers[TILEMAP_LAYER_MAX];
+};
+
+size_t tilemap_list_size = 0;
+size_t tilemap_list_count = 0;
+Tilemap** tilemap_list = NULL;
+
+TilemapStats tilemap_stats;
+
+void tilemap_free(Tilemap* m) {
+    for (size_t i = 0; i < m->layer_count; i++) {
+        TilemapLayer* layer = &m->layers[i];
+
+        for (size_t j = 0; j < (size_t)m->chunks_w * m->chunks_h; j++) {
+            TilemapChunk* c = layer->chunks[j];
+
+            if (!c) {
+                continue;
+            }
+
+            if (c->cache) {
+                tilemap_stats.cached--;
+                tilemap_stats.cached_bytes -= (size_t)c->cache->pitch * (size_t)c->cache->h;
+
+                SDL_FreeSurface(c->cache);
+            }
+
+            tilemap_stats.chunks--;
+
+            free(c);
+        }
+
+        free(layer->chunks);
+    }
+
+    asset_release(m->tileset);
+
+    free(m);
+}
+
+bool tilemap_create(uint16_t entity_id, const char* tileset, int tile_w, int tile_h, uint32_t width, uint32_t height) {
+    logmsg(LOG_DEBUG, "component(tilemap): Attempting to create tilemap for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to create tilemap, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    if (entity_has_component(e->id, tilemap_component_type)) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to create tilemap, entity[%" PRIu16 "]('%s') already has tilemap", e->id, e->name);
+
+        return false;
+    }
+
+    if (!entity_has_component(e->id, TRANSFORM)) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to create tilemap, entity[%" PRIu16 "]('%s') has no transform", e->id, e->name);
+
+        return false;
+    }
+
+    if (tile_w <= 0 || tile_h <= 0 || width == 0 || height == 0) {
+        logmsg(LOG_WARN,
+            "component(tilemap): Unable to create tilemap for entity[%" PRIu16 "]('%s'), %" PRIu32 "x%" PRIu32 " tiles of %dx%d pixels is empty",
+            e->id,
+            e->name,
+            width,
+            height,
+            tile_w,
+            tile_h);
+
+        return false;
+    }
+
+    uint32_t chunks_w = width / TILEMAP_CHUNK_SIZE + (width % TILEMAP_CHUNK_SIZE != 0);
+    uint32_t chunks_h = height / TILEMAP_CHUNK_SIZE + (height % TILEMAP_CHUNK_SIZE != 0);
+
+    if ((size_t)chunks_w > SIZE_MAX / sizeof(TilemapChunk*) / chunks_h) {
+        logmsg(LOG_WARN,
+            "component(tilemap): Unable to create tilemap for entity[%" PRIu16 "]('%s'), %" PRIu32 "x%" PRIu32 " tiles is too large",
+            e->id,
+            e->name,
+            width,
+            height);
+
+        return false;
+    }
+
+    if (tilemap_list_count == tilemap_list_size) {
+        size_t new_size = tilemap_list_size ? tilemap_list_size * 2 : SLOT_DEFAULT_SIZE;
+
+        Tilemap** tmp = realloc(tilemap_list, new_size * sizeof(Tilemap*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(tilemap): Failed to create tilemap for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+            return false;
+        }
+
+        tilemap_list = tmp;
+        tilemap_list_size = new_size;
+    }
+
+    Tilemap* m = calloc(1, sizeof(Tilemap));
+
+    if (!m) {
+        logmsg(LOG_WARN, "component(tilemap): Failed to create tilemap for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+        return false;
+    }
+
+    m->tileset = asset_image_acquire(tileset);
+
+    if (!m->tileset) {
+        logmsg(LOG_WARN, "component(tilemap): Failed to create tilemap for entity[%" PRIu16 "]('%s'), unable to load tileset '%s'", e->id, e->name, tileset);
+
+        free(m);
+
+        return false;
+    }
+
+    SDL_Rect clip = asset_get_clip(m->tileset);
+
+    uint32_t columns = (uint32_t)(clip.w / tile_w);
+    uint32_t rows = (uint32_t)(clip.h / tile_h);
+
+    if (columns == 0 || rows == 0) {
+        logmsg(LOG_WARN,
+            "component(tilemap): Failed to create tilemap for entity[%" PRIu16 "]('%s'), tileset '%s' is smaller than a %dx%d tile",
+            e->id,
+            e->name,
+            tileset,
+            tile_w,
+            tile_h);
+
+        asset_release(m->tileset);
+        free(m);
+
+        return false;
+    }
+
+    m->entity_id = e->id;
+    m->tile_w = tile_w;
+    m->tile_h = tile_h;
+    m->columns = columns;
+    m->tile_count = ((uint64_t)columns * rows > UINT16_MAX) ? UINT16_MAX : (uint16_t)(columns * rows);
+    m->width = width;
+    m->height = height;
+    m->chunks_w = chunks_w;
+    m->chunks_h = chunks_h;
+
+    if (htable_add(e->components, (uint8_t*)&tilemap_component_type, sizeof(tilemap_component_type), KV_VOIDPTR, m) != 0) {
+        logmsg(LOG_WARN, "component(tilemap): Failed to map tilemap in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        tilemap_free(m);
+
+        return false;
+    }
+
+    tilemap_list[tilemap_list_count++] = m;
+
+    return true;
+}
+
+bool tilemap_destroy(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(tilemap): Attempting to destroy tilemap for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to destroy tilemap, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    Tilemap* m = htable_lookup(e->components, (uint8_t*)&tilemap_component_type, sizeof(tilemap_component_type), NULL);
+
+    if (!m) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to destroy tilemap, failed to get tilemap associated with entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        return false;
+    }
+
+    // Fill the gap with the last tilemap
+    for (size_t i = 0; i < tilemap_list_count; i++) {
+        if (tilemap_list[i] == m) {
+            tilemap_list[i] = tilemap_list[--tilemap_list_count];
+
+            break;
+        }
+    }
+
+    tilemap_free(m);
+
+    if (htable_remove(e->components, (uint8_t*)&tilemap_component_type, sizeof(tilemap_component_type)) < 0) {
+        logmsg(LOG_ERR,
+            "component(tilemap): Failed to remove tilemap associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
+            e->id,
+            e->name);
+
+        _exit(-1);
+    }
+
+    return true;
+}
+
+void tilemap_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(tilemap): Cleaning up tilemap list");
+
+    if (tilemap_list_count > 0) {
+        logmsg(LOG_WARN, "component(tilemap): Cleaning up with %zu tilemaps still alive", tilemap_list_count);
+    }
+
+    for (size_t i = 0; i < tilemap_list_count; i++) {
+        tilemap_free(tilemap_list[i]);
+    }
+
+    free(tilemap_list);
+
+    tilemap_list = NULL;
+    tilemap_list_size = 0;
+    tilemap_list_count = 0;
+
+    memset(&tilemap_stats, 0, sizeof(TilemapStats));
+}
+
+int tilemap_layer_add(Tilemap* m, uint8_t z, bool dynamic) {
+    if (m->layer_count == TILEMAP_LAYER_MAX) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to add layer to tilemap of entity[%" PRIu16 "], it already has %d layers", m->entity_id, TILEMAP_LAYER_MAX);
+
+        return -1;
+    }
+
+    TilemapChunk** chunks = calloc((size_t)m->chunks_w * m->chunks_h, sizeof(TilemapChunk*));
+
+    if (!chunks) {
+        logmsg(LOG_WARN, "component(tilemap): Failed to add layer to tilemap of entity[%" PRIu16 "], the system is out of memory", m->entity_id);
+
+        return -1;
+    }
+
+    m->layers[m->layer_count] = (TilemapLayer){.z = z, .dynamic = dynamic, .version = 1, .chunks = chunks};
+
+    return (int)m->layer_count++;
+}
+
+// Checks that a rectangle of cells is within the map
+bool tilemap_check(Tilemap* m, size_t layer, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+    if (layer >= m->layer_count) {
+        logmsg(LOG_WARN, "component(tilemap): Unable to set tiles of tilemap of entity[%" PRIu16 "], it has no layer %zu", m->entity_id, layer);
+
+        return false;
+    }
+
+    if (w > m->width || h > m->height || x > m->width - w || y > m->height - h) {
+        logmsg(LOG_WARN,
+            "component(tilemap): Unable to set tiles of tilemap of entity[%" PRIu16 "], %" PRIu32 "x%" PRIu32 " tiles at (%" PRIu32 ", %" PRIu32
+            ") is outside of its %" PRIu32 "x%" PRIu32,
+            m->entity_id,
+            w,
+            h,
+            x,
+            y,
+            m->width,
+            m->height);
+
+        return false;
+    }
+
+    return true;
+}
+
+bool tilemap_check_tile(Tilemap* m, uint16_t tile) {
+    if (tile > m->tile_count) {
+        logmsg(LOG_WARN,
+            "component(tilemap): Unable to set tile of tilemap of entity[%" PRIu16 "], tile %" PRIu16 " is past the %" PRIu16 " in its tileset",
+            m->entity_id,
+            tile,
+            m->tile_count);
+
+        return false;
+    }
+
+    return true;
+}
+
+// Sets a tile which is known to be in range
+bool tilemap_put(Tilemap* m, TilemapLayer* layer, uint32_t x, uint32_t y, uint16_t tile) {
+    TilemapChunk** slot = &layer->chunks[(size_t)(y / TILEMAP_CHUNK_SIZE) * m->chunks_w + x / TILEMAP_CHUNK_SIZE];
+
+    if (!*slot) {
+        // Clearing a cell of a chunk which was never set changes nothing
+        if (tile == TILEMAP_TILE_EMPTY) {
+            return true;
+        }
+
+        *slot = calloc(1, sizeof(TilemapChunk));
+
+        if (!*slot) {
+            logmsg(LOG_WARN, "component(tilemap): Failed to set tile of tilemap of entity[%" PRIu16 "], the system is out of memory", m->entity_id);
+
+            return false;
+        }
+
+        tilemap_stats.chunks++;
+    }
+
+    TilemapChunk* c = *slot;
+
+    uint16_t* cell = &c->tiles[(y % TILEMAP_CHUNK_SIZE) * TILEMAP_CHUNK_SIZE + x % TILEMAP_CHUNK_SIZE];
+
+    if (*cell != tile) {
+        *cell = tile;
+
+        c->stale = true;
+        c->edited = ++layer->version;
+    }
+
+    return true;
+}
+
+bool tilemap_set_tile(Tilemap* m, size_t layer, uint32_t x, uint32_t y, uint16_t tile) {
+    if (!tilemap_check(m, layer, x, y, 1, 1) || !tilemap_check_tile(m, tile)) {
+        return false;
+    }
+
+    return tilemap_put(m, &m->layers[layer], x, y, tile);
+}
+
+bool tilemap_set_tiles(Tilemap* m, size_t layer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint16_t* tiles) {
+    if (!tilemap_check(m, layer, x, y, w, h)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        if (!tilemap_check_tile(m, tiles[i])) {
+            return false;
+        }
+    }
+
+    for (uint32_t row = 0; row < h; row++) {
+        for (uint32_t col = 0; col < w; col++) {
+            if (!tilemap_put(m, &m->layers[layer], x + col, y + row, tiles[(size_t)row * w + col])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+uint16_t tilemap_get_tile(Tilemap* m, size_t layer, uint32_t x, uint32_t y) {
+    if (layer >= m->layer_count || x >= m->width || y >= m->height) {
+        return TILEMAP_TILE_EMPTY;
+    }
+
+    TilemapChunk* c = m->layers[layer].chunks[(size_t)(y / TILEMAP_CHUNK_SIZE) * m->chunks_w + x / TILEMAP_CHUNK_SIZE];
+
+    return c ? c->tiles[(y % TILEMAP_CHUNK_SIZE) * TILEMAP_CHUNK_SIZE + x % TILEMAP_CHUNK_SIZE] : TILEMAP_TILE_EMPTY;
+}
+
+uint16_t tilemap_get_entity(Tilemap* m) {
+    return m->entity_id;
+}
+
+uint32_t tilemap_get_width(Tilemap* m) {
+    return m->width;
+}
+
+uint32_t tilemap_get_height(Tilemap* m) {
+    return m->height;
+}
+
+int tilemap_get_tile_w(Tilemap* m) {
+    return m->tile_w;
+}
+
+int tilemap_get_tile_h(Tilemap* m) {
+    return m->tile_h;
+}
+
+uint16_t tilemap_get_tile_count(Tilemap* m) {
+    return m->tile_count;
+}
+
+size_t tilemap_layer_count(Tilemap* m) {
+    return m->layer_count;
+}
+
+uint8_t tilemap_layer_get_z(Tilemap* m, size_t layer) {
+    return m->layers[layer].z;
+}
+
+bool tilemap_layer_is_dynamic(Tilemap* m, size_t layer) {
+    return m->layers[layer].dynamic;
+}
+
+uint64_t tilemap_layer_get_version(Tilemap* m, size_t layer) {
+    return m->layers[layer].version;
+}
+
+uint64_t tilemap_chunk_get_edited(Tilemap* m, size_t layer, uint32_t cx, uint32_t cy) {
+    if (layer >= m->layer_count || cx >= m->chunks_w || cy >= m->chunks_h) {
+        return 0;
+    }
+
+    TilemapChunk* c = m->layers[layer].chunks[(size_t)cy * m->chunks_w + cx];
+
+    return c ? c->edited : 0;
+}
+
+Tilemap* const* tilemap_get_all(size_t* count) {
+    *count = tilemap_list_count;
+
+    return tilemap_list;
+}
+
+Asset* tilemap_get_tileset(Tilemap* m) {
+    return m->tileset;
+}
+
+SDL_Rect tilemap_tile_rect(Tilemap* m, uint16_t tile) {
+    SDL_Rect clip = asset_get_clip(m->tileset);
+
+    uint32_t index = (uint32_t)tile - 1;
+
+    return (SDL_Rect){
+        .x = clip.x + (int)(index % m->columns) * m->tile_w,
+        .y = clip.y + (int)(index / m->columns) * m->tile_h,
+        .w = m->tile_w,
+        .h = m->tile_h,
+    };
+}
+
+// Composites the tiles of a chunk into its cached image. Returns false if the
+// tileset isn't loaded, leaving the image as it was.
+bool tilemap_chunk_build(Tilemap* m, TilemapChunk* c, uint32_t cx, uint32_t cy) {
+    if (!asset_touch(m->tileset)) {
+        return false;
+    }
+
+    if (!c->cache) {
+        // Chunks along the right and bottom edges may be cut short
+        uint32_t cols = m->width - cx * TILEMAP_CHUNK_SIZE;
+        uint32_t rows = m->height - cy * TILEMAP_CHUNK_SIZE;
+
+        cols = (cols < TILEMAP_CHUNK_SIZE) ? cols : TILEMAP_CHUNK_SIZE;
+        rows = (rows < TILEMAP_CHUNK_SIZE) ? rows : TILEMAP_CHUNK_SIZE;
+
+        c->cache = SDL_CreateRGBSurfaceWithFormat(0, (int)cols * m->tile_w, (int)rows * m->tile_h, 32, BLIT_PIXEL_FORMAT);
+
+        if (!c->cache) {
+            logmsg(LOG_WARN, "component(tilemap): Failed to create chunk image for tilemap of entity[%" PRIu16 "]: %s", m->entity_id, SDL_GetError());
+
+            return false;
+        }
+
+        tilemap_stats.cached++;
+        tilemap_stats.cached_bytes += (size_t)c->cache->pitch * (size_t)c->cache->h;
+    }
+    else {
+        SDL_FillRect(c->cache, NULL, 0);
+    }
+
+    SDL_Surface* tileset = asset_get_surface(m->tileset);
+
+    // Tiles in a layer don't overlap, so each is copied as-is, premultiplied
+    // like the tileset, rather than blended over the empty image
+    SDL_BlendMode mode;
+
+    SDL_GetSurfaceBlendMode(tileset, &mode);
+    SDL_SetSurfaceBlendMode(tileset, SDL_BLENDMODE_NONE);
+
+    bool ret = true;
+
+    for (int row = 0; row < c->cache->h / m->tile_h; row++) {
+        for (int col = 0; col < c->cache->w / m->tile_w; col++) {
+            uint16_t tile = c->tiles[row * TILEMAP_CHUNK_SIZE + col];
+
+            if (tile == TILEMAP_TILE_EMPTY) {
+                continue;
+            }
+
+            SDL_Rect src = tilemap_tile_rect(m, tile);
+            SDL_Rect dst = {col * m->tile_w, row * m->tile_h, m->tile_w, m->tile_h};
+
+            if (SDL_BlitSurface(tileset, &src, c->cache, &dst) != 0) {
+                ret = false;
+            }
+        }
+    }
+
+    SDL_SetSurfaceBlendMode(tileset, mode);
+
+    if (!ret) {
+        logmsg(LOG_WARN, "component(tilemap): Failed to draw tiles into chunk image for tilemap of entity[%" PRIu16 "]: %s", m->entity_id, SDL_GetError());
+    }
+
+    // Even a partly drawn image is only rebuilt once its tiles change again
+    c->stale = false;
+    c->version++;
+
+    tilemap_stats.rebuilds++;
+
+    return true;
+}
+
+SDL_Surface* tilemap_chunk_get(Tilemap* m, size_t layer, uint32_t cx, uint32_t cy, uint64_t* version) {
+    if (layer >= m->layer_count || m->layers[layer].dynamic || cx >= m->chunks_w || cy >= m->chunks_h) {
+        return NULL;
+    }
+
+    TilemapChunk* c = m->layers[layer].chunks[(size_t)cy * m->chunks_w + cx];
+
+    if (!c) {
+        return NULL;
+    }
+
+    if ((c->stale || !c->cache) && !tilemap_chunk_build(m, c, cx, cy) && !c->cache) {
+        return NULL;
+    }
+
+    *version = c->version;
+
+    return c->cache;
+}
+
+const TilemapStats* tilemap_get_stats(void) {
+    return &tilemap_stats;
+}
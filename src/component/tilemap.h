@@ -0,0 +1,235 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_TILEMAP
+#define RPGNG_TILEMAP
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "../asset.h"
+
+// The width and height of a chunk, in tiles
+#define TILEMAP_CHUNK_SIZE 32
+
+// The most layers a tilemap can have
+#define TILEMAP_LAYER_MAX 16
+
+// The tile ID of an empty cell. Other IDs count from 1, through the tileset
+// left to right, then top to bottom.
+#define TILEMAP_TILE_EMPTY 0
+
+typedef struct Tilemap Tilemap;
+
+typedef struct TilemapStats {
+    // Chunks holding tiles, across every layer of every tilemap
+    size_t chunks;
+
+    // Chunks with a cached image, and the memory their images take
+    size_t cached;
+    size_t cached_bytes;
+
+    // Cached images rebuilt because their tiles changed, since startup
+    size_t rebuilds;
+} TilemapStats;
+
+/*
+ * A tilemap is a grid of tiles, drawn from a single tileset image, in layers.
+ * Each layer is stored as chunks of TILEMAP_CHUNK_SIZE by TILEMAP_CHUNK_SIZE
+ * tile IDs, which are only allocated once a tile is set in them.
+ *
+ * Static layers are drawn from a cached image of each chunk, composited from
+ * its tiles the first time it's drawn, and again only after one of its tiles
+ * changes. A screen of tiles then takes a handful of chunk draws, instead of
+ * one per tile. Dynamic layers, whose tiles change often enough that caching
+ * them would cost more than it saves, are drawn a tile at a time.
+ *
+ * Layers are drawn behind sprites of the same z-order, through the same
+ * camera. The tilemap's top left corner is at its entity's position; it isn't
+ * rotated or scaled.
+ */
+
+/**
+ * Associates a tilemap with the given entity, which must have a Transform. The
+ * tilemap starts out with no layers.
+ *
+ * @param tileset The path to the image the tiles are cut from, which is
+ * loaded if it isn't already.
+ * @param tile_w The width of a tile, in pixels.
+ * @param tile_h The height of a tile, in pixels.
+ * @param width The width of the map, in tiles.
+ * @param height The height of the map, in tiles.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool tilemap_create(uint16_t entity_id, const char* tileset, int tile_w, int tile_h, uint32_t width, uint32_t height);
+
+/**
+ * Destroys the tilemap associated with the given entity, along with its layers
+ * and their cached images.
+ *
+ * @return On success, returns true. If the given entity does not have a
+ * tilemap component, this function returns false.
+ */
+bool tilemap_destroy(uint16_t entity_id);
+
+/**
+ * Frees all resources associated with the Tilemap component system.
+ */
+void tilemap_cleanup(void);
+
+/**
+ * Adds an empty layer on top of the tilemap's others.
+ *
+ * @param z The z-order to draw the layer at. The layer is drawn behind sprites
+ * of the same z-order, and in front of layers added before it.
+ * @param dynamic Whether the layer is drawn a tile at a time, rather than from
+ * cached chunk images.
+ *
+ * @return On success, returns the index of the new layer. Returns -1 if the
+ * tilemap already has TILEMAP_LAYER_MAX layers.
+ */
+int tilemap_layer_add(Tilemap* m, uint8_t z, bool dynamic);
+
+/**
+ * Sets a single tile, invalidating the cached image of its chunk if it
+ * changed.
+ *
+ * @param tile A tile ID, or TILEMAP_TILE_EMPTY to clear the cell.
+ *
+ * @return On success, returns true. Returns false if the layer, cell, or tile
+ * ID is out of range, or if the system is out of memory.
+ */
+bool tilemap_set_tile(Tilemap* m, size_t layer, uint32_t x, uint32_t y, uint16_t tile);
+
+/**
+ * Sets a rectangle of tiles at once, as when loading a map. Each chunk it
+ * touches is invalidated once.
+ *
+ * @param tiles w * h tile IDs, row by row.
+ *
+ * @return On success, returns true. Returns false, having set none of the
+ * tiles, if the layer or rectangle is out of range, or if any tile ID is. Also
+ * returns false if the system is out of memory, in which case some of the
+ * tiles may have been set.
+ */
+bool tilemap_set_tiles(Tilemap* m, size_t layer, uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint16_t* tiles);
+
+/**
+ * Gets a single tile.
+ *
+ * @return The tile ID, or TILEMAP_TILE_EMPTY if the cell is empty, or out of
+ * range.
+ */
+uint16_t tilemap_get_tile(Tilemap* m, size_t layer, uint32_t x, uint32_t y);
+
+/**
+ * Gets the entity a tilemap belongs to.
+ */
+uint16_t tilemap_get_entity(Tilemap* m);
+
+/**
+ * Gets the width of a tilemap, in tiles.
+ */
+uint32_t tilemap_get_width(Tilemap* m);
+
+/**
+ * Gets the height of a tilemap, in tiles.
+ */
+uint32_t tilemap_get_height(Tilemap* m);
+
+/**
+ * Gets the width of a tile, in pixels.
+ */
+int tilemap_get_tile_w(Tilemap* m);
+
+/**
+ * Gets the height of a tile, in pixels.
+ */
+int tilemap_get_tile_h(Tilemap* m);
+
+/**
+ * Gets the number of tile IDs the tileset holds, which is the highest valid
+ * tile ID.
+ */
+uint16_t tilemap_get_tile_count(Tilemap* m);
+
+/**
+ * Gets the number of layers in a tilemap.
+ */
+size_t tilemap_layer_count(Tilemap* m);
+
+/**
+ * Gets the z-order a layer is drawn at.
+ */
+uint8_t tilemap_layer_get_z(Tilemap* m, size_t layer);
+
+/**
+ * Determines whether a layer is drawn a tile at a time.
+ */
+bool tilemap_layer_is_dynamic(Tilemap* m, size_t layer);
+
+/**
+ * Gets the version of a layer, which changes whenever any of its tiles do.
+ */
+uint64_t tilemap_layer_get_version(Tilemap* m, size_t layer);
+
+/**
+ * Gets the version the layer had when a tile of the given chunk last changed,
+ * so that whatever mirrors the layer can tell which chunks changed since a
+ * version it saw, without comparing every tile.
+ *
+ * @param cx The column of the chunk, counted in chunks.
+ * @param cy The row of the chunk, counted in chunks.
+ *
+ * @return The version, or 0 if no tile of the chunk was ever set, or if the
+ * chunk is out of range.
+ */
+uint64_t tilemap_chunk_get_edited(Tilemap* m, size_t layer, uint32_t cx, uint32_t cy);
+
+/**
+ * Gets every tilemap, in no particular order. Called by the renderer.
+ *
+ * @param[out] count The number of tilemaps returned.
+ */
+Tilemap* const* tilemap_get_all(size_t* count);
+
+/**
+ * Gets the cached image of a chunk of a static layer, rebuilding it first if
+ * any of its tiles changed since it was last built. The image is in
+ * BLIT_PIXEL_FORMAT, with premultiplied alpha, and belongs to the tilemap.
+ * Called by the renderer.
+ *
+ * Chunks aren't rebuilt while the tileset is evicted; they're rebuilt once it
+ * has reloaded, and until then, they keep their stale image, if they have one.
+ *
+ * @param cx The column of the chunk, counted in chunks.
+ * @param cy The row of the chunk, counted in chunks.
+ * @param[out] version The version of the image, which changes whenever it's
+ * rebuilt.
+ *
+ * @return The image, or NULL if no tile was ever set in the chunk, or if it
+ * has yet to be built and can't be.
+ */
+SDL_Surface* tilemap_chunk_get(Tilemap* m, size_t layer, uint32_t cx, uint32_t cy, uint64_t* version);
+
+/**
+ * Gets the tileset a tilemap's tiles are drawn from.
+ */
+Asset* tilemap_get_tileset(Tilemap* m);
+
+/**
+ * Gets where a tile is on the tileset's surface, which may be an atlas page.
+ */
+SDL_Rect tilemap_tile_rect(Tilemap* m, uint16_t tile);
+
+/**
+ * Gets the Tilemap component system statistics.
+ */
+const TilemapStats* tilemap_get_stats(void);
+
+#endif
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: BSD-2-Clause
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,25 +11,105 @@
 #include <unistd.h>
 #endif
 
+#include "../collision.h"
 #include "../entity.h"
 #include "../log.h"
+#include "../render.h"
+#include "../simd.h"
+#include "../spatial.h"
 
 #include "component.h"
 #include "transform.h"
+#include "trigger.h"
 
 const ComponentType transform_component_type = TRANSFORM;
 
 struct Transform {
-    int pos_x;
-    int pos_y;
+    uint16_t entity_id;
 
-    double rotation;
+    // The slot in the transform store at which this transform's data lives.
+    // This changes when other transforms are destroyed.
+    size_t index;
 
-    double scale;
+    // Callbacks, bucketed by signal type
+    TransformCallbackList cb_list[TRANSFORM_SIGNAL_TYPE_COUNT];
 
-    TransformCallbackList cb_list;
+    // For each signal type, the position (plus one) of this transform's event
+    // in the signal queue, or 0 if no event is queued
+    size_t pending[TRANSFORM_SIGNAL_TYPE_COUNT];
 };
 
+// Transform data is kept as a structure of arrays so that batch operations can
+// stream through each field with SIMD kernels. Slots are dense; destroying a
+// transform moves the last slot into the hole it leaves.
+typedef struct TransformStore {
+    size_t size;
+    size_t count;
+
+    float* pos_x;
+    float* pos_y;
+
+    float* vel_x;
+    float* vel_y;
+
+    double* rotation;
+
+    double* scale;
+
+    // State as of the start of the current simulation tick, and the state
+    // interpolated between that and the current state for rendering
+    float* prev_x;
+    float* prev_y;
+
+    float* render_x;
+    float* render_y;
+
+    // Cached local-to-world matrices, and flags recording which parts of each
+    // matrix are stale
+    TransformMatrix* matrix;
+    uint8_t* dirty;
+
+    // The transform handle which owns each slot
+    Transform** owner;
+
+    // Scratch space for batch operations
+    void* scratch;
+    size_t scratch_size;
+
+    // For each signal type, the number of transforms with at least one
+    // registered callback. Batch operations skip signal dispatch entirely while
+    // this and the number of batch callbacks are both 0.
+    size_t listeners[TRANSFORM_SIGNAL_TYPE_COUNT];
+} TransformStore;
+
+TransformStore transform_store = {0};
+
+// Matrix dirty flags. Position changes only need the translation column
+// refreshed; rotation and scale changes need the trig recomputed.
+#define DIRTY_POSITION 0x1
+#define DIRTY_LINEAR 0x2
+
+// Deferred signals are appended to a per-type queue, and delivered in one batch
+// by transform_signal_flush(). The queue is drained completely on every flush,
+// so it's rewound rather than consumed like a ring.
+typedef struct TransformSignalQueue {
+    size_t size;
+    size_t count;
+
+    TransformSignalEvent* events;
+
+    // The transform which emitted each event, or NULL if the transform was
+    // destroyed before the event could be delivered
+    Transform** owner;
+} TransformSignalQueue;
+
+TransformBatchCallbackList transform_batch_cb_list[TRANSFORM_SIGNAL_TYPE_COUNT] = {0};
+
+// Each type has two queues which swap places on every flush, so that signals
+// emitted by batch callbacks don't land in the batch being delivered
+TransformSignalQueue transform_queue[TRANSFORM_SIGNAL_TYPE_COUNT] = {0};
+TransformSignalQueue transform_queue_back[TRANSFORM_SIGNAL_TYPE_COUNT] = {0};
+
 // Signals
 
 const char* transform_signal_type_str[] = {
@@ -37,7 +118,7 @@ const char* transform_signal_type_str[] = {
     "scale",
 };
 
-bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb) {
+bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb, void* userdata) {
     logmsg(LOG_DEBUG, "component(transform): Attempting to register callback for signal['%s']", transform_signal_type_str[type]);
 
     if (!cb) {
@@ -52,20 +133,13 @@ bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb)
         return false;
     }
 
-    // If the array isn't yet initialized, do that now
-    if (!t->cb_list.cb) {
-        t->cb_list.cb = calloc(SLOT_DEFAULT_SIZE, sizeof(TransformCallback));
-
-        if (!t->cb_list.cb) {
-            logmsg(LOG_WARN, "component(transform): Failed to initialize callback array, the system is out of memory");
-
-            return false;
-        }
-    }
+    TransformCallbackList* list = &t->cb_list[type];
 
     // If the array is full, double the size
-    if (t->cb_list.size == t->cb_list.count) {
-        TransformCallback* tmp = realloc(t->cb_list.cb, t->cb_list.size * 2 * sizeof(TransformCallback));
+    if (list->size == list->count) {
+        size_t size = list->size ? list->size * 2 : SLOT_DEFAULT_SIZE;
+
+        TransformCallback* tmp = realloc(list->cb, size * sizeof(TransformCallback));
 
         if (!tmp) {
             logmsg(LOG_WARN, "component(transform): Failed to resize callback array, the system is out of memory");
@@ -73,42 +147,86 @@ bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb)
             return false;
         }
 
-        t->cb_list.cb = tmp;
+        list->cb = tmp;
+        list->size = size;
+    }
 
-        // Initialize the new memory so that we can find empty slots correctly
-        memset(&t->cb_list.cb[t->cb_list.size], 0, t->cb_list.size * sizeof(TransformCallback));
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
 
-        t->cb_list.size *= 2;
+    if (list->count++ == 0) {
+        transform_store.listeners[type]++;
     }
 
-    // Add the callback
-    for (size_t i = 0; i < t->cb_list.size; i++) {
-        if (t->cb_list.cb[i].cb == NULL) {
-            t->cb_list.cb[i].cb = cb;
-            t->cb_list.cb[i].type = type;
+    return true;
+}
+
+bool transform_unregcb(Transform* t, TransformSignalType type, transform_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(transform): Attempting to unregister callback (%p)", cb);
+
+    TransformCallbackList* list = &t->cb_list[type];
+
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            // Keep the bucket compact so that dispatch never has to skip holes
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(TransformCallback));
 
-            t->cb_list.count++;
+            if (--list->count == 0) {
+                transform_store.listeners[type]--;
+            }
 
             return true;
         }
     }
 
-    logmsg(LOG_ERR,
-        "component(transform): Failed to register callback for signal['%s'], callback array isn't full, but a free slot was never found",
-        transform_signal_type_str[type]);
+    return false;
+}
+
+bool transform_regcb_batch(TransformSignalType type, transform_batch_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(transform): Attempting to register batch callback for signal['%s']", transform_signal_type_str[type]);
+
+    if (!cb) {
+        logmsg(LOG_WARN, "component(transform): Unable to register NULL batch callback");
 
-    _exit(-1);
+        return false;
+    }
+
+    TransformBatchCallbackList* list = &transform_batch_cb_list[type];
+
+    // If the array is full, double the size
+    if (list->size == list->count) {
+        size_t size = list->size ? list->size * 2 : SLOT_DEFAULT_SIZE;
+
+        TransformBatchCallback* tmp = realloc(list->cb, size * sizeof(TransformBatchCallback));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "component(transform): Failed to resize batch callback array, the system is out of memory");
+
+            return false;
+        }
+
+        list->cb = tmp;
+        list->size = size;
+    }
+
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
+
+    list->count++;
+
+    return true;
 }
 
-bool transform_unregcb_translate(Transform* t, transform_cb_t cb) {
-    logmsg(LOG_DEBUG, "component(transform): Attempting to unregister callback (%p)", cb);
+bool transform_unregcb_batch(TransformSignalType type, transform_batch_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(transform): Attempting to unregister batch callback (%p)", cb);
+
+    TransformBatchCallbackList* list = &transform_batch_cb_list[type];
 
-    for (size_t i = 0; i < t->cb_list.size; i++) {
-        if (t->cb_list.cb[i].cb == cb) {
-            t->cb_list.cb[i].cb = NULL;
-            t->cb_list.cb[i].type = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(TransformBatchCallback));
 
-            t->cb_list.count--;
+            list->count--;
 
             return true;
         }
@@ -117,16 +235,767 @@ bool transform_unregcb_translate(Transform* t, transform_cb_t cb) {
     return false;
 }
 
+bool transform_signal_queue_grow(TransformSignalQueue* q) {
+    size_t size = q->size ? q->size * 2 : SLOT_DEFAULT_SIZE;
+
+    TransformSignalEvent* events = realloc(q->events, size * sizeof(TransformSignalEvent));
+
+    if (!events) {
+        return false;
+    }
+
+    q->events = events;
+
+    Transform** owner = realloc(q->owner, size * sizeof(Transform*));
+
+    if (!owner) {
+        return false;
+    }
+
+    q->owner = owner;
+
+    q->size = size;
+
+    return true;
+}
+
+void transform_signal_queue(Transform* t, TransformSignalType type, TransformSignalArgs args) {
+    TransformSignalQueue* q = &transform_queue[type];
+
+    // Coalesce with the event already queued for this transform, keeping the
+    // original old values
+    if (t->pending[type]) {
+        TransformSignalArgs* queued = &q->events[t->pending[type] - 1].args;
+
+        switch (type) {
+            case TRANSLATE:
+                queued->x = args.x;
+                queued->y = args.y;
+                break;
+            case ROTATE:
+                queued->rotation = args.rotation;
+                break;
+            case SCALE:
+                queued->scale = args.scale;
+                break;
+        }
+
+        return;
+    }
+
+    if (q->count == q->size && !transform_signal_queue_grow(q)) {
+        logmsg(LOG_WARN,
+            "component(transform): Dropped signal['%s'] for entity[%" PRIu16 "], the system is out of memory",
+            transform_signal_type_str[type],
+            t->entity_id);
+
+        return;
+    }
+
+    q->events[q->count].entity_id = t->entity_id;
+    q->events[q->count].args = args;
+    q->owner[q->count] = t;
+
+    t->pending[type] = ++q->count;
+}
+
 void transform_signal(Transform* t, TransformSignalType type, TransformSignalArgs args) {
-    for (size_t i = 0; i < t->cb_list.count; i++) {
-        if (t->cb_list.cb[i].type == type) {
-            t->cb_list.cb[i].cb(args);
+    TransformCallbackList* list = &t->cb_list[type];
+
+    // Most signals have no subscribers at all, so test for that first
+    if ((list->count | transform_batch_cb_list[type].count) == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < list->count; i++) {
+        list->cb[i].cb(t->entity_id, args, list->cb[i].userdata);
+    }
+
+    if (transform_batch_cb_list[type].count > 0) {
+        transform_signal_queue(t, type, args);
+    }
+}
+
+void transform_signal_flush(void) {
+    for (TransformSignalType type = 0; type < TRANSFORM_SIGNAL_TYPE_COUNT; type++) {
+        TransformSignalQueue q = transform_queue[type];
+
+        if (q.count == 0) {
+            continue;
+        }
+
+        transform_queue[type] = transform_queue_back[type];
+
+        // Drop events from destroyed transforms, and detach the rest from
+        // their transforms so that new signals start a new batch
+        size_t live = 0;
+
+        for (size_t i = 0; i < q.count; i++) {
+            if (q.owner[i]) {
+                q.owner[i]->pending[type] = 0;
+
+                q.events[live++] = q.events[i];
+            }
+        }
+
+        TransformBatchCallbackList* list = &transform_batch_cb_list[type];
+
+        for (size_t i = 0; i < list->count && live > 0; i++) {
+            list->cb[i].cb(type, q.events, live, list->cb[i].userdata);
+        }
+
+        q.count = 0;
+
+        transform_queue_back[type] = q;
+    }
+}
+
+// Store management
+
+bool transform_store_grow(void) {
+    size_t size = transform_store.size ? transform_store.size * 2 : SLOT_DEFAULT_SIZE;
+
+    logmsg(LOG_DEBUG, "component(transform): Growing transform store to %zu slots", size);
+
+    // Arrays are resized one at a time. If we run out of memory partway
+    // through, the arrays that were already resized are simply larger than
+    // they need to be, and the store size remains unchanged.
+    float* pos_x = realloc(transform_store.pos_x, size * sizeof(float));
+
+    if (!pos_x) {
+        return false;
+    }
+
+    transform_store.pos_x = pos_x;
+
+    float* pos_y = realloc(transform_store.pos_y, size * sizeof(float));
+
+    if (!pos_y) {
+        return false;
+    }
+
+    transform_store.pos_y = pos_y;
+
+    float* vel_x = realloc(transform_store.vel_x, size * sizeof(float));
+
+    if (!vel_x) {
+        return false;
+    }
+
+    transform_store.vel_x = vel_x;
+
+    float* vel_y = realloc(transform_store.vel_y, size * sizeof(float));
+
+    if (!vel_y) {
+        return false;
+    }
+
+    transform_store.vel_y = vel_y;
+
+    float* prev_x = realloc(transform_store.prev_x, size * sizeof(float));
+
+    if (!prev_x) {
+        return false;
+    }
+
+    transform_store.prev_x = prev_x;
+
+    float* prev_y = realloc(transform_store.prev_y, size * sizeof(float));
+
+    if (!prev_y) {
+        return false;
+    }
+
+    transform_store.prev_y = prev_y;
+
+    float* render_x = realloc(transform_store.render_x, size * sizeof(float));
+
+    if (!render_x) {
+        return false;
+    }
+
+    transform_store.render_x = render_x;
+
+    float* render_y = realloc(transform_store.render_y, size * sizeof(float));
+
+    if (!render_y) {
+        return false;
+    }
+
+    transform_store.render_y = render_y;
+
+    double* rotation = realloc(transform_store.rotation, size * sizeof(double));
+
+    if (!rotation) {
+        return false;
+    }
+
+    transform_store.rotation = rotation;
+
+    double* scale = realloc(transform_store.scale, size * sizeof(double));
+
+    if (!scale) {
+        return false;
+    }
+
+    transform_store.scale = scale;
+
+    TransformMatrix* matrix = realloc(transform_store.matrix, size * sizeof(TransformMatrix));
+
+    if (!matrix) {
+        return false;
+    }
+
+    transform_store.matrix = matrix;
+
+    uint8_t* dirty = realloc(transform_store.dirty, size * sizeof(uint8_t));
+
+    if (!dirty) {
+        return false;
+    }
+
+    transform_store.dirty = dirty;
+
+    Transform** owner = realloc(transform_store.owner, size * sizeof(Transform*));
+
+    if (!owner) {
+        return false;
+    }
+
+    transform_store.owner = owner;
+
+    transform_store.size = size;
+
+    return true;
+}
+
+bool transform_store_check_range(size_t first, size_t count) {
+    if (first > transform_store.count || count > transform_store.count - first) {
+        logmsg(LOG_WARN,
+            "component(transform): Batch range [%zu, %zu) is out of bounds, the store holds %zu transforms",
+            first,
+            first + count,
+            transform_store.count);
+
+        return false;
+    }
+
+    return true;
+}
+
+// Returns a buffer of at least the given size, which is reused by every batch
+// operation. Its contents don't survive the next call.
+void* transform_scratch_get(size_t size) {
+    if (size > transform_store.scratch_size) {
+        void* tmp = realloc(transform_store.scratch, size);
+
+        if (!tmp) {
+            return NULL;
         }
+
+        transform_store.scratch = tmp;
+        transform_store.scratch_size = size;
+    }
+
+    return transform_store.scratch;
+}
+
+// SIMD kernels
+
+void transform_kernel_add_f32_scalar(float* dst, size_t count, float v) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] += v;
+    }
+}
+
+void transform_kernel_addv_f32_scalar(float* dst, const float* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] += src[i];
+    }
+}
+
+void transform_kernel_add_f64_scalar(double* dst, size_t count, double v) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] += v;
+    }
+}
+
+void transform_kernel_lerp_f32_scalar(float* dst, const float* from, const float* to, size_t count, float alpha) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = from[i] + (to[i] - from[i]) * alpha;
+    }
+}
+
+#ifdef RPGNG_SIMD_X86
+void transform_kernel_add_f32_sse2(float* dst, size_t count, float v) {
+    __m128 vv = _mm_set1_ps(v);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), vv));
     }
+
+    transform_kernel_add_f32_scalar(&dst[i], count - i, v);
+}
+
+void transform_kernel_addv_f32_sse2(float* dst, const float* src, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(&dst[i], _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_loadu_ps(&src[i])));
+    }
+
+    transform_kernel_addv_f32_scalar(&dst[i], &src[i], count - i);
+}
+
+void transform_kernel_add_f64_sse2(double* dst, size_t count, double v) {
+    __m128d vv = _mm_set1_pd(v);
+    size_t i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(&dst[i], _mm_add_pd(_mm_loadu_pd(&dst[i]), vv));
+    }
+
+    transform_kernel_add_f64_scalar(&dst[i], count - i, v);
+}
+
+void transform_kernel_lerp_f32_sse2(float* dst, const float* from, const float* to, size_t count, float alpha) {
+    __m128 va = _mm_set1_ps(alpha);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_loadu_ps(&from[i]);
+
+        _mm_storeu_ps(&dst[i], _mm_add_ps(f, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&to[i]), f), va)));
+    }
+
+    transform_kernel_lerp_f32_scalar(&dst[i], &from[i], &to[i], count - i, alpha);
+}
+
+RPGNG_TARGET("avx2")
+void transform_kernel_add_f32_avx2(float* dst, size_t count, float v) {
+    __m256 vv = _mm256_set1_ps(v);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(&dst[i], _mm256_add_ps(_mm256_loadu_ps(&dst[i]), vv));
+    }
+
+    transform_kernel_add_f32_scalar(&dst[i], count - i, v);
+}
+
+RPGNG_TARGET("avx2")
+void transform_kernel_addv_f32_avx2(float* dst, const float* src, size_t count) {
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(&dst[i], _mm256_add_ps(_mm256_loadu_ps(&dst[i]), _mm256_loadu_ps(&src[i])));
+    }
+
+    transform_kernel_addv_f32_scalar(&dst[i], &src[i], count - i);
+}
+
+RPGNG_TARGET("avx2")
+void transform_kernel_add_f64_avx2(double* dst, size_t count, double v) {
+    __m256d vv = _mm256_set1_pd(v);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(&dst[i], _mm256_add_pd(_mm256_loadu_pd(&dst[i]), vv));
+    }
+
+    transform_kernel_add_f64_scalar(&dst[i], count - i, v);
+}
+
+RPGNG_TARGET("avx2")
+void transform_kernel_lerp_f32_avx2(float* dst, const float* from, const float* to, size_t count, float alpha) {
+    __m256 va = _mm256_set1_ps(alpha);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_loadu_ps(&from[i]);
+
+        _mm256_storeu_ps(&dst[i], _mm256_add_ps(f, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&to[i]), f), va)));
+    }
+
+    transform_kernel_lerp_f32_scalar(&dst[i], &from[i], &to[i], count - i, alpha);
+}
+#endif
+
+void transform_kernel_add_f32(float* dst, size_t count, float v) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            transform_kernel_add_f32_avx2(dst, count, v);
+            break;
+        case SIMD_SSE2:
+            transform_kernel_add_f32_sse2(dst, count, v);
+            break;
+#endif
+        default:
+            transform_kernel_add_f32_scalar(dst, count, v);
+    }
+}
+
+void transform_kernel_addv_f32(float* dst, const float* src, size_t count) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            transform_kernel_addv_f32_avx2(dst, src, count);
+            break;
+        case SIMD_SSE2:
+            transform_kernel_addv_f32_sse2(dst, src, count);
+            break;
+#endif
+        default:
+            transform_kernel_addv_f32_scalar(dst, src, count);
+    }
+}
+
+void transform_kernel_add_f64(double* dst, size_t count, double v) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            transform_kernel_add_f64_avx2(dst, count, v);
+            break;
+        case SIMD_SSE2:
+            transform_kernel_add_f64_sse2(dst, count, v);
+            break;
+#endif
+        default:
+            transform_kernel_add_f64_scalar(dst, count, v);
+    }
+}
+
+void transform_kernel_lerp_f32(float* dst, const float* from, const float* to, size_t count, float alpha) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            transform_kernel_lerp_f32_avx2(dst, from, to, count, alpha);
+            break;
+        case SIMD_SSE2:
+            transform_kernel_lerp_f32_sse2(dst, from, to, count, alpha);
+            break;
+#endif
+        default:
+            transform_kernel_lerp_f32_scalar(dst, from, to, count, alpha);
+    }
+}
+
+// Cephes-style single precision sine and cosine, valid on [-pi/4, pi/4]. The
+// scalar and SIMD kernels evaluate the same polynomials in the same order, so
+// matrices don't depend on which kernel computed them.
+#define SINCOS_S1 -1.6666654611e-1f
+#define SINCOS_S2 8.3321608736e-3f
+#define SINCOS_S3 -1.9515295891e-4f
+#define SINCOS_C1 4.166664568298827e-2f
+#define SINCOS_C2 -1.388731625493765e-3f
+#define SINCOS_C3 2.443315711809948e-5f
+
+#define DEG_TO_RAD 0.017453292519943295
+
+// Computes the linear part of a batch of matrices. Each angle has already been
+// reduced to r in [-pi/4, pi/4] plus a quadrant q, such that the original
+// angle is r + q * pi/2.
+//
+// Outputs a = scale * cos(angle) and b = scale * sin(angle).
+void transform_kernel_sincos_scalar(const float* r, const int32_t* q, const float* scale, float* a, float* b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float z = r[i] * r[i];
+
+        float sin_r = ((SINCOS_S3 * z + SINCOS_S2) * z + SINCOS_S1) * z * r[i] + r[i];
+        float cos_r = ((SINCOS_C3 * z + SINCOS_C2) * z + SINCOS_C1) * z * z - 0.5f * z + 1.0f;
+
+        // Rotate by the quadrant
+        float sin_a = (q[i] & 1) ? cos_r : sin_r;
+        float cos_a = (q[i] & 1) ? sin_r : cos_r;
+
+        if (q[i] & 2) {
+            sin_a = -sin_a;
+        }
+
+        if ((q[i] + 1) & 2) {
+            cos_a = -cos_a;
+        }
+
+        a[i] = scale[i] * cos_a;
+        b[i] = scale[i] * sin_a;
+    }
+}
+
+#ifdef RPGNG_SIMD_X86
+void transform_kernel_sincos_sse2(const float* r, const int32_t* q, const float* scale, float* a, float* b, size_t count) {
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&r[i]);
+        __m128i qi = _mm_loadu_si128((const __m128i*)&q[i]);
+        __m128 z = _mm_mul_ps(x, x);
+
+        // Evaluated in the same order as the scalar kernel
+        __m128 sin_p = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_S3), z), _mm_set1_ps(SINCOS_S2)), z), _mm_set1_ps(SINCOS_S1));
+        __m128 sin_r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sin_p, z), x), x);
+
+        __m128 cos_p = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_C3), z), _mm_set1_ps(SINCOS_C2)), z), _mm_set1_ps(SINCOS_C1));
+        __m128 cos_r = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cos_p, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+        // Swap sine and cosine in odd quadrants, then apply each quadrant's signs
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, one), one));
+        __m128 sin_a = _mm_or_ps(_mm_and_ps(swap, cos_r), _mm_andnot_ps(swap, sin_r));
+        __m128 cos_a = _mm_or_ps(_mm_and_ps(swap, sin_r), _mm_andnot_ps(swap, cos_r));
+
+        sin_a = _mm_xor_ps(sin_a, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qi, two), 30)));
+        cos_a = _mm_xor_ps(cos_a, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qi, one), two), 30)));
+
+        __m128 s = _mm_loadu_ps(&scale[i]);
+
+        _mm_storeu_ps(&a[i], _mm_mul_ps(s, cos_a));
+        _mm_storeu_ps(&b[i], _mm_mul_ps(s, sin_a));
+    }
+
+    transform_kernel_sincos_scalar(&r[i], &q[i], &scale[i], &a[i], &b[i], count - i);
+}
+
+RPGNG_TARGET("avx2")
+void transform_kernel_sincos_avx2(const float* r, const int32_t* q, const float* scale, float* a, float* b, size_t count) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    size_t i = 0;
+
+    // FMA isn't used here, because contracting the polynomials would make the
+    // results differ from the other kernels
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(&r[i]);
+        __m256i qi = _mm256_loadu_si256((const __m256i*)&q[i]);
+        __m256 z = _mm256_mul_ps(x, x);
+
+        __m256 sin_p = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SINCOS_S3), z), _mm256_set1_ps(SINCOS_S2)), z), _mm256_set1_ps(SINCOS_S1));
+        __m256 sin_r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sin_p, z), x), x);
+
+        __m256 cos_p = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SINCOS_C3), z), _mm256_set1_ps(SINCOS_C2)), z), _mm256_set1_ps(SINCOS_C1));
+        __m256 cos_r = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cos_p, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+
+        // Swap sine and cosine in odd quadrants, then apply each quadrant's signs
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(qi, one), one));
+        __m256 sin_a = _mm256_blendv_ps(sin_r, cos_r, swap);
+        __m256 cos_a = _mm256_blendv_ps(cos_r, sin_r, swap);
+
+        sin_a = _mm256_xor_ps(sin_a, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(qi, two), 30)));
+        cos_a = _mm256_xor_ps(cos_a, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(qi, one), two), 30)));
+
+        __m256 s = _mm256_loadu_ps(&scale[i]);
+
+        _mm256_storeu_ps(&a[i], _mm256_mul_ps(s, cos_a));
+        _mm256_storeu_ps(&b[i], _mm256_mul_ps(s, sin_a));
+    }
+
+    transform_kernel_sincos_scalar(&r[i], &q[i], &scale[i], &a[i], &b[i], count - i);
+}
+#endif
+
+void transform_kernel_sincos(const float* r, const int32_t* q, const float* scale, float* a, float* b, size_t count) {
+    switch (simd_level()) {
+#ifdef RPGNG_SIMD_X86
+        case SIMD_AVX2:
+            transform_kernel_sincos_avx2(r, q, scale, a, b, count);
+            break;
+        case SIMD_SSE2:
+            transform_kernel_sincos_sse2(r, q, scale, a, b, count);
+            break;
+#endif
+        default:
+            transform_kernel_sincos_scalar(r, q, scale, a, b, count);
+    }
+}
+
+// Matrices
+
+// Splits an angle in degrees into a remainder in [-pi/4, pi/4] radians and a
+// quadrant. This is done in double precision, so that large accumulated
+// rotations don't lose accuracy.
+void transform_angle_reduce(double degrees, float* r, int32_t* q) {
+    double quadrant = nearbyint(degrees / 90.0);
+
+    *r = (float)((degrees - quadrant * 90.0) * DEG_TO_RAD);
+    *q = (int32_t)fmod(quadrant, 4.0) & 3;
+}
+
+void transform_matrix_compute(size_t index) {
+    TransformMatrix* m = &transform_store.matrix[index];
+
+    if (transform_store.dirty[index] & DIRTY_LINEAR) {
+        float r;
+        int32_t q;
+        float scale = (float)transform_store.scale[index];
+
+        transform_angle_reduce(transform_store.rotation[index], &r, &q);
+        transform_kernel_sincos_scalar(&r, &q, &scale, &m->a, &m->b, 1);
+
+        m->c = -m->b;
+        m->d = m->a;
+    }
+
+    m->tx = transform_store.pos_x[index];
+    m->ty = transform_store.pos_y[index];
+
+    transform_store.dirty[index] = 0;
+}
+
+// The number of matrices whose trig is computed together
+#define MATRIX_BATCH_SIZE 64
+
+typedef struct TransformMatrixBatch {
+    size_t count;
+
+    size_t index[MATRIX_BATCH_SIZE];
+    float r[MATRIX_BATCH_SIZE];
+    int32_t q[MATRIX_BATCH_SIZE];
+    float scale[MATRIX_BATCH_SIZE];
+    float a[MATRIX_BATCH_SIZE];
+    float b[MATRIX_BATCH_SIZE];
+} TransformMatrixBatch;
+
+void transform_matrix_batch_flush(TransformMatrixBatch* batch) {
+    transform_kernel_sincos(batch->r, batch->q, batch->scale, batch->a, batch->b, batch->count);
+
+    for (size_t i = 0; i < batch->count; i++) {
+        TransformMatrix* m = &transform_store.matrix[batch->index[i]];
+
+        m->a = batch->a[i];
+        m->b = batch->b[i];
+        m->c = -batch->b[i];
+        m->d = batch->a[i];
+    }
+
+    batch->count = 0;
+}
+
+void transform_matrix_update(void) {
+    TransformMatrixBatch batch;
+
+    batch.count = 0;
+
+    for (size_t i = 0; i < transform_store.count; i++) {
+        // Skip runs of clean transforms 8 at a time
+        if ((i & 7) == 0 && i + 8 <= transform_store.count) {
+            uint64_t flags;
+
+            memcpy(&flags, &transform_store.dirty[i], sizeof(flags));
+
+            if (flags == 0) {
+                i += 7;
+
+                continue;
+            }
+        }
+
+        uint8_t dirty = transform_store.dirty[i];
+
+        if (dirty == 0) {
+            continue;
+        }
+
+        transform_store.matrix[i].tx = transform_store.pos_x[i];
+        transform_store.matrix[i].ty = transform_store.pos_y[i];
+        transform_store.dirty[i] = 0;
+
+        if (!(dirty & DIRTY_LINEAR)) {
+            continue;
+        }
+
+        batch.index[batch.count] = i;
+        batch.scale[batch.count] = (float)transform_store.scale[i];
+
+        transform_angle_reduce(transform_store.rotation[i], &batch.r[batch.count], &batch.q[batch.count]);
+
+        if (++batch.count == MATRIX_BATCH_SIZE) {
+            transform_matrix_batch_flush(&batch);
+        }
+    }
+
+    if (batch.count > 0) {
+        transform_matrix_batch_flush(&batch);
+    }
+}
+
+TransformMatrix transform_get_matrix(Transform* t) {
+    if (transform_store.dirty[t->index]) {
+        transform_matrix_compute(t->index);
+    }
+
+    return transform_store.matrix[t->index];
+}
+
+bool transform_get_matrix_inverse(Transform* t, TransformMatrix* inverse) {
+    TransformMatrix m = transform_get_matrix(t);
+
+    float det = m.a * m.d - m.b * m.c;
+
+    if (det == 0) {
+        return false;
+    }
+
+    inverse->a = m.d / det;
+    inverse->b = -m.b / det;
+    inverse->c = -m.c / det;
+    inverse->d = m.a / det;
+    inverse->tx = -(inverse->a * m.tx + inverse->c * m.ty);
+    inverse->ty = -(inverse->b * m.tx + inverse->d * m.ty);
+
+    return true;
 }
 
 // Component operations
 
+void transform_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(transform): Cleaning up transform store");
+
+    if (transform_store.count > 0) {
+        logmsg(LOG_WARN, "component(transform): Cleaning up with %zu transforms still alive", transform_store.count);
+    }
+
+    for (size_t i = 0; i < transform_store.count; i++) {
+        for (TransformSignalType type = 0; type < TRANSFORM_SIGNAL_TYPE_COUNT; type++) {
+            free(transform_store.owner[i]->cb_list[type].cb);
+        }
+
+        free(transform_store.owner[i]);
+    }
+
+    free(transform_store.pos_x);
+    free(transform_store.pos_y);
+    free(transform_store.vel_x);
+    free(transform_store.vel_y);
+    free(transform_store.prev_x);
+    free(transform_store.prev_y);
+    free(transform_store.render_x);
+    free(transform_store.render_y);
+    free(transform_store.rotation);
+    free(transform_store.scale);
+    free(transform_store.matrix);
+    free(transform_store.dirty);
+    free(transform_store.owner);
+    free(transform_store.scratch);
+
+    memset(&transform_store, 0, sizeof(transform_store));
+
+    for (TransformSignalType type = 0; type < TRANSFORM_SIGNAL_TYPE_COUNT; type++) {
+        free(transform_batch_cb_list[type].cb);
+        free(transform_queue[type].events);
+        free(transform_queue[type].owner);
+        free(transform_queue_back[type].events);
+        free(transform_queue_back[type].owner);
+    }
+
+    memset(transform_batch_cb_list, 0, sizeof(transform_batch_cb_list));
+    memset(transform_queue, 0, sizeof(transform_queue));
+    memset(transform_queue_back, 0, sizeof(transform_queue_back));
+}
+
 bool transform_create(uint16_t entity_id) {
     logmsg(LOG_DEBUG, "component(transform): Attempting to create new transform for entity[%" PRIu16 "]", entity_id);
 
@@ -144,6 +1013,12 @@ bool transform_create(uint16_t entity_id) {
         return false;
     }
 
+    if (transform_store.count == transform_store.size && !transform_store_grow()) {
+        logmsg(LOG_WARN, "component(transform): Failed to grow transform store, the system is out of memory");
+
+        return false;
+    }
+
     Transform* t = calloc(1, sizeof(Transform));
 
     if (!t) {
@@ -160,6 +1035,29 @@ bool transform_create(uint16_t entity_id) {
         return false;
     }
 
+    t->entity_id = e->id;
+    t->index = transform_store.count++;
+
+    transform_store.pos_x[t->index] = 0;
+    transform_store.pos_y[t->index] = 0;
+    transform_store.vel_x[t->index] = 0;
+    transform_store.vel_y[t->index] = 0;
+
+    // A new transform starts where it is, rather than being drawn sliding in
+    // from wherever its slot last was
+    transform_store.prev_x[t->index] = transform_store.pos_x[t->index];
+    transform_store.prev_y[t->index] = transform_store.pos_y[t->index];
+    transform_store.render_x[t->index] = transform_store.pos_x[t->index];
+    transform_store.render_y[t->index] = transform_store.pos_y[t->index];
+    transform_store.rotation[t->index] = 0;
+    transform_store.scale[t->index] = 1;
+    transform_store.dirty[t->index] = DIRTY_POSITION | DIRTY_LINEAR;
+    transform_store.owner[t->index] = t;
+
+    // The index logs its own failures, and a transform missing from it is
+    // still usable
+    spatial_insert(t->entity_id, 0, 0);
+
     return true;
 }
 
@@ -182,8 +1080,47 @@ bool transform_destroy(uint16_t entity_id) {
         return false;
     }
 
+    // Move the last slot into the hole left by this transform
+    size_t last = --transform_store.count;
+
+    if (t->index != last) {
+        transform_store.pos_x[t->index] = transform_store.pos_x[last];
+        transform_store.pos_y[t->index] = transform_store.pos_y[last];
+        transform_store.vel_x[t->index] = transform_store.vel_x[last];
+        transform_store.vel_y[t->index] = transform_store.vel_y[last];
+        transform_store.prev_x[t->index] = transform_store.prev_x[last];
+        transform_store.prev_y[t->index] = transform_store.prev_y[last];
+        transform_store.render_x[t->index] = transform_store.render_x[last];
+        transform_store.render_y[t->index] = transform_store.render_y[last];
+        transform_store.rotation[t->index] = transform_store.rotation[last];
+        transform_store.scale[t->index] = transform_store.scale[last];
+        transform_store.matrix[t->index] = transform_store.matrix[last];
+        transform_store.dirty[t->index] = transform_store.dirty[last];
+        transform_store.owner[t->index] = transform_store.owner[last];
+
+        transform_store.owner[t->index]->index = t->index;
+    }
+
+    for (TransformSignalType type = 0; type < TRANSFORM_SIGNAL_TYPE_COUNT; type++) {
+        if (t->cb_list[type].count > 0) {
+            transform_store.listeners[type]--;
+        }
+
+        free(t->cb_list[type].cb);
+
+        // Queued signals outlive the transform, but are never delivered
+        if (t->pending[type]) {
+            transform_queue[type].owner[t->pending[type] - 1] = NULL;
+        }
+    }
+
     free(t);
 
+    spatial_remove(entity_id);
+    collision_remove(entity_id);
+    trigger_forget(entity_id);
+    render_transform_forget(entity_id);
+
     if (htable_remove(e->components, (uint8_t*)&transform_component_type, sizeof(transform_component_type)) < 0) {
         logmsg(LOG_ERR,
             "component(transform): Failed to remove transform associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
@@ -196,114 +1133,278 @@ bool transform_destroy(uint16_t entity_id) {
     return true;
 }
 
-void transform_translate(Transform* t, int x, int y) {
-    int x_old = t->pos_x;
-    int y_old = t->pos_y;
+void transform_translate(Transform* t, float x, float y) {
+    float x_old = transform_store.pos_x[t->index];
+    float y_old = transform_store.pos_y[t->index];
 
-    t->pos_x += x;
-    t->pos_y += y;
+    transform_store.pos_x[t->index] += x;
+    transform_store.pos_y[t->index] += y;
+    transform_store.dirty[t->index] |= DIRTY_POSITION;
 
-    TransformSignalArgs args = {.x_old = x_old, .y_old = y_old, .x = t->pos_x, .y = t->pos_y};
+    TransformSignalArgs args = {.x_old = x_old, .y_old = y_old, .x = transform_store.pos_x[t->index], .y = transform_store.pos_y[t->index]};
 
     transform_signal(t, TRANSLATE, args);
 }
 
-void transform_translate_set(Transform* t, int x, int y) {
-    int x_old = t->pos_x;
-    int y_old = t->pos_y;
+void transform_translate_set(Transform* t, float x, float y) {
+    float x_old = transform_store.pos_x[t->index];
+    float y_old = transform_store.pos_y[t->index];
+
+    transform_store.pos_x[t->index] = x;
+    transform_store.pos_y[t->index] = y;
+    transform_store.dirty[t->index] |= DIRTY_POSITION;
 
-    t->pos_x = x;
-    t->pos_y = y;
+    // Absolute moves are teleports, so the entity is drawn at its new position
+    // right away, instead of being interpolated across the distance
+    transform_store.prev_x[t->index] = x;
+    transform_store.prev_y[t->index] = y;
+    transform_store.render_x[t->index] = x;
+    transform_store.render_y[t->index] = y;
 
-    TransformSignalArgs args = {.x_old = x_old, .y_old = y_old, .x = t->pos_x, .y = t->pos_y};
+    TransformSignalArgs args = {.x_old = x_old, .y_old = y_old, .x = x, .y = y};
 
     transform_signal(t, TRANSLATE, args);
 }
 
 void transform_translate_reset(Transform* t) {
-    int x_old = t->pos_x;
-    int y_old = t->pos_y;
+    transform_translate_set(t, 0, 0);
+}
 
-    t->pos_x = 0;
-    t->pos_y = 0;
+bool transform_translate_batch(size_t first, size_t count, float x, float y) {
+    if (!transform_store_check_range(first, count)) {
+        return false;
+    }
 
-    TransformSignalArgs args = {.x_old = x_old, .y_old = y_old, .x = t->pos_x, .y = t->pos_y};
+    bool signal = transform_store.listeners[TRANSLATE] > 0 || transform_batch_cb_list[TRANSLATE].count > 0;
 
-    transform_signal(t, TRANSLATE, args);
+    // Keep the old positions around for the signals, rather than subtracting
+    // the translation back out and picking up rounding error
+    float* old = NULL;
+
+    if (signal) {
+        old = transform_scratch_get(2 * count * sizeof(float));
+
+        if (!old) {
+            logmsg(LOG_WARN, "component(transform): Failed to translate batch, the system is out of memory");
+
+            return false;
+        }
+
+        memcpy(old, &transform_store.pos_x[first], count * sizeof(float));
+        memcpy(&old[count], &transform_store.pos_y[first], count * sizeof(float));
+    }
+
+    transform_kernel_add_f32(&transform_store.pos_x[first], count, x);
+    transform_kernel_add_f32(&transform_store.pos_y[first], count, y);
+
+    for (size_t i = first; i < first + count; i++) {
+        transform_store.dirty[i] |= DIRTY_POSITION;
+    }
+
+    if (!signal) {
+        return true;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        TransformSignalArgs args = {
+            .x_old = old[i], .y_old = old[count + i], .x = transform_store.pos_x[first + i], .y = transform_store.pos_y[first + i]};
+
+        transform_signal(transform_store.owner[first + i], TRANSLATE, args);
+    }
+
+    return true;
 }
 
-void transform_rotate(Transform* t, double rotation) {
-    double rotation_old = t->rotation;
+void transform_velocity_set(Transform* t, float x, float y) {
+    transform_store.vel_x[t->index] = x;
+    transform_store.vel_y[t->index] = y;
+}
 
-    t->rotation += rotation;
+void transform_velocity_apply(void) {
+    size_t count = transform_store.count;
 
-    TransformSignalArgs args = {.rotation_old = rotation_old, .rotation = t->rotation};
+    bool signal = transform_store.listeners[TRANSLATE] > 0 || transform_batch_cb_list[TRANSLATE].count > 0;
 
-    transform_signal(t, ROTATE, args);
+    float* old = NULL;
+
+    if (signal) {
+        old = transform_scratch_get(2 * count * sizeof(float));
+
+        if (!old) {
+            logmsg(LOG_WARN, "component(transform): Failed to apply velocities, the system is out of memory");
+
+            return;
+        }
+
+        memcpy(old, transform_store.pos_x, count * sizeof(float));
+        memcpy(&old[count], transform_store.pos_y, count * sizeof(float));
+    }
+
+    transform_kernel_addv_f32(transform_store.pos_x, transform_store.vel_x, count);
+    transform_kernel_addv_f32(transform_store.pos_y, transform_store.vel_y, count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (transform_store.vel_x[i] != 0 || transform_store.vel_y[i] != 0) {
+            transform_store.dirty[i] |= DIRTY_POSITION;
+        }
+    }
+
+    if (!signal) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        // Stationary transforms didn't move, so they don't signal
+        if (transform_store.vel_x[i] != 0 || transform_store.vel_y[i] != 0) {
+            TransformSignalArgs args = {.x_old = old[i], .y_old = old[count + i], .x = transform_store.pos_x[i], .y = transform_store.pos_y[i]};
+
+            transform_signal(transform_store.owner[i], TRANSLATE, args);
+        }
+    }
 }
 
-void transform_rotate_set(Transform* t, double rotation) {
-    double rotation_old = t->rotation;
+void transform_snapshot(void) {
+    memcpy(transform_store.prev_x, transform_store.pos_x, transform_store.count * sizeof(float));
+    memcpy(transform_store.prev_y, transform_store.pos_y, transform_store.count * sizeof(float));
+}
 
-    t->rotation = rotation;
+void transform_interpolate(float alpha) {
+    transform_kernel_lerp_f32(transform_store.render_x, transform_store.prev_x, transform_store.pos_x, transform_store.count, alpha);
+    transform_kernel_lerp_f32(transform_store.render_y, transform_store.prev_y, transform_store.pos_y, transform_store.count, alpha);
+}
 
-    TransformSignalArgs args = {.rotation_old = rotation_old, .rotation = t->rotation};
+void transform_rotate(Transform* t, double rotation) {
+    double rotation_old = transform_store.rotation[t->index];
+
+    transform_store.rotation[t->index] += rotation;
+    transform_store.dirty[t->index] |= DIRTY_LINEAR;
+
+    TransformSignalArgs args = {.rotation_old = rotation_old, .rotation = transform_store.rotation[t->index]};
 
     transform_signal(t, ROTATE, args);
 }
 
-void transform_rotate_reset(Transform* t) {
-    double rotation_old = t->rotation;
+void transform_rotate_set(Transform* t, double rotation) {
+    double rotation_old = transform_store.rotation[t->index];
 
-    t->rotation = 0;
+    transform_store.rotation[t->index] = rotation;
+    transform_store.dirty[t->index] |= DIRTY_LINEAR;
 
-    TransformSignalArgs args = {.rotation_old = rotation_old, .rotation = t->rotation};
+    TransformSignalArgs args = {.rotation_old = rotation_old, .rotation = rotation};
 
     transform_signal(t, ROTATE, args);
 }
 
+void transform_rotate_reset(Transform* t) {
+    transform_rotate_set(t, 0);
+}
+
 void transform_scale(Transform* t, double scale) {
-    double scale_old = t->scale;
+    double scale_old = transform_store.scale[t->index];
 
-    t->scale += scale;
+    transform_store.scale[t->index] += scale;
+    transform_store.dirty[t->index] |= DIRTY_LINEAR;
 
-    TransformSignalArgs args = {.scale_old = scale_old, .scale = t->scale};
+    TransformSignalArgs args = {.scale_old = scale_old, .scale = transform_store.scale[t->index]};
 
     transform_signal(t, SCALE, args);
 }
 
 void transform_scale_set(Transform* t, double scale) {
-    double scale_old = t->scale;
+    double scale_old = transform_store.scale[t->index];
 
-    t->scale = scale;
+    transform_store.scale[t->index] = scale;
+    transform_store.dirty[t->index] |= DIRTY_LINEAR;
 
-    TransformSignalArgs args = {.scale_old = scale_old, .scale = t->scale};
+    TransformSignalArgs args = {.scale_old = scale_old, .scale = scale};
 
     transform_signal(t, SCALE, args);
 }
 
 void transform_scale_reset(Transform* t) {
-    double scale_old = t->scale;
+    transform_scale_set(t, 1);
+}
 
-    t->scale = 0;
+bool transform_scale_batch(size_t first, size_t count, double scale) {
+    if (!transform_store_check_range(first, count)) {
+        return false;
+    }
 
-    TransformSignalArgs args = {.scale_old = scale_old, .scale = t->scale};
+    bool signal = transform_store.listeners[SCALE] > 0 || transform_batch_cb_list[SCALE].count > 0;
 
-    transform_signal(t, SCALE, args);
+    double* old = NULL;
+
+    if (signal) {
+        old = transform_scratch_get(count * sizeof(double));
+
+        if (!old) {
+            logmsg(LOG_WARN, "component(transform): Failed to scale batch, the system is out of memory");
+
+            return false;
+        }
+
+        memcpy(old, &transform_store.scale[first], count * sizeof(double));
+    }
+
+    transform_kernel_add_f64(&transform_store.scale[first], count, scale);
+
+    for (size_t i = first; i < first + count; i++) {
+        transform_store.dirty[i] |= DIRTY_LINEAR;
+    }
+
+    if (!signal) {
+        return true;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        TransformSignalArgs args = {.scale_old = old[i], .scale = transform_store.scale[first + i]};
+
+        transform_signal(transform_store.owner[first + i], SCALE, args);
+    }
+
+    return true;
 }
 
-int transform_get_pos_x(Transform* t) {
-    return t->pos_x;
+float transform_get_pos_x(Transform* t) {
+    return transform_store.pos_x[t->index];
 }
 
-int transform_get_pos_y(Transform* t) {
-    return t->pos_y;
+float transform_get_pos_y(Transform* t) {
+    return transform_store.pos_y[t->index];
+}
+
+float transform_get_vel_x(Transform* t) {
+    return transform_store.vel_x[t->index];
+}
+
+float transform_get_vel_y(Transform* t) {
+    return transform_store.vel_y[t->index];
+}
+
+float transform_get_render_x(Transform* t) {
+    return transform_store.render_x[t->index];
+}
+
+float transform_get_render_y(Transform* t) {
+    return transform_store.render_y[t->index];
 }
 
 double transform_get_rotation(Transform* t) {
-    return t->rotation;
+    return transform_store.rotation[t->index];
 }
 
 double transform_get_scale(Transform* t) {
-    return t->scale;
+    return transform_store.scale[t->index];
+}
+
+size_t transform_get_index(Transform* t) {
+    return t->index;
+}
+
+uint16_t transform_get_entity(Transform* t) {
+    return t->entity_id;
+}
+
+size_t transform_count(void) {
+    return transform_store.count;
 }
@@ -6,6 +6,8 @@
 #define RPGNG_TRANSFORM
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct Transform Transform;
 
@@ -15,13 +17,15 @@ typedef enum TransformSignalType {
     SCALE
 } TransformSignalType;
 
+#define TRANSFORM_SIGNAL_TYPE_COUNT (SCALE + 1)
+
 typedef union TransformSignalArgs {
     // Translate
     struct {
-        int x_old;
-        int y_old;
-        int x;
-        int y;
+        float x_old;
+        float y_old;
+        float x;
+        float y;
     };
     // Rotate
     struct {
@@ -35,16 +39,27 @@ typedef union TransformSignalArgs {
     };
 } TransformSignalArgs;
 
+// A 2D affine matrix mapping a point (x, y) in an entity's local space to
+// (a * x + c * y + tx, b * x + d * y + ty) in world space.
+typedef struct TransformMatrix {
+    float a;
+    float b;
+    float c;
+    float d;
+    float tx;
+    float ty;
+} TransformMatrix;
+
 // Strings representing the above signal types. Use the above enum values as indexes.
 extern const char* transform_signal_type_str[];
 
 // Transform cock and ball torture
-typedef void (*transform_cb_t)(TransformSignalArgs);
+typedef void (*transform_cb_t)(uint16_t entity_id, TransformSignalArgs args, void* userdata);
 
 typedef struct TransformCallback {
-    TransformSignalType type;
-
     transform_cb_t cb;
+
+    void* userdata;
 } TransformCallback;
 
 typedef struct TransformCallbackList {
@@ -54,22 +69,79 @@ typedef struct TransformCallbackList {
     TransformCallback* cb;
 } TransformCallbackList;
 
+// A deferred signal, delivered to batch callbacks by transform_signal_flush().
+//
+// Signals of the same type from the same entity are coalesced, so the old
+// values are those from before the first signal since the last flush, and the
+// new values are those from the most recent signal.
+typedef struct TransformSignalEvent {
+    uint16_t entity_id;
+
+    TransformSignalArgs args;
+} TransformSignalEvent;
+
+typedef void (*transform_batch_cb_t)(TransformSignalType type, const TransformSignalEvent* events, size_t count, void* userdata);
+
+typedef struct TransformBatchCallback {
+    transform_batch_cb_t cb;
+
+    void* userdata;
+} TransformBatchCallback;
+
+typedef struct TransformBatchCallbackList {
+    size_t size;
+    size_t count;
+
+    TransformBatchCallback* cb;
+} TransformBatchCallbackList;
+
 /**
  * Registers a callback of the given type.
  *
  * @param type The signal type. Only signals of this type will trigger a
  * callback.
+ * @param userdata A pointer which is passed back to the callback as-is.
+ */
+bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb, void* userdata);
+
+/**
+ * Removes the given callback. Signals of the given type will no longer trigger
+ * a callback to the given function with the given userdata.
+ *
+ * @return Returns true on success. Returns false if the given callback was not
+ * found.
+ */
+bool transform_unregcb(Transform* t, TransformSignalType type, transform_cb_t cb, void* userdata);
+
+/**
+ * Registers a batch callback of the given type.
+ *
+ * Unlike callbacks registered with transform_regcb(), batch callbacks are
+ * registered for every transform, and are not called when a signal is emitted.
+ * Signals are instead queued, and delivered to batch callbacks all at once by
+ * transform_signal_flush(). Signals are only queued while at least one batch
+ * callback of their type is registered.
+ *
+ * @param type The signal type. Only signals of this type will be delivered.
+ * @param userdata A pointer which is passed back to the callback as-is.
  */
-bool transform_regcb(Transform* t, TransformSignalType type, transform_cb_t cb);
+bool transform_regcb_batch(TransformSignalType type, transform_batch_cb_t cb, void* userdata);
 
 /**
- * Removes the given callback. Signals will no longer trigger a callback to the
- * given function.
+ * Removes the given batch callback.
  *
  * @return Returns true on success. Returns false if the given callback was not
  * found.
  */
-bool transform_unregcb(Transform* t, transform_cb_t cb);
+bool transform_unregcb_batch(TransformSignalType type, transform_batch_cb_t cb, void* userdata);
+
+/**
+ * Delivers all queued signals to the registered batch callbacks, one batch per
+ * signal type. This should be called once per frame.
+ *
+ * Signals emitted by batch callbacks are queued for the next flush.
+ */
+void transform_signal_flush(void);
 
 /**
  * Frees all resources associated with the Transform component system.
@@ -79,7 +151,8 @@ void transform_cleanup(void);
 /**
  * Associates a Transform component with the given entity.
  *
- * All transform fields are initialized to 0.
+ * Position, velocity, and rotation are initialized to 0, and scale is
+ * initialized to 1.
  *
  * @return On success, returns true. On failure, returns false.
  */
@@ -93,18 +166,65 @@ bool transform_destroy(uint16_t entity_id);
 /**
  * Translates an entity by the given amounts.
  */
-void transform_translate(Transform* t, int x, int y);
+void transform_translate(Transform* t, float x, float y);
 
 /**
  * Sets the transform position to the given values.
+ *
+ * Unlike relative moves, this isn't interpolated: the previous and render
+ * positions are set too, so the entity is drawn at its new position from the
+ * next frame on, rather than sliding there over a tick.
  */
-void transform_translate_set(Transform* t, int x, int y);
+void transform_translate_set(Transform* t, float x, float y);
 
 /**
- * Resets the position of an entity to 0,0.
+ * Resets the position of an entity to 0,0, without interpolating.
  */
 void transform_translate_reset(Transform* t);
 
+/**
+ * Translates a range of transforms by the given amounts.
+ *
+ * Transforms are stored densely, and can be addressed by their index in the
+ * transform store (see transform_get_index()). Indexes are stable until a
+ * transform is destroyed, at which point the last transform in the store is
+ * moved into the destroyed transform's slot.
+ *
+ * @param first The index of the first transform to translate.
+ * @param count The number of transforms to translate.
+ *
+ * @return True on success. False if the given range is out of bounds.
+ */
+bool transform_translate_batch(size_t first, size_t count, float x, float y);
+
+/**
+ * Sets the velocity of an entity, in pixels per call to
+ * transform_velocity_apply(). The simulation applies velocities once per tick.
+ */
+void transform_velocity_set(Transform* t, float x, float y);
+
+/**
+ * Translates every transform by its velocity.
+ *
+ * Transforms with a velocity of 0 do not emit a translate signal.
+ */
+void transform_velocity_apply(void);
+
+/**
+ * Records the current position of every transform as its previous position.
+ * The simulation calls this at the start of every tick.
+ */
+void transform_snapshot(void);
+
+/**
+ * Computes the render position of every transform, by interpolating between
+ * its previous and current positions.
+ *
+ * @param alpha How far between the previous tick and the current tick the
+ * rendered frame falls, between 0 and 1.
+ */
+void transform_interpolate(float alpha);
+
 /**
  * Rotates an entity by the given amount in degrees.
  */
@@ -131,19 +251,39 @@ void transform_scale(Transform* t, double scale);
 void transform_scale_set(Transform* t, double scale);
 
 /**
- * Resets the scale of an entity.
+ * Resets the scale of an entity to 1.
  */
 void transform_scale_reset(Transform* t);
 
+/**
+ * Scales a range of transforms by the given amount.
+ *
+ * @param first The index of the first transform to scale.
+ * @param count The number of transforms to scale.
+ *
+ * @return True on success. False if the given range is out of bounds.
+ */
+bool transform_scale_batch(size_t first, size_t count, double scale);
+
 /**
  * Gets the x position of an entity.
  */
-int transform_get_pos_x(Transform* t);
+float transform_get_pos_x(Transform* t);
 
 /**
  * Gets the y position of an entity.
  */
-int transform_get_pos_y(Transform* t);
+float transform_get_pos_y(Transform* t);
+
+/**
+ * Gets the x position at which an entity should be rendered this frame.
+ */
+float transform_get_render_x(Transform* t);
+
+/**
+ * Gets the y position at which an entity should be rendered this frame.
+ */
+float transform_get_render_y(Transform* t);
 
 /**
  * Gets the rotation of an entity.
@@ -155,4 +295,55 @@ double transform_get_rotation(Transform* t);
  */
 double transform_get_scale(Transform* t);
 
+/**
+ * Gets the x velocity of an entity.
+ */
+float transform_get_vel_x(Transform* t);
+
+/**
+ * Gets the y velocity of an entity.
+ */
+float transform_get_vel_y(Transform* t);
+
+/**
+ * Gets the local-to-world matrix of an entity.
+ *
+ * Matrices are cached, and only recomputed after the position, rotation, or
+ * scale of the entity changes. If the cached matrix is stale, it's recomputed
+ * before returning.
+ */
+TransformMatrix transform_get_matrix(Transform* t);
+
+/**
+ * Gets the world-to-local matrix of an entity.
+ *
+ * @param[out] inverse The inverted matrix.
+ *
+ * @return True on success. False if the matrix isn't invertible, which happens
+ * when the entity's scale is 0.
+ */
+bool transform_get_matrix_inverse(Transform* t, TransformMatrix* inverse);
+
+/**
+ * Recomputes every stale matrix in one pass. This should be called once per
+ * frame, after simulation and before anything reads matrices, so that
+ * matrices are recomputed in batches rather than one at a time on first read.
+ */
+void transform_matrix_update(void);
+
+/**
+ * Gets the index of the given transform in the transform store.
+ */
+size_t transform_get_index(Transform* t);
+
+/**
+ * Gets the ID of the entity that owns the given transform.
+ */
+uint16_t transform_get_entity(Transform* t);
+
+/**
+ * Returns the number of transforms in the transform store.
+ */
+size_t transform_count(void);
+
 #endif
@@ -0,0 +1,797 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "../entity.h"
+#include "../log.h"
+#include "../spatial.h"
+
+#include "component.h"
+#include "transform.h"
+#include "trigger.h"
+
+// Volumes are hashed into a fixed number of buckets by the grid cells they
+// cover. Cells which share a bucket are told apart by the exact containment
+// test, so no bucket ever needs to know which cells it holds.
+#define TRIGGER_CELL_SIZE 128
+#define TRIGGER_BUCKET_COUNT 1024
+
+// Volumes covering more cells than this skip the grid and are tested against
+// every moving entity
+#define TRIGGER_CELLS_MAX 64
+
+const ComponentType trigger_component_type = TRIGGER;
+
+const char* trigger_event_type_str[] = {
+    [TRIGGER_ENTER] = "ENTER",
+    [TRIGGER_EXIT] = "EXIT",
+};
+
+struct Trigger {
+    uint16_t entity_id;
+
+    TriggerShape shape;
+
+    // Shape, relative to the owning entity
+    float x;
+    float y;
+    float w;
+    float h;
+    float radius;
+
+    // World-space bounds, as of the last time the owner moved
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+
+    // The cells this volume is bucketed under, or oversized if it's in the
+    // oversized list instead
+    int32_t cell_x0;
+    int32_t cell_y0;
+    int32_t cell_x1;
+    int32_t cell_y1;
+
+    bool oversized;
+
+    // The last lookup which visited this volume, so that volumes found in more
+    // than one bucket are only tested once
+    uint32_t stamp;
+
+    size_t size;
+    size_t count;
+
+    uint16_t* occupants;
+};
+
+typedef struct TriggerBucket {
+    size_t size;
+    size_t count;
+
+    Trigger** t;
+} TriggerBucket;
+
+// A trigger volume an entity is inside, and the entity's position in that
+// volume's occupant list
+typedef struct TriggerMembership {
+    Trigger* t;
+
+    size_t slot;
+} TriggerMembership;
+
+// Per-entity state, indexed by entity ID
+typedef struct TriggerEntity {
+    // The volume this entity owns, if any
+    Trigger* owned;
+
+    size_t size;
+    size_t count;
+
+    TriggerMembership* in;
+} TriggerEntity;
+
+TriggerBucket trigger_grid[TRIGGER_BUCKET_COUNT] = {0};
+TriggerBucket trigger_oversized = {0};
+
+size_t trigger_entities_size = 0;
+TriggerEntity* trigger_entities = NULL;
+
+// Number of trigger volumes in existence. Transform signals are only
+// subscribed to while this is non-zero.
+size_t trigger_count = 0;
+
+uint32_t trigger_stamp = 0;
+
+TriggerCallbackList trigger_cb_list = {0};
+
+// Events waiting for the next flush, and the buffer being delivered during a
+// flush
+size_t trigger_events_size = 0;
+size_t trigger_events_count = 0;
+TriggerEvent* trigger_events = NULL;
+
+size_t trigger_events_back_size = 0;
+TriggerEvent* trigger_events_back = NULL;
+
+// Scratch space for spatial queries
+size_t trigger_query_size = 0;
+uint16_t* trigger_query = NULL;
+
+void trigger_on_translate(TransformSignalType type, const TransformSignalEvent* events, size_t count, void* userdata);
+
+bool trigger_grow(void** array, size_t* size, size_t count, size_t elem_size) {
+    if (count <= *size) {
+        return true;
+    }
+
+    size_t new_size = *size ? *size : SLOT_DEFAULT_SIZE;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+
+    void* tmp = realloc(*array, new_size * elem_size);
+
+    if (!tmp) {
+        return false;
+    }
+
+    *array = tmp;
+    *size = new_size;
+
+    return true;
+}
+
+bool trigger_regcb(trigger_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(trigger): Attempting to register callback (%p)", cb);
+
+    if (!cb) {
+        logmsg(LOG_WARN, "component(trigger): Unable to register callback, callback is NULL");
+
+        return false;
+    }
+
+    TriggerCallbackList* list = &trigger_cb_list;
+
+    if (!trigger_grow((void**)&list->cb, &list->size, list->count + 1, sizeof(TriggerCallback))) {
+        logmsg(LOG_WARN, "component(trigger): Failed to register callback, the system is out of memory");
+
+        return false;
+    }
+
+    list->cb[list->count].cb = cb;
+    list->cb[list->count].userdata = userdata;
+
+    list->count++;
+
+    return true;
+}
+
+bool trigger_unregcb(trigger_cb_t cb, void* userdata) {
+    logmsg(LOG_DEBUG, "component(trigger): Attempting to unregister callback (%p)", cb);
+
+    TriggerCallbackList* list = &trigger_cb_list;
+
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->cb[i].cb == cb && list->cb[i].userdata == userdata) {
+            memmove(&list->cb[i], &list->cb[i + 1], (list->count - i - 1) * sizeof(TriggerCallback));
+
+            list->count--;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void trigger_event_push(TriggerEventType type, Trigger* t, uint16_t entity_id) {
+    if (!trigger_grow((void**)&trigger_events, &trigger_events_size, trigger_events_count + 1, sizeof(TriggerEvent))) {
+        logmsg(LOG_WARN,
+            "component(trigger): Dropped %s event for entity[%" PRIu16 "] and trigger[%" PRIu16 "], the system is out of memory",
+            trigger_event_type_str[type],
+            entity_id,
+            t->entity_id);
+
+        return;
+    }
+
+    trigger_events[trigger_events_count++] = (TriggerEvent){.type = type, .trigger_id = t->entity_id, .entity_id = entity_id};
+}
+
+void trigger_flush(void) {
+    if (trigger_events_count == 0) {
+        return;
+    }
+
+    // Swap buffers first, so that events caused by callbacks queue up for the
+    // next flush
+    TriggerEvent* events = trigger_events;
+    size_t events_size = trigger_events_size;
+    size_t count = trigger_events_count;
+
+    trigger_events = trigger_events_back;
+    trigger_events_size = trigger_events_back_size;
+    trigger_events_count = 0;
+
+    for (size_t i = 0; i < trigger_cb_list.count; i++) {
+        trigger_cb_list.cb[i].cb(events, count, trigger_cb_list.cb[i].userdata);
+    }
+
+    trigger_events_back = events;
+    trigger_events_back_size = events_size;
+}
+
+// Membership
+
+TriggerEntity* trigger_entity_get(uint16_t entity_id) {
+    if (entity_id >= trigger_entities_size) {
+        size_t size = trigger_entities_size;
+
+        if (!trigger_grow((void**)&trigger_entities, &trigger_entities_size, (size_t)entity_id + 1, sizeof(TriggerEntity))) {
+            return NULL;
+        }
+
+        memset(&trigger_entities[size], 0, (trigger_entities_size - size) * sizeof(TriggerEntity));
+    }
+
+    return &trigger_entities[entity_id];
+}
+
+bool trigger_is_member(const TriggerEntity* te, const Trigger* t) {
+    for (size_t i = 0; i < te->count; i++) {
+        if (te->in[i].t == t) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void trigger_enter(Trigger* t, uint16_t entity_id) {
+    TriggerEntity* te = trigger_entity_get(entity_id);
+
+    if (!te || !trigger_grow((void**)&te->in, &te->size, te->count + 1, sizeof(TriggerMembership))
+        || !trigger_grow((void**)&t->occupants, &t->size, t->count + 1, sizeof(uint16_t))) {
+        logmsg(LOG_WARN, "component(trigger): Failed to add entity[%" PRIu16 "] to trigger[%" PRIu16 "], the system is out of memory", entity_id, t->entity_id);
+
+        return;
+    }
+
+    te->in[te->count++] = (TriggerMembership){.t = t, .slot = t->count};
+    t->occupants[t->count++] = entity_id;
+
+    trigger_event_push(TRIGGER_ENTER, t, entity_id);
+}
+
+// Removes the membership at position i in the entity's list
+void trigger_exit(TriggerEntity* te, size_t i, uint16_t entity_id) {
+    Trigger* t = te->in[i].t;
+    size_t slot = te->in[i].slot;
+
+    // Move the last occupant into the hole, and point its membership at its
+    // new slot
+    uint16_t last = t->occupants[--t->count];
+
+    t->occupants[slot] = last;
+
+    TriggerEntity* moved = &trigger_entities[last];
+
+    for (size_t j = 0; j < moved->count; j++) {
+        if (moved->in[j].t == t) {
+            moved->in[j].slot = slot;
+
+            break;
+        }
+    }
+
+    te->in[i] = te->in[--te->count];
+
+    trigger_event_push(TRIGGER_EXIT, t, entity_id);
+}
+
+// Geometry
+
+bool trigger_test(const Trigger* t, float x, float y) {
+    if (x < t->min_x || x > t->max_x || y < t->min_y || y > t->max_y) {
+        return false;
+    }
+
+    if (t->shape == TRIGGER_RECT) {
+        return true;
+    }
+
+    float dx = x - (t->min_x + t->radius);
+    float dy = y - (t->min_y + t->radius);
+
+    return dx * dx + dy * dy <= t->radius * t->radius;
+}
+
+int32_t trigger_cell_coord(float v) {
+    float c = floorf(v / TRIGGER_CELL_SIZE);
+
+    // Written so that NaN clamps too
+    if (!(c > -(1 << 30))) {
+        return -(1 << 30);
+    }
+
+    return (c > (1 << 30)) ? (1 << 30) : (int32_t)c;
+}
+
+TriggerBucket* trigger_bucket(int32_t cx, int32_t cy) {
+    uint64_t key = ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+
+    key *= 0x9E3779B97F4A7C15ULL;
+
+    return &trigger_grid[(key >> 32) & (TRIGGER_BUCKET_COUNT - 1)];
+}
+
+bool trigger_bucket_add(TriggerBucket* b, Trigger* t) {
+    // A volume can cover two cells which share a bucket
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->t[i] == t) {
+            return true;
+        }
+    }
+
+    if (!trigger_grow((void**)&b->t, &b->size, b->count + 1, sizeof(Trigger*))) {
+        return false;
+    }
+
+    b->t[b->count++] = t;
+
+    return true;
+}
+
+void trigger_bucket_remove(TriggerBucket* b, Trigger* t) {
+    for (size_t i = 0; i < b->count; i++) {
+        if (b->t[i] == t) {
+            b->t[i] = b->t[--b->count];
+
+            return;
+        }
+    }
+}
+
+void trigger_grid_remove(Trigger* t) {
+    if (t->oversized) {
+        trigger_bucket_remove(&trigger_oversized, t);
+
+        return;
+    }
+
+    for (int32_t cy = t->cell_y0; cy <= t->cell_y1; cy++) {
+        for (int32_t cx = t->cell_x0; cx <= t->cell_x1; cx++) {
+            trigger_bucket_remove(trigger_bucket(cx, cy), t);
+        }
+    }
+}
+
+bool trigger_grid_add(Trigger* t) {
+    t->cell_x0 = trigger_cell_coord(t->min_x);
+    t->cell_y0 = trigger_cell_coord(t->min_y);
+    t->cell_x1 = trigger_cell_coord(t->max_x);
+    t->cell_y1 = trigger_cell_coord(t->max_y);
+
+    int64_t cells = ((int64_t)t->cell_x1 - t->cell_x0 + 1) * ((int64_t)t->cell_y1 - t->cell_y0 + 1);
+
+    t->oversized = cells > TRIGGER_CELLS_MAX;
+
+    if (t->oversized) {
+        return trigger_bucket_add(&trigger_oversized, t);
+    }
+
+    for (int32_t cy = t->cell_y0; cy <= t->cell_y1; cy++) {
+        for (int32_t cx = t->cell_x0; cx <= t->cell_x1; cx++) {
+            // Removal tolerates buckets the volume never made it into, so
+            // there's nothing to unwind here
+            if (!trigger_bucket_add(trigger_bucket(cx, cy), t)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Recomputes a volume's bounds from the given owner position
+void trigger_place(Trigger* t, float x, float y) {
+    if (t->shape == TRIGGER_RECT) {
+        t->min_x = x + t->x;
+        t->min_y = y + t->y;
+        t->max_x = t->min_x + t->w;
+        t->max_y = t->min_y + t->h;
+    }
+    else {
+        t->min_x = x + t->x - t->radius;
+        t->min_y = y + t->y - t->radius;
+        t->max_x = x + t->x + t->radius;
+        t->max_y = y + t->y + t->radius;
+    }
+}
+
+bool trigger_entity_pos(uint16_t entity_id, float* x, float* y) {
+    Transform* tf = entity_get_component(entity_id, TRANSFORM);
+
+    if (!tf) {
+        return false;
+    }
+
+    *x = transform_get_pos_x(tf);
+    *y = transform_get_pos_y(tf);
+
+    return true;
+}
+
+// Re-tests an entity which moved to (x, y) against the volumes near it
+void trigger_update_entity(uint16_t entity_id, float x, float y) {
+    TriggerEntity* te = (entity_id < trigger_entities_size) ? &trigger_entities[entity_id] : NULL;
+
+    // Exits first. Iterating backwards keeps removals from skipping anything.
+    for (size_t i = te ? te->count : 0; i > 0; i--) {
+        if (!trigger_test(te->in[i - 1].t, x, y)) {
+            trigger_exit(te, i - 1, entity_id);
+        }
+    }
+
+    trigger_stamp++;
+
+    TriggerBucket* buckets[] = {trigger_bucket(trigger_cell_coord(x), trigger_cell_coord(y)), &trigger_oversized};
+
+    for (size_t b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b++) {
+        for (size_t i = 0; i < buckets[b]->count; i++) {
+            Trigger* t = buckets[b]->t[i];
+
+            if (t->stamp == trigger_stamp || t->entity_id == entity_id) {
+                continue;
+            }
+
+            t->stamp = trigger_stamp;
+
+            if (!trigger_test(t, x, y)) {
+                continue;
+            }
+
+            te = (entity_id < trigger_entities_size) ? &trigger_entities[entity_id] : NULL;
+
+            if (!te || !trigger_is_member(te, t)) {
+                trigger_enter(t, entity_id);
+            }
+        }
+    }
+}
+
+// Re-tests the entities in and around a volume which was created or moved
+void trigger_update_volume(Trigger* t) {
+    // Entities which are no longer covered. Iterating backwards keeps removals
+    // from skipping anything.
+    for (size_t i = t->count; i > 0; i--) {
+        uint16_t id = t->occupants[i - 1];
+
+        float x;
+        float y;
+
+        if (trigger_entity_pos(id, &x, &y) && trigger_test(t, x, y)) {
+            continue;
+        }
+
+        TriggerEntity* te = &trigger_entities[id];
+
+        for (size_t j = 0; j < te->count; j++) {
+            if (te->in[j].t == t) {
+                trigger_exit(te, j, id);
+
+                break;
+            }
+        }
+    }
+
+    // Entities which are now covered
+    size_t max = spatial_count();
+
+    if (max == 0 || !trigger_grow((void**)&trigger_query, &trigger_query_size, max, sizeof(uint16_t))) {
+        return;
+    }
+
+    size_t found = spatial_query_rect(t->min_x, t->min_y, t->max_x - t->min_x, t->max_y - t->min_y, trigger_query, max);
+
+    for (size_t i = 0; i < found; i++) {
+        uint16_t id = trigger_query[i];
+
+        float x;
+        float y;
+
+        if (id == t->entity_id || !trigger_entity_pos(id, &x, &y) || !trigger_test(t, x, y)) {
+            continue;
+        }
+
+        if (id >= trigger_entities_size || !trigger_is_member(&trigger_entities[id], t)) {
+            trigger_enter(t, id);
+        }
+    }
+}
+
+void trigger_on_translate(TransformSignalType type, const TransformSignalEvent* events, size_t count, void* userdata) {
+    // Move volumes whose owners moved before testing anything against them
+    for (size_t i = 0; i < count; i++) {
+        uint16_t id = events[i].entity_id;
+
+        if (id < trigger_entities_size && trigger_entities[id].owned) {
+            Trigger* t = trigger_entities[id].owned;
+
+            trigger_grid_remove(t);
+            trigger_place(t, events[i].args.x, events[i].args.y);
+
+            if (!trigger_grid_add(t)) {
+                logmsg(LOG_WARN, "component(trigger): Failed to move trigger[%" PRIu16 "], the system is out of memory", id);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        trigger_update_entity(events[i].entity_id, events[i].args.x, events[i].args.y);
+    }
+
+    // Moving volumes also sweep over entities which stood still
+    for (size_t i = 0; i < count; i++) {
+        uint16_t id = events[i].entity_id;
+
+        if (id < trigger_entities_size && trigger_entities[id].owned) {
+            trigger_update_volume(trigger_entities[id].owned);
+        }
+    }
+}
+
+// Component management
+
+bool trigger_create(uint16_t entity_id, Trigger* proto) {
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(trigger): Unable to create trigger, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    TriggerEntity* te = trigger_entity_get(entity_id);
+
+    if (!te) {
+        logmsg(LOG_WARN, "component(trigger): Failed to create trigger, the system is out of memory");
+
+        return false;
+    }
+
+    if (te->owned) {
+        logmsg(LOG_WARN, "component(trigger): Unable to create trigger, entity[%" PRIu16 "]('%s') already has trigger", e->id, e->name);
+
+        return false;
+    }
+
+    float x;
+    float y;
+
+    if (!trigger_entity_pos(entity_id, &x, &y)) {
+        logmsg(LOG_WARN, "component(trigger): Unable to create trigger, entity[%" PRIu16 "]('%s') has no transform", e->id, e->name);
+
+        return false;
+    }
+
+    if (trigger_count == 0 && !transform_regcb_batch(TRANSLATE, trigger_on_translate, NULL)) {
+        logmsg(LOG_WARN, "component(trigger): Failed to create trigger, unable to subscribe to transform signals");
+
+        return false;
+    }
+
+    Trigger* t = calloc(1, sizeof(Trigger));
+
+    if (!t) {
+        logmsg(LOG_WARN, "component(trigger): Failed to create trigger for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+        goto fail;
+    }
+
+    *t = *proto;
+
+    t->entity_id = e->id;
+
+    trigger_place(t, x, y);
+
+    if (!trigger_grid_add(t)) {
+        logmsg(LOG_WARN, "component(trigger): Failed to create trigger for entity[%" PRIu16 "]('%s'), the system is out of memory", e->id, e->name);
+
+        trigger_grid_remove(t);
+        free(t);
+
+        goto fail;
+    }
+
+    if (htable_add(e->components, (uint8_t*)&trigger_component_type, sizeof(trigger_component_type), KV_VOIDPTR, t) != 0) {
+        logmsg(LOG_WARN, "component(trigger): Failed to map trigger in component table for entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        trigger_grid_remove(t);
+        free(t);
+
+        goto fail;
+    }
+
+    te->owned = t;
+    trigger_count++;
+
+    // Pick up entities already standing inside the new volume
+    trigger_update_volume(t);
+
+    return true;
+
+fail:
+    if (trigger_count == 0) {
+        transform_unregcb_batch(TRANSLATE, trigger_on_translate, NULL);
+    }
+
+    return false;
+}
+
+bool trigger_create_rect(uint16_t entity_id, float x, float y, float w, float h) {
+    logmsg(LOG_DEBUG, "component(trigger): Attempting to create rect trigger for entity[%" PRIu16 "]", entity_id);
+
+    if (!(w >= 0) || !(h >= 0)) {
+        logmsg(LOG_WARN, "component(trigger): Unable to create trigger for entity[%" PRIu16 "], size must not be negative", entity_id);
+
+        return false;
+    }
+
+    Trigger proto = {.shape = TRIGGER_RECT, .x = x, .y = y, .w = w, .h = h};
+
+    return trigger_create(entity_id, &proto);
+}
+
+bool trigger_create_circle(uint16_t entity_id, float x, float y, float radius) {
+    logmsg(LOG_DEBUG, "component(trigger): Attempting to create circle trigger for entity[%" PRIu16 "]", entity_id);
+
+    if (!(radius >= 0)) {
+        logmsg(LOG_WARN, "component(trigger): Unable to create trigger for entity[%" PRIu16 "], radius must not be negative", entity_id);
+
+        return false;
+    }
+
+    Trigger proto = {.shape = TRIGGER_CIRCLE, .x = x, .y = y, .radius = radius};
+
+    return trigger_create(entity_id, &proto);
+}
+
+bool trigger_destroy(uint16_t entity_id) {
+    logmsg(LOG_DEBUG, "component(trigger): Attempting to destroy trigger for entity[%" PRIu16 "]", entity_id);
+
+    Entity* e = entity_get(entity_id);
+
+    if (!e) {
+        logmsg(LOG_WARN, "component(trigger): Unable to destroy trigger, failed to get entity[%" PRIu16 "]", entity_id);
+
+        return false;
+    }
+
+    Trigger* t = (entity_id < trigger_entities_size) ? trigger_entities[entity_id].owned : NULL;
+
+    if (!t) {
+        logmsg(LOG_WARN, "component(trigger): Unable to destroy trigger, failed to get trigger associated with entity[%" PRIu16 "]('%s')", e->id, e->name);
+
+        return false;
+    }
+
+    // Everyone inside leaves
+    while (t->count > 0) {
+        uint16_t id = t->occupants[t->count - 1];
+
+        TriggerEntity* te = &trigger_entities[id];
+
+        for (size_t j = 0; j < te->count; j++) {
+            if (te->in[j].t == t) {
+                trigger_exit(te, j, id);
+
+                break;
+            }
+        }
+    }
+
+    trigger_grid_remove(t);
+
+    free(t->occupants);
+    free(t);
+
+    trigger_entities[entity_id].owned = NULL;
+
+    if (--trigger_count == 0) {
+        transform_unregcb_batch(TRANSLATE, trigger_on_translate, NULL);
+    }
+
+    if (htable_remove(e->components, (uint8_t*)&trigger_component_type, sizeof(trigger_component_type)) < 0) {
+        logmsg(LOG_ERR,
+            "component(trigger): Failed to remove trigger associated with entity[%" PRIu16 "]('%s'), but it was present in the component table",
+            e->id,
+            e->name);
+
+        _exit(-1);
+    }
+
+    return true;
+}
+
+void trigger_forget(uint16_t entity_id) {
+    if (entity_id >= trigger_entities_size) {
+        return;
+    }
+
+    TriggerEntity* te = &trigger_entities[entity_id];
+
+    while (te->count > 0) {
+        trigger_exit(te, te->count - 1, entity_id);
+    }
+}
+
+void trigger_cleanup(void) {
+    logmsg(LOG_DEBUG, "component(trigger): Cleaning up trigger state");
+
+    if (trigger_count > 0) {
+        logmsg(LOG_WARN, "component(trigger): Cleaning up with %zu triggers still alive", trigger_count);
+
+        transform_unregcb_batch(TRANSLATE, trigger_on_translate, NULL);
+    }
+
+    for (size_t i = 0; i < trigger_entities_size; i++) {
+        if (trigger_entities[i].owned) {
+            free(trigger_entities[i].owned->occupants);
+            free(trigger_entities[i].owned);
+        }
+
+        free(trigger_entities[i].in);
+    }
+
+    for (size_t i = 0; i < TRIGGER_BUCKET_COUNT; i++) {
+        free(trigger_grid[i].t);
+    }
+
+    free(trigger_oversized.t);
+    free(trigger_entities);
+    free(trigger_cb_list.cb);
+    free(trigger_events);
+    free(trigger_events_back);
+    free(trigger_query);
+
+    memset(trigger_grid, 0, sizeof(trigger_grid));
+    memset(&trigger_oversized, 0, sizeof(trigger_oversized));
+    memset(&trigger_cb_list, 0, sizeof(trigger_cb_list));
+
+    trigger_entities = NULL;
+    trigger_entities_size = 0;
+    trigger_count = 0;
+
+    trigger_events = NULL;
+    trigger_events_size = 0;
+    trigger_events_count = 0;
+
+    trigger_events_back = NULL;
+    trigger_events_back_size = 0;
+
+    trigger_query = NULL;
+    trigger_query_size = 0;
+}
+
+TriggerShape trigger_get_shape(Trigger* t) {
+    return t->shape;
+}
+
+size_t trigger_get_count(Trigger* t) {
+    return t->count;
+}
+
+bool trigger_contains(Trigger* t, uint16_t entity_id) {
+    return entity_id < trigger_entities_size && trigger_is_member(&trigger_entities[entity_id], t);
+}
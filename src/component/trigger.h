@@ -0,0 +1,140 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_TRIGGER
+#define RPGNG_TRIGGER
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "component.h"
+
+typedef struct Trigger Trigger;
+
+typedef enum TriggerShape {
+    TRIGGER_RECT,
+    TRIGGER_CIRCLE
+} TriggerShape;
+
+typedef enum TriggerEventType {
+    TRIGGER_ENTER,
+    TRIGGER_EXIT
+} TriggerEventType;
+
+// Strings representing the above event types. Use the above enum values as indexes.
+extern const char* trigger_event_type_str[];
+
+typedef struct TriggerEvent {
+    TriggerEventType type;
+
+    // The entity which owns the trigger volume
+    uint16_t trigger_id;
+
+    // The entity which entered or left it
+    uint16_t entity_id;
+} TriggerEvent;
+
+typedef void (*trigger_cb_t)(const TriggerEvent* events, size_t count, void* userdata);
+
+typedef struct TriggerCallback {
+    trigger_cb_t cb;
+
+    void* userdata;
+} TriggerCallback;
+
+typedef struct TriggerCallbackList {
+    size_t size;
+    size_t count;
+
+    TriggerCallback* cb;
+} TriggerCallbackList;
+
+/**
+ * Registers a callback which receives every trigger event, in one batch per
+ * call to trigger_flush().
+ *
+ * @param userdata A pointer which is passed back to the callback as-is.
+ */
+bool trigger_regcb(trigger_cb_t cb, void* userdata);
+
+/**
+ * Removes the given callback.
+ *
+ * @return Returns true on success. Returns false if the given callback was not
+ * found.
+ */
+bool trigger_unregcb(trigger_cb_t cb, void* userdata);
+
+/**
+ * Delivers all trigger events since the last flush to the registered
+ * callbacks. This should be called once per frame, after transform signals
+ * have been flushed.
+ *
+ * Events caused by trigger callbacks are delivered on the next flush.
+ */
+void trigger_flush(void);
+
+/**
+ * Frees all resources associated with the Trigger component system.
+ */
+void trigger_cleanup(void);
+
+/**
+ * Associates a rectangular trigger volume with the given entity, which must
+ * have a Transform. The volume moves with the entity.
+ *
+ * Entities are tested by their Transform position. Only entities which moved
+ * since the last flush are re-tested, except when the volume itself moves,
+ * in which case the spatial index is used to find entities it now covers.
+ *
+ * @param x The offset of the volume's left edge from the entity's position.
+ * @param y The offset of the volume's top edge from the entity's position.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool trigger_create_rect(uint16_t entity_id, float x, float y, float w, float h);
+
+/**
+ * Associates a circular trigger volume with the given entity, which must have
+ * a Transform. The volume moves with the entity.
+ *
+ * @param x The offset of the volume's center from the entity's position.
+ * @param y The offset of the volume's center from the entity's position.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool trigger_create_circle(uint16_t entity_id, float x, float y, float radius);
+
+/**
+ * Destroys the trigger volume associated with the given entity. Exit events
+ * are emitted for every entity inside it.
+ *
+ * @return On success, returns true. If the given entity does not have a
+ * trigger component, this function returns false.
+ */
+bool trigger_destroy(uint16_t entity_id);
+
+/**
+ * Removes the given entity from every trigger volume it's inside, emitting
+ * exit events. This is called when an entity's Transform is destroyed.
+ */
+void trigger_forget(uint16_t entity_id);
+
+/**
+ * Gets the shape of a trigger volume.
+ */
+TriggerShape trigger_get_shape(Trigger* t);
+
+/**
+ * Gets the number of entities inside a trigger volume.
+ */
+size_t trigger_get_count(Trigger* t);
+
+/**
+ * Determines whether the given entity is inside a trigger volume.
+ */
+bool trigger_contains(Trigger* t, uint16_t entity_id);
+
+#endif
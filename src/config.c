@@ -10,6 +10,7 @@
 #include "config.h"
 #include "htable.h"
 #include "log.h"
+#include "world.h"
 
 #define KV_STR_MAX_LEN 1024
 
@@ -40,6 +41,21 @@ void config_set_defaults(void) {
     // entity settings
     global_config.entity.root_name = "root";
     global_config.entity.first_id = 0;
+
+    // simulation settings
+    global_config.sim.tick_rate = 60;
+    global_config.sim.max_ticks = 5;
+
+    // asset settings
+    global_config.assets.pack = NULL;
+    global_config.assets.atlas = NULL;
+    global_config.assets.texture_budget = 0;
+
+    // world settings
+    global_config.world.path = NULL;
+    global_config.world.cell_size = WORLD_CELL_SIZE_DEFAULT;
+    global_config.world.radius = WORLD_RADIUS_DEFAULT;
+    global_config.world.memory_cap = 0;
 }
 
 bool config_init(void) {
@@ -85,9 +101,29 @@ bool config_load(const char* path) {
     json_t* window = NULL;
     json_t* entity = NULL;
     json_t* script = NULL;
+    json_t* sim = NULL;
+    json_t* assets = NULL;
+    json_t* world = NULL;
     json_t* custom = NULL;
 
-    int unpk = json_unpack_ex(root, &err, JSON_STRICT, "{s:o, s:o, s:o, s?o}", "window", &window, "entity", &entity, "script", &script, "custom", &custom);
+    int unpk = json_unpack_ex(root,
+        &err,
+        JSON_STRICT,
+        "{s:o, s:o, s:o, s?o, s?o, s?o, s?o}",
+        "window",
+        &window,
+        "entity",
+        &entity,
+        "script",
+        &script,
+        "simulation",
+        &sim,
+        "assets",
+        &assets,
+        "world",
+        &world,
+        "custom",
+        &custom);
 
     if (unpk == -1) {
         logmsg(LOG_WARN, "config(%s): Failed to load config, parsing error", path);
@@ -175,6 +211,108 @@ bool config_load(const char* path) {
         }
     }
 
+    // Load simulation config
+    if (sim) {
+        int tick_rate = -1;
+        int max_ticks = -1;
+
+        unpk = json_unpack_ex(sim, &err, 0, "{s?i, s?i}", "tick_rate", &tick_rate, "max_ticks", &max_ticks);
+
+        if (unpk == -1) {
+            logmsg(LOG_WARN, "config(%s): Failed to load simulation config, parsing error", path);
+            logmsg(LOG_WARN, "config(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+            goto fail;
+        }
+
+        if (tick_rate > 0) {
+            global_config.sim.tick_rate = tick_rate;
+        }
+
+        if (max_ticks > 0) {
+            global_config.sim.max_ticks = max_ticks;
+        }
+    }
+
+    // Load asset config
+    if (assets) {
+        char* pack = NULL;
+        char* atlas = NULL;
+        int texture_budget = -1;
+
+        unpk = json_unpack_ex(assets, &err, 0, "{s?s, s?s, s?i}", "pack", &pack, "atlas", &atlas, "texture_budget", &texture_budget);
+
+        if (unpk == -1) {
+            logmsg(LOG_WARN, "config(%s): Failed to load asset config, parsing error", path);
+            logmsg(LOG_WARN, "config(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+            goto fail;
+        }
+
+        if (pack) {
+            global_config.assets.pack = strdup(pack);
+
+            if (!global_config.assets.pack) {
+                logmsg(LOG_WARN, "config(%s): Failed to load asset config, the system is out of memory", path);
+
+                goto fail;
+            }
+        }
+
+        if (atlas) {
+            global_config.assets.atlas = strdup(atlas);
+
+            if (!global_config.assets.atlas) {
+                logmsg(LOG_WARN, "config(%s): Failed to load asset config, the system is out of memory", path);
+
+                goto fail;
+            }
+        }
+
+        if (texture_budget >= 0) {
+            global_config.assets.texture_budget = texture_budget;
+        }
+    }
+
+    // Load world config
+    if (world) {
+        char* world_path = NULL;
+        int cell_size = 0;
+        int radius = -1;
+        int memory_cap = -1;
+
+        unpk = json_unpack_ex(world, &err, 0, "{s?s, s?i, s?i, s?i}", "path", &world_path, "cell_size", &cell_size, "radius", &radius, "memory_cap", &memory_cap);
+
+        if (unpk == -1) {
+            logmsg(LOG_WARN, "config(%s): Failed to load world config, parsing error", path);
+            logmsg(LOG_WARN, "config(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+            goto fail;
+        }
+
+        if (world_path) {
+            global_config.world.path = strdup(world_path);
+
+            if (!global_config.world.path) {
+                logmsg(LOG_WARN, "config(%s): Failed to load world config, the system is out of memory", path);
+
+                goto fail;
+            }
+        }
+
+        if (cell_size > 0) {
+            global_config.world.cell_size = cell_size;
+        }
+
+        if (radius >= 0) {
+            global_config.world.radius = radius;
+        }
+
+        if (memory_cap >= 0) {
+            global_config.world.memory_cap = memory_cap;
+        }
+    }
+
     json_decref(root);
 
     return true;
@@ -184,6 +322,13 @@ fail:
 
     free(global_config.window.mode);
     free(global_config.entity.root_name);
+    free(global_config.assets.pack);
+    free(global_config.assets.atlas);
+    free(global_config.world.path);
+
+    global_config.assets.pack = NULL;
+    global_config.assets.atlas = NULL;
+    global_config.world.path = NULL;
 
     return false;
 }
@@ -35,10 +35,44 @@ typedef struct EntityConfig {
     uint16_t first_id;
 } EntityConfig;
 
+typedef struct SimConfig {
+    int tick_rate;
+    int max_ticks;
+} SimConfig;
+
+typedef struct AssetConfig {
+    // An asset pack to open on startup, or NULL
+    char* pack;
+
+    // Atlas metadata to load on startup, or NULL
+    char* atlas;
+
+    // The most memory loaded images may hold before the least recently drawn
+    // are evicted, in MiB, or 0 for no limit
+    int texture_budget;
+} AssetConfig;
+
+typedef struct WorldConfig {
+    // The directory to stream world cells from, or NULL for no world
+    char* path;
+
+    // The width and height of a cell, in pixels, and the distance around the
+    // focus within which cells are loaded, in cells
+    int cell_size;
+    int radius;
+
+    // The most memory cells may take before those out of range are unloaded,
+    // in MiB, or 0 to unload them as soon as they're out of range
+    int memory_cap;
+} WorldConfig;
+
 typedef struct EngineConfig {
     WindowConfig window;
     ScriptConfig script;
     EntityConfig entity;
+    SimConfig sim;
+    AssetConfig assets;
+    WorldConfig world;
     HashTable* custom;
 } EngineConfig;
 
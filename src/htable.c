@@ -112,8 +112,9 @@ void* htable_lookup(const HashTable* t, const uint8_t* key, size_t key_size, KVT
 
     size_t index = hash(key, key_size) % t->bucket_count;
 
-    // Iterate over buckets in a circle until we find the key
-    for (size_t i = index; i != index - 1; i = (i + 1) % t->bucket_count) {
+    // Iterate over buckets in a circle until we find the key, visiting each
+    // bucket once
+    for (size_t n = 0, i = index; n < t->bucket_count; n++, i = (i + 1) % t->bucket_count) {
         if (t->buckets[i].key_size == key_size) {
             size_t j;
 
@@ -165,10 +166,12 @@ int htable_rehash(HashTable* t, size_t scale) {
 
     // Swap hash table contents
     HTableEntry* tmp = t->buckets;
+    size_t tmp_count = t->bucket_count;
     t->buckets = new_t->buckets;
     t->bucket_count = new_t->bucket_count;
     t->mapping_count = new_t->mapping_count;
     new_t->buckets = tmp;
+    new_t->bucket_count = tmp_count;
 
     // Free old table
     htable_destroy(new_t);
@@ -209,8 +212,9 @@ int htable_add(HashTable* t, const uint8_t* key, size_t key_size, KVType type, v
 
     size_t index = hash(key, key_size) % t->bucket_count;
 
-    // Iterate in a circle until we find an empty bucket
-    for (size_t i = index; i != index - 1; i = (i + 1) % t->bucket_count) {
+    // Iterate in a circle until we find an empty bucket, visiting each bucket
+    // once
+    for (size_t n = 0, i = index; n < t->bucket_count; n++, i = (i + 1) % t->bucket_count) {
         if (t->buckets[i].key == NULL) {
             t->buckets[i].key = malloc(key_size);
 
@@ -263,8 +267,9 @@ int htable_remove(HashTable* t, const uint8_t* key, size_t key_size) {
 
     size_t index = hash(key, key_size) % t->bucket_count;
 
-    // Iterate over buckets in a circle until we find the key
-    for (size_t i = index; i != index - 1; i = (i + 1) % t->bucket_count) {
+    // Iterate over buckets in a circle until we find the key, visiting each
+    // bucket once
+    for (size_t n = 0, i = index; n < t->bucket_count; n++, i = (i + 1) % t->bucket_count) {
         if (t->buckets[i].key_size == key_size) {
             size_t j;
 
@@ -2,7 +2,9 @@
 //
 // SPDX-License-Identifier: BSD-2-Clause
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _MSC_VER
 #include <stdlib.h>
@@ -12,6 +14,9 @@
 
 #include <SDL2/SDL.h>
 
+#include "asset.h"
+#include "atlas.h"
+#include "collision.h"
 #include "config.h"
 #include "entity.h"
 #ifdef _MSC_VER
@@ -19,21 +24,39 @@
 #endif
 #include "htable.h"
 #include "log.h"
+#include "pack.h"
+#include "path.h"
+#include "render.h"
 #include "script.h"
-
+#include "sim.h"
+#include "spatial.h"
+#include "variant.h"
+#include "window.h"
+#include "world.h"
+
+#include "component/animation.h"
+#include "component/camera.h"
 #include "component/component.h"
 #include "component/sprite.h"
+#include "component/tilemap.h"
 #include "component/transform.h"
+#include "component/trigger.h"
 
 #define _RPGNG_STR(x) #x
 #define RPGNG_STR(x) _RPGNG_STR(x)
 
 void print_usage(void) {
-    printf("Usage: rpgng [-d] [-l logfile]\n\n");
+    printf("Usage: rpgng [-d] [-l logfile]\n");
+    printf("       rpgng -a [prefix] image...\n");
+    printf("       rpgng -b image...\n");
+    printf("       rpgng -p [pack] image...\n\n");
     printf("Command-line options:\n");
+    printf("\n\t-a [prefix]\tPacks the given images into an atlas at prefix, then exits");
+    printf("\n\t-b\t\tMeasures blit throughput of the given images, as decoded and as converted at load, then exits");
     printf("\n\t-d\t\tEnables debug mode, increasing logging verbosity");
     printf("\n\t-e [gamescript]\tThe main game script to execute on start");
     printf("\n\t-l [logfile]\tA logfile to which logs will be written");
+    printf("\n\t-p [pack]\tPacks the given images, decoded, into an asset pack, then exits");
     printf("\n\t-h\t\tPrints this help information");
     printf("\n\t-v\t\tPrints version information");
     printf("\n");
@@ -58,10 +81,21 @@ int main(int argc, char* argv[]) {
     char* log_path = NULL;
     char* mainscript_path = NULL;
     char* config_path = NULL;
+    char* atlas_prefix = NULL;
+    char* pack_path = NULL;
+    bool benchmark = false;
+
+    int status = 0;
 
     // NOLINTNEXTLINE(concurrency-mt-unsafe)
-    while ((opt = getopt(argc, argv, "c:de:hvl:")) != -1) {
+    while ((opt = getopt(argc, argv, "a:bc:de:hvl:p:")) != -1) {
         switch (opt) {
+            case 'a':
+                atlas_prefix = optarg;
+                break;
+            case 'b':
+                benchmark = true;
+                break;
             case 'c':
                 config_path = optarg;
                 break;
@@ -74,6 +108,9 @@ int main(int argc, char* argv[]) {
             case 'l':
                 log_path = optarg;
                 break;
+            case 'p':
+                pack_path = optarg;
+                break;
             case 'h':
                 print_usage();
                 _exit(0);
@@ -111,6 +148,58 @@ int main(int argc, char* argv[]) {
         _exit(-1);
     }
 
+    // Initialize the texture atlas
+    if (!atlas_init(ATLAS_PAGE_SIZE_DEFAULT)) {
+        _exit(-1);
+    }
+
+    // Pack an atlas offline, for loading with atlas_load() later
+    if (atlas_prefix) {
+        status = atlas_build(atlas_prefix, &argv[optind], (size_t)(argc - optind)) ? 0 : -1;
+
+        goto cleanup;
+    }
+
+    // Build an asset pack offline, for opening with pack_open() later
+    if (pack_path) {
+        status = pack_build(pack_path, &argv[optind], (size_t)(argc - optind)) ? 0 : -1;
+
+        goto cleanup;
+    }
+
+    // Compare blitting images as decoded against blitting them as converted
+    if (benchmark) {
+        status = asset_benchmark(&argv[optind], (size_t)(argc - optind)) ? 0 : -1;
+
+        goto cleanup;
+    }
+
+    // Open prebuilt assets named in the config
+    if (global_config.assets.atlas && !atlas_load(global_config.assets.atlas)) {
+        _exit(-1);
+    }
+
+    if (global_config.assets.pack && !pack_open(global_config.assets.pack)) {
+        _exit(-1);
+    }
+
+    // Initialize the asset cache
+    if (!asset_init()) {
+        _exit(-1);
+    }
+
+    asset_set_budget((size_t)global_config.assets.texture_budget * 1024 * 1024);
+
+    // Initialize the cache of rotated and scaled sprites
+    if (!variant_init(VARIANT_BUDGET_DEFAULT)) {
+        _exit(-1);
+    }
+
+    // Start the pathfinding workers
+    if (!path_init(PATH_SLICE_DEFAULT)) {
+        _exit(-1);
+    }
+
     // Initialize entities
     logmsg(LOG_DEBUG, "main: Initializing entity system");
 
@@ -127,6 +216,12 @@ int main(int argc, char* argv[]) {
         _exit(-1);
     }
 
+    // Initialize the spatial index before any transforms exist, so that all of
+    // them are indexed
+    if (!spatial_init(SPATIAL_CELL_SIZE_DEFAULT)) {
+        _exit(-1);
+    }
+
     // Initialize Python scripting subsystem
     logmsg(LOG_DEBUG, "main: Initializing scripting interface");
 
@@ -167,8 +262,120 @@ int main(int argc, char* argv[]) {
 
     script_foo();
 
+    // Initialize the simulation clock
+    if (!sim_init(global_config.sim.tick_rate, global_config.sim.max_ticks)) {
+        _exit(-1);
+    }
+
+    // Open the window, and draw sprites into it
+    uint32_t window_flags = 0;
+
+    if (strcmp(global_config.window.mode, "fullscreen") == 0) {
+        window_flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    }
+
+    if (global_config.window.borderless) {
+        window_flags |= SDL_WINDOW_BORDERLESS;
+    }
+
+    if (global_config.window.hidpi) {
+        window_flags |= SDL_WINDOW_ALLOW_HIGHDPI;
+    }
+
+    if (global_config.window.resizeable) {
+        window_flags |= SDL_WINDOW_RESIZABLE;
+    }
+
+    if (!window_init("rpgng",
+            global_config.window.x,
+            global_config.window.y,
+            global_config.window.width,
+            global_config.window.height,
+            window_flags)) {
+        _exit(-1);
+    }
+
+    if (!render_init(main_renderer)) {
+        _exit(-1);
+    }
+
+    // Images loaded from now on are converted to the window's format, so that
+    // drawing them needs no conversion
+    asset_set_display_format(SDL_GetWindowPixelFormat(main_window));
+
+    // Start streaming the world, if the config names one. Cells load once a
+    // focus is set.
+    if (global_config.world.path && !world_init(global_config.world.path, global_config.world.cell_size, global_config.world.radius, (size_t)global_config.world.memory_cap * 1024 * 1024)) {
+        _exit(-1);
+    }
+
+    // Main loop
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t last = SDL_GetPerformanceCounter();
+
+    bool running = true;
+
+    while (running) {
+        SDL_Event ev;
+
+        while (SDL_PollEvent(&ev)) {
+            if (ev.type == SDL_QUIT) {
+                running = false;
+            }
+            else if (ev.type == SDL_WINDOWEVENT && (ev.window.event == SDL_WINDOWEVENT_EXPOSED || ev.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+                render_damage_all();
+            }
+        }
+
+        // Publish images decoded and transformed in the background since the
+        // last frame
+        asset_sync();
+        variant_sync();
+        world_sync();
+        path_sync();
+
+        uint64_t now = SDL_GetPerformanceCounter();
+
+        sim_frame((double)(now - last) / (double)freq);
+
+        last = now;
+
+        SDL_SetRenderDrawColor(main_renderer, 0, 0, 0, 255);
+
+        render_sprites();
+
+        // Presenting waits for vsync, which paces the loop
+        render_present();
+    }
+
+    world_cleanup();
+    path_cleanup();
+
+    render_cleanup();
+    window_cleanup();
+
     script_cleanup();
 
+    animation_cleanup();
+    camera_cleanup();
+    tilemap_cleanup();
+    trigger_cleanup();
+    collision_cleanup();
+    spatial_cleanup();
+
+    // Sprites go before the images they draw, and transforms after everything
+    // above, which holds them
+    sprite_cleanup();
+    transform_cleanup();
+
+    variant_cleanup();
+    asset_cleanup();
+
+    // The offline tools only get this far
+cleanup:
+    atlas_cleanup();
+    pack_cleanup();
+
     //    uint16_t e = entity_create("adoring-fan");
 
     //    inventory_create(e, NULL, 0);
@@ -179,4 +386,6 @@ int main(int argc, char* argv[]) {
     //    if(sdl_init() != 0){
     //        _exit(-1);
     //    }
+
+    return status;
 }
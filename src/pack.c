@@ -0,0 +1,496 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <SDL2/SDL_image.h>
+
+#include "blit.h"
+#include "htable.h"
+#include "log.h"
+#include "pack.h"
+
+#ifdef __WIN32__
+#define strdup _strdup
+#endif
+
+#define PACK_MAGIC "RPGNGPAK"
+#define PACK_VERSION 2
+
+// On-disk layout. Both structures are a multiple of 8 bytes, so the index can
+// be read in place from the start of the mapping.
+typedef struct PackHeader {
+    char magic[8];
+
+    uint32_t version;
+    uint32_t format;
+    uint32_t count;
+    uint32_t reserved;
+} PackHeader;
+
+typedef struct PackEntry {
+    // Offsets from the start of the file. Names are NUL-terminated.
+    uint64_t name_offset;
+    uint64_t pixels_offset;
+
+    uint32_t w;
+    uint32_t h;
+    uint32_t pitch;
+    uint32_t reserved;
+} PackEntry;
+
+typedef struct Pack {
+    char* path;
+
+    const uint8_t* data;
+    size_t size;
+
+    // Maps image names, which point into the mapping, to their index entries
+    HashTable* index;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} Pack;
+
+size_t pack_list_size = 0;
+Pack* pack_list = NULL;
+
+PackStats pack_stats;
+
+bool pack_map(Pack* p) {
+#ifdef _WIN32
+    p->file = CreateFileA(p->path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (p->file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(p->file, &size) || size.QuadPart == 0) {
+        CloseHandle(p->file);
+
+        return false;
+    }
+
+    p->mapping = CreateFileMappingA(p->file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!p->mapping) {
+        CloseHandle(p->file);
+
+        return false;
+    }
+
+    p->data = MapViewOfFile(p->mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!p->data) {
+        CloseHandle(p->mapping);
+        CloseHandle(p->file);
+
+        return false;
+    }
+
+    p->size = (size_t)size.QuadPart;
+#else
+    int fd = open(p->path, O_RDONLY);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+
+        return false;
+    }
+
+    // The mapping outlives the descriptor
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    p->data = data;
+    p->size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+void pack_unmap(Pack* p) {
+#ifdef _WIN32
+    UnmapViewOfFile(p->data);
+    CloseHandle(p->mapping);
+    CloseHandle(p->file);
+#else
+    munmap((void*)p->data, p->size);
+#endif
+}
+
+// Checks that an index entry lies within the file, and adds it to the index
+bool pack_index_add(Pack* p, uint32_t i) {
+    const PackEntry* e = (const PackEntry*)(p->data + sizeof(PackHeader)) + i;
+
+    if (e->name_offset >= p->size || !memchr(p->data + e->name_offset, '\0', p->size - e->name_offset)) {
+        logmsg(LOG_WARN, "pack(%s): Index entry %" PRIu32 " has an invalid name", p->path, i);
+
+        return false;
+    }
+
+    const char* name = (const char*)(p->data + e->name_offset);
+
+    if (e->w == 0 || e->h == 0 || e->w > INT32_MAX || e->h > INT32_MAX || e->pitch > INT32_MAX || e->pitch / 4 < e->w
+        || e->pixels_offset > p->size || (p->size - e->pixels_offset) / e->pitch < e->h) {
+        logmsg(LOG_WARN, "pack(%s): Index entry %" PRIu32 " ('%s') has invalid pixel data", p->path, i, name);
+
+        return false;
+    }
+
+    int ret = htable_add(p->index, (const uint8_t*)name, strlen(name) + 1, KV_VOIDPTR, (void*)e);
+
+    if (ret == -2) {
+        logmsg(LOG_WARN, "pack(%s): Skipping duplicate image '%s'", p->path, name);
+
+        return true;
+    }
+
+    if (ret != 0) {
+        logmsg(LOG_WARN, "pack(%s): Failed to index image '%s', the system is out of memory", p->path, name);
+
+        return false;
+    }
+
+    pack_stats.images++;
+
+    return true;
+}
+
+bool pack_open(const char* path) {
+    logmsg(LOG_DEBUG, "pack: Attempting to open pack at '%s'", path);
+
+    if (!path) {
+        logmsg(LOG_WARN, "pack: Unable to open pack, path is NULL");
+
+        return false;
+    }
+
+    if (pack_stats.packs == pack_list_size) {
+        size_t new_size = pack_list_size ? pack_list_size * 2 : 4;
+
+        Pack* tmp = realloc(pack_list, new_size * sizeof(Pack));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "pack(%s): Failed to open pack, the system is out of memory", path);
+
+            return false;
+        }
+
+        pack_list = tmp;
+        pack_list_size = new_size;
+    }
+
+    Pack* p = &pack_list[pack_stats.packs];
+
+    memset(p, 0, sizeof(Pack));
+
+    p->path = strdup(path);
+
+    if (!p->path) {
+        logmsg(LOG_WARN, "pack(%s): Failed to open pack, the system is out of memory", path);
+
+        return false;
+    }
+
+    if (!pack_map(p)) {
+        logmsg(LOG_WARN, "pack(%s): Failed to map pack into memory", path);
+
+        free(p->path);
+
+        return false;
+    }
+
+    const PackHeader* h = (const PackHeader*)p->data;
+
+    if (p->size < sizeof(PackHeader) || memcmp(h->magic, PACK_MAGIC, sizeof(h->magic)) != 0 || h->version != PACK_VERSION) {
+        logmsg(LOG_WARN, "pack(%s): Failed to open pack, not a pack file or unsupported version", path);
+
+        goto fail;
+    }
+
+    if (h->format != PACK_PIXEL_FORMAT) {
+        logmsg(LOG_WARN, "pack(%s): Failed to open pack, built for another pixel format or byte order", path);
+
+        goto fail;
+    }
+
+    if (h->count > (p->size - sizeof(PackHeader)) / sizeof(PackEntry)) {
+        logmsg(LOG_WARN, "pack(%s): Failed to open pack, index is truncated", path);
+
+        goto fail;
+    }
+
+    p->index = htable_create(h->count ? h->count * 2 : 1);
+
+    if (!p->index) {
+        logmsg(LOG_WARN, "pack(%s): Failed to open pack, the system is out of memory", path);
+
+        goto fail;
+    }
+
+    size_t images = pack_stats.images;
+
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (!pack_index_add(p, i)) {
+            pack_stats.images = images;
+
+            goto fail;
+        }
+    }
+
+    pack_stats.packs++;
+    pack_stats.mapped_bytes += p->size;
+
+    logmsg(LOG_INFO, "pack(%s): Opened pack of %" PRIu32 " images", path, h->count);
+
+    return true;
+
+fail:
+    if (p->index) {
+        htable_destroy(p->index);
+    }
+
+    pack_unmap(p);
+
+    free(p->path);
+
+    return false;
+}
+
+void pack_cleanup(void) {
+    logmsg(LOG_DEBUG, "pack: Closing all packs");
+
+    for (size_t i = 0; i < pack_stats.packs; i++) {
+        htable_destroy(pack_list[i].index);
+
+        pack_unmap(&pack_list[i]);
+
+        free(pack_list[i].path);
+    }
+
+    free(pack_list);
+
+    pack_list = NULL;
+    pack_list_size = 0;
+
+    memset(&pack_stats, 0, sizeof(PackStats));
+}
+
+SDL_Surface* pack_image_get(const char* name) {
+    if (!name) {
+        return NULL;
+    }
+
+    size_t key_size = strlen(name) + 1;
+
+    for (size_t i = 0; i < pack_stats.packs; i++) {
+        const PackEntry* e = htable_lookup(pack_list[i].index, (const uint8_t*)name, key_size, NULL);
+
+        if (!e) {
+            continue;
+        }
+
+        // The mapping is read-only, which is fine since cached images are
+        // never modified
+        void* pixels = (void*)(pack_list[i].data + e->pixels_offset);
+
+        SDL_Surface* s = SDL_CreateRGBSurfaceWithFormatFrom(pixels, (int)e->w, (int)e->h, 32, (int)e->pitch, PACK_PIXEL_FORMAT);
+
+        if (!s) {
+            logmsg(LOG_WARN, "pack(%s): Failed to create surface for image '%s': %s", pack_list[i].path, name, SDL_GetError());
+        }
+
+        return s;
+    }
+
+    return NULL;
+}
+
+// Offline packing
+
+// Pads the file with zeros up to the next multiple of PACK_ALIGN
+bool pack_write_pad(FILE* f, uint64_t* pos) {
+    static const uint8_t zeros[PACK_ALIGN] = {0};
+
+    size_t pad = (size_t)((PACK_ALIGN - *pos % PACK_ALIGN) % PACK_ALIGN);
+
+    *pos += pad;
+
+    return fwrite(zeros, 1, pad, f) == pad;
+}
+
+bool pack_build(const char* path, char* const* paths, size_t count) {
+    logmsg(LOG_INFO, "pack: Packing %zu images into '%s'", count, path);
+
+    SDL_Surface** images = calloc(count ? count : 1, sizeof(SDL_Surface*));
+    PackEntry* entries = calloc(count ? count : 1, sizeof(PackEntry));
+    const char** names = calloc(count ? count : 1, sizeof(char*));
+
+    FILE* f = NULL;
+
+    bool ret = false;
+
+    if (!images || !entries || !names) {
+        logmsg(LOG_WARN, "pack: Failed to build pack, the system is out of memory");
+
+        goto cleanup;
+    }
+
+    uint32_t n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        SDL_Surface* loaded = IMG_Load(paths[i]);
+
+        if (!loaded) {
+            logmsg(LOG_WARN, "pack: Skipping image '%s', failed to load it", paths[i]);
+
+            continue;
+        }
+
+        images[n] = SDL_ConvertSurfaceFormat(loaded, PACK_PIXEL_FORMAT, 0);
+
+        SDL_FreeSurface(loaded);
+
+        if (images[n] && !blit_premultiply(images[n])) {
+            SDL_FreeSurface(images[n]);
+
+            images[n] = NULL;
+        }
+
+        if (!images[n]) {
+            logmsg(LOG_WARN, "pack: Skipping image '%s', failed to convert it: %s", paths[i], SDL_GetError());
+
+            continue;
+        }
+
+        names[n++] = paths[i];
+    }
+
+    // Lay out the index, then the names, then the pixels
+    uint64_t pos = sizeof(PackHeader) + (uint64_t)n * sizeof(PackEntry);
+
+    for (uint32_t i = 0; i < n; i++) {
+        entries[i].name_offset = pos;
+
+        pos += strlen(names[i]) + 1;
+    }
+
+    uint64_t names_end = pos;
+
+    for (uint32_t i = 0; i < n; i++) {
+        pos += (PACK_ALIGN - pos % PACK_ALIGN) % PACK_ALIGN;
+
+        entries[i].w = (uint32_t)images[i]->w;
+        entries[i].h = (uint32_t)images[i]->h;
+        entries[i].pitch = (uint32_t)images[i]->w * 4;
+        entries[i].pixels_offset = pos;
+
+        pos += (uint64_t)entries[i].pitch * entries[i].h;
+    }
+
+    f = fopen(path, "wb");
+
+    if (!f) {
+        logmsg(LOG_WARN, "pack: Failed to open '%s' for writing", path);
+
+        goto cleanup;
+    }
+
+    PackHeader header = {.version = PACK_VERSION, .format = PACK_PIXEL_FORMAT, .count = n};
+
+    memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+
+    if (fwrite(&header, sizeof(PackHeader), 1, f) != 1 || (n && fwrite(entries, sizeof(PackEntry), n, f) != n)) {
+        goto write_fail;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (fwrite(names[i], strlen(names[i]) + 1, 1, f) != 1) {
+            goto write_fail;
+        }
+    }
+
+    pos = names_end;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (!pack_write_pad(f, &pos)) {
+            goto write_fail;
+        }
+
+        // Rows are written tightly, whatever the surface pitch
+        for (int y = 0; y < images[i]->h; y++) {
+            if (fwrite((const uint8_t*)images[i]->pixels + (size_t)y * images[i]->pitch, entries[i].pitch, 1, f) != 1) {
+                goto write_fail;
+            }
+        }
+
+        pos += (uint64_t)entries[i].pitch * entries[i].h;
+    }
+
+    if (fclose(f) != 0) {
+        f = NULL;
+
+        goto write_fail;
+    }
+
+    f = NULL;
+
+    logmsg(LOG_INFO, "pack: Wrote %" PRIu32 " images to '%s'", n, path);
+
+    ret = true;
+
+    goto cleanup;
+
+write_fail:
+    logmsg(LOG_WARN, "pack: Failed to write pack '%s'", path);
+
+cleanup:
+    if (f) {
+        fclose(f);
+    }
+
+    if (images) {
+        for (size_t i = 0; i < count; i++) {
+            SDL_FreeSurface(images[i]);
+        }
+    }
+
+    free(images);
+    free(entries);
+    free(names);
+
+    return ret;
+}
+
+const PackStats* pack_get_stats(void) {
+    return &pack_stats;
+}
@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_PACK
+#define RPGNG_PACK
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+// The pixel format of images in a pack, which is the format images are
+// composited in, so that packed pixels are used without conversion. Color
+// channels are stored premultiplied by alpha, as the asset cache keeps them.
+#define PACK_PIXEL_FORMAT SDL_PIXELFORMAT_ARGB8888
+
+// Pixel data for each image starts on a multiple of this many bytes
+#define PACK_ALIGN 64
+
+/*
+ * A pack is a single file of images which have already been decoded. It starts
+ * with a header and an index of every image, followed by the image names, and
+ * then the pixel data of each image in PACK_PIXEL_FORMAT.
+ *
+ * Packs are written in the byte order of the machine which builds them, and
+ * are rejected by machines of the other byte order.
+ */
+
+typedef struct PackStats {
+    size_t packs;
+    size_t images;
+
+    // Bytes of pack files mapped into memory
+    size_t mapped_bytes;
+} PackStats;
+
+/**
+ * Maps the pack at the given path into memory, making its images available
+ * through pack_image_get(). Any number of packs can be open at once. When
+ * several hold an image by the same name, the first opened wins.
+ *
+ * @return On success, returns true. On failure, or if the file isn't a valid
+ * pack, returns false.
+ */
+bool pack_open(const char* path);
+
+/**
+ * Unmaps every open pack. Surfaces returned by pack_image_get() must be freed
+ * first.
+ */
+void pack_cleanup(void);
+
+/**
+ * Gets an image from an open pack. No pixels are copied or decoded; the
+ * surface refers directly to the mapped pack file, and is paged in as it's
+ * used.
+ *
+ * @param name The name of the image, which is the path it was packed from.
+ *
+ * @return On success, returns a new surface, which must be freed with
+ * SDL_FreeSurface() before the pack is closed. Returns NULL if no open pack
+ * holds the image, or on failure.
+ */
+SDL_Surface* pack_image_get(const char* name);
+
+/**
+ * Decodes the given image files, and writes them to a new pack at the given
+ * path. Images which fail to load are skipped.
+ *
+ * @param paths The image files to pack, which are also the names under which
+ * they're packed.
+ */
+bool pack_build(const char* path, char* const* paths, size_t count);
+
+/**
+ * Gets the pack statistics.
+ */
+const PackStats* pack_get_stats(void);
+
+#endif
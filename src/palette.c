@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "blit.h"
+#include "log.h"
+#include "palette.h"
+
+struct Palette {
+    // Premultiplied, in BLIT_PIXEL_FORMAT
+    uint32_t entries[PALETTE_SIZE];
+
+    // As given, in straight alpha
+    SDL_Color colors[PALETTE_SIZE];
+
+    uint64_t version;
+
+    size_t refcount;
+};
+
+void palette_premultiply(const SDL_Color* colors, size_t count, uint32_t* entries) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t a = colors[i].a;
+
+        entries[i] = (a << 24) | (blit_mul255(colors[i].r, a) << 16) | (blit_mul255(colors[i].g, a) << 8) | blit_mul255(colors[i].b, a);
+    }
+}
+
+Palette* palette_create(const SDL_Color* colors, size_t count) {
+    if (count > PALETTE_SIZE) {
+        logmsg(LOG_WARN, "palette: Unable to create palette, %zu colors is more than %d", count, PALETTE_SIZE);
+
+        return NULL;
+    }
+
+    Palette* p = calloc(1, sizeof(Palette));
+
+    if (!p) {
+        logmsg(LOG_WARN, "palette: Failed to create palette, the system is out of memory");
+
+        return NULL;
+    }
+
+    p->refcount = 1;
+    p->version = 1;
+
+    if (count > 0) {
+        memcpy(p->colors, colors, count * sizeof(SDL_Color));
+
+        palette_premultiply(colors, count, p->entries);
+    }
+
+    return p;
+}
+
+Palette* palette_create_from_surface(SDL_Surface* s) {
+    SDL_Palette* own = s->format->palette;
+
+    if (!own) {
+        logmsg(LOG_WARN, "palette: Unable to create palette, %s surfaces have no palette", SDL_GetPixelFormatName(s->format->format));
+
+        return NULL;
+    }
+
+    size_t count = (own->ncolors < PALETTE_SIZE) ? (size_t)own->ncolors : PALETTE_SIZE;
+
+    return palette_create(own->colors, count);
+}
+
+void palette_acquire(Palette* p) {
+    p->refcount++;
+}
+
+void palette_release(Palette* p) {
+    if (!p) {
+        return;
+    }
+
+    if (p->refcount == 0) {
+        logmsg(LOG_ERR, "palette: Released palette which holds no references");
+
+        _exit(-1);
+    }
+
+    if (--p->refcount == 0) {
+        free(p);
+    }
+}
+
+bool palette_set_colors(Palette* p, size_t first, const SDL_Color* colors, size_t count) {
+    if (first > PALETTE_SIZE || count > PALETTE_SIZE - first) {
+        logmsg(LOG_WARN, "palette: Unable to set %zu colors from entry %zu, palettes hold %d", count, first, PALETTE_SIZE);
+
+        return false;
+    }
+
+    memcpy(&p->colors[first], colors, count * sizeof(SDL_Color));
+
+    palette_premultiply(colors, count, &p->entries[first]);
+
+    p->version++;
+
+    return true;
+}
+
+SDL_Color palette_get_color(const Palette* p, uint8_t index) {
+    return p->colors[index];
+}
+
+const uint32_t* palette_get_entries(const Palette* p) {
+    return p->entries;
+}
+
+uint64_t palette_get_version(const Palette* p) {
+    return p->version;
+}
+
+size_t palette_get_refcount(const Palette* p) {
+    return p->refcount;
+}
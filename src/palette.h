@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_PALETTE
+#define RPGNG_PALETTE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// The number of entries in every palette, which is as many as an 8-bit index
+// can address
+#define PALETTE_SIZE 256
+
+typedef struct Palette Palette;
+
+/*
+ * Indexed images store one byte per pixel, which picks a color from a palette.
+ * Drawing the same image with another palette recolors it, without loading or
+ * storing another copy of it.
+ *
+ * Palettes are given in straight alpha, and kept in BLIT_PIXEL_FORMAT with
+ * premultiplied alpha, ready to expand into drawable pixels. Every change to a
+ * palette bumps its version, so that whatever was expanded from it can tell
+ * it's stale.
+ */
+
+/**
+ * Creates a palette. Entries past the given colors are transparent.
+ *
+ * @param count The number of colors, up to PALETTE_SIZE.
+ *
+ * @return On success, returns a palette holding one reference, which must be
+ * released with palette_release(). On failure, returns NULL.
+ */
+Palette* palette_create(const SDL_Color* colors, size_t count);
+
+/**
+ * Creates a palette holding a copy of an indexed surface's own colors, as a
+ * starting point for recoloring it.
+ *
+ * @return On success, returns a palette holding one reference, which must be
+ * released with palette_release(). Returns NULL if the surface isn't indexed,
+ * or if the system is out of memory.
+ */
+Palette* palette_create_from_surface(SDL_Surface* s);
+
+/**
+ * Acquires another reference to a palette.
+ */
+void palette_acquire(Palette* p);
+
+/**
+ * Releases a reference to a palette, freeing it once the last one is released.
+ */
+void palette_release(Palette* p);
+
+/**
+ * Replaces a run of palette entries. This only touches the entries given, so
+ * recoloring every image drawn with the palette costs at most PALETTE_SIZE
+ * writes.
+ *
+ * @param first The first entry to replace.
+ *
+ * @return On success, returns true. Returns false if the run doesn't fit in
+ * the palette.
+ */
+bool palette_set_colors(Palette* p, size_t first, const SDL_Color* colors, size_t count);
+
+/**
+ * Gets a palette entry, in straight alpha, as it was given.
+ */
+SDL_Color palette_get_color(const Palette* p, uint8_t index);
+
+/**
+ * Gets every entry of a palette, premultiplied, in BLIT_PIXEL_FORMAT. The
+ * entries belong to the palette, and change along with it.
+ */
+const uint32_t* palette_get_entries(const Palette* p);
+
+/**
+ * Gets the version of a palette, which changes whenever its colors do.
+ */
+uint64_t palette_get_version(const Palette* p);
+
+/**
+ * Gets the number of references held to a palette.
+ */
+size_t palette_get_refcount(const Palette* p);
+
+/**
+ * Premultiplies colors into palette entries in BLIT_PIXEL_FORMAT.
+ */
+void palette_premultiply(const SDL_Color* colors, size_t count, uint32_t* entries);
+
+#endif
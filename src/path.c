@@ -0,0 +1,1738 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include <SDL2/SDL.h>
+
+#include "entity.h"
+#include "htable.h"
+#include "log.h"
+#include "path.h"
+
+#include "component/component.h"
+#include "component/tilemap.h"
+
+// The length of a straight and a diagonal step onto a tile of cost 1
+#define PATH_STEP_STRAIGHT 10
+#define PATH_STEP_DIAGONAL 14
+
+// Marks a node which has left the open list
+#define PATH_CLOSED UINT32_MAX
+
+// Marks the start node, which has no parent
+#define PATH_NO_PARENT UINT32_MAX
+
+typedef struct PathEdit {
+    uint32_t index;
+    uint8_t cost;
+} PathEdit;
+
+struct PathGrid {
+    uint32_t width;
+    uint32_t height;
+
+    uint8_t* costs;
+
+    // The number of tiles of each cost, and the number of distinct walkable
+    // costs. A grid with a single walkable cost is searched with jump point
+    // search.
+    size_t histogram[256];
+    size_t distinct;
+
+    // Bumped whenever a tile gets cheaper, which drops every cached path over
+    // the grid
+    uint64_t epoch;
+
+    // Tiles made more expensive since the last batch, past which the cache is
+    // dropped wholesale rather than searched tile by tile
+    size_t raised;
+
+    // Cost changes made while the workers were busy, applied by path_sync()
+    size_t edits_size;
+    size_t edits_count;
+    PathEdit* edits;
+
+    // The tilemap layer followed, if any, and the cost of each tile ID
+    bool follows;
+    uint16_t entity_id;
+    size_t layer;
+    uint64_t version;
+
+    size_t tile_cost_count;
+    uint8_t* tile_costs;
+
+    // Set by path_grid_destroy(), under path_lock. The grid is freed by
+    // path_sync() once the workers are done with it.
+    bool dead;
+};
+
+typedef struct PathQuery PathQuery;
+
+struct PathQuery {
+    uint32_t id;
+
+    PathGrid* grid;
+
+    uint32_t sx;
+    uint32_t sy;
+    uint32_t gx;
+    uint32_t gy;
+
+    path_cb_t cb;
+    void* userdata;
+
+    // Set under path_lock. Cancelled queries aren't searched, and don't call
+    // back.
+    bool cancelled;
+
+    // Written by the worker which searched for the path. The buffer is kept
+    // when the query is recycled. Workers don't log, so a search which ran out
+    // of memory is marked failed, and reported once it's finished.
+    bool failed;
+    bool jps;
+    uint64_t epoch;
+    uint64_t expanded;
+
+    size_t points_size;
+    size_t points_count;
+    PathPoint* points;
+
+    // Where the query is in path_active
+    size_t index;
+
+    PathQuery* next;
+};
+
+// A worker's search state, sized for the largest grid it has searched. Nodes
+// are only valid when their stamp matches the current generation, so that
+// nothing needs clearing between searches.
+typedef struct PathSearch {
+    size_t capacity;
+
+    uint32_t generation;
+    uint32_t* stamp;
+
+    uint32_t* g;
+    uint32_t* f;
+    uint32_t* parent;
+
+    // Where each node is in the open list, or PATH_CLOSED
+    uint32_t* slot;
+
+    size_t open_count;
+    uint32_t* open;
+
+    // The grid being searched
+    PathGrid* grid;
+    uint32_t goal;
+    uint32_t min_cost;
+} PathSearch;
+
+typedef struct PathKey {
+    PathGrid* grid;
+
+    uint32_t sx;
+    uint32_t sy;
+    uint32_t gx;
+    uint32_t gy;
+} PathKey;
+
+typedef struct PathCacheEntry PathCacheEntry;
+
+struct PathCacheEntry {
+    PathKey key;
+
+    uint64_t epoch;
+
+    size_t points_size;
+    size_t points_count;
+    PathPoint* points;
+
+    // The bounds of the path, to rule out most entries quickly when a tile
+    // gets more expensive
+    uint32_t min_x;
+    uint32_t min_y;
+    uint32_t max_x;
+    uint32_t max_y;
+
+    PathCacheEntry* prev;
+    PathCacheEntry* next;
+};
+
+double path_slice = PATH_SLICE_DEFAULT;
+
+size_t path_grids_size = 0;
+size_t path_grids_count = 0;
+PathGrid** path_grids = NULL;
+
+// Queries which haven't called back, indexed for path_cancel()
+size_t path_active_size = 0;
+size_t path_active_count = 0;
+PathQuery** path_active = NULL;
+
+uint32_t path_next_id = 1;
+
+// Queries made since the last batch, and queries ready for reuse
+PathQuery* path_pending_head = NULL;
+PathQuery* path_pending_tail = NULL;
+PathQuery* path_free = NULL;
+
+// Cached paths, most recently used first, and entries ready for reuse
+HashTable* path_cache_table = NULL;
+
+PathCacheEntry* path_cache_head = NULL;
+PathCacheEntry* path_cache_tail = NULL;
+PathCacheEntry* path_cache_free = NULL;
+
+PathStats path_stats;
+
+// Workers, started by path_init()
+SDL_mutex* path_lock = NULL;
+SDL_cond* path_work = NULL;
+SDL_cond* path_finished = NULL;
+
+SDL_Thread* path_threads[PATH_THREADS] = {0};
+size_t path_thread_count = 0;
+
+PathSearch path_searches[PATH_THREADS];
+
+bool path_quit = false;
+
+// Guarded by path_lock. Queued queries are taken in order until the slice
+// ends, while done queries are pushed and published newest first.
+PathQuery* path_queue_head = NULL;
+PathQuery* path_queue_tail = NULL;
+PathQuery* path_done = NULL;
+
+size_t path_running = 0;
+uint64_t path_slice_end = 0;
+
+// Searching
+
+bool path_search_reserve(PathSearch* s, size_t nodes) {
+    if (nodes <= s->capacity) {
+        return true;
+    }
+
+    uint32_t* stamp = calloc(nodes, sizeof(uint32_t));
+    uint32_t* g = malloc(nodes * sizeof(uint32_t));
+    uint32_t* f = malloc(nodes * sizeof(uint32_t));
+    uint32_t* parent = malloc(nodes * sizeof(uint32_t));
+    uint32_t* slot = malloc(nodes * sizeof(uint32_t));
+    uint32_t* open = malloc(nodes * sizeof(uint32_t));
+
+    if (!stamp || !g || !f || !parent || !slot || !open) {
+        free(stamp);
+        free(g);
+        free(f);
+        free(parent);
+        free(slot);
+        free(open);
+
+        return false;
+    }
+
+    free(s->stamp);
+    free(s->g);
+    free(s->f);
+    free(s->parent);
+    free(s->slot);
+    free(s->open);
+
+    s->stamp = stamp;
+    s->g = g;
+    s->f = f;
+    s->parent = parent;
+    s->slot = slot;
+    s->open = open;
+
+    s->capacity = nodes;
+    s->generation = 0;
+
+    return true;
+}
+
+void path_search_free(PathSearch* s) {
+    free(s->stamp);
+    free(s->g);
+    free(s->f);
+    free(s->parent);
+    free(s->slot);
+    free(s->open);
+
+    memset(s, 0, sizeof(PathSearch));
+}
+
+bool path_walkable(const PathGrid* g, int64_t x, int64_t y) {
+    if (x < 0 || y < 0 || x >= g->width || y >= g->height) {
+        return false;
+    }
+
+    return g->costs[(size_t)y * g->width + (size_t)x] != PATH_COST_BLOCKED;
+}
+
+// The octile distance between two tiles, in steps of cost 1
+uint32_t path_distance(uint32_t ax, uint32_t ay, uint32_t bx, uint32_t by) {
+    uint32_t dx = (ax > bx) ? ax - bx : bx - ax;
+    uint32_t dy = (ay > by) ? ay - by : by - ay;
+
+    uint32_t lo = (dx < dy) ? dx : dy;
+    uint32_t hi = (dx < dy) ? dy : dx;
+
+    return PATH_STEP_STRAIGHT * hi + (PATH_STEP_DIAGONAL - PATH_STEP_STRAIGHT) * lo;
+}
+
+bool path_open_less(const PathSearch* s, uint32_t a, uint32_t b) {
+    // Among equally promising nodes, those nearer the goal go first
+    return s->f[a] < s->f[b] || (s->f[a] == s->f[b] && s->g[a] > s->g[b]);
+}
+
+void path_open_place(PathSearch* s, size_t i, uint32_t node) {
+    s->open[i] = node;
+    s->slot[node] = (uint32_t)i;
+}
+
+void path_open_up(PathSearch* s, size_t i) {
+    uint32_t node = s->open[i];
+
+    while (i > 0) {
+        size_t up = (i - 1) / 2;
+
+        if (!path_open_less(s, node, s->open[up])) {
+            break;
+        }
+
+        path_open_place(s, i, s->open[up]);
+
+        i = up;
+    }
+
+    path_open_place(s, i, node);
+}
+
+uint32_t path_open_pop(PathSearch* s) {
+    uint32_t top = s->open[0];
+    uint32_t node = s->open[--s->open_count];
+
+    s->slot[top] = PATH_CLOSED;
+
+    if (s->open_count == 0) {
+        return top;
+    }
+
+    size_t i = 0;
+
+    while (true) {
+        size_t child = i * 2 + 1;
+
+        if (child >= s->open_count) {
+            break;
+        }
+
+        if (child + 1 < s->open_count && path_open_less(s, s->open[child + 1], s->open[child])) {
+            child++;
+        }
+
+        if (!path_open_less(s, s->open[child], node)) {
+            break;
+        }
+
+        path_open_place(s, i, s->open[child]);
+
+        i = child;
+    }
+
+    path_open_place(s, i, node);
+
+    return top;
+}
+
+// Reaches a node at the given cost, opening it, or moving it up the open list
+// if that's cheaper than it was reached before
+void path_relax(PathSearch* s, uint32_t node, uint32_t parent, uint32_t g) {
+    if (s->stamp[node] != s->generation) {
+        uint32_t w = s->grid->width;
+
+        s->stamp[node] = s->generation;
+        s->g[node] = g;
+        s->f[node] = g + path_distance(node % w, node / w, s->goal % w, s->goal / w) * s->min_cost;
+        s->parent[node] = parent;
+
+        path_open_place(s, s->open_count++, node);
+        path_open_up(s, s->open_count - 1);
+    }
+    else if (s->slot[node] != PATH_CLOSED && g < s->g[node]) {
+        s->f[node] -= s->g[node] - g;
+        s->g[node] = g;
+        s->parent[node] = parent;
+
+        path_open_up(s, s->slot[node]);
+    }
+}
+
+void path_expand_astar(PathSearch* s, uint32_t node) {
+    const PathGrid* grid = s->grid;
+
+    int64_t x = node % grid->width;
+    int64_t y = node / grid->width;
+
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if ((dx == 0 && dy == 0) || !path_walkable(grid, x + dx, y + dy)) {
+                continue;
+            }
+
+            // Diagonal steps can't cut past a blocked corner
+            if (dx != 0 && dy != 0 && (!path_walkable(grid, x + dx, y) || !path_walkable(grid, x, y + dy))) {
+                continue;
+            }
+
+            uint32_t next = (uint32_t)((y + dy) * grid->width + (x + dx));
+            uint32_t step = (dx != 0 && dy != 0) ? PATH_STEP_DIAGONAL : PATH_STEP_STRAIGHT;
+
+            path_relax(s, next, node, s->g[node] + step * grid->costs[next]);
+        }
+    }
+}
+
+// Follows a row or column from the given tile until it reaches the goal, or a
+// tile with a neighbor which can only be reached through it
+bool path_jump_straight(const PathSearch* s, int64_t x, int64_t y, int dx, int dy, uint32_t* out) {
+    const PathGrid* grid = s->grid;
+
+    while (path_walkable(grid, x, y)) {
+        if ((uint32_t)(y * grid->width + x) == s->goal) {
+            *out = (uint32_t)(y * grid->width + x);
+
+            return true;
+        }
+
+        bool forced = false;
+
+        if (dx != 0) {
+            forced = (path_walkable(grid, x, y - 1) && !path_walkable(grid, x - dx, y - 1)) || (path_walkable(grid, x, y + 1) && !path_walkable(grid, x - dx, y + 1));
+        }
+        else {
+            forced = (path_walkable(grid, x - 1, y) && !path_walkable(grid, x - 1, y - dy)) || (path_walkable(grid, x + 1, y) && !path_walkable(grid, x + 1, y - dy));
+        }
+
+        if (forced) {
+            *out = (uint32_t)(y * grid->width + x);
+
+            return true;
+        }
+
+        x += dx;
+        y += dy;
+    }
+
+    return false;
+}
+
+// Follows a diagonal from the given tile until it reaches the goal, or a tile
+// from which a row or column leads to a jump point
+bool path_jump_diagonal(const PathSearch* s, int64_t x, int64_t y, int dx, int dy, uint32_t* out) {
+    const PathGrid* grid = s->grid;
+
+    uint32_t found = 0;
+
+    while (path_walkable(grid, x, y)) {
+        if ((uint32_t)(y * grid->width + x) == s->goal || path_jump_straight(s, x + dx, y, dx, 0, &found) || path_jump_straight(s, x, y + dy, 0, dy, &found)) {
+            *out = (uint32_t)(y * grid->width + x);
+
+            return true;
+        }
+
+        if (!path_walkable(grid, x + dx, y) || !path_walkable(grid, x, y + dy)) {
+            return false;
+        }
+
+        x += dx;
+        y += dy;
+    }
+
+    return false;
+}
+
+void path_jump(PathSearch* s, uint32_t node, int dx, int dy) {
+    const PathGrid* grid = s->grid;
+
+    int64_t x = node % grid->width;
+    int64_t y = node / grid->width;
+
+    uint32_t found = 0;
+    bool jumped = false;
+
+    if (dx != 0 && dy != 0) {
+        jumped = path_jump_diagonal(s, x + dx, y + dy, dx, dy, &found);
+    }
+    else {
+        jumped = path_jump_straight(s, x + dx, y + dy, dx, dy, &found);
+    }
+
+    if (jumped) {
+        uint32_t d = path_distance((uint32_t)x, (uint32_t)y, found % grid->width, found / grid->width);
+
+        path_relax(s, found, node, s->g[node] + d * s->min_cost);
+    }
+}
+
+// Jump point search, for grids whose walkable tiles all cost the same. Only
+// the directions a path through the node could take without a shorter
+// alternative avoiding it are followed.
+void path_expand_jps(PathSearch* s, uint32_t node) {
+    const PathGrid* grid = s->grid;
+
+    int64_t x = node % grid->width;
+    int64_t y = node / grid->width;
+
+    if (s->parent[node] == PATH_NO_PARENT) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if ((dx == 0 && dy == 0) || !path_walkable(grid, x + dx, y + dy)) {
+                    continue;
+                }
+
+                if (dx != 0 && dy != 0 && (!path_walkable(grid, x + dx, y) || !path_walkable(grid, x, y + dy))) {
+                    continue;
+                }
+
+                path_jump(s, node, dx, dy);
+            }
+        }
+
+        return;
+    }
+
+    int64_t px = s->parent[node] % grid->width;
+    int64_t py = s->parent[node] / grid->width;
+
+    int dx = (x > px) - (x < px);
+    int dy = (y > py) - (y < py);
+
+    if (dx != 0 && dy != 0) {
+        bool across = path_walkable(grid, x + dx, y);
+        bool down = path_walkable(grid, x, y + dy);
+
+        if (down) {
+            path_jump(s, node, 0, dy);
+        }
+
+        if (across) {
+            path_jump(s, node, dx, 0);
+        }
+
+        if (across && down) {
+            path_jump(s, node, dx, dy);
+        }
+    }
+    else if (dx != 0) {
+        bool ahead = path_walkable(grid, x + dx, y);
+        bool below = path_walkable(grid, x, y + 1);
+        bool above = path_walkable(grid, x, y - 1);
+
+        if (ahead) {
+            path_jump(s, node, dx, 0);
+
+            if (below) {
+                path_jump(s, node, dx, 1);
+            }
+
+            if (above) {
+                path_jump(s, node, dx, -1);
+            }
+        }
+
+        if (below) {
+            path_jump(s, node, 0, 1);
+        }
+
+        if (above) {
+            path_jump(s, node, 0, -1);
+        }
+    }
+    else {
+        bool ahead = path_walkable(grid, x, y + dy);
+        bool right = path_walkable(grid, x + 1, y);
+        bool left = path_walkable(grid, x - 1, y);
+
+        if (ahead) {
+            path_jump(s, node, 0, dy);
+
+            if (right) {
+                path_jump(s, node, 1, dy);
+            }
+
+            if (left) {
+                path_jump(s, node, -1, dy);
+            }
+        }
+
+        if (right) {
+            path_jump(s, node, 1, 0);
+        }
+
+        if (left) {
+            path_jump(s, node, -1, 0);
+        }
+    }
+}
+
+// Writes out every tile from the start to the goal. Jump points are joined by
+// straight or diagonal runs, which are filled in.
+bool path_trace(PathSearch* s, PathQuery* q) {
+    uint32_t w = s->grid->width;
+
+    size_t count = 1;
+
+    for (uint32_t node = s->goal; s->parent[node] != PATH_NO_PARENT; node = s->parent[node]) {
+        uint32_t prev = s->parent[node];
+
+        uint32_t dx = (node % w > prev % w) ? node % w - prev % w : prev % w - node % w;
+        uint32_t dy = (node / w > prev / w) ? node / w - prev / w : prev / w - node / w;
+
+        count += (dx > dy) ? dx : dy;
+    }
+
+    if (count > q->points_size) {
+        PathPoint* tmp = realloc(q->points, count * sizeof(PathPoint));
+
+        if (!tmp) {
+            return false;
+        }
+
+        q->points = tmp;
+        q->points_size = count;
+    }
+
+    size_t i = count;
+
+    for (uint32_t node = s->goal;; node = s->parent[node]) {
+        int64_t x = node % w;
+        int64_t y = node / w;
+
+        q->points[--i] = (PathPoint){(uint32_t)x, (uint32_t)y};
+
+        if (s->parent[node] == PATH_NO_PARENT) {
+            break;
+        }
+
+        int64_t px = s->parent[node] % w;
+        int64_t py = s->parent[node] / w;
+
+        int dx = (px > x) - (px < x);
+        int dy = (py > y) - (py < y);
+
+        for (x += dx, y += dy; x != px || y != py; x += dx, y += dy) {
+            q->points[--i] = (PathPoint){(uint32_t)x, (uint32_t)y};
+        }
+    }
+
+    q->points_count = count;
+
+    return true;
+}
+
+// Searches for the query's path. Run by worker threads, so it doesn't log.
+// Returns false if it ran out of memory.
+bool path_search(PathSearch* s, PathQuery* q) {
+    PathGrid* grid = q->grid;
+
+    q->points_count = 0;
+    q->expanded = 0;
+    q->epoch = grid->epoch;
+    q->jps = grid->distinct <= 1;
+
+    uint32_t start = q->sy * grid->width + q->sx;
+    uint32_t goal = q->gy * grid->width + q->gx;
+
+    if (grid->costs[goal] == PATH_COST_BLOCKED) {
+        return true;
+    }
+
+    if (!path_search_reserve(s, (size_t)grid->width * grid->height)) {
+        return false;
+    }
+
+    if (++s->generation == 0) {
+        memset(s->stamp, 0, s->capacity * sizeof(uint32_t));
+
+        s->generation = 1;
+    }
+
+    s->grid = grid;
+    s->goal = goal;
+    s->open_count = 0;
+    s->min_cost = 1;
+
+    for (size_t i = 1; i < 256; i++) {
+        if (grid->histogram[i] > 0) {
+            s->min_cost = (uint32_t)i;
+
+            break;
+        }
+    }
+
+    path_relax(s, start, PATH_NO_PARENT, 0);
+
+    while (s->open_count > 0) {
+        uint32_t node = path_open_pop(s);
+
+        if (node == goal) {
+            return path_trace(s, q);
+        }
+
+        q->expanded++;
+
+        if (q->jps) {
+            path_expand_jps(s, node);
+        }
+        else {
+            path_expand_astar(s, node);
+        }
+    }
+
+    return true;
+}
+
+int path_worker_run(void* data) {
+    PathSearch* s = data;
+
+    // Searches are background work, which mustn't take a core from the frame
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    SDL_LockMutex(path_lock);
+
+    while (true) {
+        while (!path_quit && (!path_queue_head || SDL_GetPerformanceCounter() >= path_slice_end)) {
+            SDL_CondWait(path_work, path_lock);
+        }
+
+        if (path_quit) {
+            break;
+        }
+
+        PathQuery* q = path_queue_head;
+
+        path_queue_head = q->next;
+
+        if (!path_queue_head) {
+            path_queue_tail = NULL;
+        }
+
+        bool skip = q->cancelled || q->grid->dead;
+
+        path_running++;
+
+        SDL_UnlockMutex(path_lock);
+
+        if (skip) {
+            q->points_count = 0;
+            q->expanded = 0;
+            q->failed = false;
+        }
+        else {
+            q->failed = !path_search(s, q);
+        }
+
+        SDL_LockMutex(path_lock);
+
+        q->next = path_done;
+
+        path_done = q;
+        path_running--;
+
+        SDL_CondBroadcast(path_finished);
+    }
+
+    SDL_UnlockMutex(path_lock);
+
+    return 0;
+}
+
+void path_workers_stop(void) {
+    if (!path_lock) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "path: Stopping workers");
+
+    SDL_LockMutex(path_lock);
+
+    path_quit = true;
+
+    SDL_CondBroadcast(path_work);
+    SDL_UnlockMutex(path_lock);
+
+    for (size_t i = 0; i < path_thread_count; i++) {
+        SDL_WaitThread(path_threads[i], NULL);
+
+        path_threads[i] = NULL;
+    }
+
+    for (size_t i = 0; i < PATH_THREADS; i++) {
+        path_search_free(&path_searches[i]);
+    }
+
+    SDL_DestroyCond(path_work);
+    SDL_DestroyCond(path_finished);
+    SDL_DestroyMutex(path_lock);
+
+    path_lock = NULL;
+    path_work = NULL;
+    path_finished = NULL;
+
+    path_thread_count = 0;
+    path_quit = false;
+}
+
+bool path_workers_start(void) {
+    logmsg(LOG_DEBUG, "path: Starting %d workers", PATH_THREADS);
+
+    path_lock = SDL_CreateMutex();
+    path_work = SDL_CreateCond();
+    path_finished = SDL_CreateCond();
+
+    if (!path_lock || !path_work || !path_finished) {
+        logmsg(LOG_WARN, "path: Failed to start workers: %s", SDL_GetError());
+
+        SDL_DestroyCond(path_work);
+        SDL_DestroyCond(path_finished);
+        SDL_DestroyMutex(path_lock);
+
+        path_lock = NULL;
+        path_work = NULL;
+        path_finished = NULL;
+
+        return false;
+    }
+
+    for (size_t i = 0; i < PATH_THREADS; i++) {
+        SDL_Thread* t = SDL_CreateThread(path_worker_run, "path_worker", &path_searches[path_thread_count]);
+
+        if (!t) {
+            logmsg(LOG_WARN, "path: Failed to start worker thread: %s", SDL_GetError());
+
+            continue;
+        }
+
+        path_threads[path_thread_count++] = t;
+    }
+
+    if (path_thread_count == 0) {
+        path_workers_stop();
+
+        return false;
+    }
+
+    return true;
+}
+
+// Cache
+
+void path_cache_unlink(PathCacheEntry* e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        path_cache_head = e->next;
+    }
+
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        path_cache_tail = e->prev;
+    }
+
+    e->prev = NULL;
+    e->next = NULL;
+}
+
+void path_cache_push_front(PathCacheEntry* e) {
+    e->next = path_cache_head;
+
+    if (path_cache_head) {
+        path_cache_head->prev = e;
+    }
+    else {
+        path_cache_tail = e;
+    }
+
+    path_cache_head = e;
+}
+
+// Drops an entry, keeping it and its buffer for reuse
+void path_cache_drop(PathCacheEntry* e) {
+    path_cache_unlink(e);
+
+    if (htable_remove(path_cache_table, (const uint8_t*)&e->key, sizeof(PathKey)) != 0) {
+        logmsg(LOG_ERR, "path: Failed to remove cached path, but it was present in the cache table");
+
+        _exit(-1);
+    }
+
+    e->next = path_cache_free;
+
+    path_cache_free = e;
+
+    path_stats.cached--;
+}
+
+void path_cache_key(const PathQuery* q, PathKey* key) {
+    memset(key, 0, sizeof(PathKey));
+
+    key->grid = q->grid;
+    key->sx = q->sx;
+    key->sy = q->sy;
+    key->gx = q->gx;
+    key->gy = q->gy;
+}
+
+PathCacheEntry* path_cache_lookup(const PathQuery* q) {
+    PathKey key;
+
+    path_cache_key(q, &key);
+
+    PathCacheEntry* e = htable_lookup(path_cache_table, (const uint8_t*)&key, sizeof(PathKey), NULL);
+
+    if (!e) {
+        return NULL;
+    }
+
+    // A tile on the grid got cheaper since the path was found
+    if (e->epoch != q->grid->epoch) {
+        path_cache_drop(e);
+
+        path_stats.invalidated++;
+
+        return NULL;
+    }
+
+    path_cache_unlink(e);
+    path_cache_push_front(e);
+
+    return e;
+}
+
+void path_cache_insert(const PathQuery* q) {
+    PathKey key;
+
+    path_cache_key(q, &key);
+
+    // The same path may have been searched for twice in one batch
+    PathCacheEntry* e = htable_lookup(path_cache_table, (const uint8_t*)&key, sizeof(PathKey), NULL);
+
+    if (e) {
+        path_cache_drop(e);
+    }
+
+    if (path_cache_free) {
+        e = path_cache_free;
+
+        path_cache_free = e->next;
+    }
+    else if (path_stats.cached < PATH_CACHE_SIZE) {
+        e = calloc(1, sizeof(PathCacheEntry));
+
+        if (!e) {
+            return;
+        }
+    }
+    else {
+        path_cache_drop(path_cache_tail);
+
+        e = path_cache_free;
+
+        path_cache_free = e->next;
+    }
+
+    e->next = NULL;
+
+    if (q->points_count > e->points_size) {
+        PathPoint* tmp = realloc(e->points, q->points_count * sizeof(PathPoint));
+
+        if (!tmp) {
+            e->next = path_cache_free;
+
+            path_cache_free = e;
+
+            return;
+        }
+
+        e->points = tmp;
+        e->points_size = q->points_count;
+    }
+
+    if (htable_add(path_cache_table, (const uint8_t*)&key, sizeof(PathKey), KV_VOIDPTR, e) != 0) {
+        e->next = path_cache_free;
+
+        path_cache_free = e;
+
+        return;
+    }
+
+    e->key = key;
+    e->epoch = q->epoch;
+    e->points_count = q->points_count;
+
+    e->min_x = UINT32_MAX;
+    e->min_y = UINT32_MAX;
+    e->max_x = 0;
+    e->max_y = 0;
+
+    for (size_t i = 0; i < q->points_count; i++) {
+        PathPoint p = q->points[i];
+
+        e->points[i] = p;
+
+        e->min_x = (p.x < e->min_x) ? p.x : e->min_x;
+        e->min_y = (p.y < e->min_y) ? p.y : e->min_y;
+        e->max_x = (p.x > e->max_x) ? p.x : e->max_x;
+        e->max_y = (p.y > e->max_y) ? p.y : e->max_y;
+    }
+
+    path_cache_push_front(e);
+
+    path_stats.cached++;
+}
+
+// Drops the cached paths over a grid which cross the given tile
+void path_cache_invalidate_tile(PathGrid* g, uint32_t x, uint32_t y) {
+    for (PathCacheEntry* e = path_cache_head; e;) {
+        PathCacheEntry* next = e->next;
+
+        if (e->key.grid == g && x >= e->min_x && x <= e->max_x && y >= e->min_y && y <= e->max_y) {
+            for (size_t i = 0; i < e->points_count; i++) {
+                if (e->points[i].x == x && e->points[i].y == y) {
+                    path_cache_drop(e);
+
+                    path_stats.invalidated++;
+
+                    break;
+                }
+            }
+        }
+
+        e = next;
+    }
+}
+
+// Grids
+
+bool path_grid_edit(PathGrid* g, uint32_t index, uint8_t cost) {
+    if (g->edits_count == g->edits_size) {
+        size_t new_size = g->edits_size ? g->edits_size * 2 : SLOT_DEFAULT_SIZE;
+
+        PathEdit* tmp = realloc(g->edits, new_size * sizeof(PathEdit));
+
+        if (!tmp) {
+            return false;
+        }
+
+        g->edits = tmp;
+        g->edits_size = new_size;
+    }
+
+    g->edits[g->edits_count++] = (PathEdit){index, cost};
+
+    return true;
+}
+
+// Changes a tile's cost, while the workers are idle
+void path_grid_apply(PathGrid* g, uint32_t index, uint8_t cost) {
+    uint8_t old = g->costs[index];
+
+    if (old == cost) {
+        return;
+    }
+
+    if (--g->histogram[old] == 0 && old != PATH_COST_BLOCKED) {
+        g->distinct--;
+    }
+
+    if (g->histogram[cost]++ == 0 && cost != PATH_COST_BLOCKED) {
+        g->distinct++;
+    }
+
+    g->costs[index] = cost;
+
+    // A cheaper tile might shorten any path over the grid, while a dearer one
+    // only matters to the paths which cross it
+    if (old == PATH_COST_BLOCKED || (cost != PATH_COST_BLOCKED && cost < old)) {
+        g->epoch++;
+    }
+    else if (g->raised++ < PATH_CACHE_SIZE) {
+        path_cache_invalidate_tile(g, index % g->width, index / g->width);
+    }
+    else if (g->raised == PATH_CACHE_SIZE + 1) {
+        g->epoch++;
+    }
+}
+
+uint8_t path_grid_tile_cost(PathGrid* g, uint16_t tile) {
+    return (tile < g->tile_cost_count) ? g->tile_costs[tile] : PATH_COST_BLOCKED;
+}
+
+// Brings a grid which follows a tilemap layer up to date with its tiles
+void path_grid_follow(PathGrid* g) {
+    if (!g->follows) {
+        return;
+    }
+
+    // Looked up among the tilemaps, rather than through the entity, which may
+    // have been destroyed
+    size_t count = 0;
+    Tilemap* const* maps = tilemap_get_all(&count);
+    Tilemap* m = NULL;
+
+    for (size_t i = 0; i < count && !m; i++) {
+        m = (tilemap_get_entity(maps[i]) == g->entity_id) ? maps[i] : NULL;
+    }
+
+    // A tilemap destroyed, even if its entity gets another, is followed no
+    // further
+    if (!m) {
+        g->follows = false;
+
+        return;
+    }
+
+    if (g->layer >= tilemap_layer_count(m) || tilemap_layer_get_version(m, g->layer) == g->version) {
+        return;
+    }
+
+    uint64_t seen = g->version;
+
+    g->version = tilemap_layer_get_version(m, g->layer);
+
+    // Only the chunks edited since are read again
+    for (uint32_t cy = 0; cy * TILEMAP_CHUNK_SIZE < g->height; cy++) {
+        for (uint32_t cx = 0; cx * TILEMAP_CHUNK_SIZE < g->width; cx++) {
+            if (tilemap_chunk_get_edited(m, g->layer, cx, cy) <= seen) {
+                continue;
+            }
+
+            uint32_t x_end = (cx + 1) * TILEMAP_CHUNK_SIZE;
+            uint32_t y_end = (cy + 1) * TILEMAP_CHUNK_SIZE;
+
+            x_end = (x_end < g->width) ? x_end : g->width;
+            y_end = (y_end < g->height) ? y_end : g->height;
+
+            for (uint32_t y = cy * TILEMAP_CHUNK_SIZE; y < y_end; y++) {
+                for (uint32_t x = cx * TILEMAP_CHUNK_SIZE; x < x_end; x++) {
+                    path_grid_apply(g, y * g->width + x, path_grid_tile_cost(g, tilemap_get_tile(m, g->layer, x, y)));
+                }
+            }
+        }
+    }
+}
+
+void path_grid_free(PathGrid* g) {
+    for (PathCacheEntry* e = path_cache_head; e;) {
+        PathCacheEntry* next = e->next;
+
+        if (e->key.grid == g) {
+            path_cache_drop(e);
+        }
+
+        e = next;
+    }
+
+    free(g->costs);
+    free(g->edits);
+    free(g->tile_costs);
+    free(g);
+}
+
+PathGrid* path_grid_alloc(uint32_t width, uint32_t height, uint8_t cost) {
+    if (width == 0 || height == 0 || width > PATH_GRID_SIZE_MAX || height > PATH_GRID_SIZE_MAX) {
+        logmsg(LOG_WARN, "path: Failed to create %" PRIu32 "x%" PRIu32 " grid, grids must be from 1x1 to %dx%d tiles", width, height, PATH_GRID_SIZE_MAX, PATH_GRID_SIZE_MAX);
+
+        return NULL;
+    }
+
+    if (path_grids_count == path_grids_size) {
+        size_t new_size = path_grids_size ? path_grids_size * 2 : SLOT_DEFAULT_SIZE;
+
+        PathGrid** tmp = realloc(path_grids, new_size * sizeof(PathGrid*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "path: Failed to create grid, the system is out of memory");
+
+            return NULL;
+        }
+
+        path_grids = tmp;
+        path_grids_size = new_size;
+    }
+
+    PathGrid* g = calloc(1, sizeof(PathGrid));
+
+    if (!g) {
+        logmsg(LOG_WARN, "path: Failed to create grid, the system is out of memory");
+
+        return NULL;
+    }
+
+    g->costs = malloc((size_t)width * height);
+
+    if (!g->costs) {
+        logmsg(LOG_WARN, "path: Failed to create grid, the system is out of memory");
+
+        free(g);
+
+        return NULL;
+    }
+
+    memset(g->costs, cost, (size_t)width * height);
+
+    g->width = width;
+    g->height = height;
+    g->histogram[cost] = (size_t)width * height;
+    g->distinct = (cost != PATH_COST_BLOCKED);
+
+    path_grids[path_grids_count++] = g;
+
+    return g;
+}
+
+PathGrid* path_grid_create(uint32_t width, uint32_t height, uint8_t cost) {
+    return path_grid_alloc(width, height, cost);
+}
+
+PathGrid* path_grid_create_tilemap(uint16_t entity_id, size_t layer, const uint8_t* costs, size_t cost_count) {
+    Tilemap* m = entity_get_component(entity_id, TILEMAP);
+
+    if (!m) {
+        logmsg(LOG_WARN, "path: Failed to create grid, entity[%" PRIu16 "] has no tilemap", entity_id);
+
+        return NULL;
+    }
+
+    if (layer >= tilemap_layer_count(m) || !costs || cost_count == 0) {
+        logmsg(LOG_WARN, "path: Failed to create grid for layer %zu of tilemap of entity[%" PRIu16 "], it needs a layer in range and tile costs", layer, entity_id);
+
+        return NULL;
+    }
+
+    uint8_t* tile_costs = malloc(cost_count);
+
+    if (!tile_costs) {
+        logmsg(LOG_WARN, "path: Failed to create grid, the system is out of memory");
+
+        return NULL;
+    }
+
+    PathGrid* g = path_grid_alloc(tilemap_get_width(m), tilemap_get_height(m), PATH_COST_BLOCKED);
+
+    if (!g) {
+        free(tile_costs);
+
+        return NULL;
+    }
+
+    memcpy(tile_costs, costs, cost_count);
+
+    g->follows = true;
+    g->entity_id = entity_id;
+    g->layer = layer;
+    g->tile_costs = tile_costs;
+    g->tile_cost_count = cost_count;
+
+    // Nothing can have searched the grid yet, so its tiles can be set now
+    g->version = tilemap_layer_get_version(m, layer);
+
+    for (uint32_t y = 0; y < g->height; y++) {
+        for (uint32_t x = 0; x < g->width; x++) {
+            path_grid_apply(g, y * g->width + x, path_grid_tile_cost(g, tilemap_get_tile(m, layer, x, y)));
+        }
+    }
+
+    g->raised = 0;
+
+    return g;
+}
+
+void path_grid_destroy(PathGrid* g) {
+    if (!g || g->dead) {
+        return;
+    }
+
+    if (path_lock) {
+        SDL_LockMutex(path_lock);
+    }
+
+    g->dead = true;
+
+    if (path_lock) {
+        SDL_UnlockMutex(path_lock);
+    }
+}
+
+bool path_grid_set_cost(PathGrid* g, uint32_t x, uint32_t y, uint8_t cost) {
+    if (x >= g->width || y >= g->height) {
+        logmsg(LOG_WARN, "path: Failed to set cost of tile (%" PRIu32 ", %" PRIu32 "), it's outside the %" PRIu32 "x%" PRIu32 " grid", x, y, g->width, g->height);
+
+        return false;
+    }
+
+    if (!path_grid_edit(g, y * g->width + x, cost)) {
+        logmsg(LOG_WARN, "path: Failed to set cost of tile (%" PRIu32 ", %" PRIu32 "), the system is out of memory", x, y);
+
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t path_grid_get_cost(PathGrid* g, uint32_t x, uint32_t y) {
+    if (x >= g->width || y >= g->height) {
+        return PATH_COST_BLOCKED;
+    }
+
+    return g->costs[y * g->width + x];
+}
+
+uint32_t path_grid_get_width(PathGrid* g) {
+    return g->width;
+}
+
+uint32_t path_grid_get_height(PathGrid* g) {
+    return g->height;
+}
+
+// Queries
+
+void path_query_release(PathQuery* q) {
+    path_active[q->index] = path_active[--path_active_count];
+    path_active[q->index]->index = q->index;
+
+    q->grid = NULL;
+    q->cb = NULL;
+    q->userdata = NULL;
+    q->next = path_free;
+
+    path_free = q;
+
+    path_stats.pending = path_active_count;
+}
+
+void path_query_finish(PathQuery* q) {
+    if (q->jps) {
+        path_stats.jps++;
+    }
+    else {
+        path_stats.astar++;
+    }
+
+    path_stats.expanded += q->expanded;
+
+    if (!q->cancelled && !q->grid->dead) {
+        // A search which ran out of memory calls back without a path, but
+        // isn't cached as having found none
+        if (q->failed) {
+            logmsg(LOG_WARN,
+                "path: Failed to search for path from (%" PRIu32 ", %" PRIu32 ") to (%" PRIu32 ", %" PRIu32 "), the system is out of memory",
+                q->sx,
+                q->sy,
+                q->gx,
+                q->gy);
+        }
+        else {
+            path_cache_insert(q);
+        }
+
+        q->cb(q->id, q->points, q->points_count, q->userdata);
+    }
+
+    path_query_release(q);
+}
+
+// Drops cancelled queries, and queries over destroyed grids, from a list
+PathQuery* path_query_list_prune(PathQuery* q, PathQuery** tail) {
+    PathQuery* head = NULL;
+
+    *tail = NULL;
+
+    while (q) {
+        PathQuery* next = q->next;
+
+        q->next = NULL;
+
+        if (q->cancelled || q->grid->dead) {
+            path_query_release(q);
+        }
+        else {
+            if (*tail) {
+                (*tail)->next = q;
+            }
+            else {
+                head = q;
+            }
+
+            *tail = q;
+        }
+
+        q = next;
+    }
+
+    return head;
+}
+
+// Brings the grids up to date, and frees those destroyed, while the workers
+// are idle
+void path_grids_update(void) {
+    path_pending_head = path_query_list_prune(path_pending_head, &path_pending_tail);
+
+    SDL_LockMutex(path_lock);
+
+    path_queue_head = path_query_list_prune(path_queue_head, &path_queue_tail);
+
+    SDL_UnlockMutex(path_lock);
+
+    for (size_t i = path_grids_count; i > 0; i--) {
+        PathGrid* g = path_grids[i - 1];
+
+        if (g->dead) {
+            path_grid_free(g);
+
+            path_grids[i - 1] = path_grids[--path_grids_count];
+
+            continue;
+        }
+
+        g->raised = 0;
+
+        path_grid_follow(g);
+
+        for (size_t j = 0; j < g->edits_count; j++) {
+            path_grid_apply(g, g->edits[j].index, g->edits[j].cost);
+        }
+
+        g->edits_count = 0;
+    }
+}
+
+bool path_init(double slice) {
+    if (path_cache_table) {
+        logmsg(LOG_WARN, "path: Failed to initialize path system, already initialized");
+
+        return false;
+    }
+
+    path_cache_table = htable_create(64);
+
+    if (!path_cache_table) {
+        logmsg(LOG_WARN, "path: Failed to create path cache, the system is out of memory");
+
+        return false;
+    }
+
+    if (!path_workers_start()) {
+        htable_destroy(path_cache_table);
+
+        path_cache_table = NULL;
+
+        return false;
+    }
+
+    memset(&path_stats, 0, sizeof(PathStats));
+
+    path_slice = slice;
+
+    return true;
+}
+
+void path_cleanup(void) {
+    if (!path_cache_table) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "path: Cleaning up path system");
+
+    path_workers_stop();
+
+    // Every query is in one of the lists, or was never sent out
+    for (size_t i = 0; i < path_active_count; i++) {
+        free(path_active[i]->points);
+        free(path_active[i]);
+    }
+
+    while (path_free) {
+        PathQuery* next = path_free->next;
+
+        free(path_free->points);
+        free(path_free);
+
+        path_free = next;
+    }
+
+    for (size_t i = 0; i < path_grids_count; i++) {
+        path_grid_free(path_grids[i]);
+    }
+
+    while (path_cache_free) {
+        PathCacheEntry* next = path_cache_free->next;
+
+        free(path_cache_free->points);
+        free(path_cache_free);
+
+        path_cache_free = next;
+    }
+
+    htable_destroy(path_cache_table);
+
+    free(path_active);
+    free(path_grids);
+
+    path_cache_table = NULL;
+
+    path_active = NULL;
+    path_active_size = 0;
+    path_active_count = 0;
+
+    path_grids = NULL;
+    path_grids_size = 0;
+    path_grids_count = 0;
+
+    path_pending_head = NULL;
+    path_pending_tail = NULL;
+    path_queue_head = NULL;
+    path_queue_tail = NULL;
+    path_done = NULL;
+
+    memset(&path_stats, 0, sizeof(PathStats));
+}
+
+uint32_t path_find(PathGrid* g, uint32_t sx, uint32_t sy, uint32_t gx, uint32_t gy, path_cb_t cb, void* userdata) {
+    if (!path_cache_table) {
+        logmsg(LOG_WARN, "path: Failed to queue query, the path system isn't initialized");
+
+        return 0;
+    }
+
+    if (!g || g->dead || !cb || sx >= g->width || sy >= g->height || gx >= g->width || gy >= g->height) {
+        logmsg(LOG_WARN, "path: Failed to queue query from (%" PRIu32 ", %" PRIu32 ") to (%" PRIu32 ", %" PRIu32 "), it needs a live grid, a callback, and tiles on the grid", sx, sy, gx, gy);
+
+        return 0;
+    }
+
+    if (path_active_count == path_active_size) {
+        size_t new_size = path_active_size ? path_active_size * 2 : SLOT_DEFAULT_SIZE;
+
+        PathQuery** tmp = realloc(path_active, new_size * sizeof(PathQuery*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "path: Failed to queue query, the system is out of memory");
+
+            return 0;
+        }
+
+        path_active = tmp;
+        path_active_size = new_size;
+    }
+
+    PathQuery* q = path_free;
+
+    if (q) {
+        path_free = q->next;
+    }
+    else {
+        q = calloc(1, sizeof(PathQuery));
+
+        if (!q) {
+            logmsg(LOG_WARN, "path: Failed to queue query, the system is out of memory");
+
+            return 0;
+        }
+    }
+
+    // IDs wrap around past 0, which means failure
+    q->id = path_next_id++;
+
+    if (path_next_id == 0) {
+        path_next_id = 1;
+    }
+
+    q->grid = g;
+    q->sx = sx;
+    q->sy = sy;
+    q->gx = gx;
+    q->gy = gy;
+    q->cb = cb;
+    q->userdata = userdata;
+    q->cancelled = false;
+    q->points_count = 0;
+    q->next = NULL;
+
+    q->index = path_active_count;
+    path_active[path_active_count++] = q;
+
+    if (path_pending_tail) {
+        path_pending_tail->next = q;
+    }
+    else {
+        path_pending_head = q;
+    }
+
+    path_pending_tail = q;
+
+    path_stats.queries++;
+    path_stats.pending = path_active_count;
+
+    return q->id;
+}
+
+bool path_cancel(uint32_t query_id) {
+    for (size_t i = 0; i < path_active_count; i++) {
+        PathQuery* q = path_active[i];
+
+        if (q->id != query_id) {
+            continue;
+        }
+
+        if (q->cancelled) {
+            return false;
+        }
+
+        SDL_LockMutex(path_lock);
+
+        q->cancelled = true;
+
+        SDL_UnlockMutex(path_lock);
+
+        return true;
+    }
+
+    return false;
+}
+
+void path_sync(void) {
+    if (!path_cache_table) {
+        return;
+    }
+
+    SDL_LockMutex(path_lock);
+
+    PathQuery* done = path_done;
+
+    path_done = NULL;
+
+    // Once the slice is over, no worker will start another search, so the
+    // grids are safe to change
+    bool idle = path_running == 0 && (!path_queue_head || SDL_GetPerformanceCounter() >= path_slice_end);
+
+    SDL_UnlockMutex(path_lock);
+
+    while (done) {
+        PathQuery* next = done->next;
+
+        path_query_finish(done);
+
+        done = next;
+    }
+
+    if (!idle) {
+        return;
+    }
+
+    path_grids_update();
+
+    // Callbacks may make new queries, which wait for the next batch
+    PathQuery* q = path_pending_head;
+
+    path_pending_head = NULL;
+    path_pending_tail = NULL;
+
+    PathQuery* head = NULL;
+    PathQuery* tail = NULL;
+
+    while (q) {
+        PathQuery* next = q->next;
+
+        q->next = NULL;
+
+        PathCacheEntry* e = (q->cancelled || q->grid->dead) ? NULL : path_cache_lookup(q);
+
+        if (q->cancelled || q->grid->dead) {
+            path_query_release(q);
+        }
+        else if (e) {
+            path_stats.hits++;
+
+            q->cb(q->id, e->points, e->points_count, q->userdata);
+
+            path_query_release(q);
+        }
+        else {
+            if (tail) {
+                tail->next = q;
+            }
+            else {
+                head = q;
+            }
+
+            tail = q;
+        }
+
+        q = next;
+    }
+
+    SDL_LockMutex(path_lock);
+
+    if (head) {
+        if (path_queue_tail) {
+            path_queue_tail->next = head;
+        }
+        else {
+            path_queue_head = head;
+        }
+
+        path_queue_tail = tail;
+    }
+
+    path_slice_end = SDL_GetPerformanceCounter() + (uint64_t)(path_slice * (double)SDL_GetPerformanceFrequency() / 1000.0);
+
+    if (path_queue_head) {
+        SDL_CondBroadcast(path_work);
+    }
+
+    SDL_UnlockMutex(path_lock);
+}
+
+void path_wait(void) {
+    if (!path_cache_table) {
+        return;
+    }
+
+    while (true) {
+        path_sync();
+
+        if (path_active_count == 0) {
+            break;
+        }
+
+        SDL_LockMutex(path_lock);
+
+        // Wait for a search to finish, or for the slice to run out, so that
+        // the next sync can start another
+        while (!path_done && (path_running > 0 || (path_queue_head && SDL_GetPerformanceCounter() < path_slice_end))) {
+            SDL_CondWaitTimeout(path_finished, path_lock, 1);
+        }
+
+        SDL_UnlockMutex(path_lock);
+    }
+}
+
+const PathStats* path_get_stats(void) {
+    return &path_stats;
+}
@@ -0,0 +1,189 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_PATH
+#define RPGNG_PATH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The cost of a tile which can't be walked through. Other costs run from 1 to
+// 255, and are multiplied into the length of each step onto the tile.
+#define PATH_COST_BLOCKED 0
+
+// The widest and tallest a grid may be, in tiles
+#define PATH_GRID_SIZE_MAX 1024
+
+// The number of background threads which search for paths
+#define PATH_THREADS 2
+
+// The time the workers may spend starting searches each frame, in milliseconds
+#define PATH_SLICE_DEFAULT 4.0
+
+// The number of paths the cache holds
+#define PATH_CACHE_SIZE 256
+
+typedef struct PathGrid PathGrid;
+
+typedef struct PathPoint {
+    uint32_t x;
+    uint32_t y;
+} PathPoint;
+
+/**
+ * Called with the result of a query, from path_sync().
+ *
+ * @param points Every tile along the path, from the start to the goal,
+ * inclusive. These belong to the path system, and are only valid until the
+ * callback returns.
+ * @param count The number of tiles along the path, or 0 if there is no path,
+ * or if the search ran out of memory.
+ */
+typedef void (*path_cb_t)(uint32_t query_id, const PathPoint* points, size_t count, void* userdata);
+
+typedef struct PathStats {
+    // Queries made, and queries answered from the cache
+    uint64_t queries;
+    uint64_t hits;
+
+    // Searches run by the workers, which used jump point search and A*, and the
+    // nodes they expanded
+    uint64_t jps;
+    uint64_t astar;
+    uint64_t expanded;
+
+    // Cached paths dropped because a tile they cross got more expensive, or
+    // because a tile on their grid got cheaper
+    uint64_t invalidated;
+
+    // Queries waiting for a worker, and paths cached
+    size_t pending;
+    size_t cached;
+} PathStats;
+
+/*
+ * Paths are found over grids of tile costs, 8 ways, without cutting corners
+ * past blocked tiles. A grid whose walkable tiles all cost the same is
+ * searched with jump point search, which skips over the open runs of tiles
+ * that make up most of such grids; any other grid is searched with A*.
+ *
+ * Queries are answered in batches, by background workers. path_sync() hands
+ * them the queries made since the last frame, and the workers start on as
+ * many as they can within the frame's time slice, leaving the rest for the
+ * next frame. Each worker keeps its own node arrays and open list, sized for
+ * the largest grid it has searched, so that searches allocate nothing.
+ *
+ * Recent paths are cached. A cached path is dropped when a tile it crosses
+ * gets more expensive, or when any tile on its grid gets cheaper, as either
+ * might make another path better.
+ */
+
+/**
+ * Initializes the path system, and starts its workers.
+ *
+ * @param slice The time the workers may spend starting searches each frame,
+ * in milliseconds. A search started within the slice runs to the end.
+ */
+bool path_init(double slice);
+
+/**
+ * Stops the workers, drops every query without calling back, and frees every
+ * grid.
+ */
+void path_cleanup(void);
+
+/**
+ * Creates a grid whose tiles all have the given cost.
+ *
+ * @return The grid, or NULL if it's larger than PATH_GRID_SIZE_MAX in either
+ * direction, or if the system is out of memory.
+ */
+PathGrid* path_grid_create(uint32_t width, uint32_t height, uint8_t cost);
+
+/**
+ * Creates a grid which follows a layer of the tilemap associated with the
+ * given entity. Whenever a tile of the layer changes, the grid is updated at
+ * the next path_sync(). If the tilemap is destroyed, the grid keeps the costs
+ * it last had.
+ *
+ * @param costs The cost of each tile ID, indexed by tile ID, starting with
+ * TILEMAP_TILE_EMPTY. The table is copied. Tile IDs past its end are blocked.
+ *
+ * @return The grid, or NULL if the entity has no tilemap, the layer is out of
+ * range, the tilemap is too large, or the system is out of memory.
+ */
+PathGrid* path_grid_create_tilemap(uint16_t entity_id, size_t layer, const uint8_t* costs, size_t cost_count);
+
+/**
+ * Destroys a grid once the workers are done with it. Queries over it which
+ * haven't been answered are dropped without calling back.
+ */
+void path_grid_destroy(PathGrid* g);
+
+/**
+ * Sets the cost of a tile. The change takes effect at the next path_sync(),
+ * before any queries made after it are searched.
+ *
+ * @return Returns false if the tile is out of range, or if the system is out
+ * of memory.
+ */
+bool path_grid_set_cost(PathGrid* g, uint32_t x, uint32_t y, uint8_t cost);
+
+/**
+ * Gets the cost of a tile, as searches currently see it.
+ *
+ * @return The cost, or PATH_COST_BLOCKED if the tile is out of range.
+ */
+uint8_t path_grid_get_cost(PathGrid* g, uint32_t x, uint32_t y);
+
+/**
+ * Gets the width of a grid, in tiles.
+ */
+uint32_t path_grid_get_width(PathGrid* g);
+
+/**
+ * Gets the height of a grid, in tiles.
+ */
+uint32_t path_grid_get_height(PathGrid* g);
+
+/**
+ * Queues a search for the cheapest path between two tiles. The start tile may
+ * be blocked, as when the tile under a standing NPC is marked blocked; the
+ * goal must not be.
+ *
+ * @param cb The function to call with the path, from a later path_sync().
+ *
+ * @return The ID of the query, or 0 if either tile is out of range, or if the
+ * system is out of memory.
+ */
+uint32_t path_find(PathGrid* g, uint32_t sx, uint32_t sy, uint32_t gx, uint32_t gy, path_cb_t cb, void* userdata);
+
+/**
+ * Cancels a query, so that it never calls back.
+ *
+ * @return Returns false if the query has already called back, or never
+ * existed.
+ */
+bool path_cancel(uint32_t query_id);
+
+/**
+ * Calls back with the paths the workers have found, then, if the workers are
+ * done with the last batch, applies changes to the grids and hands them the
+ * queries made since. This should be called once per frame.
+ */
+void path_sync(void);
+
+/**
+ * Waits until every query has called back. For tools and tests; in game, this
+ * stalls the frame.
+ */
+void path_wait(void);
+
+/**
+ * Gets the path system statistics.
+ */
+const PathStats* path_get_stats(void);
+
+#endif
@@ -0,0 +1,1942 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asset.h"
+#include "atlas.h"
+#include "blit.h"
+#include "entity.h"
+#include "log.h"
+#include "palette.h"
+#include "render.h"
+#include "variant.h"
+
+#include "component/camera.h"
+#include "component/sprite.h"
+#include "component/tilemap.h"
+#include "component/transform.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RENDER_Z_COUNT 256
+
+// The draw list is sorted by insertion sort when at most one in this many
+// entries moved, and by radix sort otherwise
+#define RENDER_SORT_DIRTY_DIVISOR 16
+
+// Insertion sort gives up, and falls back to radix sort, once it has shifted
+// entries this many times the length of the draw list
+#define RENDER_SORT_SHIFT_BUDGET 4
+
+// Sort keys are z-order in the high byte, then the feet of the sprite
+#define RENDER_SORT_KEY_BITS 40
+
+// Damage scattered over more rects than this, or covering more than this
+// fraction of the screen, is redrawn as a whole frame instead
+#define RENDER_DAMAGE_MAX 64
+#define RENDER_DAMAGE_AREA_MAX 0.75
+
+// A texture made from a surface. The texture is found through the surface's
+// userdata, and holds a reference to the surface, so that the surface can't be
+// freed and its address reused while the texture exists.
+typedef struct RenderTexture RenderTexture;
+
+struct RenderTexture {
+    SDL_Surface* surface;
+    SDL_Texture* texture;
+
+    // Position in the texture list
+    uint32_t id;
+
+    // For atlas pages, the page version the texture was made from. For
+    // indexed surfaces, the version of the palette it was expanded with.
+    uint64_t version;
+
+    // Indexed surfaces get a texture for each palette they're drawn with,
+    // chained from the one in the surface's userdata. The palette is NULL for
+    // the surface's own.
+    bool indexed;
+    Palette* palette;
+
+    RenderTexture* next;
+};
+
+// A sprite to draw, already transformed to screen space
+typedef struct RenderItem {
+    SDL_Vertex v[4];
+
+    // The pixels the sprite covers
+    SDL_Rect bounds;
+
+    uint32_t texture;
+
+    // For indexed sprites, the version of the palette they're drawn with
+    uint64_t palette_version;
+
+    // Whether the sprite is drawn at its simulation position, which it keeps
+    // until its next TRANSLATE signal. Until then, it's still being
+    // interpolated toward it.
+    bool settled;
+
+    // Whether the sprite is drawn from the variant cache
+    bool variant;
+} RenderItem;
+
+// A sprite in the draw list
+typedef struct RenderSortEntry {
+    uint64_t key;
+
+    // NULL once the sprite is destroyed, until the list is compacted
+    Sprite* s;
+
+    uint16_t entity_id;
+
+    // The entity's transform, looked up the first time it's needed rather than
+    // every frame. NULL until then, and once the transform is destroyed.
+    Transform* t;
+
+    // Whether the entity is in the dirty list, waiting for its key to be
+    // recomputed
+    bool dirty;
+
+    // Where the sprite was last drawn on screen, if it was, and whether it has
+    // changed since
+    SDL_Rect bounds;
+    bool drawn;
+    bool damaged;
+
+    // Whether the sprite was last drawn from the variant cache, and the
+    // version of the palette it was last drawn with
+    bool variant;
+    uint64_t palette_version;
+} RenderSortEntry;
+
+// A tilemap layer in view, and the part of it which is
+typedef struct RenderLayer {
+    Tilemap* m;
+    size_t layer;
+
+    uint16_t entity_id;
+    uint8_t z;
+    bool dynamic;
+
+    // Where the top left corner of the map is on screen
+    float x;
+    float y;
+
+    // For dynamic layers, the version of their tiles. Static layers damage
+    // each chunk as its texture changes instead.
+    uint64_t version;
+
+    // The chunks in view, or for dynamic layers, the tiles, from the first up
+    // to but not including the end
+    uint32_t first_col;
+    uint32_t first_row;
+    uint32_t end_col;
+    uint32_t end_row;
+
+    // The pixels the layer covers on screen
+    SDL_Rect bounds;
+} RenderLayer;
+
+// The signals which move or change sprites on screen. Translating, scaling,
+// and changing z-order also move sprites in the draw order.
+const TransformSignalType render_transform_signals[] = {TRANSLATE, ROTATE, SCALE};
+const SpriteSignalType render_sprite_signals[] = {FLIP_H, FLIP_V, OPACITY, Z_ORDER};
+
+#define RENDER_TRANSFORM_SIGNAL_COUNT (sizeof(render_transform_signals) / sizeof(render_transform_signals[0]))
+#define RENDER_SPRITE_SIGNAL_COUNT (sizeof(render_sprite_signals) / sizeof(render_sprite_signals[0]))
+
+SDL_Renderer* render_renderer = NULL;
+
+// Images are stored with premultiplied alpha, so textures blend their color
+// unscaled by alpha. Renderers which can't blend that way are given textures
+// made from straight alpha copies instead.
+bool render_premultiplied = false;
+SDL_BlendMode render_blend_mode = SDL_BLENDMODE_BLEND;
+
+// Whether rotated and scaled sprites are drawn from the variant cache, which
+// saves software renderers from resampling them every frame
+bool render_variants = false;
+
+// The entity whose camera sprites are drawn through, or 0 for none
+uint16_t render_camera = 0;
+
+size_t render_textures_size = 0;
+size_t render_textures_count = 0;
+RenderTexture** render_textures = NULL;
+
+// Per-frame buffers, grown to fit and kept between frames
+size_t render_items_size = 0;
+RenderItem* render_items = NULL;
+
+// Every sprite, kept in draw order from frame to frame. Entries which move are
+// marked dirty by signals, and only they are re-keyed before drawing. The
+// scratch list is the same size, for radix sort.
+size_t render_draw_size = 0;
+size_t render_draw_count = 0;
+size_t render_draw_removed = 0;
+RenderSortEntry* render_draw_list = NULL;
+RenderSortEntry* render_draw_tmp = NULL;
+
+// The position (plus one) of each entity's entry in the draw list, indexed by
+// entity ID. Zero means the entity has no sprite.
+size_t render_draw_pos_size = 0;
+uint32_t* render_draw_pos = NULL;
+
+size_t render_dirty_size = 0;
+size_t render_dirty_count = 0;
+uint16_t* render_dirty = NULL;
+
+// Set when an entry couldn't be added to the dirty list, so every key is
+// recomputed next frame instead
+bool render_dirty_all = false;
+
+// One batch of vertices, and the indices of RENDER_BATCH_MAX quads, which are
+// the same every batch
+SDL_Vertex* render_vertices = NULL;
+int* render_indices = NULL;
+
+// The tilemap layers in view, back to front, and those of the last frame,
+// which are compared to find the layers which moved or changed
+size_t render_layers_size = 0;
+size_t render_layers_count = 0;
+RenderLayer* render_layers = NULL;
+
+size_t render_layers_last_size = 0;
+size_t render_layers_last_count = 0;
+RenderLayer* render_layers_last = NULL;
+
+RenderStats render_stats;
+
+// Damage tracking
+
+// Whether only damaged regions are redrawn and presented, which relies on the
+// previous frame still being in the window surface
+bool render_damage_enabled = false;
+
+// Damage since the last frame was drawn, and the damage the last frame redrew,
+// which is what gets presented
+bool render_damage_full = true;
+size_t render_damage_size = 0;
+size_t render_damage_count = 0;
+SDL_Rect* render_damage_list = NULL;
+
+bool render_frame_full = false;
+size_t render_frame_size = 0;
+size_t render_frame_count = 0;
+SDL_Rect* render_frame_list = NULL;
+
+// Where the camera was when the last frame was drawn
+float render_camera_x = 0.0f;
+float render_camera_y = 0.0f;
+
+void render_damage(const SDL_Rect* rect) {
+    if (!render_damage_enabled || render_damage_full || SDL_RectEmpty(rect)) {
+        return;
+    }
+
+    if (render_damage_count == render_damage_size) {
+        size_t new_size = render_damage_size ? render_damage_size * 2 : 64;
+
+        SDL_Rect* tmp = realloc(render_damage_list, new_size * sizeof(SDL_Rect));
+
+        if (!tmp) {
+            render_damage_full = true;
+
+            return;
+        }
+
+        render_damage_list = tmp;
+        render_damage_size = new_size;
+    }
+
+    render_damage_list[render_damage_count++] = *rect;
+}
+
+void render_damage_all(void) {
+    render_damage_full = true;
+}
+
+// Clips damage to the screen, and merges overlapping rects until none overlap
+void render_damage_merge(int view_w, int view_h) {
+    if (render_damage_full) {
+        return;
+    }
+
+    SDL_Rect screen = {0, 0, view_w, view_h};
+
+    size_t count = 0;
+
+    for (size_t i = 0; i < render_damage_count; i++) {
+        if (SDL_IntersectRect(&render_damage_list[i], &screen, &render_damage_list[count])) {
+            count++;
+        }
+    }
+
+    render_damage_count = count;
+
+    bool merged = true;
+
+    while (merged) {
+        merged = false;
+
+        for (size_t i = 0; i < render_damage_count; i++) {
+            for (size_t j = i + 1; j < render_damage_count;) {
+                if (!SDL_HasIntersection(&render_damage_list[i], &render_damage_list[j])) {
+                    j++;
+
+                    continue;
+                }
+
+                SDL_UnionRect(&render_damage_list[i], &render_damage_list[j], &render_damage_list[i]);
+
+                render_damage_list[j] = render_damage_list[--render_damage_count];
+
+                merged = true;
+            }
+        }
+    }
+
+    // Rects no longer overlap, so their areas add up
+    double area = 0.0;
+
+    for (size_t i = 0; i < render_damage_count; i++) {
+        area += (double)render_damage_list[i].w * (double)render_damage_list[i].h;
+    }
+
+    if (render_damage_count > RENDER_DAMAGE_MAX || area > RENDER_DAMAGE_AREA_MAX * (double)view_w * (double)view_h) {
+        render_damage_full = true;
+    }
+}
+
+// Damage tracking needs a software renderer drawing into a window's surface,
+// which keeps the last frame between presents
+SDL_BlendMode render_premultiplied_mode(void) {
+    return SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE,
+        SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+        SDL_BLENDOPERATION_ADD,
+        SDL_BLENDFACTOR_ONE,
+        SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+        SDL_BLENDOPERATION_ADD);
+}
+
+// Renderers only say whether they support a blend mode when it's set
+bool render_premultiplied_supported(void) {
+    SDL_Texture* probe = SDL_CreateTexture(render_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, 1, 1);
+
+    if (!probe) {
+        return false;
+    }
+
+    bool supported = SDL_SetTextureBlendMode(probe, render_premultiplied_mode()) == 0;
+
+    SDL_DestroyTexture(probe);
+
+    return supported;
+}
+
+bool render_is_software(void) {
+    SDL_RendererInfo info;
+
+    if (SDL_GetRendererInfo(render_renderer, &info) != 0) {
+        return false;
+    }
+
+    return (info.flags & SDL_RENDERER_SOFTWARE) != 0;
+}
+
+bool render_damage_supported(void) {
+    return SDL_RenderGetWindow(render_renderer) && render_is_software();
+}
+
+// Draw order
+
+Transform* render_entry_transform(RenderSortEntry* entry) {
+    if (!entry->t) {
+        entry->t = entity_get_component(entry->entity_id, TRANSFORM);
+    }
+
+    return entry->t;
+}
+
+// Sprites sort back to front by z-order, and within a layer, by the y of their
+// feet, so that whatever stands lower on screen is drawn over whatever stands
+// behind it. The key uses the simulation position rather than the
+// interpolated one, so that it only changes when a TRANSLATE signal says so.
+uint64_t render_sort_key(Sprite* s, Transform* t) {
+    float feet = 0.0f;
+
+    if (t) {
+        float y = transform_get_pos_y(t);
+        float bottom = y + (float)sprite_get_clip(s).h * (float)transform_get_scale(t);
+
+        feet = (bottom > y) ? bottom : y;
+    }
+
+    uint32_t bits;
+
+    memcpy(&bits, &feet, sizeof(bits));
+
+    // Negative floats order backwards as integers, so flip every bit of those,
+    // and only the sign bit of the rest
+    bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+
+    // Lower z-orders are nearer the front, so they sort last
+    return ((uint64_t)(RENDER_Z_COUNT - 1 - sprite_get_z(s)) << 32) | bits;
+}
+
+void render_sprite_touch(uint16_t entity_id) {
+    if (entity_id >= render_draw_pos_size || !render_draw_pos[entity_id]) {
+        return;
+    }
+
+    RenderSortEntry* entry = &render_draw_list[render_draw_pos[entity_id] - 1];
+
+    entry->damaged = true;
+
+    if (entry->dirty || render_dirty_all) {
+        return;
+    }
+
+    if (render_dirty_count == render_dirty_size) {
+        size_t new_size = render_dirty_size ? render_dirty_size * 2 : 64;
+
+        uint16_t* tmp = realloc(render_dirty, new_size * sizeof(uint16_t));
+
+        if (!tmp) {
+            render_dirty_all = true;
+
+            return;
+        }
+
+        render_dirty = tmp;
+        render_dirty_size = new_size;
+    }
+
+    entry->dirty = true;
+
+    render_dirty[render_dirty_count++] = entity_id;
+}
+
+// Marks the sprite of the given entity to be redrawn, without re-sorting it
+void render_sprite_damage(uint16_t entity_id) {
+    if (entity_id < render_draw_pos_size && render_draw_pos[entity_id]) {
+        render_draw_list[render_draw_pos[entity_id] - 1].damaged = true;
+    }
+}
+
+void render_transform_cb(TransformSignalType type, const TransformSignalEvent* events, size_t count, void* userdata) {
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        if (type == ROTATE) {
+            render_sprite_damage(events[i].entity_id);
+        }
+        else {
+            render_sprite_touch(events[i].entity_id);
+        }
+    }
+}
+
+void render_sprite_cb(SpriteSignalType type, const SpriteSignalEvent* events, size_t count, void* userdata) {
+    (void)userdata;
+
+    for (size_t i = 0; i < count; i++) {
+        if (type == Z_ORDER) {
+            render_sprite_touch(events[i].entity_id);
+        }
+        else {
+            render_sprite_damage(events[i].entity_id);
+        }
+    }
+}
+
+// Listens for the signals which move or change sprites on screen, for only as
+// long as the draw list holds any
+bool render_draw_listen(bool listen) {
+    size_t t = 0;
+    size_t s = 0;
+
+    if (listen) {
+        while (t < RENDER_TRANSFORM_SIGNAL_COUNT && transform_regcb_batch(render_transform_signals[t], render_transform_cb, NULL)) {
+            t++;
+        }
+
+        while (t == RENDER_TRANSFORM_SIGNAL_COUNT && s < RENDER_SPRITE_SIGNAL_COUNT && sprite_regcb_batch(render_sprite_signals[s], render_sprite_cb, NULL)) {
+            s++;
+        }
+
+        if (s == RENDER_SPRITE_SIGNAL_COUNT) {
+            return true;
+        }
+    }
+    else {
+        t = RENDER_TRANSFORM_SIGNAL_COUNT;
+        s = RENDER_SPRITE_SIGNAL_COUNT;
+    }
+
+    // Stop listening to whatever was registered
+    while (t > 0) {
+        transform_unregcb_batch(render_transform_signals[--t], render_transform_cb, NULL);
+    }
+
+    while (s > 0) {
+        sprite_unregcb_batch(render_sprite_signals[--s], render_sprite_cb, NULL);
+    }
+
+    return !listen;
+}
+
+bool render_sprite_add(Sprite* s) {
+    uint16_t entity_id = sprite_get_entity(s);
+
+    if (entity_id >= render_draw_pos_size) {
+        size_t new_size = render_draw_pos_size ? render_draw_pos_size : 64;
+
+        while (new_size <= entity_id) {
+            new_size *= 2;
+        }
+
+        uint32_t* tmp = realloc(render_draw_pos, new_size * sizeof(uint32_t));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "render: Failed to add sprite of entity[%" PRIu16 "] to draw list, the system is out of memory", entity_id);
+
+            return false;
+        }
+
+        memset(&tmp[render_draw_pos_size], 0, (new_size - render_draw_pos_size) * sizeof(uint32_t));
+
+        render_draw_pos = tmp;
+        render_draw_pos_size = new_size;
+    }
+
+    if (render_draw_count == render_draw_size) {
+        size_t new_size = render_draw_size ? render_draw_size * 2 : 64;
+
+        RenderSortEntry* tmp = realloc(render_draw_list, new_size * sizeof(RenderSortEntry));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "render: Failed to add sprite of entity[%" PRIu16 "] to draw list, the system is out of memory", entity_id);
+
+            return false;
+        }
+
+        render_draw_list = tmp;
+
+        tmp = realloc(render_draw_tmp, new_size * sizeof(RenderSortEntry));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "render: Failed to add sprite of entity[%" PRIu16 "] to draw list, the system is out of memory", entity_id);
+
+            return false;
+        }
+
+        render_draw_tmp = tmp;
+        render_draw_size = new_size;
+    }
+
+    if (render_draw_count == render_draw_removed && !render_draw_listen(true)) {
+        logmsg(LOG_WARN, "render: Failed to add sprite of entity[%" PRIu16 "] to draw list, unable to register signal callbacks", entity_id);
+
+        return false;
+    }
+
+    render_draw_list[render_draw_count] = (RenderSortEntry){.s = s, .entity_id = entity_id};
+    render_draw_pos[entity_id] = (uint32_t)++render_draw_count;
+
+    render_sprite_touch(entity_id);
+
+    return true;
+}
+
+void render_sprite_remove(uint16_t entity_id) {
+    if (entity_id >= render_draw_pos_size || !render_draw_pos[entity_id]) {
+        return;
+    }
+
+    RenderSortEntry* entry = &render_draw_list[render_draw_pos[entity_id] - 1];
+
+    if (entry->drawn) {
+        render_damage(&entry->bounds);
+    }
+
+    // Removed entries are dropped before the next sort, which keeps the rest
+    // in order
+    entry->s = NULL;
+    render_draw_pos[entity_id] = 0;
+    render_draw_removed++;
+
+    if (render_draw_removed == render_draw_count) {
+        render_draw_listen(false);
+
+        render_draw_count = 0;
+        render_draw_removed = 0;
+        render_dirty_count = 0;
+        render_dirty_all = false;
+    }
+}
+
+void render_transform_forget(uint16_t entity_id) {
+    if (entity_id >= render_draw_pos_size || !render_draw_pos[entity_id]) {
+        return;
+    }
+
+    render_draw_list[render_draw_pos[entity_id] - 1].t = NULL;
+}
+
+void render_draw_clear(void) {
+    if (render_draw_count > render_draw_removed) {
+        render_draw_listen(false);
+    }
+
+    free(render_draw_list);
+    free(render_draw_tmp);
+    free(render_draw_pos);
+    free(render_dirty);
+
+    render_draw_list = NULL;
+    render_draw_tmp = NULL;
+    render_draw_size = 0;
+    render_draw_count = 0;
+    render_draw_removed = 0;
+
+    render_draw_pos = NULL;
+    render_draw_pos_size = 0;
+
+    render_dirty = NULL;
+    render_dirty_size = 0;
+    render_dirty_count = 0;
+    render_dirty_all = false;
+}
+
+// Insertion sort, which only does work where entries are out of order. Returns
+// false if it ran out of budget, leaving the list partly sorted.
+bool render_sort_insertion(void) {
+    size_t budget = render_draw_count * RENDER_SORT_SHIFT_BUDGET;
+
+    for (size_t i = 1; i < render_draw_count; i++) {
+        RenderSortEntry entry = render_draw_list[i];
+
+        size_t j = i;
+
+        while (j > 0 && render_draw_list[j - 1].key > entry.key) {
+            if (render_stats.sort_shifts == budget) {
+                break;
+            }
+
+            render_draw_list[j] = render_draw_list[j - 1];
+            render_draw_pos[render_draw_list[j].entity_id] = (uint32_t)(j + 1);
+
+            render_stats.sort_shifts++;
+
+            j--;
+        }
+
+        if (j != i) {
+            render_draw_list[j] = entry;
+            render_draw_pos[entry.entity_id] = (uint32_t)(j + 1);
+        }
+
+        if (render_stats.sort_shifts == budget) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Stable LSD radix sort, a byte at a time, skipping bytes which every key
+// shares
+void render_sort_radix(void) {
+    size_t counts[256];
+
+    RenderSortEntry* in = render_draw_list;
+    RenderSortEntry* out = render_draw_tmp;
+
+    for (int shift = 0; shift < RENDER_SORT_KEY_BITS; shift += 8) {
+        memset(counts, 0, sizeof(counts));
+
+        for (size_t i = 0; i < render_draw_count; i++) {
+            counts[(in[i].key >> shift) & 0xFF]++;
+        }
+
+        if (counts[(in[0].key >> shift) & 0xFF] == render_draw_count) {
+            continue;
+        }
+
+        size_t sum = 0;
+
+        for (size_t i = 0; i < 256; i++) {
+            size_t n = counts[i];
+
+            counts[i] = sum;
+            sum += n;
+        }
+
+        for (size_t i = 0; i < render_draw_count; i++) {
+            out[counts[(in[i].key >> shift) & 0xFF]++] = in[i];
+        }
+
+        RenderSortEntry* tmp = in;
+
+        in = out;
+        out = tmp;
+    }
+
+    render_draw_list = in;
+    render_draw_tmp = out;
+
+    for (size_t i = 0; i < render_draw_count; i++) {
+        render_draw_pos[render_draw_list[i].entity_id] = (uint32_t)(i + 1);
+    }
+
+    render_stats.sort_radix = true;
+}
+
+// Brings the draw list up to date with everything that moved since last frame
+void render_draw_update(void) {
+    render_stats.sort_dirty = 0;
+    render_stats.sort_shifts = 0;
+    render_stats.sort_radix = false;
+
+    if (render_draw_removed) {
+        size_t count = 0;
+
+        for (size_t i = 0; i < render_draw_count; i++) {
+            if (render_draw_list[i].s) {
+                render_draw_list[count] = render_draw_list[i];
+                render_draw_pos[render_draw_list[count].entity_id] = (uint32_t)(count + 1);
+
+                count++;
+            }
+        }
+
+        render_draw_count = count;
+        render_draw_removed = 0;
+    }
+
+    if (render_dirty_all) {
+        for (size_t i = 0; i < render_draw_count; i++) {
+            render_draw_list[i].key = render_sort_key(render_draw_list[i].s, render_entry_transform(&render_draw_list[i]));
+            render_draw_list[i].dirty = false;
+        }
+
+        render_stats.sort_dirty = render_draw_count;
+    }
+    else {
+        for (size_t i = 0; i < render_dirty_count; i++) {
+            uint16_t entity_id = render_dirty[i];
+
+            // Entities destroyed since they were marked are no longer in the
+            // list, nor are their entries dirty if they were replaced
+            if (!render_draw_pos[entity_id]) {
+                continue;
+            }
+
+            RenderSortEntry* entry = &render_draw_list[render_draw_pos[entity_id] - 1];
+
+            if (entry->dirty) {
+                entry->key = render_sort_key(entry->s, render_entry_transform(entry));
+                entry->dirty = false;
+
+                render_stats.sort_dirty++;
+            }
+        }
+    }
+
+    render_dirty_count = 0;
+    render_dirty_all = false;
+
+    if (render_stats.sort_dirty == 0) {
+        return;
+    }
+
+    // A few entries which moved a little since last frame are cheap to put
+    // back in place. Past that, sorting the whole list is cheaper.
+    if (render_stats.sort_dirty > render_draw_count / RENDER_SORT_DIRTY_DIVISOR || !render_sort_insertion()) {
+        render_sort_radix();
+    }
+}
+
+bool render_init(SDL_Renderer* renderer) {
+    if (render_renderer) {
+        logmsg(LOG_WARN, "render: Failed to initialize renderer, already initialized");
+
+        return false;
+    }
+
+    if (!renderer) {
+        logmsg(LOG_WARN, "render: Failed to initialize renderer, renderer is NULL");
+
+        return false;
+    }
+
+    render_vertices = malloc(RENDER_BATCH_MAX * 4 * sizeof(SDL_Vertex));
+    render_indices = malloc(RENDER_BATCH_MAX * 6 * sizeof(int));
+
+    if (!render_vertices || !render_indices) {
+        logmsg(LOG_WARN, "render: Failed to initialize renderer, the system is out of memory");
+
+        free(render_vertices);
+        free(render_indices);
+
+        render_vertices = NULL;
+        render_indices = NULL;
+
+        return false;
+    }
+
+    // Vertices are top left, top right, bottom left, bottom right
+    for (int i = 0; i < RENDER_BATCH_MAX; i++) {
+        int* idx = &render_indices[i * 6];
+
+        idx[0] = i * 4;
+        idx[1] = i * 4 + 1;
+        idx[2] = i * 4 + 2;
+        idx[3] = i * 4 + 2;
+        idx[4] = i * 4 + 1;
+        idx[5] = i * 4 + 3;
+    }
+
+    render_renderer = renderer;
+
+    memset(&render_stats, 0, sizeof(RenderStats));
+
+    render_premultiplied = render_premultiplied_supported();
+    render_blend_mode = render_premultiplied ? render_premultiplied_mode() : SDL_BLENDMODE_BLEND;
+
+    if (!render_premultiplied) {
+        logmsg(LOG_INFO, "render: Renderer can't blend premultiplied alpha, converting images back to straight alpha as they upload");
+    }
+
+    render_variants = render_is_software();
+
+    if (render_damage_supported()) {
+        logmsg(LOG_INFO, "render: Using a software renderer, redrawing only damaged regions");
+
+        render_damage_enabled = true;
+        render_damage_full = true;
+    }
+
+    return true;
+}
+
+void render_texture_free(RenderTexture* rt) {
+    SDL_DestroyTexture(rt->texture);
+
+    RenderTexture** link = (RenderTexture**)&rt->surface->userdata;
+
+    while (*link != rt) {
+        link = &(*link)->next;
+    }
+
+    *link = rt->next;
+
+    SDL_FreeSurface(rt->surface);
+    palette_release(rt->palette);
+
+    free(rt);
+}
+
+void render_cleanup(void) {
+    // The draw list is kept whether or not the renderer was initialized
+    render_draw_clear();
+
+    if (!render_renderer) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "render: Cleaning up renderer");
+
+    for (size_t i = 0; i < render_textures_count; i++) {
+        render_texture_free(render_textures[i]);
+    }
+
+    free(render_textures);
+    free(render_items);
+    free(render_layers);
+    free(render_layers_last);
+    free(render_damage_list);
+    free(render_frame_list);
+    free(render_vertices);
+    free(render_indices);
+
+    render_renderer = NULL;
+
+    render_textures = NULL;
+    render_textures_size = 0;
+    render_textures_count = 0;
+
+    render_items = NULL;
+    render_items_size = 0;
+
+    render_layers = NULL;
+    render_layers_size = 0;
+    render_layers_count = 0;
+
+    render_layers_last = NULL;
+    render_layers_last_size = 0;
+    render_layers_last_count = 0;
+
+    render_damage_enabled = false;
+    render_damage_full = true;
+    render_damage_list = NULL;
+    render_damage_size = 0;
+    render_damage_count = 0;
+
+    render_frame_full = false;
+    render_frame_list = NULL;
+    render_frame_size = 0;
+    render_frame_count = 0;
+
+    render_vertices = NULL;
+    render_indices = NULL;
+}
+
+// Textures
+
+// Copies a premultiplied surface back to straight alpha, for renderers which
+// can't blend premultiplied textures
+SDL_Surface* render_straight_copy(SDL_Surface* surface) {
+    SDL_Surface* copy = SDL_ConvertSurfaceFormat(surface, BLIT_PIXEL_FORMAT, 0);
+
+    if (!copy) {
+        logmsg(LOG_WARN, "render: Failed to copy surface for upload: %s", SDL_GetError());
+
+        return NULL;
+    }
+
+    if (!blit_unpremultiply(copy)) {
+        SDL_FreeSurface(copy);
+
+        return NULL;
+    }
+
+    return copy;
+}
+
+// Makes a texture for a surface from the given pixels, which are usually the
+// surface's own. The texture is added to the texture list, but not linked to
+// the surface.
+RenderTexture* render_texture_new(SDL_Surface* surface, SDL_Surface* pixels) {
+    if (render_textures_count == render_textures_size) {
+        size_t new_size = render_textures_size ? render_textures_size * 2 : 16;
+
+        RenderTexture** tmp = realloc(render_textures, new_size * sizeof(RenderTexture*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "render: Failed to create texture, the system is out of memory");
+
+            return NULL;
+        }
+
+        render_textures = tmp;
+        render_textures_size = new_size;
+    }
+
+    RenderTexture* rt = calloc(1, sizeof(RenderTexture));
+
+    if (!rt) {
+        logmsg(LOG_WARN, "render: Failed to create texture, the system is out of memory");
+
+        return NULL;
+    }
+
+    SDL_Surface* straight = render_premultiplied ? NULL : render_straight_copy(pixels);
+
+    if (!render_premultiplied && !straight) {
+        free(rt);
+
+        return NULL;
+    }
+
+    rt->texture = SDL_CreateTextureFromSurface(render_renderer, straight ? straight : pixels);
+
+    SDL_FreeSurface(straight);
+
+    if (!rt->texture) {
+        logmsg(LOG_WARN, "render: Failed to create texture: %s", SDL_GetError());
+
+        free(rt);
+
+        return NULL;
+    }
+
+    if (SDL_SetTextureBlendMode(rt->texture, render_blend_mode) != 0) {
+        logmsg(LOG_WARN, "render: Failed to set texture blend mode: %s", SDL_GetError());
+    }
+
+    rt->surface = surface;
+    rt->id = (uint32_t)render_textures_count;
+
+    surface->refcount++;
+
+    render_textures[render_textures_count++] = rt;
+
+    render_stats.uploads++;
+
+    return rt;
+}
+
+RenderTexture* render_texture_get(SDL_Surface* surface) {
+    if (surface->userdata) {
+        return surface->userdata;
+    }
+
+    RenderTexture* rt = render_texture_new(surface, surface);
+
+    if (rt) {
+        surface->userdata = rt;
+    }
+
+    return rt;
+}
+
+// Uploads new pixels to an existing texture
+bool render_texture_refresh(RenderTexture* rt, SDL_Surface* pixels) {
+    SDL_Surface* straight = render_premultiplied ? NULL : render_straight_copy(pixels);
+
+    if (!render_premultiplied && !straight) {
+        return false;
+    }
+
+    SDL_Surface* src = straight ? straight : pixels;
+
+    int update = SDL_UpdateTexture(rt->texture, NULL, src->pixels, src->pitch);
+
+    SDL_FreeSurface(straight);
+
+    if (update != 0) {
+        logmsg(LOG_WARN, "render: Failed to refresh texture: %s", SDL_GetError());
+
+        return false;
+    }
+
+    render_stats.uploads++;
+
+    return true;
+}
+
+// Gets the texture of a surface whose pixels change, as atlas pages and
+// tilemap chunks do, uploading them again if the surface's version changed
+// since. Sets changed if the texture was made or refreshed.
+RenderTexture* render_texture_get_versioned(SDL_Surface* surface, uint64_t version, bool* changed) {
+    RenderTexture* rt = surface->userdata;
+
+    *changed = false;
+
+    if (!rt) {
+        rt = render_texture_get(surface);
+
+        if (rt) {
+            rt->version = version;
+
+            *changed = true;
+        }
+    }
+    else if (rt->version != version && render_texture_refresh(rt, surface)) {
+        rt->version = version;
+
+        *changed = true;
+    }
+
+    return rt;
+}
+
+// Expands an indexed surface through a palette, or through its own palette if
+// that's NULL, into premultiplied pixels
+SDL_Surface* render_expand(SDL_Surface* surface, Palette* palette) {
+    uint32_t own[PALETTE_SIZE] = {0};
+
+    const uint32_t* entries = own;
+
+    if (palette) {
+        entries = palette_get_entries(palette);
+    }
+    else {
+        SDL_Palette* p = surface->format->palette;
+
+        palette_premultiply(p->colors, (p->ncolors < PALETTE_SIZE) ? (size_t)p->ncolors : PALETTE_SIZE, own);
+    }
+
+    SDL_Surface* expanded = SDL_CreateRGBSurfaceWithFormat(0, surface->w, surface->h, 32, BLIT_PIXEL_FORMAT);
+
+    if (!expanded) {
+        logmsg(LOG_WARN, "render: Failed to expand indexed surface: %s", SDL_GetError());
+
+        return NULL;
+    }
+
+    // Blending onto transparent pixels copies the source as-is
+    if (!blit_indexed(surface, NULL, entries, expanded, 0, 0, 1.0, 0)) {
+        SDL_FreeSurface(expanded);
+
+        return NULL;
+    }
+
+    return expanded;
+}
+
+uint64_t render_palette_version(SDL_Surface* surface, Palette* palette) {
+    return palette ? palette_get_version(palette) : surface->format->palette->version;
+}
+
+// Gets the texture of an indexed surface drawn with the given palette,
+// expanding it again if the palette has changed since
+RenderTexture* render_texture_get_indexed(SDL_Surface* surface, Palette* palette) {
+    uint64_t version = render_palette_version(surface, palette);
+
+    RenderTexture* rt = surface->userdata;
+
+    while (rt && rt->palette != palette) {
+        rt = rt->next;
+    }
+
+    if (rt && rt->version == version) {
+        return rt;
+    }
+
+    SDL_Surface* expanded = render_expand(surface, palette);
+
+    if (!expanded) {
+        return NULL;
+    }
+
+    if (rt) {
+        if (render_texture_refresh(rt, expanded)) {
+            rt->version = version;
+        }
+    }
+    else {
+        rt = render_texture_new(surface, expanded);
+
+        if (rt) {
+            rt->version = version;
+            rt->indexed = true;
+            rt->palette = palette;
+            rt->next = surface->userdata;
+
+            if (palette) {
+                palette_acquire(palette);
+            }
+
+            surface->userdata = rt;
+        }
+    }
+
+    SDL_FreeSurface(expanded);
+
+    return rt;
+}
+
+// Counts the textures holding a reference to a surface
+int render_texture_holds(SDL_Surface* surface) {
+    int holds = 0;
+
+    for (RenderTexture* rt = surface->userdata; rt; rt = rt->next) {
+        holds++;
+    }
+
+    return holds;
+}
+
+// Frees the textures of surfaces which nothing else holds anymore, and of
+// palettes which nothing else holds, then refreshes textures of atlas pages
+// which have changed
+void render_textures_update(void) {
+    for (size_t i = 0; i < render_textures_count;) {
+        RenderTexture* rt = render_textures[i];
+
+        bool held = rt->surface->refcount > (rt->indexed ? render_texture_holds(rt->surface) : 1);
+
+        if (held && (!rt->palette || palette_get_refcount(rt->palette) > 1)) {
+            i++;
+
+            continue;
+        }
+
+        render_texture_free(rt);
+
+        // Fill the gap with the last texture
+        if (i < --render_textures_count) {
+            render_textures[i] = render_textures[render_textures_count];
+            render_textures[i]->id = (uint32_t)i;
+        }
+    }
+
+    const AtlasStats* atlas = atlas_get_stats();
+
+    for (size_t page = 0; page < atlas->pages; page++) {
+        bool changed;
+
+        render_texture_get_versioned(atlas_get_page(page), atlas_get_page_version(page), &changed);
+    }
+}
+
+// Sprites
+
+bool render_reserve(size_t count) {
+    if (count <= render_items_size) {
+        return true;
+    }
+
+    size_t new_size = render_items_size ? render_items_size : 256;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+
+    RenderItem* items = realloc(render_items, new_size * sizeof(RenderItem));
+
+    if (!items) {
+        return false;
+    }
+
+    render_items = items;
+    render_items_size = new_size;
+
+    return true;
+}
+
+// Transforms a sprite into screen space, relative to the given origin. Returns
+// false if it can't be seen.
+bool render_item_make(Sprite* s, Transform* t, RenderItem* item, float origin_x, float origin_y, float view_w, float view_h) {
+    double opacity = sprite_get_opacity(s);
+
+    if (!t || opacity <= 0.0 || sprite_is_loading(s)) {
+        return false;
+    }
+
+    // An evicted image keeps its clip, so the sprite can still be placed
+    Asset* image = sprite_get_image(s);
+
+    bool resident = asset_get_state(image) == ASSET_READY;
+
+    SDL_Surface* surface = sprite_get_surface(s);
+    SDL_Rect clip = sprite_get_clip(s);
+
+    // Indexed sprites are expanded into a texture per palette, which the
+    // variant cache doesn't handle
+    bool indexed = resident && surface->format->format == SDL_PIXELFORMAT_INDEX8;
+
+    // The cached matrix rotates and scales the sprite about the entity's
+    // position, which is its top left corner. The position itself is the
+    // interpolated one, rather than the matrix's.
+    TransformMatrix m = transform_get_matrix(t);
+
+    float x = transform_get_render_x(t) - origin_x;
+    float y = transform_get_render_y(t) - origin_y;
+    float scale = (float)transform_get_scale(t);
+    double rotation = transform_get_rotation(t);
+
+    bool flip_h = sprite_get_flip_h(s);
+    bool flip_v = sprite_get_flip_v(s);
+
+    // Once the variant cache has the sprite already transformed, it's drawn
+    // as-is, offset from where it was transformed about
+    Variant variant;
+
+    uint32_t flags = (flip_h ? VARIANT_FLIP_H : 0) | (flip_v ? VARIANT_FLIP_V : 0);
+
+    item->variant = resident && !indexed && render_variants && (rotation != 0.0 || scale != 1.0f) && variant_get(surface, clip, rotation, scale, flags, &variant);
+
+    if (item->variant) {
+        surface = variant.surface;
+        clip = (SDL_Rect){.x = 0, .y = 0, .w = surface->w, .h = surface->h};
+
+        x += (float)variant.x;
+        y += (float)variant.y;
+
+        m = (TransformMatrix){.a = 1.0f, .d = 1.0f};
+
+        flip_h = false;
+        flip_v = false;
+    }
+
+    float w = (float)clip.w;
+    float h = (float)clip.h;
+
+    float min_x = view_w;
+    float max_x = 0.0f;
+    float min_y = view_h;
+    float max_y = 0.0f;
+
+    for (int i = 0; i < 4; i++) {
+        float lx = (i & 1) ? w : 0.0f;
+        float ly = (i & 2) ? h : 0.0f;
+
+        float px = x + m.a * lx + m.c * ly;
+        float py = y + m.b * lx + m.d * ly;
+
+        item->v[i].position = (SDL_FPoint){px, py};
+
+        min_x = (px < min_x) ? px : min_x;
+        max_x = (px > max_x) ? px : max_x;
+        min_y = (py < min_y) ? py : min_y;
+        max_y = (py > max_y) ? py : max_y;
+    }
+
+    if (max_x <= 0.0f || max_y <= 0.0f || min_x >= view_w || min_y >= view_h) {
+        return false;
+    }
+
+    // Rasterization may touch the pixel past either edge
+    item->bounds.x = (int)floorf(min_x) - 1;
+    item->bounds.y = (int)floorf(min_y) - 1;
+    item->bounds.w = (int)ceilf(max_x) - item->bounds.x + 1;
+    item->bounds.h = (int)ceilf(max_y) - item->bounds.y + 1;
+
+    item->settled = transform_get_render_x(t) == transform_get_pos_x(t) && transform_get_render_y(t) == transform_get_pos_y(t);
+
+    // Sprites on screen keep their images resident. One whose image was
+    // evicted starts it reloading, and is skipped until the next frame at the
+    // earliest, since it was placed without its surface.
+    if (!asset_touch(image) || !resident) {
+        return false;
+    }
+
+    RenderTexture* rt = indexed ? render_texture_get_indexed(surface, sprite_get_palette(s)) : render_texture_get(surface);
+
+    if (!rt) {
+        return false;
+    }
+
+    item->palette_version = indexed ? rt->version : 0;
+
+    float u0 = (float)clip.x / (float)surface->w;
+    float u1 = (float)(clip.x + clip.w) / (float)surface->w;
+    float v0 = (float)clip.y / (float)surface->h;
+    float v1 = (float)(clip.y + clip.h) / (float)surface->h;
+
+    if (flip_h) {
+        float tmp = u0;
+
+        u0 = u1;
+        u1 = tmp;
+    }
+
+    if (flip_v) {
+        float tmp = v0;
+
+        v0 = v1;
+        v1 = tmp;
+    }
+
+    Uint8 alpha = (opacity >= 1.0) ? 255 : (Uint8)(opacity * 255.0 + 0.5);
+
+    // Premultiplied colors fade along with their alpha
+    SDL_Color color = render_premultiplied ? (SDL_Color){alpha, alpha, alpha, alpha} : (SDL_Color){255, 255, 255, alpha};
+
+    for (int i = 0; i < 4; i++) {
+        item->v[i].color = color;
+        item->v[i].tex_coord = (SDL_FPoint){(i & 1) ? u1 : u0, (i & 2) ? v1 : v0};
+    }
+
+    item->texture = rt->id;
+
+    return true;
+}
+
+// Tilemaps
+
+// Places part of a texture's surface on screen, as it is
+void render_item_quad(RenderItem* item, RenderTexture* rt, SDL_Rect clip, float x, float y) {
+    float w = (float)clip.w;
+    float h = (float)clip.h;
+
+    float u0 = (float)clip.x / (float)rt->surface->w;
+    float u1 = (float)(clip.x + clip.w) / (float)rt->surface->w;
+    float v0 = (float)clip.y / (float)rt->surface->h;
+    float v1 = (float)(clip.y + clip.h) / (float)rt->surface->h;
+
+    for (int i = 0; i < 4; i++) {
+        item->v[i].position = (SDL_FPoint){(i & 1) ? x + w : x, (i & 2) ? y + h : y};
+        item->v[i].color = (SDL_Color){255, 255, 255, 255};
+        item->v[i].tex_coord = (SDL_FPoint){(i & 1) ? u1 : u0, (i & 2) ? v1 : v0};
+    }
+
+    item->bounds.x = (int)floorf(x) - 1;
+    item->bounds.y = (int)floorf(y) - 1;
+    item->bounds.w = (int)ceilf(x + w) - item->bounds.x + 1;
+    item->bounds.h = (int)ceilf(y + h) - item->bounds.y + 1;
+
+    item->texture = rt->id;
+    item->palette_version = 0;
+    item->settled = true;
+    item->variant = false;
+}
+
+// Finds the range of cells of the given size in view along one axis, for a
+// map starting at the given position on screen
+void render_layer_span(float pos, float cell, uint32_t cells, float view, uint32_t* first, uint32_t* end) {
+    double start = (pos < 0.0f) ? floor(-(double)pos / cell) : 0.0;
+    double stop = ceil(((double)view - pos) / cell);
+
+    stop = (stop > 0.0) ? stop : 0.0;
+
+    *first = (start < (double)cells) ? (uint32_t)start : cells;
+    *end = (stop < (double)cells) ? (uint32_t)stop : cells;
+}
+
+bool render_layers_reserve(size_t count) {
+    if (count <= render_layers_size) {
+        return true;
+    }
+
+    size_t new_size = render_layers_size ? render_layers_size * 2 : 16;
+
+    while (new_size < count) {
+        new_size *= 2;
+    }
+
+    RenderLayer* tmp = realloc(render_layers, new_size * sizeof(RenderLayer));
+
+    if (!tmp) {
+        return false;
+    }
+
+    render_layers = tmp;
+    render_layers_size = new_size;
+
+    return true;
+}
+
+// Finds the tilemap layers in view, sorted back to front. Returns the most
+// items drawing them can take.
+size_t render_layers_gather(Camera* camera, float view_w, float view_h) {
+    render_layers_count = 0;
+
+    size_t maps = 0;
+    Tilemap* const* tilemaps = tilemap_get_all(&maps);
+
+    size_t items = 0;
+
+    for (size_t i = 0; i < maps; i++) {
+        Tilemap* m = tilemaps[i];
+
+        Transform* t = entity_get_component(tilemap_get_entity(m), TRANSFORM);
+
+        if (!t || !render_layers_reserve(render_layers_count + tilemap_layer_count(m))) {
+            continue;
+        }
+
+        float tile_w = (float)tilemap_get_tile_w(m);
+        float tile_h = (float)tilemap_get_tile_h(m);
+
+        uint32_t width = tilemap_get_width(m);
+        uint32_t height = tilemap_get_height(m);
+
+        for (size_t j = 0; j < tilemap_layer_count(m); j++) {
+            RenderLayer* l = &render_layers[render_layers_count];
+
+            l->m = m;
+            l->layer = j;
+            l->entity_id = tilemap_get_entity(m);
+            l->z = tilemap_layer_get_z(m, j);
+            l->dynamic = tilemap_layer_is_dynamic(m, j);
+            l->version = l->dynamic ? tilemap_layer_get_version(m, j) : 0;
+
+            float origin_x = 0.0f;
+            float origin_y = 0.0f;
+
+            if (camera) {
+                camera_get_origin(camera, l->z, &origin_x, &origin_y);
+            }
+
+            l->x = transform_get_render_x(t) - origin_x;
+            l->y = transform_get_render_y(t) - origin_y;
+
+            // Static layers are drawn a chunk at a time, and dynamic ones a
+            // tile at a time
+            uint32_t span = l->dynamic ? 1 : TILEMAP_CHUNK_SIZE;
+
+            float cell_w = tile_w * (float)span;
+            float cell_h = tile_h * (float)span;
+
+            render_layer_span(l->x, cell_w, width / span + (width % span != 0), view_w, &l->first_col, &l->end_col);
+            render_layer_span(l->y, cell_h, height / span + (height % span != 0), view_h, &l->first_row, &l->end_row);
+
+            if (l->first_col >= l->end_col || l->first_row >= l->end_row) {
+                continue;
+            }
+
+            // Chunks along the right and bottom edges may be cut short
+            float right = l->x + (float)((l->end_col * span < width) ? l->end_col * span : width) * tile_w;
+            float bottom = l->y + (float)((l->end_row * span < height) ? l->end_row * span : height) * tile_h;
+
+            float left = l->x + (float)l->first_col * cell_w;
+            float top = l->y + (float)l->first_row * cell_h;
+
+            l->bounds.x = (int)floorf(left) - 1;
+            l->bounds.y = (int)floorf(top) - 1;
+            l->bounds.w = (int)ceilf(right) - l->bounds.x + 1;
+            l->bounds.h = (int)ceilf(bottom) - l->bounds.y + 1;
+
+            items += (size_t)(l->end_col - l->first_col) * (l->end_row - l->first_row);
+
+            render_layers_count++;
+        }
+    }
+
+    // Back to front by z-order, keeping layers of the same z-order in the
+    // order they were added
+    for (size_t i = 1; i < render_layers_count; i++) {
+        RenderLayer l = render_layers[i];
+
+        size_t j = i;
+
+        while (j > 0 && render_layers[j - 1].z < l.z) {
+            render_layers[j] = render_layers[j - 1];
+
+            j--;
+        }
+
+        render_layers[j] = l;
+    }
+
+    return items;
+}
+
+// Damages the layers which moved, changed, appeared, or disappeared since the
+// last frame, then keeps this frame's layers to compare against the next
+void render_layers_damage(void) {
+    size_t count = (render_layers_count > render_layers_last_count) ? render_layers_count : render_layers_last_count;
+
+    for (size_t i = 0; i < count; i++) {
+        const RenderLayer* now = (i < render_layers_count) ? &render_layers[i] : NULL;
+        const RenderLayer* last = (i < render_layers_last_count) ? &render_layers_last[i] : NULL;
+
+        if (now && last && now->entity_id == last->entity_id && now->layer == last->layer && now->z == last->z && now->x == last->x &&
+            now->y == last->y && now->version == last->version && SDL_RectEquals(&now->bounds, &last->bounds)) {
+            continue;
+        }
+
+        if (now) {
+            render_damage(&now->bounds);
+        }
+
+        if (last) {
+            render_damage(&last->bounds);
+        }
+    }
+
+    RenderLayer* tmp = render_layers_last;
+
+    render_layers_last = render_layers;
+    render_layers_last_count = render_layers_count;
+
+    render_layers = tmp;
+    render_layers_count = 0;
+
+    size_t size = render_layers_last_size;
+
+    render_layers_last_size = render_layers_size;
+    render_layers_size = size;
+}
+
+// Adds the chunks, or tiles, of a layer in view to the frame. Returns the
+// number of items added.
+size_t render_layer_items(const RenderLayer* l, RenderItem* items) {
+    size_t count = 0;
+
+    float tile_w = (float)tilemap_get_tile_w(l->m);
+    float tile_h = (float)tilemap_get_tile_h(l->m);
+
+    if (!l->dynamic) {
+        float chunk_w = tile_w * (float)TILEMAP_CHUNK_SIZE;
+        float chunk_h = tile_h * (float)TILEMAP_CHUNK_SIZE;
+
+        for (uint32_t row = l->first_row; row < l->end_row; row++) {
+            for (uint32_t col = l->first_col; col < l->end_col; col++) {
+                uint64_t version = 0;
+
+                SDL_Surface* surface = tilemap_chunk_get(l->m, l->layer, col, row, &version);
+
+                if (!surface) {
+                    continue;
+                }
+
+                bool changed;
+
+                RenderTexture* rt = render_texture_get_versioned(surface, version, &changed);
+
+                if (!rt) {
+                    continue;
+                }
+
+                RenderItem* item = &items[count++];
+
+                render_item_quad(item, rt, (SDL_Rect){0, 0, surface->w, surface->h}, l->x + (float)col * chunk_w, l->y + (float)row * chunk_h);
+
+                // Chunks which were rebuilt change without moving
+                if (changed) {
+                    render_damage(&item->bounds);
+                }
+            }
+        }
+
+        render_stats.chunks += count;
+
+        return count;
+    }
+
+    // Tiles of dynamic layers are drawn straight from the tileset, which is
+    // kept resident while they're in view
+    Asset* tileset = tilemap_get_tileset(l->m);
+
+    if (!asset_touch(tileset)) {
+        return 0;
+    }
+
+    RenderTexture* rt = render_texture_get(asset_get_surface(tileset));
+
+    if (!rt) {
+        return 0;
+    }
+
+    for (uint32_t row = l->first_row; row < l->end_row; row++) {
+        for (uint32_t col = l->first_col; col < l->end_col; col++) {
+            uint16_t tile = tilemap_get_tile(l->m, l->layer, col, row);
+
+            if (tile == TILEMAP_TILE_EMPTY) {
+                continue;
+            }
+
+            render_item_quad(&items[count++], rt, tilemap_tile_rect(l->m, tile), l->x + (float)col * tile_w, l->y + (float)row * tile_h);
+        }
+    }
+
+    render_stats.tiles += count;
+
+    return count;
+}
+
+bool render_batch(uint32_t texture, size_t quads) {
+    SDL_Texture* tex = render_textures[texture]->texture;
+
+    if (SDL_RenderGeometry(render_renderer, tex, render_vertices, (int)quads * 4, render_indices, (int)quads * 6) != 0) {
+        logmsg(LOG_WARN, "render: Failed to draw batch of %zu sprites: %s", quads, SDL_GetError());
+
+        return false;
+    }
+
+    render_stats.draw_calls++;
+
+    return true;
+}
+
+// Draws the gathered sprites, or only those overlapping the given rect
+bool render_submit(size_t count, const SDL_Rect* rect) {
+    bool ret = true;
+
+    bool first = true;
+    size_t quads = 0;
+    uint32_t texture = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const RenderItem* item = &render_items[i];
+
+        if (rect && !SDL_HasIntersection(&item->bounds, rect)) {
+            continue;
+        }
+
+        if (quads > 0 && (item->texture != texture || quads == RENDER_BATCH_MAX)) {
+            ret = render_batch(texture, quads) && ret;
+
+            quads = 0;
+        }
+
+        if (first || item->texture != texture) {
+            render_stats.batches++;
+        }
+
+        first = false;
+        texture = item->texture;
+
+        memcpy(&render_vertices[quads * 4], item->v, sizeof(item->v));
+
+        quads++;
+    }
+
+    if (quads > 0) {
+        ret = render_batch(texture, quads) && ret;
+    }
+
+    return ret;
+}
+
+bool render_sprites(void) {
+    if (!render_renderer) {
+        logmsg(LOG_WARN, "render: Unable to draw sprites, the renderer is not initialized");
+
+        return false;
+    }
+
+    render_stats.sprites = 0;
+    render_stats.culled = 0;
+    render_stats.batches = 0;
+    render_stats.draw_calls = 0;
+    render_stats.uploads = 0;
+    render_stats.chunks = 0;
+    render_stats.tiles = 0;
+    render_stats.damage_rects = 0;
+    render_stats.damage_pixels = 0;
+
+    render_textures_update();
+    render_draw_update();
+
+    size_t sprites = render_draw_count;
+
+    int view_w = 0;
+    int view_h = 0;
+
+    if (SDL_GetRendererOutputSize(render_renderer, &view_w, &view_h) != 0) {
+        logmsg(LOG_WARN, "render: Unable to draw sprites, failed to get output size: %s", SDL_GetError());
+
+        return false;
+    }
+
+    Camera* camera = NULL;
+
+    if (render_camera) {
+        camera = entity_get_component(render_camera, CAMERA);
+
+        if (!camera) {
+            logmsg(LOG_WARN, "render: Entity[%" PRIu16 "] has no camera, drawing sprites in screen space", render_camera);
+
+            render_camera = 0;
+        }
+    }
+
+    Transform* camera_transform = camera ? entity_get_component(render_camera, TRANSFORM) : NULL;
+
+    if (camera_transform && render_damage_enabled) {
+        float camera_x = transform_get_render_x(camera_transform);
+        float camera_y = transform_get_render_y(camera_transform);
+
+        // Everything moves with the camera
+        if (camera_x != render_camera_x || camera_y != render_camera_y) {
+            render_damage_all();
+        }
+
+        render_camera_x = camera_x;
+        render_camera_y = camera_y;
+    }
+
+    size_t tiles = render_layers_gather(camera, (float)view_w, (float)view_h);
+
+    if (!render_reserve(sprites + tiles)) {
+        logmsg(LOG_WARN, "render: Unable to draw sprites, the system is out of memory");
+
+        return false;
+    }
+
+    // Gather, in draw order, with each tilemap layer behind the sprites of its
+    // z-order
+    size_t count = 0;
+    size_t drawn = 0;
+    size_t layer = 0;
+
+    // The list is sorted by z-order, so the origin only changes between runs
+    // of sprites of the same z-order
+    int origin_z = -1;
+    float origin_x = 0.0f;
+    float origin_y = 0.0f;
+
+    for (size_t i = 0; i < sprites; i++) {
+        RenderSortEntry* entry = &render_draw_list[i];
+
+        uint8_t z = sprite_get_z(entry->s);
+
+        while (layer < render_layers_count && render_layers[layer].z >= z) {
+            count += render_layer_items(&render_layers[layer++], &render_items[count]);
+        }
+
+        bool visible = !camera || camera_is_visible(camera, entry->entity_id);
+
+        if (camera && visible && z != origin_z) {
+            camera_get_origin(camera, z, &origin_x, &origin_y);
+
+            origin_z = z;
+        }
+
+        RenderItem* item = &render_items[count];
+
+        visible = visible && render_item_make(entry->s, render_entry_transform(entry), item, origin_x, origin_y, (float)view_w, (float)view_h);
+
+        // A variant arriving, or being evicted, changes how the sprite looks
+        // without anything signalling it, as do its image coming back after
+        // being evicted, and its palette changing
+        if (visible && (!entry->drawn || item->variant != entry->variant || item->palette_version != entry->palette_version)) {
+            entry->damaged = true;
+        }
+
+        // Changed sprites damage where they were, and where they are now.
+        // Sprites still being interpolated keep changing until they settle.
+        if (entry->damaged) {
+            if (entry->drawn) {
+                render_damage(&entry->bounds);
+            }
+
+            if (visible) {
+                render_damage(&item->bounds);
+            }
+
+            entry->damaged = !visible || !item->settled;
+        }
+
+        entry->drawn = visible;
+
+        if (visible) {
+            entry->bounds = item->bounds;
+            entry->variant = item->variant;
+            entry->palette_version = item->palette_version;
+
+            count++;
+            drawn++;
+        }
+    }
+
+    while (layer < render_layers_count) {
+        count += render_layer_items(&render_layers[layer++], &render_items[count]);
+    }
+
+    render_layers_damage();
+
+    render_stats.sprites = drawn;
+    render_stats.culled = sprites - drawn;
+    render_stats.textures = render_textures_count;
+
+    if (!render_damage_enabled) {
+        SDL_RenderClear(render_renderer);
+
+        return render_submit(count, NULL);
+    }
+
+    // Redraw what was damaged, and keep it to present
+    render_damage_merge(view_w, view_h);
+
+    SDL_Rect* tmp = render_frame_list;
+
+    render_frame_list = render_damage_list;
+    render_frame_count = render_damage_count;
+    render_frame_full = render_damage_full;
+
+    render_damage_list = tmp;
+    render_damage_count = 0;
+    render_damage_full = false;
+
+    size_t size = render_frame_size;
+
+    render_frame_size = render_damage_size;
+    render_damage_size = size;
+
+    if (render_frame_full) {
+        render_stats.damage_rects = 1;
+        render_stats.damage_pixels = (size_t)view_w * (size_t)view_h;
+
+        SDL_RenderClear(render_renderer);
+
+        return render_submit(count, NULL);
+    }
+
+    render_stats.damage_rects = render_frame_count;
+    render_stats.damage_pixels = 0;
+
+    bool ret = true;
+
+    for (size_t i = 0; i < render_frame_count; i++) {
+        const SDL_Rect* rect = &render_frame_list[i];
+
+        render_stats.damage_pixels += (size_t)rect->w * (size_t)rect->h;
+
+        SDL_RenderSetClipRect(render_renderer, rect);
+
+        ret = (SDL_RenderFillRect(render_renderer, rect) == 0) && ret;
+        ret = render_submit(count, rect) && ret;
+    }
+
+    SDL_RenderSetClipRect(render_renderer, NULL);
+
+    return ret;
+}
+
+bool render_present(void) {
+    if (!render_renderer) {
+        logmsg(LOG_WARN, "render: Unable to present, the renderer is not initialized");
+
+        return false;
+    }
+
+    if (!render_damage_enabled) {
+        SDL_RenderPresent(render_renderer);
+
+        return true;
+    }
+
+    // Nothing changed, so the last frame is still on screen
+    if (!render_frame_full && render_frame_count == 0) {
+        return true;
+    }
+
+    // Drawing is deferred until the renderer is flushed, and the software
+    // renderer draws straight into the window surface
+    SDL_RenderFlush(render_renderer);
+
+    SDL_Window* window = SDL_RenderGetWindow(render_renderer);
+
+    int ret = render_frame_full ? SDL_UpdateWindowSurface(window) : SDL_UpdateWindowSurfaceRects(window, render_frame_list, (int)render_frame_count);
+
+    render_frame_full = false;
+    render_frame_count = 0;
+
+    if (ret != 0) {
+        logmsg(LOG_WARN, "render: Failed to present damaged regions: %s", SDL_GetError());
+
+        render_damage_all();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool render_set_damage_tracking(bool enable) {
+    if (!render_renderer) {
+        logmsg(LOG_WARN, "render: Unable to set damage tracking, the renderer is not initialized");
+
+        return false;
+    }
+
+    if (enable && !render_damage_supported()) {
+        logmsg(LOG_WARN, "render: Unable to enable damage tracking, the renderer doesn't draw into a window surface");
+
+        return false;
+    }
+
+    render_damage_enabled = enable;
+    render_damage_full = true;
+    render_damage_count = 0;
+
+    return true;
+}
+
+void render_set_camera(uint16_t entity_id) {
+    render_camera = entity_id;
+
+    render_damage_all();
+}
+
+const RenderStats* render_get_stats(void) {
+    return &render_stats;
+}
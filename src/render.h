@@ -0,0 +1,164 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_RENDER
+#define RPGNG_RENDER
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+#include "component/sprite.h"
+
+// The most sprites submitted in a single draw call
+#define RENDER_BATCH_MAX 4096
+
+typedef struct RenderStats {
+    // Sprites drawn last frame, and sprites skipped because they were
+    // transparent, off screen, still loading, or had no transform
+    size_t sprites;
+    size_t culled;
+
+    // Runs of sprites sharing a texture, and the draw calls submitted for them.
+    // A batch larger than RENDER_BATCH_MAX takes more than one draw call.
+    size_t batches;
+    size_t draw_calls;
+
+    // Tilemap chunks drawn from their cached images, and tiles of dynamic
+    // tilemap layers drawn one at a time
+    size_t chunks;
+    size_t tiles;
+
+    // Textures resident, and textures created or refreshed last frame
+    size_t textures;
+    size_t uploads;
+
+    // Sprites re-keyed in the draw list because they moved, entries shifted
+    // by insertion sort, and whether the list had to be sorted from scratch
+    size_t sort_dirty;
+    size_t sort_shifts;
+    bool sort_radix;
+
+    // With damage tracking, the regions redrawn last frame, and the pixels
+    // they cover
+    size_t damage_rects;
+    size_t damage_pixels;
+} RenderStats;
+
+/**
+ * Initializes the sprite renderer.
+ *
+ * Software renderers drawing into a window have damage tracking enabled, so
+ * that only the regions of the screen which changed are redrawn and
+ * presented.
+ *
+ * @param renderer The renderer to draw with. Any SDL renderer will do,
+ * including a software renderer created with SDL_CreateSoftwareRenderer(),
+ * which can draw without a window.
+ */
+bool render_init(SDL_Renderer* renderer);
+
+/**
+ * Frees every texture and buffer held by the sprite renderer. The SDL renderer
+ * itself belongs to the caller.
+ */
+void render_cleanup(void);
+
+/**
+ * Draws every visible sprite at its interpolated position, back to front by
+ * z-order. Within a z-order, sprites are drawn top to bottom by the y of their
+ * feet, which is the bottom edge of the sprite, so that sprites lower on screen
+ * overlap those above them. Consecutive sprites sharing a texture, as sprites
+ * in the same atlas page do, are drawn with a single call.
+ *
+ * Tilemap layers are drawn along with sprites, each behind the sprites of its
+ * z-order, a chunk at a time from cached images unless they're dynamic.
+ *
+ * The draw order is kept between frames, and only sprites which moved are
+ * re-sorted.
+ *
+ * The frame is cleared first, with the renderer's draw color. With damage
+ * tracking, only damaged regions are cleared and redrawn; anything else
+ * drawing to the frame should mark what it changes with render_damage(), and
+ * draw under the same clip.
+ *
+ * This should be called once per frame, after sim_frame().
+ *
+ * @return Returns true on success. Returns false if any draw call failed.
+ */
+bool render_sprites(void);
+
+/**
+ * Presents the frame drawn by render_sprites(). With damage tracking, only the
+ * damaged regions are presented, and nothing at all if nothing changed.
+ */
+bool render_present(void);
+
+/**
+ * Enables or disables damage tracking. Damage tracking relies on the last
+ * frame remaining in the window surface, so it can only be enabled for
+ * software renderers drawing into a window.
+ *
+ * @return Returns false if damage tracking can't be enabled.
+ */
+bool render_set_damage_tracking(bool enable);
+
+/**
+ * Marks a region of the screen to be redrawn next frame. Sprites damage the
+ * regions they're drawn in when they move or change, so this is only needed
+ * for whatever else is drawn to the frame.
+ */
+void render_damage(const SDL_Rect* rect);
+
+/**
+ * Marks the whole screen to be redrawn next frame, as after the window is
+ * exposed or resized, or a camera's viewport or parallax changes.
+ */
+void render_damage_all(void);
+
+/**
+ * Draws sprites through the camera of the given entity. Only sprites found in
+ * view by the camera's last visibility pass are drawn, offset by the camera's
+ * position and the parallax factor of their z-order.
+ *
+ * @param entity_id The entity with the camera, or 0 to draw sprites at their
+ * positions on screen, which is the default. If the entity loses its camera,
+ * this is reset to 0.
+ */
+void render_set_camera(uint16_t entity_id);
+
+/**
+ * Adds a sprite to the draw list. Called by the sprite component when a sprite
+ * is created.
+ */
+bool render_sprite_add(Sprite* s);
+
+/**
+ * Removes the sprite of the given entity from the draw list. Called by the
+ * sprite component when a sprite is destroyed.
+ */
+void render_sprite_remove(uint16_t entity_id);
+
+/**
+ * Drops the draw list's cached pointer to the transform of the given entity.
+ * Called by the transform component when a transform is destroyed.
+ */
+void render_transform_forget(uint16_t entity_id);
+
+/**
+ * Marks the sprite of the given entity to be re-sorted before the next frame
+ * is drawn. Moving, scaling, and changing the z-order of sprites does this
+ * already. Called by the sprite component when an image finishes loading,
+ * which changes the sprite's size.
+ */
+void render_sprite_touch(uint16_t entity_id);
+
+/**
+ * Gets the renderer statistics for the last frame.
+ */
+const RenderStats* render_get_stats(void);
+
+#endif
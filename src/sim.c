@@ -0,0 +1,147 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "collision.h"
+#include "log.h"
+#include "sim.h"
+
+#include "component/animation.h"
+#include "component/camera.h"
+#include "component/component.h"
+#include "component/transform.h"
+
+// Weight given to the newest sample in the tick time moving average
+#define SIM_AVG_WEIGHT 0.05
+
+double sim_dt = 0;
+double sim_accumulator = 0;
+
+unsigned int sim_max_ticks = 0;
+
+sim_tick_cb_t sim_tick_cb = NULL;
+void* sim_tick_userdata = NULL;
+
+SimStats sim_stats;
+
+bool sim_init(unsigned int tick_rate, unsigned int max_ticks) {
+    if (tick_rate == 0) {
+        logmsg(LOG_WARN, "sim: Failed to initialize simulation, tick rate must be non-zero");
+
+        return false;
+    }
+
+    if (max_ticks == 0) {
+        logmsg(LOG_WARN, "sim: Failed to initialize simulation, max ticks per frame must be non-zero");
+
+        return false;
+    }
+
+    sim_dt = 1.0 / tick_rate;
+    sim_accumulator = 0;
+    sim_max_ticks = max_ticks;
+
+    memset(&sim_stats, 0, sizeof(SimStats));
+
+    logmsg(LOG_DEBUG, "sim: Running at %u ticks per second, at most %u per frame", tick_rate, max_ticks);
+
+    return true;
+}
+
+void sim_set_tick_cb(sim_tick_cb_t cb, void* userdata) {
+    sim_tick_cb = cb;
+    sim_tick_userdata = userdata;
+}
+
+void sim_tick(void) {
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    transform_snapshot();
+    transform_velocity_apply();
+
+    // Frames can change sprite sizes, so they're advanced before collision
+    // bodies are
+    animation_update(sim_dt);
+
+    collision_update();
+
+    if (sim_tick_cb) {
+        sim_tick_cb(sim_dt, sim_tick_userdata);
+    }
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    if (sim_stats.ticks == 0) {
+        sim_stats.tick_time_avg = elapsed;
+    }
+    else {
+        sim_stats.tick_time_avg += SIM_AVG_WEIGHT * (elapsed - sim_stats.tick_time_avg);
+    }
+
+    sim_stats.tick_time = elapsed;
+    sim_stats.budget_used = sim_stats.tick_time_avg / sim_dt;
+    sim_stats.ticks++;
+}
+
+double sim_frame(double frame_time) {
+    if (sim_dt == 0) {
+        logmsg(LOG_WARN, "sim: Unable to advance simulation, not initialized");
+
+        return 0;
+    }
+
+    // Negative frame times can't happen unless the clock goes backwards
+    if (frame_time > 0) {
+        sim_accumulator += frame_time;
+    }
+
+    unsigned int ticks = 0;
+
+    while (sim_accumulator >= sim_dt && ticks < sim_max_ticks) {
+        sim_tick();
+
+        sim_accumulator -= sim_dt;
+        ticks++;
+    }
+
+    // If we're still behind, the simulation can't keep up with real time.
+    // Drop the debt instead of trying to repay it next frame, which would only
+    // make the next frame slower.
+    if (sim_accumulator >= sim_dt) {
+        unsigned int dropped = (unsigned int)(sim_accumulator / sim_dt);
+
+        logmsg(LOG_DEBUG, "sim: Falling behind, dropping %u ticks", dropped);
+
+        sim_stats.ticks_dropped += dropped;
+        sim_accumulator -= dropped * sim_dt;
+    }
+
+    sim_stats.frame_ticks = ticks;
+
+    component_flush();
+
+    double alpha = sim_accumulator / sim_dt;
+
+    transform_interpolate((float)alpha);
+
+    // The renderer places every sprite with its matrix, so recompute the stale
+    // ones in batches now rather than one at a time while drawing
+    transform_matrix_update();
+
+    camera_update();
+
+    return alpha;
+}
+
+double sim_get_dt(void) {
+    return sim_dt;
+}
+
+const SimStats* sim_get_stats(void) {
+    return &sim_stats;
+}
@@ -0,0 +1,77 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_SIM
+#define RPGNG_SIM
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Called once per simulation tick, after velocities have been applied.
+ *
+ * @param dt The length of a tick, in seconds.
+ */
+typedef void (*sim_tick_cb_t)(double dt, void* userdata);
+
+typedef struct SimStats {
+    // Total ticks run since sim_init()
+    uint64_t ticks;
+
+    // Total ticks skipped by the spiral-of-death guard
+    uint64_t ticks_dropped;
+
+    // Ticks run during the most recent frame
+    unsigned int frame_ticks;
+
+    // Wall time taken by the most recent tick, in seconds
+    double tick_time;
+
+    // Moving average of tick wall time, in seconds
+    double tick_time_avg;
+
+    // Fraction of the tick length consumed by an average tick. Values
+    // approaching 1 mean the simulation can't keep up.
+    double budget_used;
+} SimStats;
+
+/**
+ * Initializes the simulation clock.
+ *
+ * @param tick_rate The number of simulation ticks per second.
+ * @param max_ticks The maximum number of ticks to run in a single frame.
+ * Any further time owed to the simulation is dropped, so that a slow frame
+ * doesn't cause even more work on the next one.
+ */
+bool sim_init(unsigned int tick_rate, unsigned int max_ticks);
+
+/**
+ * Sets a function to be called once per simulation tick. Pass NULL to clear
+ * it.
+ */
+void sim_set_tick_cb(sim_tick_cb_t cb, void* userdata);
+
+/**
+ * Advances the simulation by the given amount of wall time, running as many
+ * fixed ticks as are owed, then computes interpolated render transforms for
+ * the remainder.
+ *
+ * @param frame_time The wall time elapsed since the previous frame, in
+ * seconds.
+ *
+ * @return The interpolation factor used for rendering, between 0 and 1.
+ */
+double sim_frame(double frame_time);
+
+/**
+ * Gets the length of a simulation tick, in seconds.
+ */
+double sim_get_dt(void);
+
+/**
+ * Gets the simulation timing statistics.
+ */
+const SimStats* sim_get_stats(void);
+
+#endif
@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+#include "log.h"
+#include "simd.h"
+
+const char* simd_level_str[] = {
+    [SIMD_SCALAR] = "scalar",
+    [SIMD_SSE2] = "sse2",
+    [SIMD_AVX2] = "avx2",
+};
+
+bool simd_detected = false;
+
+SimdLevel simd_level_host = SIMD_SCALAR;
+SimdLevel simd_level_cur = SIMD_SCALAR;
+
+void simd_detect(void) {
+#ifdef RPGNG_SIMD_X86
+    if (SDL_HasSSE2()) {
+        simd_level_host = SIMD_SSE2;
+    }
+
+    if (SDL_HasAVX2()) {
+        simd_level_host = SIMD_AVX2;
+    }
+#endif
+
+    simd_level_cur = simd_level_host;
+    simd_detected = true;
+
+    logmsg(LOG_DEBUG, "simd: Using '%s' kernels", simd_level_str[simd_level_cur]);
+}
+
+SimdLevel simd_level(void) {
+    if (!simd_detected) {
+        simd_detect();
+    }
+
+    return simd_level_cur;
+}
+
+SimdLevel simd_level_set(SimdLevel level) {
+    if (!simd_detected) {
+        simd_detect();
+    }
+
+    simd_level_cur = (level < simd_level_host) ? level : simd_level_host;
+
+    logmsg(LOG_DEBUG, "simd: Requested '%s' kernels, using '%s'", simd_level_str[level], simd_level_str[simd_level_cur]);
+
+    return simd_level_cur;
+}
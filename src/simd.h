@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_SIMD
+#define RPGNG_SIMD
+
+// SSE2 is part of the x86-64 baseline, so kernels at that level can be
+// compiled unconditionally. Higher levels are compiled per-function with
+// RPGNG_TARGET() and selected at runtime with simd_level().
+#if defined(__x86_64__) || defined(_M_X64)
+#define RPGNG_SIMD_X86 1
+
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RPGNG_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RPGNG_TARGET(isa)
+#endif
+
+typedef enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+} SimdLevel;
+
+// Strings representing the above SIMD levels. Use the above enum values as indexes.
+extern const char* simd_level_str[];
+
+/**
+ * Returns the highest instruction set level supported by both the build and
+ * the host CPU, or the level most recently requested with simd_level_set(),
+ * whichever is lower.
+ */
+SimdLevel simd_level(void);
+
+/**
+ * Caps the instruction set level used by all SIMD kernels. This is mostly
+ * useful for comparing kernels against each other.
+ *
+ * @return The level that will actually be used, which may be lower than the
+ * requested level if the host CPU doesn't support it.
+ */
+SimdLevel simd_level_set(SimdLevel level);
+
+#endif
@@ -0,0 +1,625 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "spatial.h"
+
+#include "component/transform.h"
+
+// Cell coordinates are clamped to this range, so that ring searches can step
+// past the edge of the world without overflowing
+#define SPATIAL_COORD_MAX (1 << 30)
+
+#define SPATIAL_TABLE_DEFAULT_SIZE 64
+
+typedef struct SpatialCell {
+    int32_t cx;
+    int32_t cy;
+
+    bool used;
+
+    uint32_t size;
+    uint32_t count;
+
+    uint16_t* ids;
+} SpatialCell;
+
+typedef struct SpatialEntry {
+    float x;
+    float y;
+
+    // The cell table slot holding this entity, and its position within that
+    // cell's ID list
+    uint32_t cell;
+    uint32_t slot;
+
+    bool present;
+} SpatialEntry;
+
+typedef struct SpatialIndex {
+    float cell_size;
+
+    // Open-addressed table of grid cells, keyed on cell coordinates. Emptied
+    // cells stay in place, so that probing past them still works, until the
+    // table is rehashed without them. Cells used, and those holding entities.
+    size_t size;
+    size_t used;
+    size_t live;
+
+    SpatialCell* cells;
+
+    // Entries indexed by entity ID
+    size_t entries_size;
+
+    SpatialEntry* entries;
+
+    size_t count;
+} SpatialIndex;
+
+SpatialIndex spatial;
+
+void spatial_on_translate(TransformSignalType type, const TransformSignalEvent* events, size_t count, void* userdata) {
+    for (size_t i = 0; i < count; i++) {
+        spatial_move(events[i].entity_id, events[i].args.x, events[i].args.y);
+    }
+}
+
+bool spatial_init(float cell_size) {
+    if (spatial.cells) {
+        logmsg(LOG_WARN, "spatial: Failed to initialize spatial index, already initialized");
+
+        return false;
+    }
+
+    if (!(cell_size > 0)) {
+        logmsg(LOG_WARN, "spatial: Failed to initialize spatial index, cell size must be positive");
+
+        return false;
+    }
+
+    spatial.cells = calloc(SPATIAL_TABLE_DEFAULT_SIZE, sizeof(SpatialCell));
+
+    if (!spatial.cells) {
+        logmsg(LOG_WARN, "spatial: Failed to initialize spatial index, the system is out of memory");
+
+        return false;
+    }
+
+    spatial.size = SPATIAL_TABLE_DEFAULT_SIZE;
+    spatial.cell_size = cell_size;
+
+    if (!transform_regcb_batch(TRANSLATE, spatial_on_translate, NULL)) {
+        logmsg(LOG_WARN, "spatial: Failed to subscribe to transform signals");
+
+        spatial_cleanup();
+
+        return false;
+    }
+
+    logmsg(LOG_DEBUG, "spatial: Initialized spatial index with %gpx cells", cell_size);
+
+    return true;
+}
+
+void spatial_cleanup(void) {
+    if (!spatial.cells) {
+        return;
+    }
+
+    transform_unregcb_batch(TRANSLATE, spatial_on_translate, NULL);
+
+    for (size_t i = 0; i < spatial.size; i++) {
+        free(spatial.cells[i].ids);
+    }
+
+    free(spatial.cells);
+    free(spatial.entries);
+
+    memset(&spatial, 0, sizeof(SpatialIndex));
+}
+
+int32_t spatial_cell_coord(float v) {
+    float c = floorf(v / spatial.cell_size);
+
+    // Written so that NaN clamps too
+    if (!(c > -SPATIAL_COORD_MAX)) {
+        return -SPATIAL_COORD_MAX;
+    }
+
+    if (c > SPATIAL_COORD_MAX) {
+        return SPATIAL_COORD_MAX;
+    }
+
+    return (int32_t)c;
+}
+
+size_t spatial_cell_hash(int32_t cx, int32_t cy) {
+    uint64_t key = ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+
+    key *= 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(key ^ (key >> 29));
+}
+
+// Returns the table slot holding the given cell, or the empty slot where it
+// belongs if it's not present
+size_t spatial_cell_probe(int32_t cx, int32_t cy) {
+    size_t mask = spatial.size - 1;
+    size_t i = spatial_cell_hash(cx, cy) & mask;
+
+    while (spatial.cells[i].used && (spatial.cells[i].cx != cx || spatial.cells[i].cy != cy)) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+SpatialCell* spatial_cell_find(int32_t cx, int32_t cy) {
+    SpatialCell* cell = &spatial.cells[spatial_cell_probe(cx, cy)];
+
+    return (cell->used && cell->count > 0) ? cell : NULL;
+}
+
+// Moves the cells holding entities into a table of the given size, dropping
+// the empty ones
+bool spatial_table_rehash(size_t size) {
+    logmsg(LOG_DEBUG, "spatial: Rehashing %zu of %zu cells into %zu slots", spatial.live, spatial.used, size);
+
+    SpatialCell* old = spatial.cells;
+    size_t old_size = spatial.size;
+
+    spatial.cells = calloc(size, sizeof(SpatialCell));
+
+    if (!spatial.cells) {
+        spatial.cells = old;
+
+        return false;
+    }
+
+    spatial.size = size;
+    spatial.used = spatial.live;
+
+    // Rehash, and point every entry at its cell's new slot
+    for (size_t i = 0; i < old_size; i++) {
+        if (!old[i].used) {
+            continue;
+        }
+
+        if (old[i].count == 0) {
+            free(old[i].ids);
+
+            continue;
+        }
+
+        size_t slot = spatial_cell_probe(old[i].cx, old[i].cy);
+
+        spatial.cells[slot] = old[i];
+
+        for (uint32_t j = 0; j < old[i].count; j++) {
+            spatial.entries[old[i].ids[j]].cell = (uint32_t)slot;
+        }
+    }
+
+    free(old);
+
+    return true;
+}
+
+bool spatial_cell_add(uint16_t entity_id, int32_t cx, int32_t cy) {
+    // Keep the load factor at or below one half
+    if ((spatial.used + 1) * 2 > spatial.size && !spatial_table_rehash(spatial.size * 2)) {
+        return false;
+    }
+
+    size_t slot = spatial_cell_probe(cx, cy);
+
+    SpatialCell* cell = &spatial.cells[slot];
+
+    if (!cell->used) {
+        cell->cx = cx;
+        cell->cy = cy;
+        cell->used = true;
+
+        spatial.used++;
+    }
+
+    if (cell->count == cell->size) {
+        uint32_t size = cell->size ? cell->size * 2 : 4;
+
+        uint16_t* ids = realloc(cell->ids, size * sizeof(uint16_t));
+
+        if (!ids) {
+            return false;
+        }
+
+        cell->ids = ids;
+        cell->size = size;
+    }
+
+    SpatialEntry* entry = &spatial.entries[entity_id];
+
+    entry->cell = (uint32_t)slot;
+    entry->slot = cell->count;
+
+    if (cell->count == 0) {
+        spatial.live++;
+    }
+
+    cell->ids[cell->count++] = entity_id;
+
+    return true;
+}
+
+void spatial_cell_remove(uint16_t entity_id) {
+    SpatialEntry* entry = &spatial.entries[entity_id];
+    SpatialCell* cell = &spatial.cells[entry->cell];
+
+    // Move the last ID in the cell into the hole
+    uint16_t last = cell->ids[--cell->count];
+
+    cell->ids[entry->slot] = last;
+    spatial.entries[last].slot = entry->slot;
+
+    if (cell->count > 0) {
+        return;
+    }
+
+    spatial.live--;
+
+    // Once most cells are empty, as they become when entities stream through
+    // the world, drop them, shrinking the table to a quarter full. A failed
+    // rehash leaves the table as it was, to be tried again later.
+    if (spatial.used > SPATIAL_TABLE_DEFAULT_SIZE / 4 && spatial.used > spatial.live * 2) {
+        size_t size = SPATIAL_TABLE_DEFAULT_SIZE;
+
+        while (size < spatial.live * 4) {
+            size *= 2;
+        }
+
+        spatial_table_rehash(size);
+    }
+}
+
+bool spatial_entries_grow(uint16_t entity_id) {
+    size_t size = spatial.entries_size ? spatial.entries_size : SPATIAL_TABLE_DEFAULT_SIZE;
+
+    while (size <= entity_id) {
+        size *= 2;
+    }
+
+    SpatialEntry* entries = realloc(spatial.entries, size * sizeof(SpatialEntry));
+
+    if (!entries) {
+        return false;
+    }
+
+    memset(&entries[spatial.entries_size], 0, (size - spatial.entries_size) * sizeof(SpatialEntry));
+
+    spatial.entries = entries;
+    spatial.entries_size = size;
+
+    return true;
+}
+
+bool spatial_insert(uint16_t entity_id, float x, float y) {
+    if (!spatial.cells) {
+        return true;
+    }
+
+    if (entity_id >= spatial.entries_size && !spatial_entries_grow(entity_id)) {
+        logmsg(LOG_WARN, "spatial: Failed to insert entity[%" PRIu16 "], the system is out of memory", entity_id);
+
+        return false;
+    }
+
+    SpatialEntry* entry = &spatial.entries[entity_id];
+
+    if (entry->present) {
+        logmsg(LOG_WARN, "spatial: Failed to insert entity[%" PRIu16 "], already indexed", entity_id);
+
+        return false;
+    }
+
+    if (!spatial_cell_add(entity_id, spatial_cell_coord(x), spatial_cell_coord(y))) {
+        logmsg(LOG_WARN, "spatial: Failed to insert entity[%" PRIu16 "], the system is out of memory", entity_id);
+
+        return false;
+    }
+
+    entry->x = x;
+    entry->y = y;
+    entry->present = true;
+
+    spatial.count++;
+
+    return true;
+}
+
+bool spatial_remove(uint16_t entity_id) {
+    if (!spatial.cells) {
+        return true;
+    }
+
+    if (entity_id >= spatial.entries_size || !spatial.entries[entity_id].present) {
+        return false;
+    }
+
+    spatial_cell_remove(entity_id);
+
+    spatial.entries[entity_id].present = false;
+    spatial.count--;
+
+    return true;
+}
+
+bool spatial_move(uint16_t entity_id, float x, float y) {
+    if (entity_id >= spatial.entries_size || !spatial.entries[entity_id].present) {
+        return false;
+    }
+
+    SpatialEntry* entry = &spatial.entries[entity_id];
+
+    entry->x = x;
+    entry->y = y;
+
+    int32_t cx = spatial_cell_coord(x);
+    int32_t cy = spatial_cell_coord(y);
+
+    SpatialCell* cell = &spatial.cells[entry->cell];
+
+    // Most moves stay within a cell
+    if (cell->cx == cx && cell->cy == cy) {
+        return true;
+    }
+
+    spatial_cell_remove(entity_id);
+
+    if (!spatial_cell_add(entity_id, cx, cy)) {
+        logmsg(LOG_WARN, "spatial: Dropped entity[%" PRIu16 "] from index, the system is out of memory", entity_id);
+
+        entry->present = false;
+        spatial.count--;
+
+        return false;
+    }
+
+    return true;
+}
+
+// Visits every non-empty cell in the given inclusive range of cell
+// coordinates. Sparse ranges larger than the table are walked via the table
+// instead.
+typedef bool (*spatial_visit_cb_t)(const SpatialCell* cell, void* ctx);
+
+void spatial_visit(int32_t cx0, int32_t cy0, int32_t cx1, int32_t cy1, spatial_visit_cb_t cb, void* ctx) {
+    if (cx1 < cx0 || cy1 < cy0) {
+        return;
+    }
+
+    uint64_t w = (uint64_t)((int64_t)cx1 - cx0 + 1);
+    uint64_t h = (uint64_t)((int64_t)cy1 - cy0 + 1);
+
+    // Compared without multiplying, which could overflow
+    if (w > spatial.size || h > spatial.size / w) {
+        for (size_t i = 0; i < spatial.size; i++) {
+            SpatialCell* cell = &spatial.cells[i];
+
+            if (cell->used && cell->count > 0 && cell->cx >= cx0 && cell->cx <= cx1 && cell->cy >= cy0 && cell->cy <= cy1) {
+                if (!cb(cell, ctx)) {
+                    return;
+                }
+            }
+        }
+
+        return;
+    }
+
+    for (int32_t cy = cy0; cy <= cy1; cy++) {
+        for (int32_t cx = cx0; cx <= cx1; cx++) {
+            SpatialCell* cell = spatial_cell_find(cx, cy);
+
+            if (cell && !cb(cell, ctx)) {
+                return;
+            }
+        }
+    }
+}
+
+typedef struct SpatialQuery {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+
+    // Squared radius, or negative for rectangle queries
+    float r2;
+    float x;
+    float y;
+
+    uint16_t* out;
+    size_t max;
+    size_t count;
+} SpatialQuery;
+
+bool spatial_query_cell(const SpatialCell* cell, void* ctx) {
+    SpatialQuery* q = ctx;
+
+    for (uint32_t i = 0; i < cell->count; i++) {
+        const SpatialEntry* entry = &spatial.entries[cell->ids[i]];
+
+        if (entry->x < q->x0 || entry->x > q->x1 || entry->y < q->y0 || entry->y > q->y1) {
+            continue;
+        }
+
+        if (q->r2 >= 0) {
+            float dx = entry->x - q->x;
+            float dy = entry->y - q->y;
+
+            if (dx * dx + dy * dy > q->r2) {
+                continue;
+            }
+        }
+
+        q->out[q->count++] = cell->ids[i];
+
+        if (q->count == q->max) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t spatial_query_box(SpatialQuery* q) {
+    if (!spatial.cells || q->max == 0 || !q->out) {
+        return 0;
+    }
+
+    spatial_visit(spatial_cell_coord(q->x0), spatial_cell_coord(q->y0), spatial_cell_coord(q->x1), spatial_cell_coord(q->y1), spatial_query_cell, q);
+
+    return q->count;
+}
+
+size_t spatial_query_rect(float x, float y, float w, float h, uint16_t* out, size_t max) {
+    SpatialQuery q = {.x0 = x, .y0 = y, .x1 = x + w, .y1 = y + h, .r2 = -1, .out = out, .max = max};
+
+    return spatial_query_box(&q);
+}
+
+size_t spatial_query_radius(float x, float y, float radius, uint16_t* out, size_t max) {
+    if (radius < 0) {
+        return 0;
+    }
+
+    SpatialQuery q = {
+        .x0 = x - radius, .y0 = y - radius, .x1 = x + radius, .y1 = y + radius, .r2 = radius * radius, .x = x, .y = y, .out = out, .max = max};
+
+    return spatial_query_box(&q);
+}
+
+typedef struct SpatialNearest {
+    float x;
+    float y;
+
+    // The best candidates so far, sorted by increasing distance
+    uint16_t* out;
+    float* dist;
+    size_t k;
+    size_t count;
+
+    // Entities considered so far
+    size_t seen;
+} SpatialNearest;
+
+bool spatial_nearest_cell(const SpatialCell* cell, void* ctx) {
+    SpatialNearest* n = ctx;
+
+    for (uint32_t i = 0; i < cell->count; i++) {
+        const SpatialEntry* entry = &spatial.entries[cell->ids[i]];
+
+        float dx = entry->x - n->x;
+        float dy = entry->y - n->y;
+        float d = dx * dx + dy * dy;
+
+        n->seen++;
+
+        if (n->count == n->k && d >= n->dist[n->k - 1]) {
+            continue;
+        }
+
+        size_t j = (n->count < n->k) ? n->count++ : n->k - 1;
+
+        for (; j > 0 && n->dist[j - 1] > d; j--) {
+            n->dist[j] = n->dist[j - 1];
+            n->out[j] = n->out[j - 1];
+        }
+
+        n->dist[j] = d;
+        n->out[j] = cell->ids[i];
+    }
+
+    return true;
+}
+
+size_t spatial_query_nearest(float x, float y, size_t k, uint16_t* out) {
+    if (!spatial.cells || k == 0 || !out || spatial.count == 0) {
+        return 0;
+    }
+
+    if (k > spatial.count) {
+        k = spatial.count;
+    }
+
+    float* dist = malloc(k * sizeof(float));
+
+    if (!dist) {
+        logmsg(LOG_WARN, "spatial: Failed to query nearest entities, the system is out of memory");
+
+        return 0;
+    }
+
+    SpatialNearest n = {.x = x, .y = y, .out = out, .dist = dist, .k = k};
+
+    int32_t cx = spatial_cell_coord(x);
+    int32_t cy = spatial_cell_coord(y);
+
+    // Search outward in square rings of cells around the query point. Every
+    // cell in ring r + 1 is at least r cells away, so once the kth best
+    // candidate is closer than that, nothing further out can beat it.
+    size_t visited = 0;
+
+    for (int32_t r = 0; n.seen < spatial.count; r++) {
+        if (n.count == k) {
+            float bound = (float)(r - 1) * spatial.cell_size;
+
+            if (r > 0 && n.dist[k - 1] <= bound * bound) {
+                break;
+            }
+        }
+
+        // Rings in sparse worlds can cover far more cells than are occupied.
+        // Past that point, one pass over the whole table is cheaper.
+        if (visited > spatial.size) {
+            n.count = 0;
+            n.seen = 0;
+
+            spatial_visit(INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX, spatial_nearest_cell, &n);
+
+            break;
+        }
+
+        if (r == 0) {
+            SpatialCell* cell = spatial_cell_find(cx, cy);
+
+            if (cell) {
+                spatial_nearest_cell(cell, &n);
+            }
+
+            visited++;
+
+            continue;
+        }
+
+        // Top and bottom rows, then the left and right columns between them
+        spatial_visit(cx - r, cy - r, cx + r, cy - r, spatial_nearest_cell, &n);
+        spatial_visit(cx - r, cy + r, cx + r, cy + r, spatial_nearest_cell, &n);
+        spatial_visit(cx - r, cy - r + 1, cx - r, cy + r - 1, spatial_nearest_cell, &n);
+        spatial_visit(cx + r, cy - r + 1, cx + r, cy + r - 1, spatial_nearest_cell, &n);
+
+        visited += 8 * (size_t)r;
+    }
+
+    free(dist);
+
+    return n.count;
+}
+
+size_t spatial_count(void) {
+    return spatial.count;
+}
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_SPATIAL
+#define RPGNG_SPATIAL
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPATIAL_CELL_SIZE_DEFAULT 64
+
+/**
+ * Initializes the spatial index, a hash grid over transform positions.
+ *
+ * Once initialized, every transform created is added to the index, and
+ * removed again when destroyed. Positions are updated from deferred TRANSLATE
+ * signals, so the index reflects the positions of entities as of the most
+ * recent call to component_flush(). Only entities which moved are updated.
+ *
+ * Transforms created before the index is initialized are not indexed.
+ *
+ * @param cell_size The width and height of a grid cell, in pixels. Queries are
+ * fastest when this is close to the typical query radius.
+ */
+bool spatial_init(float cell_size);
+
+/**
+ * Frees all memory held by the spatial index, and stops tracking transforms.
+ */
+void spatial_cleanup(void);
+
+/**
+ * Adds an entity to the index at the given position. Does nothing if the
+ * index hasn't been initialized.
+ */
+bool spatial_insert(uint16_t entity_id, float x, float y);
+
+/**
+ * Removes an entity from the index. Does nothing if the index hasn't been
+ * initialized.
+ */
+bool spatial_remove(uint16_t entity_id);
+
+/**
+ * Moves an indexed entity to the given position.
+ *
+ * @return Returns false if the entity isn't in the index.
+ */
+bool spatial_move(uint16_t entity_id, float x, float y);
+
+/**
+ * Finds the entities whose positions lie within the given rectangle, edges
+ * included.
+ *
+ * @param[out] out An array of at least max entity IDs.
+ *
+ * @return The number of entity IDs written to out, which is at most max.
+ */
+size_t spatial_query_rect(float x, float y, float w, float h, uint16_t* out, size_t max);
+
+/**
+ * Finds the entities whose positions lie within the given distance of (x, y).
+ *
+ * @param[out] out An array of at least max entity IDs.
+ *
+ * @return The number of entity IDs written to out, which is at most max.
+ */
+size_t spatial_query_radius(float x, float y, float radius, uint16_t* out, size_t max);
+
+/**
+ * Finds the k entities nearest to (x, y).
+ *
+ * @param[out] out An array of at least k entity IDs. Entities are written in
+ * order of increasing distance.
+ *
+ * @return The number of entity IDs written to out, which is less than k only
+ * if fewer than k entities are indexed.
+ */
+size_t spatial_query_nearest(float x, float y, size_t k, uint16_t* out);
+
+/**
+ * Gets the number of entities in the index.
+ */
+size_t spatial_count(void);
+
+#endif
@@ -0,0 +1,736 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include "blit.h"
+#include "htable.h"
+#include "log.h"
+#include "variant.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Variants larger than this, on either side, aren't cached
+#define VARIANT_SIZE_MAX 4096
+
+// No single variant may take more than this fraction of the budget
+#define VARIANT_BUDGET_SHARE 4
+
+#define VARIANT_EDGE_EPSILON 0.001f
+
+typedef struct VariantJob VariantJob;
+
+// Every field is set, padding included, so that keys compare bytewise
+typedef struct VariantKey {
+    SDL_Surface* source;
+    SDL_Rect clip;
+
+    uint16_t angle;
+    uint16_t scale;
+    uint32_t flags;
+} VariantKey;
+
+typedef struct VariantEntry VariantEntry;
+
+struct VariantEntry {
+    VariantKey key;
+    Variant variant;
+
+    size_t bytes;
+
+    // The generation in flight, if still being generated
+    VariantJob* job;
+
+    // Set when the source surface is freed while the variant is being
+    // generated, so that it's dropped once published
+    bool orphaned;
+
+    // Every entry is linked into a list, most recently used first
+    VariantEntry* prev;
+    VariantEntry* next;
+};
+
+// Jobs are only touched by worker threads while queued. Each has its own copy
+// of the source pixels, so that the source can change or be freed meanwhile.
+struct VariantJob {
+    VariantEntry* entry;
+
+    SDL_Surface* image;
+
+    // The forward transform, and the bounds of the transformed image
+    float a;
+    float b;
+
+    int x;
+    int y;
+    int w;
+    int h;
+
+    uint32_t flags;
+
+    SDL_Surface* surface;
+
+    VariantJob* next;
+};
+
+HashTable* variant_table = NULL;
+
+VariantEntry* variant_head = NULL;
+VariantEntry* variant_tail = NULL;
+
+VariantStats variant_stats;
+
+// Workers, started by the first miss
+SDL_mutex* variant_lock = NULL;
+SDL_cond* variant_work = NULL;
+
+SDL_Thread* variant_threads[VARIANT_THREADS] = {0};
+size_t variant_thread_count = 0;
+
+bool variant_quit = false;
+
+// Guarded by variant_lock. Queued jobs are taken in order, while done jobs
+// are pushed and published newest first.
+VariantJob* variant_queue_head = NULL;
+VariantJob* variant_queue_tail = NULL;
+VariantJob* variant_done = NULL;
+
+bool variant_init(size_t budget) {
+    if (variant_table) {
+        logmsg(LOG_WARN, "variant: Failed to initialize variant cache, already initialized");
+
+        return false;
+    }
+
+    variant_table = htable_create(64);
+
+    if (!variant_table) {
+        logmsg(LOG_WARN, "variant: Failed to create variant table, the system is out of memory");
+
+        return false;
+    }
+
+    memset(&variant_stats, 0, sizeof(VariantStats));
+
+    variant_stats.budget = budget;
+
+    return true;
+}
+
+// Generation
+
+// Reads a pixel, or transparency beyond the edges
+uint32_t variant_pixel(const SDL_Surface* s, int x, int y) {
+    if (x < 0 || y < 0 || x >= s->w || y >= s->h) {
+        return 0;
+    }
+
+    return ((const uint32_t*)((const uint8_t*)s->pixels + (size_t)y * (size_t)s->pitch))[x];
+}
+
+// Samples between pixel centers. Colors are premultiplied, so channels can be
+// interpolated independently.
+uint32_t variant_sample(const SDL_Surface* s, float u, float v) {
+    float fu = floorf(u);
+    float fv = floorf(v);
+
+    int x = (int)fu;
+    int y = (int)fv;
+
+    if (x < -1 || y < -1 || x >= s->w || y >= s->h) {
+        return 0;
+    }
+
+    float fx = u - fu;
+    float fy = v - fv;
+
+    uint32_t p00 = variant_pixel(s, x, y);
+    uint32_t p10 = variant_pixel(s, x + 1, y);
+    uint32_t p01 = variant_pixel(s, x, y + 1);
+    uint32_t p11 = variant_pixel(s, x + 1, y + 1);
+
+    uint32_t out = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        float top = (float)((p00 >> shift) & 0xFF) * (1.0f - fx) + (float)((p10 >> shift) & 0xFF) * fx;
+        float bottom = (float)((p01 >> shift) & 0xFF) * (1.0f - fx) + (float)((p11 >> shift) & 0xFF) * fx;
+
+        out |= (uint32_t)(top * (1.0f - fy) + bottom * fy + 0.5f) << shift;
+    }
+
+    return out;
+}
+
+// Resamples the job's image through the inverse of its transform. Run by
+// worker threads, so it doesn't log.
+SDL_Surface* variant_generate(const VariantJob* job) {
+    SDL_Surface* out = SDL_CreateRGBSurfaceWithFormat(0, job->w, job->h, 32, BLIT_PIXEL_FORMAT);
+
+    if (!out) {
+        return NULL;
+    }
+
+    // The transform is a rotation and a uniform scale, whose inverse is its
+    // transpose over its determinant
+    float det = job->a * job->a + job->b * job->b;
+    float ia = job->a / det;
+    float ib = job->b / det;
+
+    float w = (float)job->image->w;
+    float h = (float)job->image->h;
+
+    for (int y = 0; y < job->h; y++) {
+        uint32_t* row = (uint32_t*)((uint8_t*)out->pixels + (size_t)y * (size_t)out->pitch);
+
+        float py = (float)(job->y + y) + 0.5f;
+
+        for (int x = 0; x < job->w; x++) {
+            float px = (float)(job->x + x) + 0.5f;
+
+            float lx = ia * px + ib * py;
+            float ly = -ib * px + ia * py;
+
+            if (job->flags & VARIANT_FLIP_H) {
+                lx = w - lx;
+            }
+
+            if (job->flags & VARIANT_FLIP_V) {
+                ly = h - ly;
+            }
+
+            float u = lx - 0.5f;
+            float v = ly - 0.5f;
+
+            // Within the image, edges are clamped, so that they stay sharp.
+            // Beyond it, they fade into transparency, which smooths the edges
+            // of rotated images.
+            if (lx >= 0.0f && lx <= w && ly >= 0.0f && ly <= h) {
+                u = (u < 0.0f) ? 0.0f : (u > w - 1.0f) ? w - 1.0f : u;
+                v = (v < 0.0f) ? 0.0f : (v > h - 1.0f) ? h - 1.0f : v;
+            }
+
+            row[x] = variant_sample(job->image, u, v);
+        }
+    }
+
+    return out;
+}
+
+int variant_worker_run(void* data) {
+    (void)data;
+
+    SDL_LockMutex(variant_lock);
+
+    while (true) {
+        while (!variant_queue_head && !variant_quit) {
+            SDL_CondWait(variant_work, variant_lock);
+        }
+
+        if (variant_quit) {
+            break;
+        }
+
+        VariantJob* job = variant_queue_head;
+
+        variant_queue_head = job->next;
+
+        if (!variant_queue_head) {
+            variant_queue_tail = NULL;
+        }
+
+        SDL_UnlockMutex(variant_lock);
+
+        SDL_Surface* surface = variant_generate(job);
+
+        SDL_LockMutex(variant_lock);
+
+        job->surface = surface;
+        job->next = variant_done;
+
+        variant_done = job;
+    }
+
+    SDL_UnlockMutex(variant_lock);
+
+    return 0;
+}
+
+void variant_job_free(VariantJob* job) {
+    SDL_FreeSurface(job->image);
+    SDL_FreeSurface(job->surface);
+
+    free(job);
+}
+
+void variant_job_list_free(VariantJob* job) {
+    while (job) {
+        VariantJob* next = job->next;
+
+        variant_job_free(job);
+
+        job = next;
+    }
+}
+
+void variant_workers_stop(void) {
+    if (!variant_lock) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "variant: Stopping workers");
+
+    SDL_LockMutex(variant_lock);
+
+    variant_quit = true;
+
+    SDL_CondBroadcast(variant_work);
+    SDL_UnlockMutex(variant_lock);
+
+    for (size_t i = 0; i < variant_thread_count; i++) {
+        SDL_WaitThread(variant_threads[i], NULL);
+
+        variant_threads[i] = NULL;
+    }
+
+    // Nothing is left to take the lock, so unfinished jobs can be freed as-is
+    variant_job_list_free(variant_queue_head);
+    variant_job_list_free(variant_done);
+
+    variant_queue_head = NULL;
+    variant_queue_tail = NULL;
+    variant_done = NULL;
+
+    SDL_DestroyCond(variant_work);
+    SDL_DestroyMutex(variant_lock);
+
+    variant_lock = NULL;
+    variant_work = NULL;
+
+    variant_thread_count = 0;
+    variant_quit = false;
+}
+
+bool variant_workers_start(void) {
+    if (variant_lock) {
+        return true;
+    }
+
+    logmsg(LOG_DEBUG, "variant: Starting %d workers", VARIANT_THREADS);
+
+    variant_lock = SDL_CreateMutex();
+    variant_work = SDL_CreateCond();
+
+    if (!variant_lock || !variant_work) {
+        logmsg(LOG_WARN, "variant: Failed to start workers: %s", SDL_GetError());
+
+        SDL_DestroyCond(variant_work);
+        SDL_DestroyMutex(variant_lock);
+
+        variant_lock = NULL;
+        variant_work = NULL;
+
+        return false;
+    }
+
+    for (size_t i = 0; i < VARIANT_THREADS; i++) {
+        SDL_Thread* t = SDL_CreateThread(variant_worker_run, "variant_worker", NULL);
+
+        if (!t) {
+            logmsg(LOG_WARN, "variant: Failed to start worker thread: %s", SDL_GetError());
+
+            continue;
+        }
+
+        variant_threads[variant_thread_count++] = t;
+    }
+
+    if (variant_thread_count == 0) {
+        variant_workers_stop();
+
+        return false;
+    }
+
+    return true;
+}
+
+// Entries
+
+void variant_unlink(VariantEntry* e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        variant_head = e->next;
+    }
+
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        variant_tail = e->prev;
+    }
+
+    e->prev = NULL;
+    e->next = NULL;
+}
+
+void variant_push_front(VariantEntry* e) {
+    e->next = variant_head;
+
+    if (variant_head) {
+        variant_head->prev = e;
+    }
+    else {
+        variant_tail = e;
+    }
+
+    variant_head = e;
+}
+
+void variant_entry_free(VariantEntry* e) {
+    variant_unlink(e);
+
+    if (htable_remove(variant_table, (const uint8_t*)&e->key, sizeof(VariantKey)) != 0) {
+        logmsg(LOG_ERR, "variant: Failed to remove variant, but it was present in the variant table");
+
+        _exit(-1);
+    }
+
+    variant_stats.count--;
+    variant_stats.bytes -= e->bytes;
+
+    SDL_FreeSurface(e->variant.surface);
+
+    free(e);
+}
+
+// Evicts the least recently used variants until the given number of bytes
+// fits in the budget. Variants still being generated can't be evicted.
+bool variant_evict(size_t bytes) {
+    VariantEntry* e = variant_tail;
+
+    while (e && variant_stats.bytes + bytes > variant_stats.budget) {
+        VariantEntry* prev = e->prev;
+
+        if (!e->job) {
+            variant_entry_free(e);
+
+            variant_stats.evictions++;
+        }
+
+        e = prev;
+    }
+
+    return variant_stats.bytes + bytes <= variant_stats.budget;
+}
+
+void variant_cleanup(void) {
+    if (!variant_table) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "variant: Cleaning up variant cache");
+
+    variant_workers_stop();
+
+    while (variant_head) {
+        VariantEntry* e = variant_head;
+
+        variant_head = e->next;
+
+        SDL_FreeSurface(e->variant.surface);
+
+        free(e);
+    }
+
+    htable_destroy(variant_table);
+
+    variant_table = NULL;
+    variant_head = NULL;
+    variant_tail = NULL;
+}
+
+// Copies the part of the source a variant is made from
+SDL_Surface* variant_copy(SDL_Surface* source, SDL_Rect clip) {
+    SDL_Surface* copy = SDL_CreateRGBSurfaceWithFormat(0, clip.w, clip.h, 32, BLIT_PIXEL_FORMAT);
+
+    if (!copy) {
+        return NULL;
+    }
+
+    // Copy the pixels as-is, rather than blending them over the empty copy
+    SDL_BlendMode mode;
+
+    SDL_GetSurfaceBlendMode(source, &mode);
+    SDL_SetSurfaceBlendMode(source, SDL_BLENDMODE_NONE);
+
+    int blit = SDL_BlitSurface(source, &clip, copy, NULL);
+
+    SDL_SetSurfaceBlendMode(source, mode);
+
+    if (blit != 0) {
+        SDL_FreeSurface(copy);
+
+        return NULL;
+    }
+
+    return copy;
+}
+
+// Queues the generation of a new entry's variant
+bool variant_queue(VariantEntry* e, float a, float b, int w, int h) {
+    if (!variant_workers_start()) {
+        return false;
+    }
+
+    VariantJob* job = calloc(1, sizeof(VariantJob));
+
+    if (!job) {
+        logmsg(LOG_WARN, "variant: Failed to queue variant, the system is out of memory");
+
+        return false;
+    }
+
+    job->image = variant_copy(e->key.source, e->key.clip);
+
+    if (!job->image) {
+        logmsg(LOG_WARN, "variant: Failed to queue variant, unable to copy source: %s", SDL_GetError());
+
+        free(job);
+
+        return false;
+    }
+
+    job->entry = e;
+    job->a = a;
+    job->b = b;
+    job->x = e->variant.x;
+    job->y = e->variant.y;
+    job->w = w;
+    job->h = h;
+    job->flags = e->key.flags;
+
+    e->job = job;
+
+    SDL_LockMutex(variant_lock);
+
+    if (variant_queue_tail) {
+        variant_queue_tail->next = job;
+    }
+    else {
+        variant_queue_head = job;
+    }
+
+    variant_queue_tail = job;
+
+    SDL_CondSignal(variant_work);
+    SDL_UnlockMutex(variant_lock);
+
+    return true;
+}
+
+bool variant_get(SDL_Surface* source, SDL_Rect clip, double rotation, double scale, uint32_t flags, Variant* v) {
+    if (!variant_table || !source || clip.w <= 0 || clip.h <= 0) {
+        return false;
+    }
+
+    double turn = fmod(rotation, 360.0);
+
+    turn = (turn < 0.0) ? turn + 360.0 : turn;
+
+    long scale_step = lround(scale * VARIANT_SCALE_STEPS);
+
+    if (scale_step <= 0 || scale_step > UINT16_MAX) {
+        return false;
+    }
+
+    VariantKey key;
+
+    memset(&key, 0, sizeof(VariantKey));
+
+    key.source = source;
+    key.clip = clip;
+    key.angle = (uint16_t)(lround(turn * VARIANT_ANGLE_STEPS / 360.0) % VARIANT_ANGLE_STEPS);
+    key.scale = (uint16_t)scale_step;
+    key.flags = flags & (VARIANT_FLIP_H | VARIANT_FLIP_V);
+
+    VariantEntry* e = htable_lookup(variant_table, (const uint8_t*)&key, sizeof(VariantKey), NULL);
+
+    if (e) {
+        if (e->job) {
+            variant_stats.misses++;
+
+            return false;
+        }
+
+        variant_stats.hits++;
+
+        // Keep it from eviction the longest
+        if (e != variant_head) {
+            variant_unlink(e);
+            variant_push_front(e);
+        }
+
+        *v = e->variant;
+
+        return true;
+    }
+
+    variant_stats.misses++;
+
+    // The transform of the rounded rotation and scale, and the bounds of the
+    // image under it
+    double r = (double)key.angle * 2.0 * M_PI / VARIANT_ANGLE_STEPS;
+    double s = (double)key.scale / VARIANT_SCALE_STEPS;
+
+    float a = (float)(cos(r) * s);
+    float b = (float)(sin(r) * s);
+
+    float min_x = 0.0f;
+    float max_x = 0.0f;
+    float min_y = 0.0f;
+    float max_y = 0.0f;
+
+    for (int i = 1; i < 4; i++) {
+        float lx = (i & 1) ? (float)clip.w : 0.0f;
+        float ly = (i & 2) ? (float)clip.h : 0.0f;
+
+        float px = a * lx - b * ly;
+        float py = b * lx + a * ly;
+
+        min_x = (px < min_x) ? px : min_x;
+        max_x = (px > max_x) ? px : max_x;
+        min_y = (py < min_y) ? py : min_y;
+        max_y = (py > max_y) ? py : max_y;
+    }
+
+    // Corners within rounding error of a pixel edge don't reach past it
+    int x = (int)floorf(min_x + VARIANT_EDGE_EPSILON);
+    int y = (int)floorf(min_y + VARIANT_EDGE_EPSILON);
+    int w = (int)ceilf(max_x - VARIANT_EDGE_EPSILON) - x;
+    int h = (int)ceilf(max_y - VARIANT_EDGE_EPSILON) - y;
+
+    if (w <= 0 || h <= 0 || w > VARIANT_SIZE_MAX || h > VARIANT_SIZE_MAX) {
+        return false;
+    }
+
+    size_t bytes = (size_t)w * (size_t)h * 4;
+
+    if (bytes > variant_stats.budget / VARIANT_BUDGET_SHARE || !variant_evict(bytes)) {
+        return false;
+    }
+
+    e = calloc(1, sizeof(VariantEntry));
+
+    if (!e) {
+        logmsg(LOG_WARN, "variant: Failed to cache variant, the system is out of memory");
+
+        return false;
+    }
+
+    e->key = key;
+    e->variant = (Variant){.surface = NULL, .x = x, .y = y};
+    e->bytes = bytes;
+
+    if (htable_add(variant_table, (const uint8_t*)&e->key, sizeof(VariantKey), KV_VOIDPTR, e) != 0) {
+        logmsg(LOG_WARN, "variant: Failed to map variant in variant table");
+
+        free(e);
+
+        return false;
+    }
+
+    variant_push_front(e);
+
+    variant_stats.count++;
+    variant_stats.bytes += bytes;
+
+    if (!variant_queue(e, a, b, w, h)) {
+        variant_entry_free(e);
+
+        return false;
+    }
+
+    variant_stats.pending++;
+
+    return false;
+}
+
+void variant_sync(void) {
+    if (!variant_lock) {
+        return;
+    }
+
+    SDL_LockMutex(variant_lock);
+
+    VariantJob* done = variant_done;
+
+    variant_done = NULL;
+
+    SDL_UnlockMutex(variant_lock);
+
+    while (done) {
+        VariantJob* next = done->next;
+        VariantEntry* e = done->entry;
+
+        e->job = NULL;
+
+        variant_stats.pending--;
+
+        if (done->surface && !e->orphaned) {
+            e->variant.surface = done->surface;
+
+            done->surface = NULL;
+
+            variant_stats.generated++;
+        }
+        else {
+            if (!done->surface) {
+                logmsg(LOG_WARN, "variant: Failed to generate variant, the system is out of memory");
+            }
+
+            variant_entry_free(e);
+        }
+
+        variant_job_free(done);
+
+        done = next;
+    }
+
+    // Variants generated while over the budget
+    variant_evict(0);
+}
+
+void variant_forget(SDL_Surface* source) {
+    if (!variant_table) {
+        return;
+    }
+
+    for (VariantEntry* e = variant_head; e;) {
+        VariantEntry* next = e->next;
+
+        if (e->key.source == source) {
+            if (e->job) {
+                e->orphaned = true;
+            }
+            else {
+                variant_entry_free(e);
+            }
+        }
+
+        e = next;
+    }
+}
+
+const VariantStats* variant_get_stats(void) {
+    return &variant_stats;
+}
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_VARIANT
+#define RPGNG_VARIANT
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// Memory the cache may hold in transformed images, in bytes
+#define VARIANT_BUDGET_DEFAULT (16 * 1024 * 1024)
+
+// Rotations are rounded to one of this many steps around the circle
+#define VARIANT_ANGLE_STEPS 256
+
+// Scales are rounded to a multiple of one over this
+#define VARIANT_SCALE_STEPS 64
+
+// The number of background threads which generate variants
+#define VARIANT_THREADS 2
+
+typedef enum VariantFlags {
+    VARIANT_FLIP_H = 1 << 0,
+    VARIANT_FLIP_V = 1 << 1,
+} VariantFlags;
+
+/*
+ * Drawing a rotated or scaled sprite on a software renderer resamples every
+ * pixel of it, every frame. The variant cache keeps images already rotated,
+ * scaled and mirrored, so that they can be drawn with a plain copy instead.
+ *
+ * Variants are keyed by the part of the source surface they're made from,
+ * along with their rotation, scale and flips, rounded so that nearly equal
+ * transforms share a variant. A missing variant is generated in the
+ * background, and the least recently used ones are evicted to keep the cache
+ * within its memory budget.
+ */
+
+typedef struct Variant {
+    // The transformed image, in BLIT_PIXEL_FORMAT with premultiplied alpha.
+    // This belongs to the cache, and must not be freed or modified.
+    SDL_Surface* surface;
+
+    // Where the top left corner of the surface goes, relative to the point the
+    // source image was rotated and scaled about
+    int x;
+    int y;
+} Variant;
+
+typedef struct VariantStats {
+    // Lookups which found a finished variant, and lookups which didn't
+    uint64_t hits;
+    uint64_t misses;
+
+    // Variants generated, and variants evicted to stay within the budget
+    uint64_t generated;
+    uint64_t evictions;
+
+    // Variants cached, and how many of those are still being generated
+    size_t count;
+    size_t pending;
+
+    // Memory held by cached variants, including those still being generated,
+    // and the most it may hold, in bytes
+    size_t bytes;
+    size_t budget;
+} VariantStats;
+
+/**
+ * Initializes the variant cache.
+ *
+ * @param budget The most memory the cache may hold in transformed images, in
+ * bytes.
+ */
+bool variant_init(size_t budget);
+
+/**
+ * Waits for variants being generated, then frees every cached variant.
+ */
+void variant_cleanup(void);
+
+/**
+ * Looks up the given part of a surface, rotated about its top left corner,
+ * scaled, and mirrored within its own bounds before either. If the variant
+ * isn't cached, it's queued for generation, and this returns false until a
+ * later variant_sync() publishes it.
+ *
+ * The cache doesn't hold a reference to the source surface, so whatever frees
+ * it must call variant_forget() first.
+ *
+ * @param rotation In degrees, clockwise.
+ * @param flags Any of the VariantFlags, or 0.
+ * @param[out] v Receives the variant, if it's ready.
+ *
+ * @return Returns true if the variant is ready. Returns false if it's being
+ * generated, or couldn't be, or if the cache is not initialized.
+ */
+bool variant_get(SDL_Surface* source, SDL_Rect clip, double rotation, double scale, uint32_t flags, Variant* v);
+
+/**
+ * Publishes variants generated since the last call, then evicts variants over
+ * the budget. This should be called once per frame, from the main thread.
+ */
+void variant_sync(void);
+
+/**
+ * Drops every variant made from the given surface, which is about to be
+ * freed. Variants still being generated are dropped once they're done.
+ */
+void variant_forget(SDL_Surface* source);
+
+/**
+ * Gets the variant cache statistics.
+ */
+const VariantStats* variant_get_stats(void);
+
+#endif
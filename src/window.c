@@ -6,8 +6,54 @@
 
 #include <SDL2/SDL.h>
 
-SDL_Surface* main_window = NULL;
+#include "log.h"
+#include "window.h"
+
+SDL_Window* main_window = NULL;
+SDL_Renderer* main_renderer = NULL;
 
 bool window_init(const char* title, int x, int y, int w, int h, uint32_t flags) {
+    if (main_window) {
+        logmsg(LOG_WARN, "window: Failed to open window, already open");
+
+        return false;
+    }
+
+    x = (x < 0) ? (int)SDL_WINDOWPOS_CENTERED : x;
+    y = (y < 0) ? (int)SDL_WINDOWPOS_CENTERED : y;
+
+    main_window = SDL_CreateWindow(title, x, y, w, h, flags);
+
+    if (!main_window) {
+        logmsg(LOG_WARN, "window: Failed to open window: %s", SDL_GetError());
+
+        return false;
+    }
+
+    main_renderer = SDL_CreateRenderer(main_window, -1, SDL_RENDERER_PRESENTVSYNC);
+
+    if (!main_renderer) {
+        logmsg(LOG_WARN, "window: Failed to create renderer: %s", SDL_GetError());
+
+        SDL_DestroyWindow(main_window);
+
+        main_window = NULL;
+
+        return false;
+    }
+
     return true;
 }
+
+void window_cleanup(void) {
+    if (main_renderer) {
+        SDL_DestroyRenderer(main_renderer);
+    }
+
+    if (main_window) {
+        SDL_DestroyWindow(main_window);
+    }
+
+    main_renderer = NULL;
+    main_window = NULL;
+}
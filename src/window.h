@@ -9,8 +9,22 @@
 
 #include <SDL2/SDL.h>
 
-extern SDL_Surface* main_window;
+extern SDL_Window* main_window;
+extern SDL_Renderer* main_renderer;
 
+/**
+ * Opens the main window, along with a renderer which presents in step with
+ * the display's refresh rate.
+ *
+ * @param x The x position of the window, or -1 to center it.
+ * @param y The y position of the window, or -1 to center it.
+ * @param flags SDL window flags.
+ */
 bool window_init(const char* title, int x, int y, int w, int h, uint32_t flags);
 
+/**
+ * Closes the main window, and destroys its renderer.
+ */
+void window_cleanup(void);
+
 #endif
@@ -0,0 +1,1180 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+#include <SDL2/SDL.h>
+#include <jansson.h>
+
+#include "asset.h"
+#include "collision.h"
+#include "entity.h"
+#include "htable.h"
+#include "log.h"
+#include "spatial.h"
+#include "world.h"
+
+#include "component/animation.h"
+#include "component/camera.h"
+#include "component/component.h"
+#include "component/dialogue.h"
+#include "component/inventory.h"
+#include "component/sprite.h"
+#include "component/tilemap.h"
+#include "component/transform.h"
+#include "component/trigger.h"
+
+// The memory each entity is estimated to take, for the memory cap. Images are
+// counted by the asset budget instead.
+#define WORLD_ENTITY_BYTES 256
+
+typedef enum WorldCellState {
+    // Waiting for, or being parsed by, the loader
+    WORLD_CELL_QUEUED,
+
+    // Parsed, and waiting for its tileset to load
+    WORLD_CELL_PARSED,
+
+    // Its contents are in the world
+    WORLD_CELL_RESIDENT
+} WorldCellState;
+
+typedef struct WorldEntityDef {
+    // Relative to the cell
+    float x;
+    float y;
+
+    // NULL for entities without a sprite
+    char* sprite;
+    uint8_t z;
+} WorldEntityDef;
+
+typedef struct WorldLayerDef {
+    uint8_t z;
+    bool dynamic;
+
+    uint16_t* tiles;
+} WorldLayerDef;
+
+// The contents of a cell file, as parsed by the loader
+typedef struct WorldCellData {
+    // NULL for cells without a tilemap
+    char* tileset;
+
+    int tile_w;
+    int tile_h;
+    uint32_t width;
+    uint32_t height;
+
+    size_t layer_count;
+    WorldLayerDef layers[TILEMAP_LAYER_MAX];
+
+    size_t entity_count;
+    WorldEntityDef* entities;
+
+    size_t bytes;
+} WorldCellData;
+
+typedef struct WorldLoadJob WorldLoadJob;
+
+typedef struct WorldCell {
+    int32_t cx;
+    int32_t cy;
+
+    WorldCellState state;
+
+    // While queued, the job loading the cell, and once parsed, its contents,
+    // and a reference to its tileset while it loads
+    WorldLoadJob* job;
+    WorldCellData* data;
+    Asset* tileset;
+
+    // Once resident, the entities created for the cell, and the memory they
+    // take
+    size_t entities_size;
+    size_t entities_count;
+    uint16_t* entities;
+
+    size_t bytes;
+} WorldCell;
+
+struct WorldLoadJob {
+    char* path;
+
+    // NULL once the cell is dropped, in which case the job is skipped, or its
+    // result thrown away
+    WorldCell* cell;
+
+    WorldCellData* data;
+
+    WorldLoadJob* next;
+};
+
+char* world_path = NULL;
+
+int world_cell_size = WORLD_CELL_SIZE_DEFAULT;
+int world_radius = WORLD_RADIUS_DEFAULT;
+size_t world_memory_cap = 0;
+
+uint16_t world_focus = 0;
+
+// Maps cells by their coordinates, for every cell which is queued, parsed, or
+// resident
+HashTable* world_cell_table = NULL;
+
+size_t world_cells_size = 0;
+size_t world_cells_count = 0;
+WorldCell** world_cells = NULL;
+
+// Entities of unloaded cells, parked with their transforms until they're
+// reused
+size_t world_pool_size = 0;
+size_t world_pool_count = 0;
+uint16_t* world_pool = NULL;
+
+// Numbers the names of the entities the world creates
+size_t world_entity_serial = 0;
+
+WorldStats world_stats;
+
+// Background loader, started by world_init()
+SDL_mutex* world_loader_lock = NULL;
+SDL_cond* world_loader_work = NULL;
+SDL_cond* world_loader_done = NULL;
+
+SDL_Thread* world_loader_thread = NULL;
+
+bool world_loader_quit = false;
+
+// Guarded by world_loader_lock. Queued jobs are taken in order, and done jobs
+// are pushed and published newest first. Pending jobs are those queued or being
+// parsed.
+WorldLoadJob* world_queue_head = NULL;
+WorldLoadJob* world_queue_tail = NULL;
+WorldLoadJob* world_done = NULL;
+
+size_t world_pending = 0;
+
+// Loading
+
+void world_cell_data_free(WorldCellData* data) {
+    if (!data) {
+        return;
+    }
+
+    for (size_t i = 0; i < data->layer_count; i++) {
+        free(data->layers[i].tiles);
+    }
+
+    for (size_t i = 0; i < data->entity_count; i++) {
+        free(data->entities[i].sprite);
+    }
+
+    free(data->entities);
+    free(data->tileset);
+    free(data);
+}
+
+bool world_parse_tilemap(const char* path, json_t* tilemap, WorldCellData* data) {
+    json_error_t err;
+
+    const char* tileset = NULL;
+    int tile_w = 0;
+    int tile_h = 0;
+    int width = 0;
+    int height = 0;
+    json_t* layers = NULL;
+
+    int unpk = json_unpack_ex(tilemap,
+        &err,
+        JSON_STRICT,
+        "{s:s, s:i, s:i, s:i, s:i, s:o}",
+        "tileset",
+        &tileset,
+        "tile_w",
+        &tile_w,
+        "tile_h",
+        &tile_h,
+        "width",
+        &width,
+        "height",
+        &height,
+        "layers",
+        &layers);
+
+    if (unpk == -1) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell tilemap, parsing error", path);
+        logmsg(LOG_WARN, "world(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+        return false;
+    }
+
+    if (tile_w <= 0 || tile_h <= 0 || width <= 0 || height <= 0) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell tilemap, %dx%d tiles of %dx%d pixels is empty", path, width, height, tile_w, tile_h);
+
+        return false;
+    }
+
+    if (!json_is_array(layers) || json_array_size(layers) > TILEMAP_LAYER_MAX) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell tilemap, layers must be an array of at most %d layers", path, TILEMAP_LAYER_MAX);
+
+        return false;
+    }
+
+    data->tileset = strdup(tileset);
+
+    if (!data->tileset) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell tilemap, the system is out of memory", path);
+
+        return false;
+    }
+
+    data->tile_w = tile_w;
+    data->tile_h = tile_h;
+    data->width = (uint32_t)width;
+    data->height = (uint32_t)height;
+
+    size_t tile_count = (size_t)width * (size_t)height;
+
+    for (size_t i = 0; i < json_array_size(layers); i++) {
+        int z = 0;
+        int dynamic = 0;
+        json_t* tiles = NULL;
+
+        unpk = json_unpack_ex(json_array_get(layers, i), &err, JSON_STRICT, "{s?i, s?b, s:o}", "z", &z, "dynamic", &dynamic, "tiles", &tiles);
+
+        if (unpk == -1) {
+            logmsg(LOG_WARN, "world(%s): Failed to load layer %zu of cell tilemap, parsing error", path, i);
+            logmsg(LOG_WARN, "world(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+            return false;
+        }
+
+        if (z < 0 || z > UINT8_MAX || !json_is_array(tiles) || json_array_size(tiles) != tile_count) {
+            logmsg(LOG_WARN, "world(%s): Failed to load layer %zu of cell tilemap, it needs a z-order from 0 to 255, and %zu tiles", path, i, tile_count);
+
+            return false;
+        }
+
+        WorldLayerDef* layer = &data->layers[data->layer_count];
+
+        layer->tiles = malloc(tile_count * sizeof(uint16_t));
+
+        if (!layer->tiles) {
+            logmsg(LOG_WARN, "world(%s): Failed to load layer %zu of cell tilemap, the system is out of memory", path, i);
+
+            return false;
+        }
+
+        layer->z = (uint8_t)z;
+        layer->dynamic = dynamic;
+
+        data->layer_count++;
+
+        for (size_t j = 0; j < tile_count; j++) {
+            json_t* tile = json_array_get(tiles, j);
+
+            if (!json_is_integer(tile) || json_integer_value(tile) < 0 || json_integer_value(tile) > UINT16_MAX) {
+                logmsg(LOG_WARN, "world(%s): Failed to load layer %zu of cell tilemap, tile %zu isn't a tile ID", path, i, j);
+
+                return false;
+            }
+
+            layer->tiles[j] = (uint16_t)json_integer_value(tile);
+        }
+
+        data->bytes += tile_count * sizeof(uint16_t);
+    }
+
+    return true;
+}
+
+bool world_parse_entities(const char* path, json_t* entities, WorldCellData* data) {
+    json_error_t err;
+
+    if (!json_is_array(entities)) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell entities, entities must be an array", path);
+
+        return false;
+    }
+
+    if (json_array_size(entities) == 0) {
+        return true;
+    }
+
+    data->entities = calloc(json_array_size(entities), sizeof(WorldEntityDef));
+
+    if (!data->entities) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell entities, the system is out of memory", path);
+
+        return false;
+    }
+
+    for (size_t i = 0; i < json_array_size(entities); i++) {
+        double x = 0.0;
+        double y = 0.0;
+        const char* sprite = NULL;
+        int z = 0;
+
+        int unpk = json_unpack_ex(json_array_get(entities, i), &err, JSON_STRICT, "{s:F, s:F, s?s, s?i}", "x", &x, "y", &y, "sprite", &sprite, "z", &z);
+
+        if (unpk == -1) {
+            logmsg(LOG_WARN, "world(%s): Failed to load entity %zu of cell, parsing error", path, i);
+            logmsg(LOG_WARN, "world(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+            return false;
+        }
+
+        if (z < 0 || z > UINT8_MAX) {
+            logmsg(LOG_WARN, "world(%s): Failed to load entity %zu of cell, z-order %d is out of range", path, i, z);
+
+            return false;
+        }
+
+        WorldEntityDef* e = &data->entities[data->entity_count++];
+
+        e->x = (float)x;
+        e->y = (float)y;
+        e->z = (uint8_t)z;
+
+        if (sprite) {
+            e->sprite = strdup(sprite);
+
+            if (!e->sprite) {
+                logmsg(LOG_WARN, "world(%s): Failed to load entity %zu of cell, the system is out of memory", path, i);
+
+                return false;
+            }
+        }
+
+        data->bytes += WORLD_ENTITY_BYTES;
+    }
+
+    return true;
+}
+
+// Reads and parses a cell file. A missing file is an empty cell. Returns NULL
+// if the file can't be parsed.
+WorldCellData* world_cell_parse(const char* path) {
+    WorldCellData* data = calloc(1, sizeof(WorldCellData));
+
+    if (!data) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell, the system is out of memory", path);
+
+        return NULL;
+    }
+
+    FILE* f = fopen(path, "rb");
+
+    if (!f) {
+        return data;
+    }
+
+    fclose(f);
+
+    json_error_t err;
+
+    json_t* root = json_load_file(path, JSON_REJECT_DUPLICATES, &err);
+
+    if (!root) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell, parsing error", path);
+        logmsg(LOG_WARN, "world(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+        free(data);
+
+        return NULL;
+    }
+
+    json_t* tilemap = NULL;
+    json_t* entities = NULL;
+
+    int unpk = json_unpack_ex(root, &err, JSON_STRICT, "{s?o, s?o}", "tilemap", &tilemap, "entities", &entities);
+
+    if (unpk == -1) {
+        logmsg(LOG_WARN, "world(%s): Failed to load cell, parsing error", path);
+        logmsg(LOG_WARN, "world(%s): %s at line %d, column %d", path, err.text, err.line, err.column);
+
+        goto fail;
+    }
+
+    if (tilemap && !world_parse_tilemap(path, tilemap, data)) {
+        goto fail;
+    }
+
+    if (entities && !world_parse_entities(path, entities, data)) {
+        goto fail;
+    }
+
+    json_decref(root);
+
+    return data;
+
+fail:
+    json_decref(root);
+
+    world_cell_data_free(data);
+
+    return NULL;
+}
+
+int world_loader_run(void* userdata) {
+    (void)userdata;
+
+    SDL_LockMutex(world_loader_lock);
+
+    while (true) {
+        while (!world_queue_head && !world_loader_quit) {
+            SDL_CondWait(world_loader_work, world_loader_lock);
+        }
+
+        if (world_loader_quit) {
+            break;
+        }
+
+        WorldLoadJob* job = world_queue_head;
+
+        world_queue_head = job->next;
+
+        if (!world_queue_head) {
+            world_queue_tail = NULL;
+        }
+
+        // Cells dropped while they were queued aren't worth parsing
+        if (job->cell) {
+            SDL_UnlockMutex(world_loader_lock);
+
+            WorldCellData* data = world_cell_parse(job->path);
+
+            SDL_LockMutex(world_loader_lock);
+
+            job->data = data;
+        }
+
+        job->next = world_done;
+
+        world_done = job;
+        world_pending--;
+
+        SDL_CondBroadcast(world_loader_done);
+    }
+
+    SDL_UnlockMutex(world_loader_lock);
+
+    return 0;
+}
+
+void world_job_list_free(WorldLoadJob* job) {
+    while (job) {
+        WorldLoadJob* next = job->next;
+
+        world_cell_data_free(job->data);
+
+        free(job->path);
+        free(job);
+
+        job = next;
+    }
+}
+
+void world_loader_stop(void) {
+    if (!world_loader_lock) {
+        return;
+    }
+
+    SDL_LockMutex(world_loader_lock);
+
+    world_loader_quit = true;
+
+    SDL_CondBroadcast(world_loader_work);
+    SDL_UnlockMutex(world_loader_lock);
+
+    SDL_WaitThread(world_loader_thread, NULL);
+
+    // Nothing is left to take the lock, so unfinished jobs can be freed as-is
+    world_job_list_free(world_queue_head);
+    world_job_list_free(world_done);
+
+    world_queue_head = NULL;
+    world_queue_tail = NULL;
+    world_done = NULL;
+    world_pending = 0;
+
+    SDL_DestroyCond(world_loader_work);
+    SDL_DestroyCond(world_loader_done);
+    SDL_DestroyMutex(world_loader_lock);
+
+    world_loader_lock = NULL;
+    world_loader_work = NULL;
+    world_loader_done = NULL;
+    world_loader_thread = NULL;
+    world_loader_quit = false;
+}
+
+bool world_loader_start(void) {
+    logmsg(LOG_DEBUG, "world: Starting background cell loader");
+
+    world_loader_lock = SDL_CreateMutex();
+    world_loader_work = SDL_CreateCond();
+    world_loader_done = SDL_CreateCond();
+
+    if (world_loader_lock && world_loader_work && world_loader_done) {
+        world_loader_thread = SDL_CreateThread(world_loader_run, "world_loader", NULL);
+    }
+
+    if (!world_loader_thread) {
+        logmsg(LOG_WARN, "world: Failed to start background cell loader: %s", SDL_GetError());
+
+        SDL_DestroyCond(world_loader_work);
+        SDL_DestroyCond(world_loader_done);
+        SDL_DestroyMutex(world_loader_lock);
+
+        world_loader_lock = NULL;
+        world_loader_work = NULL;
+        world_loader_done = NULL;
+
+        return false;
+    }
+
+    return true;
+}
+
+// Entities
+
+// Gets an entity at the given position, reusing a parked one if there is one
+uint16_t world_entity_take(WorldCell* cell, float x, float y) {
+    if (cell->entities_count == cell->entities_size) {
+        size_t new_size = cell->entities_size ? cell->entities_size * 2 : SLOT_DEFAULT_SIZE;
+
+        uint16_t* tmp = realloc(cell->entities, new_size * sizeof(uint16_t));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "world: Failed to create entity for cell (%" PRId32 ", %" PRId32 "), the system is out of memory", cell->cx, cell->cy);
+
+            return 0;
+        }
+
+        cell->entities = tmp;
+        cell->entities_size = new_size;
+    }
+
+    uint16_t id = 0;
+    Transform* t = NULL;
+
+    if (world_pool_count > 0) {
+        id = world_pool[--world_pool_count];
+        t = entity_get_component(id, TRANSFORM);
+
+        // Undo whatever was done to it while it was last in use
+        transform_rotate_reset(t);
+        transform_scale_reset(t);
+
+        // The index logs its own failures, as for a new transform
+        spatial_insert(id, x, y);
+
+        world_stats.reused++;
+    }
+    else {
+        char name[ENTITY_NAME_LEN_MAX];
+
+        snprintf(name, sizeof(name), "world:%zu", world_entity_serial++);
+
+        id = entity_create(name);
+
+        if (id == (uint16_t)-1) {
+            logmsg(LOG_WARN, "world: Failed to create entity for cell (%" PRId32 ", %" PRId32 ")", cell->cx, cell->cy);
+
+            return 0;
+        }
+
+        if (!transform_create(id)) {
+            logmsg(LOG_WARN, "world: Failed to create transform for cell (%" PRId32 ", %" PRId32 ")", cell->cx, cell->cy);
+
+            entity_destroy(id);
+
+            return 0;
+        }
+
+        t = entity_get_component(id, TRANSFORM);
+    }
+
+    // Setting the position outright also snaps the render position, so that a
+    // reused entity isn't drawn sliding over from where it was parked
+    transform_translate_set(t, x, y);
+
+    cell->entities[cell->entities_count++] = id;
+
+    return id;
+}
+
+// Strips an entity of every component but its transform, whether its cell
+// gave them or a script added them since
+void world_entity_strip(uint16_t id) {
+    if (entity_has_component(id, ANIMATION)) {
+        animation_destroy(id);
+    }
+
+    if (entity_has_component(id, CAMERA)) {
+        camera_destroy(id);
+    }
+
+    if (entity_has_component(id, DIALOGUE)) {
+        dialogue_destroy(id);
+    }
+
+    if (entity_has_component(id, INVENTORY)) {
+        inventory_destroy(id);
+    }
+
+    if (entity_has_component(id, SPRITE)) {
+        sprite_destroy(id);
+    }
+
+    if (entity_has_component(id, TILEMAP)) {
+        tilemap_destroy(id);
+    }
+
+    if (entity_has_component(id, TRIGGER)) {
+        trigger_destroy(id);
+    }
+}
+
+void world_entity_destroy(uint16_t id) {
+    world_entity_strip(id);
+
+    transform_destroy(id);
+    entity_destroy(id);
+}
+
+// Parks an entity for reuse, or destroys it if it can't be parked. A parked
+// entity is taken out of the spatial index and the collision world, and leaves
+// any trigger it was inside, so that nothing finds it until it's reused.
+void world_entity_park(uint16_t id) {
+    world_entity_strip(id);
+
+    transform_velocity_set(entity_get_component(id, TRANSFORM), 0.0f, 0.0f);
+
+    spatial_remove(id);
+    collision_remove(id);
+    trigger_forget(id);
+
+    if (world_pool_count == world_pool_size) {
+        size_t new_size = world_pool_size ? world_pool_size * 2 : SLOT_DEFAULT_SIZE;
+
+        uint16_t* tmp = realloc(world_pool, new_size * sizeof(uint16_t));
+
+        if (!tmp) {
+            world_entity_destroy(id);
+
+            return;
+        }
+
+        world_pool = tmp;
+        world_pool_size = new_size;
+    }
+
+    world_pool[world_pool_count++] = id;
+}
+
+// Cells
+
+float world_cell_origin(int32_t c) {
+    return (float)((double)c * (double)world_cell_size);
+}
+
+WorldCell* world_cell_get(int32_t cx, int32_t cy) {
+    int32_t key[2] = {cx, cy};
+
+    return htable_lookup(world_cell_table, (uint8_t*)key, sizeof(key), NULL);
+}
+
+// Adds a cell, and queues it to be loaded
+bool world_cell_queue(int32_t cx, int32_t cy) {
+    if (world_cells_count == world_cells_size) {
+        size_t new_size = world_cells_size ? world_cells_size * 2 : SLOT_DEFAULT_SIZE;
+
+        WorldCell** tmp = realloc(world_cells, new_size * sizeof(WorldCell*));
+
+        if (!tmp) {
+            logmsg(LOG_WARN, "world: Failed to queue cell (%" PRId32 ", %" PRId32 "), the system is out of memory", cx, cy);
+
+            return false;
+        }
+
+        world_cells = tmp;
+        world_cells_size = new_size;
+    }
+
+    WorldCell* cell = calloc(1, sizeof(WorldCell));
+    WorldLoadJob* job = calloc(1, sizeof(WorldLoadJob));
+
+    int len = snprintf(NULL, 0, "%s/%" PRId32 "_%" PRId32 ".json", world_path, cx, cy);
+
+    char* path = malloc((size_t)len + 1);
+
+    if (!cell || !job || !path) {
+        logmsg(LOG_WARN, "world: Failed to queue cell (%" PRId32 ", %" PRId32 "), the system is out of memory", cx, cy);
+
+        free(cell);
+        free(job);
+        free(path);
+
+        return false;
+    }
+
+    snprintf(path, (size_t)len + 1, "%s/%" PRId32 "_%" PRId32 ".json", world_path, cx, cy);
+
+    int32_t key[2] = {cx, cy};
+
+    if (htable_add(world_cell_table, (uint8_t*)key, sizeof(key), KV_VOIDPTR, cell) != 0) {
+        logmsg(LOG_WARN, "world: Failed to map cell (%" PRId32 ", %" PRId32 ") in cell table", cx, cy);
+
+        free(cell);
+        free(job);
+        free(path);
+
+        return false;
+    }
+
+    cell->cx = cx;
+    cell->cy = cy;
+    cell->state = WORLD_CELL_QUEUED;
+    cell->job = job;
+
+    job->path = path;
+    job->cell = cell;
+
+    world_cells[world_cells_count++] = cell;
+
+    SDL_LockMutex(world_loader_lock);
+
+    if (world_queue_tail) {
+        world_queue_tail->next = job;
+    }
+    else {
+        world_queue_head = job;
+    }
+
+    world_queue_tail = job;
+    world_pending++;
+
+    SDL_CondSignal(world_loader_work);
+    SDL_UnlockMutex(world_loader_lock);
+
+    world_stats.loading++;
+
+    return true;
+}
+
+// Creates everything in a parsed cell
+void world_cell_instantiate(WorldCell* cell) {
+    WorldCellData* data = cell->data;
+
+    float x = world_cell_origin(cell->cx);
+    float y = world_cell_origin(cell->cy);
+
+    // A tileset which couldn't be acquired, or which failed to load, has
+    // already been complained about, and leaves the cell without a tilemap
+    if (data->tileset && cell->tileset && asset_get_state(cell->tileset) != ASSET_FAILED) {
+        uint16_t id = world_entity_take(cell, x, y);
+
+        if (id && tilemap_create(id, data->tileset, data->tile_w, data->tile_h, data->width, data->height)) {
+            Tilemap* m = entity_get_component(id, TILEMAP);
+
+            for (size_t i = 0; i < data->layer_count; i++) {
+                int layer = tilemap_layer_add(m, data->layers[i].z, data->layers[i].dynamic);
+
+                if (layer < 0 || !tilemap_set_tiles(m, (size_t)layer, 0, 0, data->width, data->height, data->layers[i].tiles)) {
+                    logmsg(LOG_WARN, "world: Failed to load layer %zu of cell (%" PRId32 ", %" PRId32 ")", i, cell->cx, cell->cy);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < data->entity_count; i++) {
+        WorldEntityDef* def = &data->entities[i];
+
+        uint16_t id = world_entity_take(cell, x + def->x, y + def->y);
+
+        if (!id || !def->sprite) {
+            continue;
+        }
+
+        if (sprite_create_async(id, def->sprite, NULL, NULL)) {
+            sprite_z_set(entity_get_component(id, SPRITE), def->z);
+        }
+    }
+
+    if (cell->tileset) {
+        asset_release(cell->tileset);
+    }
+
+    cell->bytes = data->bytes;
+    cell->state = WORLD_CELL_RESIDENT;
+    cell->data = NULL;
+    cell->tileset = NULL;
+
+    world_cell_data_free(data);
+
+    world_stats.loading--;
+    world_stats.resident++;
+    world_stats.loads++;
+    world_stats.bytes += cell->bytes;
+    world_stats.entities += cell->entities_count;
+}
+
+// Unloads a cell, or drops it if it's still loading, and forgets it
+void world_cell_remove(size_t index, bool destroy) {
+    WorldCell* cell = world_cells[index];
+
+    if (cell->state == WORLD_CELL_RESIDENT) {
+        for (size_t i = 0; i < cell->entities_count; i++) {
+            if (destroy) {
+                world_entity_destroy(cell->entities[i]);
+            }
+            else {
+                world_entity_park(cell->entities[i]);
+            }
+        }
+
+        world_stats.resident--;
+        world_stats.unloads++;
+        world_stats.bytes -= cell->bytes;
+        world_stats.entities -= cell->entities_count;
+    }
+    else {
+        world_stats.loading--;
+    }
+
+    // The loader skips, or throws away, the jobs of dropped cells
+    if (cell->job) {
+        SDL_LockMutex(world_loader_lock);
+
+        cell->job->cell = NULL;
+
+        SDL_UnlockMutex(world_loader_lock);
+    }
+
+    if (cell->tileset) {
+        asset_release(cell->tileset);
+    }
+
+    world_cell_data_free(cell->data);
+
+    int32_t key[2] = {cell->cx, cell->cy};
+
+    if (htable_remove(world_cell_table, (uint8_t*)key, sizeof(key)) < 0) {
+        logmsg(LOG_ERR, "world: Failed to remove cell (%" PRId32 ", %" PRId32 "), but it was present in the cell table", cell->cx, cell->cy);
+
+        _exit(-1);
+    }
+
+    free(cell->entities);
+    free(cell);
+
+    world_cells[index] = world_cells[--world_cells_count];
+}
+
+// Takes the cells the loader has finished with, and starts loading their
+// tilesets
+void world_publish(void) {
+    SDL_LockMutex(world_loader_lock);
+
+    WorldLoadJob* job = world_done;
+
+    world_done = NULL;
+
+    SDL_UnlockMutex(world_loader_lock);
+
+    while (job) {
+        WorldLoadJob* next = job->next;
+
+        WorldCell* cell = job->cell;
+
+        if (cell) {
+            cell->job = NULL;
+            cell->state = WORLD_CELL_PARSED;
+
+            // A cell which fails to parse is left empty, rather than retried
+            cell->data = job->data ? job->data : calloc(1, sizeof(WorldCellData));
+
+            job->data = NULL;
+
+            if (cell->data && cell->data->tileset) {
+                cell->tileset = asset_image_acquire_async(cell->data->tileset);
+            }
+        }
+
+        job->next = NULL;
+
+        world_job_list_free(job);
+
+        job = next;
+    }
+}
+
+uint32_t world_distance(WorldCell* cell, int32_t cx, int32_t cy) {
+    int64_t dx = llabs((int64_t)cell->cx - cx);
+    int64_t dy = llabs((int64_t)cell->cy - cy);
+
+    return (uint32_t)((dx > dy) ? dx : dy);
+}
+
+// Drops the cells out of range which are still loading
+void world_drop(int32_t cx, int32_t cy) {
+    for (size_t i = world_cells_count; i > 0; i--) {
+        WorldCell* cell = world_cells[i - 1];
+
+        if (cell->state != WORLD_CELL_RESIDENT && world_distance(cell, cx, cy) > (uint32_t)world_radius) {
+            world_cell_remove(i - 1, false);
+        }
+    }
+}
+
+// Unloads the resident cells out of range, farthest first, until the rest fit
+// under the memory cap
+void world_trim(int32_t cx, int32_t cy) {
+    while (world_stats.bytes > world_memory_cap || world_memory_cap == 0) {
+        size_t farthest = world_cells_count;
+        uint32_t distance = (uint32_t)world_radius;
+
+        for (size_t i = 0; i < world_cells_count; i++) {
+            uint32_t d = world_distance(world_cells[i], cx, cy);
+
+            if (d > distance) {
+                farthest = i;
+                distance = d;
+            }
+        }
+
+        if (farthest == world_cells_count) {
+            break;
+        }
+
+        world_cell_remove(farthest, false);
+    }
+}
+
+// Queues the cells in range which aren't loaded, nearest first
+void world_fill(int32_t cx, int32_t cy) {
+    for (int32_t ring = 0; ring <= world_radius; ring++) {
+        for (int32_t dy = -ring; dy <= ring; dy++) {
+            for (int32_t dx = -ring; dx <= ring; dx++) {
+                // Only the edge of each ring is new
+                if (abs(dx) != ring && abs(dy) != ring) {
+                    continue;
+                }
+
+                if (!world_cell_get(cx + dx, cy + dy) && !world_cell_queue(cx + dx, cy + dy)) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void world_sync_run(bool wait) {
+    if (!world_cell_table) {
+        return;
+    }
+
+    Transform* t = world_focus ? entity_get_component(world_focus, TRANSFORM) : NULL;
+
+    int32_t cx = 0;
+    int32_t cy = 0;
+
+    if (t) {
+        world_cell_at(transform_get_pos_x(t), transform_get_pos_y(t), &cx, &cy);
+
+        world_drop(cx, cy);
+    }
+
+    world_publish();
+
+    // Everything parsed is created at once. Cells wait for their tileset to
+    // load, unless told not to, in which case creating their tilemap waits.
+    for (size_t i = 0; i < world_cells_count; i++) {
+        WorldCell* cell = world_cells[i];
+
+        if (cell->state != WORLD_CELL_PARSED) {
+            continue;
+        }
+
+        if (!cell->data) {
+            logmsg(LOG_WARN, "world: Failed to load cell (%" PRId32 ", %" PRId32 "), the system is out of memory", cell->cx, cell->cy);
+
+            continue;
+        }
+
+        if (wait || !cell->tileset || asset_get_state(cell->tileset) != ASSET_LOADING) {
+            world_cell_instantiate(cell);
+        }
+    }
+
+    if (t) {
+        world_trim(cx, cy);
+        world_fill(cx, cy);
+    }
+
+    world_stats.pooled = world_pool_count;
+}
+
+void world_sync(void) {
+    world_sync_run(false);
+}
+
+void world_wait(void) {
+    if (!world_cell_table) {
+        return;
+    }
+
+    // Queue whatever is missing, and wait for the loader to parse it
+    world_sync_run(false);
+
+    SDL_LockMutex(world_loader_lock);
+
+    while (world_pending > 0) {
+        SDL_CondWait(world_loader_done, world_loader_lock);
+    }
+
+    SDL_UnlockMutex(world_loader_lock);
+
+    world_sync_run(true);
+}
+
+bool world_init(const char* path, int cell_size, int radius, size_t memory_cap) {
+    if (world_cell_table) {
+        logmsg(LOG_WARN, "world: Failed to initialize world, already initialized");
+
+        return false;
+    }
+
+    if (!path || cell_size <= 0 || radius < 0) {
+        logmsg(LOG_WARN, "world: Failed to initialize world, it needs a directory, a cell size above 0, and a radius of at least 0");
+
+        return false;
+    }
+
+    world_path = strdup(path);
+    world_cell_table = htable_create(64);
+
+    if (!world_path || !world_cell_table) {
+        logmsg(LOG_WARN, "world: Failed to initialize world, the system is out of memory");
+
+        free(world_path);
+        htable_destroy(world_cell_table);
+
+        world_path = NULL;
+        world_cell_table = NULL;
+
+        return false;
+    }
+
+    // Objects are hashed with a seed picked on first use, which the loader
+    // thread mustn't race to pick
+    json_object_seed(0);
+
+    if (!world_loader_start()) {
+        free(world_path);
+        htable_destroy(world_cell_table);
+
+        world_path = NULL;
+        world_cell_table = NULL;
+
+        return false;
+    }
+
+    world_cell_size = cell_size;
+    world_radius = radius;
+    world_memory_cap = memory_cap;
+
+    memset(&world_stats, 0, sizeof(WorldStats));
+
+    logmsg(LOG_INFO, "world: Streaming %dx%d pixel cells from '%s', %d around the focus", cell_size, cell_size, path, radius);
+
+    return true;
+}
+
+void world_cleanup(void) {
+    if (!world_cell_table) {
+        return;
+    }
+
+    logmsg(LOG_DEBUG, "world: Cleaning up world");
+
+    world_loader_stop();
+
+    // Stopping the loader freed every job
+    for (size_t i = 0; i < world_cells_count; i++) {
+        world_cells[i]->job = NULL;
+    }
+
+    while (world_cells_count > 0) {
+        world_cell_remove(world_cells_count - 1, true);
+    }
+
+    for (size_t i = 0; i < world_pool_count; i++) {
+        world_entity_destroy(world_pool[i]);
+    }
+
+    free(world_cells);
+    free(world_pool);
+    free(world_path);
+
+    htable_destroy(world_cell_table);
+
+    world_cells = NULL;
+    world_cells_size = 0;
+    world_cells_count = 0;
+
+    world_pool = NULL;
+    world_pool_size = 0;
+    world_pool_count = 0;
+
+    world_path = NULL;
+    world_cell_table = NULL;
+    world_focus = 0;
+
+    memset(&world_stats, 0, sizeof(WorldStats));
+}
+
+void world_set_focus(uint16_t entity_id) {
+    world_focus = entity_id;
+}
+
+void world_cell_at(float x, float y, int32_t* cx, int32_t* cy) {
+    *cx = (int32_t)floor((double)x / (double)world_cell_size);
+    *cy = (int32_t)floor((double)y / (double)world_cell_size);
+}
+
+bool world_cell_is_resident(int32_t cx, int32_t cy) {
+    WorldCell* cell = world_cell_table ? world_cell_get(cx, cy) : NULL;
+
+    return cell && cell->state == WORLD_CELL_RESIDENT;
+}
+
+const uint16_t* world_cell_get_entities(int32_t cx, int32_t cy, size_t* count) {
+    WorldCell* cell = world_cell_table ? world_cell_get(cx, cy) : NULL;
+
+    if (!cell || cell->state != WORLD_CELL_RESIDENT) {
+        *count = 0;
+
+        return NULL;
+    }
+
+    *count = cell->entities_count;
+
+    return cell->entities;
+}
+
+const WorldStats* world_get_stats(void) {
+    return &world_stats;
+}
@@ -0,0 +1,139 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#ifndef RPGNG_WORLD
+#define RPGNG_WORLD
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The default size of a cell, in pixels
+#define WORLD_CELL_SIZE_DEFAULT 1024
+
+// The default distance around the focus, in cells, within which cells are
+// loaded
+#define WORLD_RADIUS_DEFAULT 1
+
+typedef struct WorldStats {
+    // Cells whose contents are in the world, and cells being read, parsed, or
+    // waiting on their tileset
+    size_t resident;
+    size_t loading;
+
+    // The memory the contents of resident cells take, as estimated from their
+    // tiles and entities
+    size_t bytes;
+
+    // Entities belonging to resident cells, and entities parked for reuse
+    size_t entities;
+    size_t pooled;
+
+    // Cells loaded and unloaded, and entities reused rather than created, since
+    // the world was initialized
+    size_t loads;
+    size_t unloads;
+    size_t reused;
+} WorldStats;
+
+/*
+ * The world is partitioned into square cells, each described by a file named
+ * after its coordinates, such as "3_-2.json", in the world directory. Cells
+ * within a radius of the focus are loaded, and cells beyond it are unloaded,
+ * so that only the part of the world around the camera is ever in memory.
+ *
+ * Cell files are read and parsed by a background thread. Once a cell's tileset
+ * has loaded too, world_sync() creates everything in it in one go, between
+ * frames. A cell file looks like:
+ *
+ *     {
+ *         "tilemap": {
+ *             "tileset": "tiles.png", "tile_w": 16, "tile_h": 16,
+ *             "width": 64, "height": 64,
+ *             "layers": [{"z": 200, "dynamic": false, "tiles": [1, 1, 2, ...]}]
+ *         },
+ *         "entities": [{"x": 120.0, "y": 48.5, "sprite": "tree.png", "z": 100}]
+ *     }
+ *
+ * Both parts are optional, and cells without a file are empty. Positions are
+ * relative to the cell's top left corner.
+ *
+ * Entity IDs are never reused once an entity is destroyed, so unloading a
+ * cell doesn't destroy its entities. They're parked instead, with their
+ * Transform, and reused by the next cells to load. Parking an entity destroys
+ * every other component it has, including any a script added, and takes it out
+ * of the spatial index and the collision world until it's reused.
+ */
+
+/**
+ * Initializes the world, without loading any cells.
+ *
+ * @param path The directory holding the cell files.
+ * @param cell_size The width and height of a cell, in pixels.
+ * @param radius The distance around the focus within which cells are loaded,
+ * in cells. A radius of 1 loads the focus's cell and the 8 around it.
+ * @param memory_cap The most memory cells may take, in bytes. Cells which
+ * leave the radius are kept for as long as they fit, nearest first, so that
+ * turning back doesn't load them again. Cells within the radius are kept
+ * regardless. With a cap of 0, cells are unloaded as soon as they leave the
+ * radius.
+ *
+ * @return On success, returns true. On failure, returns false.
+ */
+bool world_init(const char* path, int cell_size, int radius, size_t memory_cap);
+
+/**
+ * Unloads every cell, and destroys every entity the world created, including
+ * those parked for reuse.
+ */
+void world_cleanup(void);
+
+/**
+ * Sets the entity cells are loaded around, which must have a Transform, such
+ * as the entity with the camera.
+ *
+ * @param entity_id The entity to follow, or 0 to stop loading cells.
+ */
+void world_set_focus(uint16_t entity_id);
+
+/**
+ * Creates the contents of every cell which finished loading, unloads cells
+ * which are out of range or over the memory cap, and queues the cells which
+ * came into range. This should be called once per frame, after asset_sync().
+ */
+void world_sync(void);
+
+/**
+ * Waits for every cell in range of the focus to finish loading, then syncs,
+ * as on startup, or after the focus moves far enough that the cells around it
+ * won't arrive in time.
+ */
+void world_wait(void);
+
+/**
+ * Finds the cell which holds the given world position.
+ */
+void world_cell_at(float x, float y, int32_t* cx, int32_t* cy);
+
+/**
+ * Determines whether the contents of a cell are in the world.
+ */
+bool world_cell_is_resident(int32_t cx, int32_t cy);
+
+/**
+ * Gets the entities created for a resident cell, including the one holding its
+ * tilemap, if it has one.
+ *
+ * @param[out] count The number of entity IDs returned.
+ *
+ * @return The entity IDs, or NULL if the cell isn't resident.
+ */
+const uint16_t* world_cell_get_entities(int32_t cx, int32_t cy, size_t* count);
+
+/**
+ * Gets the world statistics.
+ */
+const WorldStats* world_get_stats(void);
+
+#endif
@@ -0,0 +1,105 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#define SDL_MAIN_HANDLED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "blit.h"
+#include "simd.h"
+
+// Long enough for a full AVX2 vector, a full SSE2 vector, and the longest tail
+// either leaves behind
+#define ROW_BODY 16
+#define ROW_TAIL_MAX 8
+#define ROW_MAX (ROW_BODY + ROW_TAIL_MAX)
+
+uint32_t test_src[ROW_MAX];
+uint32_t test_dst[ROW_MAX];
+
+uint32_t test_rng_state = 0x2545F491u;
+
+// xorshift32, so that every run tests the same pixels
+uint32_t test_rng(void) {
+    uint32_t x = test_rng_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return test_rng_state = x;
+}
+
+void setUp(void) {
+    // The first pixels hit the edge cases of each blend: fully transparent,
+    // fully opaque, and colors brighter than their alpha, which premultiplied
+    // blending has to saturate
+    const uint32_t edges[] = {0x00000000, 0xFFFFFFFF, 0x00FFFFFF, 0xFF000000, 0x80FFFFFF, 0x7F808080, 0x01FF00FF, 0xFE010203};
+
+    for (size_t i = 0; i < ROW_MAX; i++) {
+        test_src[i] = (i < sizeof(edges) / sizeof(edges[0])) ? edges[i] : test_rng();
+        test_dst[i] = test_rng();
+    }
+}
+
+void tearDown(void) {
+    simd_level_set(SIMD_AVX2);
+}
+
+// Blends the test row with the given kernel level, and checks it against the
+// scalar kernel, for every opacity, blend mode, direction, and tail length
+void test_blit_row_level(SimdLevel level) {
+    if (simd_level_set(level) != level) {
+        TEST_IGNORE_MESSAGE("Kernel not supported by this build or CPU");
+    }
+
+    uint32_t expected[ROW_MAX];
+    uint32_t actual[ROW_MAX];
+
+    for (size_t tail = 0; tail <= ROW_TAIL_MAX; tail++) {
+        size_t count = ROW_BODY + tail;
+
+        for (int premultiplied = 0; premultiplied < 2; premultiplied++) {
+            for (int reverse = 0; reverse < 2; reverse++) {
+                // Reversed rows are read leftward from their last pixel
+                const uint32_t* src = reverse ? &test_src[count - 1] : test_src;
+
+                for (int opacity = 0; opacity <= 255; opacity++) {
+                    memcpy(expected, test_dst, sizeof(expected));
+                    memcpy(actual, test_dst, sizeof(actual));
+
+                    simd_level_set(SIMD_SCALAR);
+                    blit_row(expected, src, count, (uint8_t)opacity, reverse, premultiplied);
+
+                    simd_level_set(level);
+                    blit_row(actual, src, count, (uint8_t)opacity, reverse, premultiplied);
+
+                    // The pixels past the row must be left alone, too
+                    TEST_ASSERT_EQUAL_HEX32_ARRAY(expected, actual, ROW_MAX);
+                }
+            }
+        }
+    }
+}
+
+void test_blit_row_sse2(void) {
+    test_blit_row_level(SIMD_SSE2);
+}
+
+void test_blit_row_avx2(void) {
+    test_blit_row_level(SIMD_AVX2);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_blit_row_sse2);
+    RUN_TEST(test_blit_row_avx2);
+
+    return UNITY_END();
+}
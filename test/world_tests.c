@@ -0,0 +1,110 @@
+// SPDX-FileCopyrightText: 2023 David Zero <zero-one@zer0-one.net>
+//
+// SPDX-License-Identifier: BSD-2-Clause
+
+#define SDL_MAIN_HANDLED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "unity.h"
+
+#include "asset.h"
+#include "entity.h"
+#include "log.h"
+#include "world.h"
+#include "component/component.h"
+#include "component/transform.h"
+
+// The fixture cells, each holding a single entity: (0, 0) and (5, 5), 100
+// pixels wide
+#define WORLD_TEST_PATH "data/world"
+#define WORLD_TEST_CELL_SIZE 100
+
+uint16_t test_focus = 0;
+Transform* test_focus_t = NULL;
+
+void setUp(void) {
+    TEST_ASSERT_TRUE(world_init(WORLD_TEST_PATH, WORLD_TEST_CELL_SIZE, 0, 0));
+
+    world_set_focus(test_focus);
+}
+
+void tearDown(void) {
+    world_set_focus(0);
+    world_cleanup();
+}
+
+// Moves the focus to the given cell, and waits for it to load
+const uint16_t* test_world_visit(int32_t cx, int32_t cy) {
+    transform_translate_set(test_focus_t, cx * WORLD_TEST_CELL_SIZE + 50.0f, cy * WORLD_TEST_CELL_SIZE + 50.0f);
+
+    world_wait();
+
+    size_t count = 0;
+    const uint16_t* ids = world_cell_get_entities(cx, cy, &count);
+
+    TEST_ASSERT_EQUAL_size_t(1, count);
+
+    return ids;
+}
+
+void test_world_entity_new(void) {
+    const uint16_t* ids = test_world_visit(0, 0);
+    Transform* t = entity_get_component(ids[0], TRANSFORM);
+
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, transform_get_render_x(t));
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, transform_get_render_y(t));
+}
+
+// A reused entity must be drawn at its spawn position right away, rather than
+// sliding there from where it was parked
+void test_world_entity_reused(void) {
+    test_world_visit(0, 0);
+
+    const uint16_t* ids = test_world_visit(5, 5);
+
+    TEST_ASSERT_EQUAL_size_t(1, world_get_stats()->reused);
+
+    Transform* t = entity_get_component(ids[0], TRANSFORM);
+
+    TEST_ASSERT_EQUAL_FLOAT(530.0f, transform_get_pos_x(t));
+    TEST_ASSERT_EQUAL_FLOAT(540.0f, transform_get_pos_y(t));
+    TEST_ASSERT_EQUAL_FLOAT(530.0f, transform_get_render_x(t));
+    TEST_ASSERT_EQUAL_FLOAT(540.0f, transform_get_render_y(t));
+
+    // Interpolating before the next tick has nothing to slide from, either
+    transform_interpolate(0.5f);
+
+    TEST_ASSERT_EQUAL_FLOAT(530.0f, transform_get_render_x(t));
+    TEST_ASSERT_EQUAL_FLOAT(540.0f, transform_get_render_y(t));
+}
+
+int main(void) {
+    if (log_init(LOG_WARN, NULL) != 0) {
+        return 1;
+    }
+
+    if (!asset_init() || !entity_init() || !component_init()) {
+        return 1;
+    }
+
+    test_focus = entity_create("focus");
+
+    if (test_focus == (uint16_t)-1 || !transform_create(test_focus)) {
+        return 1;
+    }
+
+    test_focus_t = entity_get_component(test_focus, TRANSFORM);
+
+    UNITY_BEGIN();
+
+    RUN_TEST(test_world_entity_new);
+    RUN_TEST(test_world_entity_reused);
+
+    int failures = UNITY_END();
+
+    asset_cleanup();
+
+    return failures;
+}